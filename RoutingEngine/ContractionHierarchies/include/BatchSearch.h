@@ -0,0 +1,118 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include "Queue.h"
+#include "QueryGraph.h"
+
+/**
+* The purpose of this class is to answer many shortest path distance queries on a contracted graph with a single thread.
+* A contraction hierarchies query spends most of its time waiting for the edges of the next vertex to arrive from memory.
+* Instead of running the queries one after another, we run a batch of independent queries side by side: each query
+* settles one vertex and then prefetches the edges of the next vertex it will settle before we switch to the next query.
+* By the time we come back to a query, its edges are already in the cache.
+*
+* Each query conducts the same modified bidirectional search as BidirectionalSearch::executeSearch, but only computes the
+* length of the shortest path.
+*/
+class BatchSearch {
+
+private:
+
+    // The best shortest path estimate is initially initialized to infinity, and improved throughout the search.
+    const double INF_ = std::numeric_limits<double>::infinity();
+
+    // The search state of a single vertex in one query.
+    struct Label {
+
+        // The index of the vertex, or QueryGraph::INVALID_INDEX if the slot is unused.
+        uint32_t index;
+
+        // Bit 0 and 1 indicate whether the vertex was reached by the forward and backward search. Bit 2 and 3 indicate
+        // whether the vertex was settled by the forward and backward search.
+        uint32_t flags;
+
+        // The length of the shortest path found so far from the source and to the target.
+        double dist[2];
+    };
+
+    /**
+     * A small open addressing hash table that holds the labels of a single query. Contraction hierarchies queries only
+     * settle a few hundred vertices, so the table stays in the cache, unlike an array the size of the graph.
+     */
+    class LabelTable {
+
+    private:
+
+        // The slots of the table. The number of slots is always a power of two.
+        std::vector<Label> slots_;
+
+        // The positions of the slots that are in use. Used to clear the table between queries.
+        std::vector<uint32_t> used_;
+
+        // Doubles the size of the table.
+        void grow();
+
+    public:
+
+        LabelTable();
+
+        /**
+         * Finds the label of a vertex, inserting an empty label if the vertex has not been seen in this query.
+         * @param index The index of the vertex.
+         * @return A reference to the label. Only valid until the next insertion.
+         */
+        Label& get(uint32_t index);
+
+        // Removes all labels from the table.
+        void clear();
+    };
+
+    // The state of one of the queries that are being processed side by side.
+    struct Lane {
+        Queue::MinHeap<HeapElement> queue;
+        LabelTable labels;
+        double best;
+        size_t query;
+        bool active;
+    };
+
+    // The contracted graph that the queries are conducted on.
+    const QueryGraph* graph_;
+
+    // The queries that are processed side by side.
+    std::vector<Lane> lanes_;
+
+    /**
+     * Starts a new query in a lane.
+     * @param lane The lane that will process the query.
+     * @param query The position of the query in the batch.
+     * @param source The index of the source vertex.
+     * @param target The index of the target vertex.
+     */
+    void startQuery(Lane& lane, size_t query, uint32_t source, uint32_t target) const;
+
+    /**
+     * Settles the next vertex of a query and prefetches the edges of the vertex that will be settled after it.
+     * @param lane The lane of the query.
+     * @return Returns false if the query is finished, otherwise true.
+     */
+    bool step(Lane& lane) const;
+
+public:
+
+    /**
+     * A constructor for the BatchSearch class.
+     * @param graph The contracted graph that the queries will be conducted on.
+     * @param batch_size The number of queries that are processed side by side. Between 8 and 16 queries are usually
+     * enough to hide the memory latency.
+     */
+    explicit BatchSearch(const QueryGraph* graph, int batch_size = 16);
+
+    /**
+     * Computes the length of the shortest path of every query.
+     * @param queries Pairs of source and target vertex IDs. Every vertex must be present in the graph.
+     * @return The length of the shortest path of every query, in the same order as the queries. The length is -1 if
+     * there is no path from the source to the target.
+     */
+    std::vector<double> computeDistances(const std::vector<std::pair<uint64_t, uint64_t>>& queries);
+};
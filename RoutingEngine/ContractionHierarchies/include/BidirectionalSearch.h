@@ -3,8 +3,55 @@
 #include <unordered_set>
 #include <vector>
 #include <queue>
+#include <limits>
 #include "Queue.h"
 #include "Graph.h"
+#include "QueryGraph.h"
+#include "QueryStats.h"
+
+/**
+* The search state of the modified bidirectional search. Index 0 of each array belongs to the forward search and index 1
+* to the backward search. A workspace is reused between queries so that it does not need to be allocated and cleared for
+* every query; an entry is only valid if its timestamp matches the timestamp of the current query.
+*/
+struct SearchWorkspace {
+
+    // The length of the shortest path found so far for each vertex encountered in the search.
+    std::vector<double> dist[2];
+
+    // The parent of each vertex encountered in the search and the position of the edge that leads to it from the
+    // parent. Used for reconstructing the shortest path.
+    std::vector<uint32_t> prev[2], prev_edge[2];
+
+    // The timestamp of the query in which a vertex was last reached and settled.
+    std::vector<uint32_t> reached[2], settled[2];
+
+    // The timestamp of the current query.
+    uint32_t timestamp = 0;
+
+    /**
+     * Prepares the workspace for a new query on a graph with the given number of vertices.
+     * @param num_vertices The number of vertices in the graph being searched.
+     */
+    void reset(uint32_t num_vertices);
+
+    bool isReached(uint32_t index, bool backward) const { return reached[backward][index] == timestamp; }
+
+    bool isSettled(uint32_t index, bool backward) const { return settled[backward][index] == timestamp; }
+};
+
+// A route found by the search for alternative routes.
+struct AlternativePath {
+
+    // The index of the source vertex in the query graph.
+    uint32_t source_index;
+
+    // The original edges that make up the route, in order of travel.
+    std::vector<OriginalEdge> edges;
+
+    // The length of the route.
+    double length;
+};
 
 /**
 * The purpose of this class is to find the shortest path between two vertices in a graph. We implement two different
@@ -20,12 +67,21 @@ private:
     // The vertices that the search will be conducted on.
     const std::unordered_map<uint64_t, Vertex>* vertices_;
 
-    // Used for unpacking the shortest path.
-    const std::unordered_map<uint64_t, std::unordered_map<uint64_t, uint64_t>>* shortcuts_;
+    // The contracted graph that the modified search will be conducted on.
+    const QueryGraph* query_graph_;
 
-    // The OSM node IDs that connect vertices in the graph.
+    // The search state of the modified search. Owned by the thread conducting the search.
+    SearchWorkspace* workspace_;
+
+    // The edges that connect vertices in the graph.
     const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>* edges_;
 
+    // The OSM node IDs that make up the edges.
+    const GeometryStore* geometry_;
+
+    // The statistics of the current query, or nullptr if they are not collected.
+    QueryStats* stats_ = nullptr;
+
     // Keeps track of which vertices have been settled in the forward and reverse search.
     std::unordered_set<uint64_t> visited_source_, visited_target_, stalled_;
 
@@ -52,10 +108,60 @@ private:
      * @param vertex_id The ID of the vertex currently being settled.
      * @param backward Indicates whether we are performing a backward search or a forward search. True if backward,
      * false otherwise.
-     * @param standard If standard is set to true, then we perform a bidirectional Dijkstra search. Otherwise,
-     * we perform a modified search.
      */
-    void relax_edge(uint64_t vertex_id, bool backward = false, bool standard = false);
+    void relax_edge(uint64_t vertex_id, bool backward = false);
+
+    /**
+     * Relaxes the upward edges of a vertex in the query graph during the modified bidirectional search.
+     * @param index The index of the vertex currently being settled.
+     * @param backward Indicates whether we are performing a backward search or a forward search. True if backward,
+     * false otherwise.
+     */
+    void relaxUpwardEdges(uint32_t index, bool backward);
+
+    /**
+     * The modified bidirectional search. Only edges leading to vertices of higher order are relaxed, and the search
+     * is conducted on the query graph.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @return A pair containing the shortest path and the length of the shortest path.
+     */
+    std::pair<std::vector<uint64_t>, double> executeHierarchySearch(uint64_t source, uint64_t target);
+
+    /**
+     * Runs the modified bidirectional search without reconstructing the shortest path.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param length The length of the shortest path.
+     * @param bound The searches continue until the smallest distance estimate exceeds bound times the length of the
+     * shortest path. A bound greater than one finds paths other than the shortest path as well.
+     * @param settled_vertices If not null, every vertex settled by either search is appended to it.
+     * @return The index of the vertex at which the forward and backward searches meet, or QueryGraph::INVALID_INDEX if
+     * there is no path.
+     */
+    uint32_t searchHierarchy(uint64_t source, uint64_t target, double* length, double bound = 1,
+                             std::vector<uint32_t>* settled_vertices = nullptr);
+
+    /**
+     * Reconstructs the shortest path determined by the modified bidirectional search as a sequence of original edges.
+     * @param intersection The index of the vertex at which the forward and backward searches meet.
+     * @param edges The original edges that make up the shortest path, in order of travel.
+     * @param weights If not null, receives the weight of every original edge.
+     * @return The index of the source vertex.
+     */
+    uint32_t collectOriginalEdges(uint32_t intersection, std::vector<OriginalEdge>* edges, std::vector<double>* weights = nullptr) const;
+
+    /**
+     * Checks that the part of a route around its via vertex is a shortest path, by a search between the vertices that
+     * are the given distance before and after the via vertex. The search uses a workspace of its own, so the search
+     * spaces of the search for alternative routes are kept.
+     * @param path The route.
+     * @param weights The weight of every original edge of the route.
+     * @param via_distance The distance from the source to the via vertex along the route.
+     * @param window The length of the part of the route that is checked on either side of the via vertex.
+     * @return Returns true if the part of the route is a shortest path, otherwise false.
+     */
+    bool isLocallyOptimal(const AlternativePath& path, const std::vector<double>& weights, double via_distance, double window);
 
     /**
      * Retrieves the appropriate set of edges for the given search (i.e. if we are relaxing edges during the forward
@@ -65,7 +171,7 @@ private:
      * we return the incoming edges of the vertex. Otherwise, we return the outgoing edges.
      * @return A hashmap that maps vertex IDs to weights.
      */
-    const std::unordered_map<uint64_t, double>& getAllowedEdges(uint64_t vertex_id, bool backward);
+    const FlatHashMap<uint64_t, double>& getAllowedEdges(uint64_t vertex_id, bool backward);
 
     /**
      * Retrieves the appropriate distance estimates for the given search.
@@ -100,25 +206,17 @@ private:
      * @param target The ID of the target vertex.
      * @param intersection The ID of the vertex at which the forward and backward searches meet (note that this might not be the first vertex at
      * which the searches meet).
-     * @return A vector of vertex IDs that make up the shortest path (the shortcuts must still be unpacked and the edges must still be inserted).
+     * @return A vector of vertex IDs that make up the shortest path (the edges must still be inserted).
      */
     std::vector<uint64_t> reconstructPath(uint64_t source, uint64_t target, uint64_t intersection);
 
     /**
-     * Given two vertices, unpacks all of the shortcuts that connect those vertices.
-     * @param start The ID of the first vertex.
-     * @param end The ID of the second vertex.
-     * @return A vector containing all of the vertex IDs that shortcut edges go through.
-     */
-    std::vector<uint64_t> unpackShortcut(uint64_t start, uint64_t end);
-
-    /**
-     * Unpacks all the shortcuts in a reconstructed path and outputs a complete path.
-     * @param path A path that has been reconstructed after the search process is complete.
-     * @return A vector representing the shortest path between the source and target vertices in the graph. Note that
-     * this path does not contain the vertex IDs that are contained in the graph edges.
+     * Reconstructs the shortest path determined by the modified bidirectional search and unpacks the shortcut edges in
+     * it. The OSM nodes that make up the edges are inserted as well.
+     * @param intersection The index of the vertex at which the forward and backward searches meet.
+     * @return A complete path that is ready to be used for routing.
      */
-    std::vector<uint64_t> unpackPath(std::vector<uint64_t>* path);
+    std::vector<uint64_t> unpackHierarchyPath(uint32_t intersection) const;
 
     /**
      * Inserts the vertex IDs that are connect two adjacent vertices in the shortest path into the path. More
@@ -129,26 +227,18 @@ private:
      */
     std::vector<uint64_t> insertEdgeNodes(const std::vector<uint64_t>& path);
 
-    /**
-     * Indicates whether a shortcut edge connects two vertices.
-     * @param start The first vertex ID.
-     * @param end The second vertex ID.
-     * @return A boolean indicating whether a shortcut edge connects the given vertices.
-     */
-    bool isShortcut(uint64_t start, uint64_t end);
-
-
 public:
 
     /**
      * The constructor for the BidirectionalSearch class.
      * @param vertices The vertices that the search will be conducted on.
-     * @param shortcuts The shortcut edges present in the graph, if any.
      * @param edges The edge data for the graph.
+     * @param geometry The geometry of the edges.
+     * @param query_graph The contracted graph that the modified search will be conducted on, if any.
      */
     BidirectionalSearch(const std::unordered_map<uint64_t, Vertex>* vertices,
-                        const std::unordered_map<uint64_t, std::unordered_map<uint64_t, uint64_t>>* shortcuts,
-                        const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>* edges);
+                        const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>* edges,
+                        const GeometryStore* geometry, const QueryGraph* query_graph = nullptr);
 
     /**
      * This is the primary search we will use for routing. Provides the option of running a bidirectional Dijkstra search
@@ -164,4 +254,36 @@ public:
      */
     std::pair<std::vector<uint64_t>, double> executeSearch(uint64_t source, uint64_t target, bool standard);
 
+    /**
+     * Runs the modified bidirectional search and returns the shortest path as the original edges that make it up. Unlike
+     * executeSearch, only the query graph is needed, so the search also works on a graph that was mapped from a file.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param edges The original edges that make up the shortest path, in order of travel.
+     * @param source_index The index of the source vertex in the query graph. The path starts at this vertex.
+     * @return The length of the shortest path, or -1 if there is no path.
+     */
+    double findOriginalEdges(uint64_t source, uint64_t target, std::vector<OriginalEdge>* edges, uint32_t* source_index);
+
+    /**
+     * Finds the shortest path and up to a given number of alternative paths with a single modified bidirectional
+     * search. The searches go on past the shortest path, and every vertex that both searches reach is the via vertex of
+     * a candidate path: the path of the forward search to it followed by the path of the backward search from it.
+     * Candidates are tried from the shortest up, and a candidate is accepted if it is not much longer than the shortest
+     * path, shares little with the paths accepted before it, has no loops, and is locally optimal (see
+     * AlternativeRouteOptions).
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param options The criteria that an alternative path must meet.
+     * @return The shortest path followed by the alternative paths, by increasing length. Empty if there is no path.
+     */
+    std::vector<AlternativePath> findAlternativePaths(uint64_t source, uint64_t target, const AlternativeRouteOptions& options);
+
+    /**
+     * Requests statistics about the following searches. The statistics are only collected if the library is built with
+     * CH_QUERY_STATS defined; see QueryStats.
+     * @param stats The statistics that the counters and timings of the searches are added to, or nullptr.
+     */
+    void setStats(QueryStats* stats) { stats_ = stats; }
+
 };
\ No newline at end of file
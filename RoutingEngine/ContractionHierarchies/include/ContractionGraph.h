@@ -0,0 +1,230 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include "Graph.h"
+#include "MappedFile.h"
+
+/**
+* The working copy of a graph that is used while the graph is contracted. Only what the contraction needs is kept: the
+* vertices are numbered from 0 to n - 1, and every vertex has a list of its incoming and outgoing edges with their
+* weights. The list of a vertex is short (road intersections have about three neighbors), so scanning it is faster than
+* a hash map lookup, and it uses a fraction of the memory of a copy of the graph.
+*
+* The lists are blocks in a single pool of edges. A block has room for more edges than it holds, so adding a shortcut
+* rarely moves it; a block that is outgrown is moved to a block of twice the size and its old space is used again by the
+* next block of the same size. When a vertex is contracted, its own lists are kept: they then hold the edges to the
+* vertices that are contracted later, i.e. the edges of the vertex in the hierarchy, so the contracted graph can be read
+* from the working graph once the contraction is done.
+*/
+class ContractionGraph {
+
+public:
+
+    // Marks an edge that is not a shortcut.
+    static constexpr uint32_t NO_MIDDLE = UINT32_MAX;
+
+    // An edge in the working graph, stored with the vertex at its other end.
+    struct Arc {
+
+        // The index of the vertex at the other end of the edge.
+        uint32_t vertex;
+
+        // The number of edges of the original graph that the edge represents: one, unless the edge is a shortcut.
+        uint32_t original_edges;
+
+        // The index of the vertex that the shortcut bypasses, or NO_MIDDLE if the edge is not a shortcut.
+        uint32_t middle;
+
+        // The weight of the edge.
+        double weight;
+    };
+
+    // The edges of a vertex in one direction.
+    struct ArcRange {
+        const Arc* first;
+        const Arc* last;
+        const Arc* begin() const { return first; }
+        const Arc* end() const { return last; }
+        size_t size() const { return size_t(last - first); }
+    };
+
+private:
+
+    // A block of the pool: the edges are found in [first, first + size), and there is room for capacity edges. The
+    // capacity is a power of two.
+    struct Block {
+        uint64_t first = 0;
+        uint32_t size = 0, capacity = 0;
+    };
+
+    // The smallest capacity of a block.
+    static constexpr uint32_t MIN_CAPACITY = 4;
+
+    // The ID of every vertex.
+    std::vector<uint64_t> ids_;
+
+    // The pool that the edges of every vertex are stored in.
+    std::vector<Arc> arcs_;
+
+    // The blocks of the outgoing and incoming edges of every vertex.
+    std::vector<Block> out_blocks_, in_blocks_;
+
+    // The blocks that were outgrown, by the base two logarithm of their capacity.
+    std::vector<std::vector<uint64_t>> free_blocks_;
+
+    // The number of neighbors of every vertex that have been contracted.
+    std::vector<int> deleted_neighbors_;
+
+    // The level of every vertex in the hierarchy: one more than the highest level of a contracted neighbor, or zero.
+    std::vector<uint32_t> levels_;
+
+    // The number of vertices that have not been contracted.
+    uint32_t num_remaining_;
+
+    // The number of edges between the vertices that have not been contracted.
+    uint64_t num_arcs_;
+
+    /**
+     * Computes the capacity of a block that leaves some room for shortcuts.
+     * @param size The number of edges in the block.
+     * @return The smallest power of two, and at least MIN_CAPACITY, that is greater than the number of edges.
+     */
+    static uint32_t getCapacity(uint32_t size);
+
+    /**
+     * Takes an empty block from the pool, reusing an outgrown block if there is one.
+     * @param capacity The capacity of the block. Must be a power of two.
+     * @return The block.
+     */
+    Block allocate(uint32_t capacity);
+
+    /**
+     * Fills a block with edges.
+     * @param begin An iterator to the first edge.
+     * @param end An iterator past the last edge.
+     * @return The block.
+     */
+    template <class Iterator>
+    Block allocate(Iterator begin, Iterator end) {
+        Block block = allocate(getCapacity(uint32_t(std::distance(begin, end))));
+        for (auto it = begin; it != end; ++it) { arcs_[block.first + block.size++] = *it; }
+        return block;
+    }
+
+    /**
+     * Adds an edge to a block, moving the block to a larger one if it is full.
+     * @param block The block.
+     * @param arc The edge.
+     */
+    void append(Block* block, const Arc& arc);
+
+    /**
+     * Removes the edge to a vertex from a block. The order of the other edges is kept.
+     * @param block The block.
+     * @param vertex The index of the vertex at the other end of the edge.
+     * @return Returns true if there was such an edge.
+     */
+    bool erase(Block* block, uint32_t vertex);
+
+    ArcRange getArcs(const Block& block) const { return ArcRange{arcs_.data() + block.first, arcs_.data() + block.first + block.size}; }
+
+public:
+
+    /**
+     * A constructor for the ContractionGraph class. Reads the vertices and their edges from a graph in a single pass
+     * over the vertices, without copying the graph. The edges of a graph of a routing profile are read from its road
+     * network, along with the weights of the profile.
+     * @param graph The graph that will be contracted.
+     */
+    explicit ContractionGraph(const Graph& graph);
+
+    /**
+     * This method gets the number of vertices, including the vertices that have been contracted.
+     * @return an integer that denotes how many vertices are in the working graph.
+     */
+    uint32_t getNumVertices() const { return uint32_t(ids_.size()); }
+
+    /**
+     * This method gets the number of vertices that have not been contracted yet.
+     * @return an integer that denotes how many vertices remain.
+     */
+    uint32_t getNumRemaining() const { return num_remaining_; }
+
+    /**
+     * Computes the average number of incoming and outgoing edges of the vertices that have not been contracted yet.
+     * @return The average degree, or zero if every vertex has been contracted.
+     */
+    double getAverageDegree() const { return num_remaining_ ? 2.0 * double(num_arcs_) / num_remaining_ : 0.0; }
+
+    /**
+     * Retrieves the ID of a vertex.
+     * @param vertex The index of the vertex.
+     * @return The OSM node ID of the vertex.
+     */
+    uint64_t getId(const uint32_t vertex) const { return ids_[vertex]; }
+
+    /**
+     * Retrieves the outgoing or incoming edges of a vertex. If the vertex has been contracted, these are its edges to
+     * the vertices that were contracted after it. Invalidated by setArc.
+     * @param vertex The index of the vertex.
+     * @return The edges of the vertex.
+     */
+    ArcRange getOutArcs(const uint32_t vertex) const { return getArcs(out_blocks_[vertex]); }
+
+    ArcRange getInArcs(const uint32_t vertex) const { return getArcs(in_blocks_[vertex]); }
+
+    int getDeletedNeighbors(const uint32_t vertex) const { return deleted_neighbors_[vertex]; }
+
+    void incrementDeletedNeighbors(const uint32_t vertex) { deleted_neighbors_[vertex]++; }
+
+    uint32_t getLevel(const uint32_t vertex) const { return levels_[vertex]; }
+
+    void raiseLevel(const uint32_t vertex, const uint32_t level) { levels_[vertex] = std::max(levels_[vertex], level); }
+
+    /**
+     * Looks up the weight of an edge.
+     * @param tail The index of the vertex that the edge starts at.
+     * @param head The index of the vertex that the edge ends at.
+     * @return A pointer to the weight of the edge, or nullptr if there is no such edge.
+     */
+    const double* findArc(uint32_t tail, uint32_t head) const;
+
+    /**
+     * Adds an edge, or replaces the edge if it already exists.
+     * @param tail The index of the vertex that the edge starts at.
+     * @param head The index of the vertex that the edge ends at.
+     * @param weight The weight of the edge.
+     * @param original_edges The number of edges of the original graph that the edge represents.
+     * @param middle The index of the vertex that the edge bypasses, or NO_MIDDLE if it is not a shortcut.
+     */
+    void setArc(uint32_t tail, uint32_t head, double weight, uint32_t original_edges, uint32_t middle);
+
+    /**
+     * Removes a contracted vertex from the edges of the vertices that have not been contracted. The edges of the
+     * vertex itself are kept, see getOutArcs.
+     * @param vertex The index of the vertex.
+     */
+    void removeVertex(uint32_t vertex);
+
+    /**
+     * Gets the amount of memory that the edges take up.
+     * @return The capacity of the pool of edges and of the blocks, in bytes.
+     */
+    uint64_t getNumAllocatedBytes() const;
+
+    /**
+     * Writes the working graph to a flat file, e.g. to checkpoint a contraction.
+     * @param writer The writer of the flat file.
+     */
+    void saveFlat(FlatWriter& writer) const;
+
+    /**
+     * Replaces the working graph with one written by saveFlat. The working graph is copied out of the file. Throws
+     * std::logic_error if the file was written for a graph with different vertices, and std::runtime_error if its edges
+     * are corrupt.
+     * @param reader The reader of the flat file.
+     */
+    void loadFlat(FlatReader& reader);
+};
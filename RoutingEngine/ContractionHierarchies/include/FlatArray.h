@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <cereal/types/vector.hpp>
+
+/**
+* An array that either owns its elements or refers to elements that are stored elsewhere, usually in a memory mapped
+* file. Reading the array works the same way in both cases, so the structures used for searching do not need to know
+* whether they were built in memory or mapped from a file. Only an array that owns its elements can be modified.
+* @tparam T The type of the elements. Must be trivially copyable if the array is written to a flat file.
+*/
+template <class T>
+class FlatArray {
+
+private:
+
+    // The elements, if the array owns them.
+    std::vector<T> owned_;
+
+    // The first element and the number of elements. Points into owned_ unless the array is a view.
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+
+    // Indicates whether the elements are stored elsewhere.
+    bool view_ = false;
+
+    void update() {
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+
+    std::vector<T>& modify() {
+        if (view_) { throw std::logic_error("Cannot modify an array that refers to a memory mapped file."); }
+        return owned_;
+    }
+
+public:
+
+    FlatArray() = default;
+
+    /**
+     * A constructor for the FlatArray class. The array takes ownership of the given elements.
+     * @param values The elements of the array.
+     */
+    FlatArray(std::vector<T> values) : owned_(std::move(values)) { update(); }
+
+    FlatArray(const FlatArray& other) : owned_(other.owned_), data_(other.data_), size_(other.size_), view_(other.view_) {
+        if (!view_) { update(); }
+    }
+
+    FlatArray(FlatArray&& other) noexcept : owned_(std::move(other.owned_)), data_(other.data_), size_(other.size_), view_(other.view_) {
+        if (!view_) { update(); }
+        other.owned_.clear();
+        other.update();
+        other.view_ = false;
+    }
+
+    FlatArray& operator=(FlatArray other) {
+        owned_.swap(other.owned_);
+        data_ = other.data_;
+        size_ = other.size_;
+        view_ = other.view_;
+        if (!view_) { update(); }
+        return *this;
+    }
+
+    /**
+     * Creates an array that refers to elements that are stored elsewhere. The elements must outlive the array.
+     * @param data The first element.
+     * @param size The number of elements.
+     * @return An array that does not own its elements.
+     */
+    static FlatArray view(const T* data, size_t size) {
+        FlatArray array;
+        array.data_ = data;
+        array.size_ = size;
+        array.view_ = true;
+        return array;
+    }
+
+    const T& operator[](size_t i) const { return data_[i]; }
+
+    const T* data() const { return data_; }
+
+    const T* begin() const { return data_; }
+
+    const T* end() const { return data_ + size_; }
+
+    const T& back() const { return data_[size_ - 1]; }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * Appends an element to the array. Throws an exception if the array does not own its elements.
+     * @param value The element to be appended.
+     */
+    void push_back(const T& value) {
+        modify().push_back(value);
+        update();
+    }
+
+    /**
+     * Appends a range of elements to the array. Throws an exception if the array does not own its elements.
+     * @tparam Iterator An input iterator.
+     * @param first The first element to be appended.
+     * @param last The element after the last element to be appended.
+     */
+    template <class Iterator>
+    void append(Iterator first, Iterator last) {
+        modify().insert(owned_.end(), first, last);
+        update();
+    }
+
+    /**
+     * Retrieves the number of bytes occupied by the elements.
+     * @return The number of bytes occupied by the elements.
+     */
+    size_t getNumBytes() const { return size_ * sizeof(T); }
+
+    /**
+     * Retrieves the number of bytes allocated for the elements, including unused capacity.
+     * @return The number of bytes allocated by the array, or 0 if the array does not own its elements.
+     */
+    size_t getNumAllocatedBytes() const { return view_ ? 0 : owned_.capacity() * sizeof(T); }
+
+    /**
+     * Serializes necessary information so that the array can be saved in a binary file. The array is stored exactly
+     * like a std::vector. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void save(Archive& ar) const { ar(std::vector<T>(begin(), end())); }
+
+    /**
+     * Serializes necessary information so that the array can be loaded from a binary file. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void load(Archive& ar) {
+        std::vector<T> values;
+        ar(values);
+        *this = FlatArray(std::move(values));
+    }
+};
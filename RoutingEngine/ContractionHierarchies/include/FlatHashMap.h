@@ -0,0 +1,370 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cereal/cereal.hpp>
+
+/**
+* A hash map that stores its elements in a single array and resolves collisions with linear probing. Unlike
+* std::unordered_map, which allocates a node for every element, a FlatHashMap makes one allocation for all of its
+* elements. This matters for the adjacency of a road network: a vertex has about three neighbors, so its map fits in
+* four slots that are scanned in a single cache line or two.
+*
+* Erased elements leave a tombstone behind, so erasing an element does not move any other element, and erasing while
+* iterating is safe. Inserting an element may rehash the map, which invalidates all iterators and references.
+*
+* Like std::unordered_map, the elements are pairs with a const key, so iterating over the map cannot change the key of an
+* element without moving it to its slot. The keys and the values must be default constructible. The binary format written by cereal is the same as that of
+* std::unordered_map, so the two can be loaded from each other's archives.
+* @tparam Key The type of the keys.
+* @tparam Value The type of the values.
+* @tparam Hash The hash function of the keys. Its output is mixed before use, so std::hash may be the identity.
+* @tparam Allocator The allocator used for the slots of the map.
+*/
+template <class Key, class Value, class Hash = std::hash<Key>, class Allocator = std::allocator<std::pair<const Key, Value>>>
+class FlatHashMap {
+
+public:
+
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+    using size_type = size_t;
+
+private:
+
+    enum class State : uint8_t { EMPTY, OCCUPIED, DELETED };
+
+    // The element of a slot only exists while the slot is occupied. It is constructed in place, as its key is const.
+    struct Slot {
+        union { value_type value; };
+        State state = State::EMPTY;
+
+        Slot() {}
+
+        Slot(const Slot& other) : state(other.state) {
+            if (state == State::OCCUPIED) { new (&value) value_type(other.value); }
+        }
+
+        Slot(Slot&& other) noexcept(std::is_nothrow_move_constructible_v<value_type>) : state(other.state) {
+            if (state == State::OCCUPIED) { new (&value) value_type(std::move(other.value)); }
+        }
+
+        Slot& operator=(const Slot& other) {
+            if (this != &other) {
+                reset();
+                if (other.state == State::OCCUPIED) { new (&value) value_type(other.value); }
+                state = other.state;
+            }
+            return *this;
+        }
+
+        ~Slot() { reset(); }
+
+        template <class... Args>
+        void construct(Args&&... args) {
+            new (&value) value_type(std::forward<Args>(args)...);
+            state = State::OCCUPIED;
+        }
+
+        // Destroys the element, if there is one, and leaves the slot empty.
+        void reset() {
+            if (state == State::OCCUPIED) { value.~value_type(); }
+            state = State::EMPTY;
+        }
+    };
+
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+
+    // The slots of the map. The number of slots is always zero or a power of two.
+    std::vector<Slot, SlotAllocator> slots_;
+
+    // The number of occupied slots and the number of tombstones.
+    size_t size_ = 0, num_deleted_ = 0;
+
+    static constexpr size_t NOT_FOUND = size_t(-1);
+
+    // The smallest number of slots that the map may have once it holds any elements.
+    static constexpr size_t MIN_CAPACITY = 4;
+
+    /**
+     * Computes the slot that the probe for a key starts at.
+     * @param key The key.
+     * @return The index of the first slot that is probed.
+     */
+    size_t getHome(const Key& key) const {
+        // Fibonacci hashing spreads consecutive keys, such as OSM node IDs, over the slots.
+        return size_t((uint64_t(Hash{}(key)) * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (slots_.size() - 1);
+    }
+
+    /**
+     * Computes the number of slots needed to hold some number of elements. At most three quarters of the slots are
+     * used, so that a probe always ends at an empty slot.
+     * @param num_elements The number of elements.
+     * @return The number of slots.
+     */
+    static size_t getCapacityFor(const size_t num_elements) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity * 3 < num_elements * 4) { capacity *= 2; }
+        return capacity;
+    }
+
+    size_t findIndex(const Key& key) const {
+        if (size_ == 0) { return NOT_FOUND; }
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = getHome(key);; i = (i + 1) & mask) {
+            const Slot& slot = slots_[i];
+            if (slot.state == State::EMPTY) { return NOT_FOUND; }
+            if (slot.state == State::OCCUPIED && slot.value.first == key) { return i; }
+        }
+    }
+
+    void rehash(const size_t capacity) {
+        std::vector<Slot, SlotAllocator> slots(capacity, Slot{}, slots_.get_allocator());
+        slots.swap(slots_);
+        num_deleted_ = 0;
+        const size_t mask = capacity - 1;
+        for (auto& slot : slots) {
+            if (slot.state != State::OCCUPIED) { continue; }
+            size_t i = getHome(slot.value.first);
+            while (slots_[i].state != State::EMPTY) { i = (i + 1) & mask; }
+            slots_[i].construct(std::move(slot.value));
+        }
+    }
+
+    /**
+     * Inserts a key that is not in the map.
+     * @param key The key.
+     * @param value The value of the key.
+     * @return The index of the slot of the key.
+     */
+    size_t insertIndex(const Key& key, Value value) {
+        if ((size_ + num_deleted_ + 1) * 4 > slots_.size() * 3) {
+            // When most of the used slots are tombstones, the map is cleaned up without growing it.
+            rehash(std::max(getCapacityFor(size_ + 1), num_deleted_ > size_ ? slots_.size() : slots_.size() * 2));
+        }
+        const size_t mask = slots_.size() - 1;
+        size_t i = getHome(key);
+        while (slots_[i].state == State::OCCUPIED) { i = (i + 1) & mask; }
+        if (slots_[i].state == State::DELETED) { num_deleted_--; }
+        slots_[i].construct(key, std::move(value));
+        size_++;
+        return i;
+    }
+
+public:
+
+    // Iterates over the occupied slots of the map in the order of the slots.
+    template <bool IsConst>
+    class Iterator {
+
+        friend class FlatHashMap;
+
+        using SlotPointer = std::conditional_t<IsConst, const Slot*, Slot*>;
+
+        SlotPointer slot_, end_;
+
+        void skipUnoccupied() {
+            while (slot_ != end_ && slot_->state != State::OCCUPIED) { ++slot_; }
+        }
+
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+        using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+
+        Iterator() : slot_(nullptr), end_(nullptr) {}
+
+        Iterator(SlotPointer slot, SlotPointer end) : slot_(slot), end_(end) { skipUnoccupied(); }
+
+        // An iterator converts to a const iterator.
+        template <bool WasConst, class = std::enable_if_t<IsConst && !WasConst>>
+        Iterator(const Iterator<WasConst>& other) : slot_(other.slot_), end_(other.end_) {}
+
+        reference operator*() const { return slot_->value; }
+
+        pointer operator->() const { return &slot_->value; }
+
+        Iterator& operator++() {
+            ++slot_;
+            skipUnoccupied();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const { return slot_ == other.slot_; }
+
+        bool operator!=(const Iterator& other) const { return slot_ != other.slot_; }
+
+        template <bool> friend class Iterator;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+
+    explicit FlatHashMap(const Allocator& allocator) : slots_(SlotAllocator(allocator)) {}
+
+    iterator begin() { return iterator(slots_.data(), slots_.data() + slots_.size()); }
+
+    iterator end() { return iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+
+    const_iterator begin() const { return const_iterator(slots_.data(), slots_.data() + slots_.size()); }
+
+    const_iterator end() const { return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * Looks up a key.
+     * @param key The key.
+     * @return An iterator to the element with the given key, or end() if there is no such element.
+     */
+    iterator find(const Key& key) {
+        const size_t i = findIndex(key);
+        return i == NOT_FOUND ? end() : iterator(slots_.data() + i, slots_.data() + slots_.size());
+    }
+
+    const_iterator find(const Key& key) const {
+        const size_t i = findIndex(key);
+        return i == NOT_FOUND ? end() : const_iterator(slots_.data() + i, slots_.data() + slots_.size());
+    }
+
+    size_t count(const Key& key) const { return findIndex(key) == NOT_FOUND ? 0 : 1; }
+
+    /**
+     * Retrieves the value of a key.
+     * @param key The key.
+     * @return A reference to the value of the key. Throws std::out_of_range if the key is not in the map.
+     */
+    Value& at(const Key& key) {
+        const size_t i = findIndex(key);
+        if (i == NOT_FOUND) { throw std::out_of_range("FlatHashMap::at: key not found"); }
+        return slots_[i].value.second;
+    }
+
+    const Value& at(const Key& key) const {
+        const size_t i = findIndex(key);
+        if (i == NOT_FOUND) { throw std::out_of_range("FlatHashMap::at: key not found"); }
+        return slots_[i].value.second;
+    }
+
+    /**
+     * Retrieves the value of a key, inserting a default constructed value if the key is not in the map.
+     * @param key The key.
+     * @return A reference to the value of the key.
+     */
+    Value& operator[](const Key& key) {
+        const size_t i = findIndex(key);
+        return slots_[i == NOT_FOUND ? insertIndex(key, Value{}) : i].value.second;
+    }
+
+    /**
+     * Inserts an element if its key is not in the map.
+     * @param key The key.
+     * @param value The value.
+     * @return An iterator to the element with the given key, and a boolean value indicating whether it was inserted.
+     */
+    std::pair<iterator, bool> emplace(const Key& key, Value value) {
+        size_t i = findIndex(key);
+        const bool inserted = i == NOT_FOUND;
+        if (inserted) { i = insertIndex(key, std::move(value)); }
+        return {iterator(slots_.data() + i, slots_.data() + slots_.size()), inserted};
+    }
+
+    /**
+     * Erases an element.
+     * @param position An iterator to the element.
+     * @return An iterator to the element that follows the erased element.
+     */
+    iterator erase(const_iterator position) {
+        const size_t i = position.slot_ - slots_.data();
+        const size_t mask = slots_.size() - 1;
+        slots_[i].reset();
+        // A tombstone is only needed if a probe may pass over the slot, i.e. if the next slot is not empty.
+        if (slots_[(i + 1) & mask].state != State::EMPTY) {
+            slots_[i].state = State::DELETED;
+            num_deleted_++;
+        }
+        if (--size_ == 0) {
+            clear();
+            return end();
+        }
+        return iterator(slots_.data() + i, slots_.data() + slots_.size());
+    }
+
+    size_t erase(const Key& key) {
+        const size_t i = findIndex(key);
+        if (i == NOT_FOUND) { return 0; }
+        erase(const_iterator(slots_.data() + i, slots_.data() + slots_.size()));
+        return 1;
+    }
+
+    // Removes all elements but keeps the slots.
+    void clear() {
+        for (auto& slot : slots_) { slot.reset(); }
+        size_ = 0;
+        num_deleted_ = 0;
+    }
+
+    /**
+     * Makes room for some number of elements, so that inserting them does not rehash the map.
+     * @param num_elements The number of elements.
+     */
+    void reserve(const size_t num_elements) {
+        const size_t capacity = getCapacityFor(num_elements);
+        if (capacity > slots_.size()) { rehash(capacity); }
+    }
+
+    /**
+     * Gets the number of bytes allocated for the slots of the map.
+     * @return The capacity of the slot array, in bytes.
+     */
+    uint64_t getNumAllocatedBytes() const { return slots_.capacity() * sizeof(Slot); }
+
+    /**
+     * Serializes the map in the same format as std::unordered_map. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void save(Archive& ar) const {
+        ar(cereal::make_size_tag(static_cast<cereal::size_type>(size_)));
+        for (const auto& [key, value] : *this) { ar(cereal::make_map_item(key, value)); }
+    }
+
+    /**
+     * Deserializes a map that was saved by a FlatHashMap or by a std::unordered_map. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void load(Archive& ar) {
+        cereal::size_type size;
+        ar(cereal::make_size_tag(size));
+        clear();
+        reserve(size_t(size));
+        for (cereal::size_type i = 0; i < size; i++) {
+            Key key;
+            Value value;
+            ar(cereal::make_map_item(key, value));
+            emplace(key, std::move(value));
+        }
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <limits>
+#include <cstdint>
+#include <cereal/types/vector.hpp>
+#include "FlatArray.h"
+
+class FlatWriter;
+class FlatReader;
+
+/**
+* The purpose of this class is to store the geometry of the road segments in the graph compactly. The geometry of a road
+* segment consists of the OSM nodes strictly between its two end vertices, along with their coordinates. Each segment is
+* stored once, even if the road can be traveled in both directions, and can be decoded in either direction.
+*
+* All segments are encoded into a single byte buffer. A segment starts with the number of OSM nodes it contains. For
+* every OSM node, the difference between its ID and the ID of the previous node, followed by the difference between its
+* fixed point latitude and longitude and those of the previous node, are written as zigzag encoded variable length
+* integers. Consecutive OSM nodes are usually close to each other, so most differences only take one or two bytes.
+*/
+class GeometryStore {
+
+public:
+
+    // Indicates that a road segment contains no OSM nodes between its end vertices.
+    static constexpr uint32_t NO_GEOMETRY = std::numeric_limits<uint32_t>::max();
+
+    // The number of fixed point units per degree. OSM itself stores coordinates with seven decimal places.
+    static constexpr double COORDINATE_PRECISION = 1e7;
+
+private:
+
+    // The encoded segments.
+    FlatArray<uint8_t> buffer_;
+
+    // The position of every segment in buffer_. Segment s is found in the range [offsets_[s], offsets_[s + 1]).
+    FlatArray<uint64_t> offsets_{std::vector<uint64_t>{0}};
+
+    /**
+     * Decodes a segment and passes every OSM node to the given function in the order in which it was stored.
+     * @tparam Function A callable that accepts an OSM node ID and its coordinates.
+     * @param segment The index of the segment.
+     * @param function The function that is called for every OSM node.
+     */
+    template <class Function>
+    void decode(uint32_t segment, Function function) const;
+
+public:
+
+    /**
+     * Adds the geometry of a road segment to the store.
+     * @param nodes The OSM node IDs strictly between the end vertices of the segment.
+     * @param coordinates The coordinates (latitude and longitude) of each OSM node.
+     * @return The index of the segment, or NO_GEOMETRY if there are no OSM nodes.
+     */
+    uint32_t addSegment(const std::vector<uint64_t>& nodes, const std::vector<std::array<double, 2>>& coordinates);
+
+    /**
+     * Appends the OSM node IDs of a segment to a path.
+     * @param segment The index of the segment, or NO_GEOMETRY.
+     * @param reversed If true, the OSM nodes are appended in the opposite order from which they were added.
+     * @param path The path that the OSM node IDs are appended to.
+     */
+    void decodeNodes(uint32_t segment, bool reversed, std::vector<uint64_t>* path) const;
+
+    /**
+     * Appends the coordinates of the OSM nodes of a segment to a path.
+     * @param segment The index of the segment, or NO_GEOMETRY.
+     * @param reversed If true, the coordinates are appended in the opposite order from which they were added.
+     * @param path The path that the coordinates (latitude and longitude) are appended to.
+     */
+    void decodeCoordinates(uint32_t segment, bool reversed, std::vector<std::array<double, 2>>* path) const;
+
+    /**
+     * This method gets the number of segments in the store.
+     * @return an integer that denotes how many segments are in the store.
+     */
+    uint32_t getNumSegments() const { return uint32_t(offsets_.size() - 1); }
+
+    /**
+     * This method gets the size of the encoded geometry.
+     * @return The number of bytes used by the encoded segments.
+     */
+    uint64_t getNumBytes() const { return buffer_.getNumBytes() + offsets_.getNumBytes(); }
+
+    /**
+     * This method gets the amount of memory allocated for the encoded geometry.
+     * @return The number of bytes allocated by the store, including unused capacity, or 0 if the store is mapped.
+     */
+    uint64_t getNumAllocatedBytes() const { return buffer_.getNumAllocatedBytes() + offsets_.getNumAllocatedBytes(); }
+
+    /**
+     * Writes the store to a flat file.
+     * @param writer The flat file that the encoded segments are written to.
+     */
+    void saveFlat(FlatWriter& writer) const;
+
+    /**
+     * Reads a store that was written with saveFlat from a mapped flat file. The store refers to the mapped file, which
+     * must remain mapped for as long as the store is used.
+     * @param reader The mapped flat file, positioned at the encoded segments.
+     */
+    void mapFlat(FlatReader& reader);
+
+    /**
+     * Serializes necessary information so that the store can be saved in a binary file. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void serialize(Archive& ar) { ar(buffer_, offsets_); }
+};
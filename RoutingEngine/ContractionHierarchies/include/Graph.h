@@ -9,6 +9,17 @@
 #include <cereal/types/array.hpp>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include <string>
+#include <iterator>
+#include "QueryGraph.h"
+#include "GeometryStore.h"
+#include "QueryStats.h"
+#include "MemoryUsage.h"
+#include "FlatHashMap.h"
+#include "RoadNetwork.h"
+
+class MappedFile;
 
 /**
 * This struct stores basic information about a Vertex as well as adjacent vertices
@@ -19,8 +30,9 @@ struct Vertex {
     // A standard 64-bit OSM node id.
     uint64_t id;
 
-    // Adjacent vertices and their edge weights.
-    std::unordered_map<uint64_t, double> in_edges, out_edges;
+    // Adjacent vertices and their edge weights. A vertex has few neighbors, so they are kept in flat hash maps rather
+    // than in node based maps that make an allocation for every edge.
+    FlatHashMap<uint64_t, double> in_edges, out_edges;
 
     // Keeps track of how many adjacent vertices have been contracted. Used when computing priority term in hierarchy
     // construction.
@@ -49,17 +61,21 @@ struct Vertex {
 };
 
 /**
-* The Edge struct is primarily used to store the OSM nodes that connect two vertices in the graph.
+* The Edge struct is primarily used to locate the OSM nodes that connect two vertices in the graph.
 * All of these edges are added during OSM file parsing. These edges play no role in the hierarchy
 * construction and the bidirectional search, but they should be added to a path if it is to be
 * plotted on a map.
 */
 struct Edge {
 
-    // The OSM nodes that make up an Edge in a graph.
-    std::vector<uint64_t> nodes;
+    // The segment in the geometry store of the graph that holds the OSM nodes that make up the Edge. Both directions of
+    // a two way road share the same segment.
+    uint32_t geometry;
 
-    // Note that the start and end nodes are not actually stored in the nodes vector.
+    // Indicates whether the Edge traverses its segment in the opposite order from which the OSM nodes were stored.
+    bool reversed;
+
+    // Note that the start and end nodes are not actually stored in the segment.
     uint64_t start;
     uint64_t end;
 
@@ -76,12 +92,13 @@ struct Edge {
      * A constructor for the Edge struct.
      * @param start The vertex ID on one end of the edge.
      * @param end The vertex ID on the other end of the edge.
-     * @param nodes The OSM Node IDs that make up the edge.
+     * @param geometry The segment that holds the OSM Node IDs that make up the edge.
+     * @param reversed Indicates whether the edge traverses the segment in reverse.
      * @param time_weight The weight of the edge in time units.
      * @param distance_weight The weight of the edge in distance units.
      */
 
-    Edge(uint64_t start, uint64_t end, std::vector<uint64_t>& nodes, double time_weight, double distance_weight);
+    Edge(uint64_t start, uint64_t end, uint32_t geometry, bool reversed, double time_weight, double distance_weight);
 
     /**
      * A constructor for the Edge struct. This constructor is primarily used for testing purposes.
@@ -99,7 +116,148 @@ struct Edge {
      * @param ar See cereal documentation.
     */
     template <class Archive>
-    void serialize(Archive& ar) { ar(start, end, nodes, time_weight, distance_weight); }
+    void serialize(Archive& ar) { ar(start, end, geometry, reversed, time_weight, distance_weight); }
+};
+
+// The criteria that an alternative route must meet. See BidirectionalSearch::findAlternativePaths.
+struct AlternativeRouteOptions {
+
+    // The number of routes that are returned at most besides the shortest route.
+    int max_alternatives = 2;
+
+    // An alternative route is at most 1 + max_stretch times as long as the shortest route.
+    double max_stretch = 0.25;
+
+    // An alternative route shares at most this fraction of the length of the shortest route with the routes before it.
+    double max_sharing = 0.8;
+
+    // The part of an alternative route that is within this fraction of the length of the shortest route of its via
+    // vertex, in either direction, must be a shortest path. This rules out routes that take a detour just to pass the
+    // via vertex.
+    double local_optimality = 0.25;
+};
+
+/**
+* A read-only range over the keys of a map, such as the IDs of the vertices of a graph. Iterating over the range copies
+* neither the map nor its elements. The range is invalidated by any change to the map.
+* @tparam Map The type of the map.
+*/
+template <class Map>
+class KeyRange {
+
+private:
+
+    const Map* map_;
+
+public:
+
+    class iterator {
+
+    private:
+
+        typename Map::const_iterator it_;
+
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename Map::key_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        explicit iterator(typename Map::const_iterator it) : it_(it) {}
+
+        reference operator*() const { return it_->first; }
+
+        iterator& operator++() {
+            ++it_;
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return it_ == other.it_; }
+
+        bool operator!=(const iterator& other) const { return it_ != other.it_; }
+    };
+
+    explicit KeyRange(const Map& map) : map_(&map) {}
+
+    iterator begin() const { return iterator(map_->begin()); }
+
+    iterator end() const { return iterator(map_->end()); }
+
+    size_t size() const { return map_->size(); }
+
+    bool empty() const { return map_->empty(); }
+};
+
+/**
+* A read-only range over the edges of a graph, which are stored in a hash map of hash maps keyed by their end vertices.
+* Every Edge is visited once, without copying any of them. The range is invalidated by any change to the edges.
+*/
+class EdgeRange {
+
+public:
+
+    using EdgeMap = std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>;
+
+private:
+
+    const EdgeMap* edges_;
+
+public:
+
+    class iterator {
+
+    private:
+
+        EdgeMap::const_iterator outer_, outer_end_;
+
+        std::unordered_map<uint64_t, Edge>::const_iterator inner_;
+
+        // Moves to the first edge of the next start vertex that has any edges, unless the current start vertex has more.
+        void skipEmpty() {
+            while (outer_ != outer_end_ && inner_ == outer_->second.end()) {
+                if (++outer_ != outer_end_) { inner_ = outer_->second.begin(); }
+            }
+        }
+
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Edge;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Edge*;
+        using reference = const Edge&;
+
+        iterator(EdgeMap::const_iterator outer, EdgeMap::const_iterator outer_end) : outer_(outer), outer_end_(outer_end) {
+            if (outer_ != outer_end_) {
+                inner_ = outer_->second.begin();
+                skipEmpty();
+            }
+        }
+
+        reference operator*() const { return inner_->second; }
+
+        pointer operator->() const { return &inner_->second; }
+
+        iterator& operator++() {
+            ++inner_;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const {
+            return outer_ == other.outer_ && (outer_ == outer_end_ || inner_ == other.inner_);
+        }
+
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+
+    explicit EdgeRange(const EdgeMap& edges) : edges_(&edges) {}
+
+    iterator begin() const { return iterator(edges_->begin(), edges_->end()); }
+
+    iterator end() const { return iterator(edges_->end(), edges_->end()); }
 };
 
 /**
@@ -119,8 +277,13 @@ private:
     // paths in bidirectional search.
     std::unordered_map<uint64_t, std::unordered_map<uint64_t, uint64_t>> shortcuts_;
 
-    // Maps vertex IDs to coordinates.
-    std::unordered_map<uint64_t, std::array<double, 2>> locations_;
+    // Maps vertex IDs to coordinates. The coordinates of the other OSM nodes are stored in geometry_. May be shared
+    // with other graphs built from the same OSM data, see the constructor.
+    std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>> locations_;
+
+    // The OSM nodes that make up the edges, along with their coordinates. May be shared with other graphs built from
+    // the same OSM data.
+    std::shared_ptr<GeometryStore> geometry_;
 
     // Keeps track of the edges present in the graph (these edges represent road segments). Lookup an edge by using a
     // start and end node ID as keys to the hash tables.
@@ -129,6 +292,68 @@ private:
     // Maps vertex IDs to Vertex objects.
     std::unordered_map<uint64_t, Vertex> vertices_;
 
+    // A compact copy of the contracted graph that is used by the modified bidirectional search. Empty until the graph
+    // has been contracted.
+    QueryGraph query_graph_;
+
+    // The flat file that the query graph and the geometry refer to, if the graph was mapped from a file. Shared by every
+    // copy of the graph, so the file stays mapped for as long as any copy is in use.
+    std::shared_ptr<const MappedFile> mapping_;
+
+    // The road network that holds the edges of the graph, if the graph belongs to one of several routing profiles that
+    // share their roads. Such a graph has no vertices and edges of its own, see the constructor.
+    std::shared_ptr<const RoadNetwork> network_;
+
+    // The weight of every edge of the road network for the profile of the graph, or infinity if the profile cannot use
+    // the edge. Empty unless the graph has a road network.
+    FlatArray<double> weights_;
+
+    /**
+     * Checks whether a vertex is present in the graph. A mapped graph only knows the vertices of its query graph.
+     * @param id The ID of the vertex.
+     * @return A boolean indicating whether the vertex is present in the graph or not.
+     */
+    bool containsVertex(uint64_t id) const;
+
+    /**
+     * Decodes the coordinates of the shortest path between two vertices one edge at a time. Only the query graph and
+     * the geometry are used, so this also works on a mapped graph.
+     * @tparam Function A callable that accepts a vector of coordinates.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param function The function that is called with the coordinates of every vertex and of every edge in the path.
+     * @param stats The statistics of the query, or nullptr.
+     * @return The length of the shortest path, or -1 if there is no path.
+     */
+    template <class Function>
+    double decodeShortestRoute(uint64_t source, uint64_t target, Function function, QueryStats* stats = nullptr) const;
+
+    /**
+     * Decodes the coordinates of a path of original edges one edge at a time.
+     * @tparam Function A callable that accepts a vector of coordinates.
+     * @param source_index The index of the vertex in the query graph that the path starts at.
+     * @param edges The original edges that make up the path, in order of travel.
+     * @param function The function that is called with the coordinates of every vertex and of every edge in the path.
+     * @param stats The statistics of the query, or nullptr.
+     */
+    template <class Function>
+    void decodeOriginalEdges(uint32_t source_index, const std::vector<OriginalEdge>& edges, Function function, QueryStats* stats) const;
+
+    /**
+     * Decodes the coordinates of a path one edge at a time.
+     * @tparam Function A callable that accepts a vector of coordinates.
+     * @param path A path made up of OSM Node IDs, as returned by getShortestPath.
+     * @param function The function that is called with the coordinates of every vertex and of every edge in the path.
+     */
+    template <class Function>
+    void decodePath(const std::vector<uint64_t>& path, Function function) const;
+
+    /**
+     * Replaces the graph with the query graph and the geometry stored in a mapped flat file written by saveFlat.
+     * @param mapping The mapped file.
+     */
+    void mapFlat(std::shared_ptr<const MappedFile> mapping);
+
 public:
 
     /**
@@ -138,12 +363,33 @@ public:
      */
     explicit Graph(std::unordered_map<uint64_t, std::array<double, 2>> locations);
 
+    /**
+     * A constructor for graphs that share their locations and geometry with other graphs, such as the graphs of
+     * several routing profiles built from the same OSM data. Each graph then only adds its own edges, weights and
+     * hierarchy. Copies of a graph share its locations and geometry as well.
+     * @param locations The coordinates of the OSM nodes, see the constructor above.
+     * @param geometry The geometry store that holds the segments of the edges.
+     */
+    Graph(std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>> locations, std::shared_ptr<GeometryStore> geometry);
+
+    /**
+     * A constructor for the graph of a routing profile whose roads are stored in a road network that is shared with the
+     * graphs of other profiles. The graph only stores the weight of every edge, and its query graph once it has been
+     * contracted; its vertices and edges are read from the road network. Such a graph cannot be modified or searched
+     * with the standard search, so it must be contracted before it is searched. It can be saved as a flat file, along
+     * with the graphs of the other profiles (see saveProfilesFlat), but not with cereal.
+     * @param network The road network.
+     * @param weights The weight of every edge of the road network for the profile, or infinity if the profile cannot
+     * use the edge.
+     */
+    Graph(std::shared_ptr<const RoadNetwork> network, std::vector<double> weights);
+
     Graph();
 
     /**
      * This method is primarily used when parsing the OSM data. Adds an Edge to the graph and stores the nodes that
      * make up the Edge. If the start or end vertex is not in the graph, it will be added. This method should NOT
-     * be used when adding a shortcut Edge.
+     * be used when adding a shortcut Edge. The locations of the nodes must be known to the graph.
      * @param start The ID of the vertex on one end of the edge.
      * @param end The ID of the vertex on the other end of the edge.
      * @param nodes The OSM node IDs that connect the start and end vertices.
@@ -156,6 +402,28 @@ public:
     void addEdge(uint64_t start, uint64_t end, std::vector<uint64_t> *nodes, double time_weight, double distance_weight,
                  bool bidirectional = false, bool time = true);
 
+    /**
+     * Adds an Edge whose OSM nodes are already stored as a segment of the geometry store. Used to add the same road
+     * to several graphs that share their geometry. If the start or end vertex is not in the graph, it will be added.
+     * @param start The ID of the vertex on one end of the edge.
+     * @param end The ID of the vertex on the other end of the edge.
+     * @param geometry The segment that holds the OSM nodes that connect the start and end vertices.
+     * @param time_weight The time unit weight of the edge.
+     * @param distance_weight The distance unit weight of the edge.
+     * @param bidirectional A boolean value indicating whether a bidirectional edge should be added to the graph.
+     * @param time A boolean value indicating whether a time weight should be the primary weight of the edge.
+     */
+    void addEdge(uint64_t start, uint64_t end, uint32_t geometry, double time_weight, double distance_weight,
+                 bool bidirectional = false, bool time = true);
+
+    /**
+     * Removes the locations of the OSM nodes that are not vertices. Should be called once all edges have been added;
+     * the coordinates of those OSM nodes are then only stored, compressed, with the geometry of the edges. If the
+     * locations are shared with other graphs, the graph gets its own copy of the locations of its vertices. Does
+     * nothing if the graph has a road network, which only keeps the locations of its vertices.
+     */
+    void discardNodeLocations();
+
     /**
      * This method adds an edge to the graph, but does not store the OSM nodes that make up the edge. Primarily used for
      * testing.
@@ -199,7 +467,7 @@ public:
      * This method gets the number of vertices present in the graph.
      * @return an integer that denotes how many vertices are in the graph.
      */
-    uint64_t getNumVertices() const { return vertices_.size(); }
+    uint64_t getNumVertices() const;
 
     /**
      * The method gets the number of edges present in the graph, including any shortcut edges.
@@ -208,29 +476,182 @@ public:
     uint64_t getNumEdges() const { return num_edges_; }
 
     /**
-     * This method gets a copy of the vertices in the graph.
+     * This method gets a copy of the vertices in the graph. Copying every Vertex along with its adjacent edges is
+     * expensive; use getVertexIds and getVertex to read the graph without copying it.
      * @return A hashmap that maps vertex IDs to Vertex objects.
      */
     std::unordered_map<uint64_t, Vertex> getVertices() const { return vertices_; }
 
+    /**
+     * Retrieves the IDs of the vertices in the graph without copying them. Empty if the graph is mapped or has a road
+     * network, see getNetwork.
+     * @return A range over the vertex IDs, in no particular order.
+     */
+    KeyRange<std::unordered_map<uint64_t, Vertex>> getVertexIds() const { return KeyRange<std::unordered_map<uint64_t, Vertex>>(vertices_); }
+
+    /**
+     * Retrieves a Vertex, along with its incoming and outgoing edges, without copying it. Raises an exception if the
+     * vertex is not in the graph.
+     * @param id The ID of the vertex.
+     * @return A reference to the Vertex. Invalidated by any change to the graph.
+     */
+    const Vertex& getVertex(uint64_t id) const;
+
+    /**
+     * Retrieves the location of an OSM node. Raises an exception if the location of the node is not known.
+     * @param id The ID of the node.
+     * @return An array containing the latitude and longitude of the node.
+     */
+    const std::array<double, 2>& getLocation(uint64_t id) const { return locations_->at(id); }
+
+    /**
+     * Retrieves the edges that were added while parsing the OSM data without copying them. Shortcut edges are not
+     * included. Empty if the graph is mapped or has a road network, see getNetwork.
+     * @return A range over the edges, in no particular order.
+     */
+    EdgeRange getEdges() const { return EdgeRange(edges_); }
+
     /**
      * Computes the shortest path using a modified bidirectional search algorithm. If standard is set to true, a standard bidirectional Dijkstra search is
      * conducted instead. The standard bidirectional Dijkstra search is only used for testing, as it is much slower than the modified bidirectional search.
+     * If the graph has not been contracted, the standard search is always used. A mapped graph only supports the modified search.
      * @param source The ID of the source vertex.
      * @param target The ID of the target vertex.
      * @param standard If standard is set to true, a standard bidirectional Dijkstra search is conducted. The
      * standard bidirectional Dijkstra search is only used for testing, as it is much slower than the modified
      * bidirectional search. Otherwise, the modified bidirectional search is used.
+     * @param stats If not null, the counters and timings of the query are added to it. See QueryStats.
      * @return A pair containing the shortest path (as OSM Node IDs) and the weight of the shortest path.
      */
-    std::pair<std::vector<uint64_t>, double> getShortestPath(uint64_t source, uint64_t target, bool standard = false);
+    std::pair<std::vector<uint64_t>, double> getShortestPath(uint64_t source, uint64_t target, bool standard = false,
+                                                             QueryStats* stats = nullptr) const;
 
     /**
-     * Converts a path that is in terms of OSM Node IDs to a path containing coordinates
-     * @param path A path made up of OSM Node IDs.
+     * Computes the length of the shortest path for many source and target pairs. If the graph has been contracted, the
+     * queries are processed side by side in batches, which hides most of the memory latency of the individual searches.
+     * @param queries Pairs of source and target vertex IDs.
+     * @param batch_size The number of queries that are processed side by side.
+     * @return The length of the shortest path for every query, in the same order as the queries. The length is -1 if
+     * there is no path from the source to the target.
+     */
+    std::vector<double> getShortestPathLengths(const std::vector<std::pair<uint64_t, uint64_t>>& queries, int batch_size = 16) const;
+
+    /**
+     * Converts a path that is in terms of OSM Node IDs to a path containing coordinates. The coordinates of the OSM
+     * nodes between two vertices are decoded from the geometry of the edge that connects them.
+     * @param path A path made up of OSM Node IDs, as returned by getShortestPath.
      * @return A path that is made up of coordinates (i.e. arrays containing latitude and longitude).
      */
-    std::vector<std::array<double, 2>> convertPathToCoordinates(const std::vector<uint64_t>& path);
+    std::vector<std::array<double, 2>> convertPathToCoordinates(const std::vector<uint64_t>& path) const;
+
+    /**
+     * Converts a path that is in terms of OSM Node IDs to an encoded polyline. Unless the path is simplified, the
+     * polyline is encoded while the geometry of the edges is decoded, without converting the whole path to coordinates.
+     * @param path A path made up of OSM Node IDs, as returned by getShortestPath.
+     * @param tolerance If positive, the path is simplified with the Douglas-Peucker algorithm first. Points that lie
+     * within this many meters of the simplified path are dropped.
+     * @param precision The number of decimal places that are kept in the polyline.
+     * @return The path as an encoded polyline.
+     */
+    std::string convertPathToPolyline(const std::vector<uint64_t>& path, double tolerance = 0, int precision = 5) const;
+
+    /**
+     * Computes the shortest path between two vertices as coordinates. Equivalent to converting the result of
+     * getShortestPath with convertPathToCoordinates, but a contracted graph decodes the coordinates straight from the
+     * edges found by the search, which also works on a mapped graph.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param standard If standard is set to true, a standard bidirectional Dijkstra search is conducted.
+     * @param stats If not null, the counters and timings of the query are added to it. See QueryStats.
+     * @return A pair containing the shortest path (as coordinates) and the weight of the shortest path.
+     */
+    std::pair<std::vector<std::array<double, 2>>, double> getShortestRoute(uint64_t source, uint64_t target, bool standard = false,
+                                                                           QueryStats* stats = nullptr) const;
+
+    /**
+     * Computes the shortest route through a sequence of waypoints, one leg after another. Every leg is searched by the
+     * same searcher, so its search state is only set up once. The legs are stitched together: the last point of a leg
+     * is the first point of the next leg, and it is only included once.
+     * @param waypoints The IDs of the vertices that the route goes through, in order. At least two are required.
+     * @param leg_weights Receives the weight of every leg: leg i goes from waypoints[i] to waypoints[i + 1]. The weight
+     * is -1 if there is no path for the leg.
+     * @param waypoint_offsets Receives the position of every waypoint in the route, so that leg i is made up of the
+     * points [waypoint_offsets[i], waypoint_offsets[i + 1]]. Empty if some leg has no path.
+     * @param stats If not null, the counters and timings of the legs are added to it. See QueryStats.
+     * @return A pair containing the route (as coordinates) and its weight, the sum of the weights of the legs. If some
+     * leg has no path, the route is empty and its weight is -1.
+     */
+    std::pair<std::vector<std::array<double, 2>>, double> getWaypointRoute(const std::vector<uint64_t>& waypoints, std::vector<double>* leg_weights,
+                                                                           std::vector<uint64_t>* waypoint_offsets, QueryStats* stats = nullptr) const;
+
+    /**
+     * Computes the shortest route between two vertices and up to a given number of alternative routes, all from a
+     * single search. An alternative route is the shortest route through some other vertex, and it is only returned if
+     * it is not much longer than the shortest route, differs enough from the routes before it, and has no detours. See
+     * BidirectionalSearch::findAlternativePaths. The graph must have been contracted; mapped graphs are supported.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param options The criteria that an alternative route must meet.
+     * @return The shortest route followed by the alternative routes, by increasing weight. Every route is a pair of its
+     * coordinates and its weight. Empty if there is no route.
+     */
+    std::vector<std::pair<std::vector<std::array<double, 2>>, double>> getAlternativeRoutes(
+            uint64_t source, uint64_t target, const AlternativeRouteOptions& options = AlternativeRouteOptions()) const;
+
+    /**
+     * Computes the shortest path between two vertices as an encoded polyline. See getShortestRoute and
+     * convertPathToPolyline.
+     * @param source The ID of the source vertex.
+     * @param target The ID of the target vertex.
+     * @param tolerance If positive, the path is simplified with the Douglas-Peucker algorithm first.
+     * @param precision The number of decimal places that are kept in the polyline.
+     * @param standard If standard is set to true, a standard bidirectional Dijkstra search is conducted.
+     * @return A pair containing the shortest path (as an encoded polyline) and the weight of the shortest path.
+     */
+    std::pair<std::string, double> getEncodedRoute(uint64_t source, uint64_t target, double tolerance = 0,
+                                                   int precision = 5, bool standard = false) const;
+
+    /**
+     * Writes the query graph and the geometry to a flat file that can be mapped with mapFlat. The graph must have been
+     * contracted.
+     * @param filename The name of the file to be written.
+     */
+    void saveFlat(const char* filename) const;
+
+    /**
+     * Replaces the graph with the query graph and the geometry stored in a flat file written by saveFlat. The file is
+     * mapped read-only rather than read, so mapping it is nearly instant and every process that maps the same file
+     * shares a single copy of it in physical memory. A mapped graph can compute routes and their costs with the
+     * modified bidirectional search, but it cannot be modified, saved with cereal, or searched with the standard search.
+     * @param filename The name of the flat file.
+     */
+    void mapFlat(const char* filename);
+
+    /**
+     * Writes the contracted graphs of several routing profiles that share a road network to a single flat file that can
+     * be mapped with mapProfilesFlat. The geometry and the road network are stored once, followed by the name, the edge
+     * weights and the query graph of every profile, so the file is barely larger than the file of a single profile.
+     * @param filename The name of the file to be written.
+     * @param profiles The name and the graph of every profile. The graphs must share a road network, every graph must
+     * have been contracted, and no two profiles may have the same name.
+     */
+    static void saveProfilesFlat(const char* filename, const std::vector<std::pair<std::string, const Graph*>>& profiles);
+
+    /**
+     * Maps the graphs of the routing profiles stored in a flat file written by saveProfilesFlat. The file is mapped
+     * once, and the graphs share its geometry and its road network, so every profile only adds its weights and its
+     * query graph to the memory that the graphs use. A flat file written by saveFlat is mapped as a single profile with
+     * an empty name. The mapped graphs support the same searches as a graph mapped with mapFlat.
+     * @param filename The name of the flat file.
+     * @return The name and the graph of every profile, in the order in which they were written.
+     */
+    static std::vector<std::pair<std::string, Graph>> mapProfilesFlat(const char* filename);
+
+    /**
+     * Indicates whether the graph was mapped from a flat file.
+     * @return Returns true if the graph refers to a mapped flat file, otherwise false.
+     */
+    bool isMapped() const { return mapping_ != nullptr; }
 
     /**
      * Used to remove unnecessary edges after the graph is contracted. Edges that start at a Vertex of greater order than the Vertex the Edge ends at can
@@ -238,13 +659,69 @@ public:
     */
     void optimizeEdges();
 
+    /**
+     * Builds the query graph that is searched by the modified bidirectional search. Must be called after the graph is
+     * contracted and optimized. The layout determines how the vertices are arranged in memory. The query graph of a
+     * graph that has a road network is built by the contraction instead, see setQueryGraph.
+     * @param layout The strategy used to number the vertices of the query graph.
+     * @param unpack_threshold If non-zero, the unpacked geometry of every shortcut edge that contains at least this many
+     * OSM nodes is stored in the query graph, which makes unpacking long routes faster at the cost of memory.
+     */
+    void buildQueryGraph(QueryGraph::Layout layout = QueryGraph::Layout::DFS, uint32_t unpack_threshold = 0);
+
+    /**
+     * Retrieves the query graph. The query graph is empty if the graph has not been contracted.
+     * @return A reference to the query graph.
+     */
+    const QueryGraph& getQueryGraph() const { return query_graph_; }
+
+    /**
+     * Retrieves the geometry of the edges.
+     * @return A reference to the geometry store.
+     */
+    const GeometryStore& getGeometry() const { return *geometry_; }
+
+    /**
+     * Retrieves the road network that holds the vertices and edges of the graph of a routing profile.
+     * @return The road network, or nullptr if the graph stores its own vertices and edges.
+     */
+    const std::shared_ptr<const RoadNetwork>& getNetwork() const { return network_; }
+
+    /**
+     * Retrieves the weight of every edge of the road network. See the constructor that takes a road network.
+     * @return The weights of the edges, or an empty array if the graph has no road network.
+     */
+    const FlatArray<double>& getWeights() const { return weights_; }
+
+    /**
+     * Replaces the query graph of a graph that has a road network. Such a graph has no vertices to add shortcuts to, so
+     * the query graph is built straight from the hierarchy that the contraction found. See HierarchyConstructor.
+     * @param query_graph The query graph.
+     * @param num_shortcuts The number of shortcut edges in the query graph, which are counted as edges of the graph.
+     */
+    void setQueryGraph(QueryGraph query_graph, uint64_t num_shortcuts);
+
+    /**
+     * Reports how much memory every component of the graph uses: the vertices, their adjacent edges, the edges with
+     * their geometry segments, the shortcuts, the vertex locations, the encoded geometry, the query graph, the road
+     * network and the weights of its edges. The hash maps that hold most components usually take far more memory than
+     * the data they hold, see MemoryUsage. A graph that has a road network only adds its weights and its query graph to
+     * the components that it shares with the graphs of other profiles.
+     * @return The payload and the overhead of every component, in bytes.
+     */
+    MemoryUsage getMemoryUsage() const;
+
     /**
      * Serializes necessary information so that the graph can be saved in a binary file. See cereal documentation.
      * @tparam Archive See cereal documentation.
      * @param ar See cereal documentation.
    */
     template <class Archive>
-    void save(Archive& ar) const{ ar(vertices_, edges_, shortcuts_, locations_); }
+    void save(Archive& ar) const {
+        if (mapping_) { throw std::logic_error("A mapped graph cannot be saved. Save the graph that the flat file was written from."); }
+        if (network_) { throw std::logic_error("A graph that has a road network cannot be saved with cereal. Save it as a flat file instead."); }
+        ar(vertices_, edges_, shortcuts_, *locations_, *geometry_, query_graph_);
+    }
 
     /**
      * Serializes necessary information so that the graph can be loaded from a binary file. See cereal documentation.
@@ -252,6 +729,11 @@ public:
      * @param ar See cereal documentation.
    */
     template <class Archive>
-    void load(Archive& ar) { ar(vertices_, edges_, shortcuts_, locations_); }
+    void load(Archive& ar) {
+        // A loaded graph does not share its locations and geometry with any other graph.
+        locations_ = std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>();
+        geometry_ = std::make_shared<GeometryStore>();
+        ar(vertices_, edges_, shortcuts_, *locations_, *geometry_, query_graph_);
+    }
 };
 
@@ -1,8 +1,11 @@
 #pragma once
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
 #include "Graph.h"
+#include "ContractionGraph.h"
 #include "Queue.h"
 
 /**
@@ -19,8 +22,8 @@
 class HierarchyConstructor {
 
 private:
-    // The hop limit is the maximum number of vertices that we will allow to be in the shortest path during a witness search.
-    // If the hop limit is exceeded, we terminate the search.
+    // The hop limit is the maximum number of vertices that we will allow to be settled during a witness search.
+    // If the hop limit is exceeded, we terminate the search. Used unless other limits are set, see setWitnessLimits.
     static const int HOP_LIMIT = 1000;
 
     // The graph that will be contracted.
@@ -35,57 +38,224 @@ private:
     // A multiplier for the deleted neighbor priority term. Benchmarking has shown that 190 an ideal number.
     int deleted_neighbors_coefficient;
 
-    std::unordered_map<uint64_t, Vertex> vertices_;
+    // Multipliers for the original edges and the level priority terms. Zero unless set, see Coefficients.
+    int original_edges_coefficient;
+    int level_coefficient;
+
+    // The number of threads that compute the initial ordering. If zero, one thread per hardware thread is used.
+    int num_threads_;
+
+    // The vertices that have not been contracted yet and the edges between them, including the shortcuts added so far.
+    ContractionGraph working_graph_;
+
+    /**
+    * The state of a witness search, indexed by vertex. It is kept between searches and only the entries touched by the
+    * previous search are reset, so a witness search does not allocate any memory. Every thread that simulates
+    * contractions has its own state.
+    */
+    struct WitnessSearch {
+
+        explicit WitnessSearch(uint32_t num_vertices);
+
+        // The tentative distance of every vertex from the source, or infinity if the vertex has not been reached.
+        std::vector<double> distances;
+
+        // Indicates whether a vertex has been settled, and whether it is one of the vertices a witness is sought for.
+        std::vector<uint8_t> settled, targets;
+
+        // The number of edges on the path to every vertex that has been reached.
+        std::vector<int> hops;
+
+        // The vertices whose entries were changed by the current search.
+        std::vector<uint32_t> touched;
+
+        Queue::MinHeap<HeapElement> queue;
+    };
+
+    // The state of the witness searches of the contraction itself, which runs on a single thread.
+    WitnessSearch witness_search_;
+
+public:
+
+    // The ways of choosing the next vertex to contract.
+    enum class Ordering {
+
+        // The vertex with the lowest priority, updated lazily as the graph is contracted. See Coefficients.
+        GREEDY,
+
+        // A fixed order computed by nested dissection before the contraction. The order takes less time to compute
+        // on several threads and the depth of the hierarchy is predictable, but more shortcuts are added.
+        NESTED_DISSECTION
+    };
+
+    /**
+    * The multipliers of the terms that make up the priority of a vertex. The vertex with the lowest priority is
+    * contracted next. The original edges and level terms keep the hierarchy shallow, which makes the search spaces of
+    * queries smaller, at the cost of more shortcuts. The [Tuning] benchmark compares coefficients on a given map.
+    */
+    struct Coefficients {
+
+        // The number of shortcuts that contracting the vertex adds minus the number of edges that it removes.
+        int edge_difference = 170;
+
+        // The number of neighbors of the vertex that have been contracted.
+        int deleted_neighbors = 190;
+
+        // The number of original edges that the added shortcuts represent minus those that the removed edges represent.
+        int original_edges = 0;
+
+        // The level of the vertex in the hierarchy, i.e. the length of the longest chain of contracted vertices below it.
+        int level = 0;
+    };
+
+    /**
+    * The limits of the witness searches while the remaining graph has at most a given average degree. A search that
+    * gives up early only adds a shortcut that is not needed, which hardly matters while the remaining graph is sparse,
+    * so cheap searches are used at first and their limits grow with the average degree. See setWitnessLimits.
+    */
+    struct WitnessLimit {
+
+        // The limits apply while the average degree of the vertices that have not been contracted is at most this.
+        double max_average_degree;
+
+        // The maximum number of edges on a witness path.
+        int hop_limit;
+
+        // The maximum number of vertices that a witness search settles.
+        int settled_limit;
+    };
+
+    // Limits that contract the sparse early stages of a road network with searches of one and then three hops, and
+    // the dense later stages with searches that are only limited by HOP_LIMIT.
+    static const std::vector<WitnessLimit> STAGED_WITNESS_LIMITS;
+
+    // How long the phases of the contraction took, in seconds.
+    struct Timings {
+
+        // Simulating the contraction of every vertex to find the initial ordering.
+        double initial_ordering = 0;
+
+        // Contracting the vertices one by one, including building the query graph.
+        double contraction = 0;
+    };
+
+private:
+
+    Timings timings_;
+
+    // How the next vertex to contract is chosen.
+    Ordering ordering_ = Ordering::GREEDY;
+
+    // The limits of the witness searches, by increasing average degree.
+    std::vector<WitnessLimit> witness_limits_;
+
+    // The position of every vertex in the contraction order, or NOT_CONTRACTED.
+    std::vector<uint64_t> orders_;
+    static constexpr uint64_t NOT_CONTRACTED = UINT64_MAX;
+
+    // The first value of a checkpoint. Must be changed whenever the contents of a checkpoint change.
+    static constexpr uint64_t CHECKPOINT_VERSION = 3;
+
+    // The file that checkpoints are written to, and the number of vertices contracted between two checkpoints.
+    std::string checkpoint_filename_;
+    uint32_t checkpoint_interval_ = 0;
+
+    // Set to make the contraction stop at the next vertex.
+    std::atomic<bool> stop_requested_{false};
+
+    /**
+     * Writes the state of the contraction to the checkpoint file. The state is written to a temporary file first, so
+     * an interrupted write leaves the previous checkpoint intact.
+     * @param queue The vertices that have not been contracted yet.
+     * @param ordering_count The number of vertices contracted so far.
+     */
+    void saveCheckpoint(const Queue::MinHeap<HeapElement>& queue, uint64_t ordering_count) const;
+
+    /**
+     * Restores the state of the contraction from the checkpoint file, if there is one.
+     * @param queue Set to the vertices that have not been contracted yet.
+     * @param ordering_count Set to the number of vertices contracted so far.
+     * @return Returns true if a checkpoint was restored, otherwise false.
+     */
+    bool loadCheckpoint(Queue::MinHeap<HeapElement>* queue, uint64_t* ordering_count);
 
     /**
-     * This method is used to contract a vertex during the hierarchy construction process.
-     * @param contracted_vertex The ID of the vertex being contracted.
+     * This method is used to contract a vertex during the hierarchy construction process. Only reads the working graph
+     * if simulated is set to true, so contractions can be simulated on several threads at once.
+     * @param search The state of the witness searches.
+     * @param contracted_vertex The index of the vertex being contracted in the working graph.
      * @param simulated If simulated is set to true, no edges will be added. If simulated is set to
      * false, the necessary shortcut edges will be added to the graph. The purpose of simulating the contraction of a Vertex
      * is to determine the cost of contracting the Vertex
+     * @param added_original_edges If not null, set to the number of original edges that the shortcuts represent.
      * @return An integer value that represents the cost of contracting this vertex. The cost of contracting a Vertex is the number of shortcut edges
      * that must be added when we remove the Vertex from the graph.
      */
-    int contractVertex(uint64_t contracted_vertex, bool simulated = false);
+    int contractVertex(WitnessSearch& search, uint32_t contracted_vertex, bool simulated = false, int* added_original_edges = nullptr);
 
     /**
      * The purpose of this method is to find witness paths between vertices. We find witness paths by applying a
-     * standard unidirectional Dijkstra algorithm. If HOP_LIMIT is exceeded, we terminate the search. If u is the Vertex being contracted,
+     * standard unidirectional Dijkstra algorithm. If the limits are exceeded, we terminate the search. If u is the Vertex being contracted,
      * then the maximum weight is weight(v, u) + max(weight(u, w)). We can abort the search if this weight is exceeded, because there
      * is then no hope of finding a witness path. We can also abort the search if we have settled all outgoing vertices of the Vertex being
      * contracted.
-     * @param source The ID of the vertex that is the starting point for the witness search.
-     * @param contracted_vertex The ID of the vertex that is currently being contracted.
+     * @param search The state of the witness search.
+     * @param source The index of the vertex that is the starting point for the witness search.
+     * @param contracted_vertex The index of the vertex that is currently being contracted.
      * @param max_distance The maximum distance that we will allow a witness path to be before terminating the search.
-     * @return An unordered map that maps vertex IDs to shortest path distances from the source vertex.
+     * @param limit The limits on the number of hops and settled vertices of the search.
+     * @return The distances from the source vertex to every vertex, indexed by vertex. Infinite for vertices that were not
+     * reached. Valid until the next witness search.
+     */
+    const std::vector<double>& witnessSearch(WitnessSearch& search, uint32_t source, uint32_t contracted_vertex, double max_distance,
+                                             const WitnessLimit& limit) const;
+
+    /**
+     * Chooses the limits of the witness searches for the current average degree of the remaining graph.
+     * @return The limits of the first stage whose average degree is not exceeded, or of the last stage.
      */
-    std::unordered_map<uint64_t, double> witnessSearch(uint64_t source, uint64_t contracted_vertex, double max_distance);
+    const WitnessLimit& getWitnessLimit() const;
 
     /**
      * This method updates the deleted neighbor counter of all vertices adjacent to the Vertex being contracted.
      * The deleted neighbor counter is used when determining the priority term of a Vertex. The deleted neighbor counter
      * ensures uniform contraction of nodes across the graph. Uniform contraction of nodes reduces preprocessing time and
-     * improves route query time.
-     * @param contracted_vertex The ID of the vertex currently being contracted.
+     * improves route query time. The level of the adjacent vertices is raised above the level of the contracted vertex.
+     * @param contracted_vertex The index of the vertex currently being contracted.
      */
-    void contractedNeighbors(uint64_t contracted_vertex);
+    void contractedNeighbors(uint32_t contracted_vertex);
+
+    /**
+     * Adds the ordering and the shortcuts to the graph once every vertex has been contracted, and builds its query graph.
+     */
+    void buildHierarchy();
+
+    /**
+     * Builds the query graph of a graph that has a road network once every vertex has been contracted. Such a graph has
+     * no vertices to add the ordering and the shortcuts to, so the query graph is built straight from the working graph.
+     */
+    void buildProfileHierarchy();
 
     /**
      * During the contraction of a node, the necessary shortcuts are gathered in a vector. This method adds those shortcuts
-     * to the graph.
-     * @param contracted_vertex The ID of the vertex currently being contracted.
-     * @param shortcuts The shortcut edges that will be added to the graph.
+     * to the working graph; they are added to the graph by buildHierarchy.
+     * @param contracted_vertex The index of the vertex currently being contracted.
+     * @param shortcuts The shortcut edges that will be added to the graph, as indices of their end vertices, along with
+     * their weights and the number of original edges that they represent.
      */
-    void addShortcuts(uint64_t contracted_vertex, const std::vector<std::tuple<unsigned long long, unsigned long long, double>>* shortcuts);
+    void addShortcuts(uint32_t contracted_vertex, const std::vector<std::tuple<uint32_t, uint32_t, double, uint32_t>>* shortcuts);
 
     /**
      * This method computes the Edge difference when a Vertex is contracted. The Edge difference for a Vertex u is given
      * by the number of shortcuts that must be added when u is contracted minus the total number of incoming and outgoing edges
      * that u has.
-     * @param contracted_vertex The ID of the vertex currently being contracted.
+     * @param search The state of the witness searches.
+     * @param contracted_vertex The index of the vertex currently being contracted.
+     * @param original_edges_difference If not null, set to the number of original edges that the shortcuts represent
+     * minus the number of original edges that the edges of the vertex represent.
      * @return An integer representing the edge difference term.
      */
-    int getEdgeDifference(uint64_t contracted_vertex);
+    int getEdgeDifference(WitnessSearch& search, uint32_t contracted_vertex, int* original_edges_difference = nullptr);
 
     /**
      * Determines the maximum outgoing Edge weight of a Vertex being contracted. This distance is used for determining
@@ -93,7 +263,7 @@ private:
      * @param contracted_vertex The vertex currently being contracted.
      * @return The maximum outgoing edge weight of the vertex currently being contracted.
      */
-    double getMaxOutDistance(uint64_t contracted_vertex) const;
+    double getMaxOutDistance(uint32_t contracted_vertex) const;
 
     /**
      * This method gets the next Vertex that is to be contracted. We check to see if the next Vertex
@@ -102,24 +272,33 @@ private:
      * MinHeap has the minimum cost. This process continues until we successfully find a Vertex that still
      * has the minimum cost after a simulated contraction.
      * @param queue A minimum binary heap that contains the vertices that must still be contracted.
-     * @return The ID of the vertex that will be contracted next.
+     * @return The index of the vertex that will be contracted next.
      */
-    uint64_t getNext(Queue::MinHeap<HeapElement> *queue);
+    uint32_t getNext(Queue::MinHeap<HeapElement> *queue);
 
     /**
      * This method is used to compute the initial cost of contraction of all the vertices in the graph. A minimum binary heap is used
-     * to store the vertices and their associated cost.
+     * to store the vertices and their associated cost. The simulated contractions are independent of each other, so they are
+     * split among several threads, and the heap is built from all the costs at once.
      * @return A minimum binary heap containing the vertices that will be contracted.
      */
     Queue::MinHeap<HeapElement> getInitialOrdering();
 
+    /**
+     * Computes the order of contraction by nested dissection, see NestedDissection. The priority of a vertex in the
+     * returned heap is its position in the order.
+     * @return A minimum binary heap containing the vertices that will be contracted.
+     */
+    Queue::MinHeap<HeapElement> getNestedDissectionOrdering();
+
     /**
      * Computes its cost of contracting a given vertex.
-     * @param contracted_vertex The ID of the vertex that will be contracted.
+     * @param search The state of the witness searches.
+     * @param contracted_vertex The index of the vertex that will be contracted.
      * @param simulated If simulated is set to true, the vertex will not actually be contracted.
      * @return An integer representing the cost of contracting the vertex.
      */
-    int getPriorityTerm(uint64_t contracted_vertex, bool simulated = false);
+    int getPriorityTerm(WitnessSearch& search, uint32_t contracted_vertex, bool simulated = false);
 
 public:
     /**
@@ -127,11 +306,61 @@ public:
      * @param graph A reference to the graph that will be contracted.
      * @param edge_difference_coefficient A multiplier that will be used when computing the cost of contracting a vertex.
      * @param deleted_neighbors_coefficient A multiplier that will be used when computing the cost of contracting a vertex.
+     * @param num_threads The number of threads that compute the initial ordering. If zero, one thread per hardware
+     * thread is used.
+     */
+    explicit HierarchyConstructor(Graph& graph, int edge_difference_coefficient = 170, int deleted_neighbors_coefficient = 190,
+                                  int num_threads = 0);
+
+    /**
+     * A constructor for the HierarchyConstructor class that sets every priority coefficient.
+     * @param graph A reference to the graph that will be contracted.
+     * @param coefficients The multipliers of the priority terms.
+     * @param num_threads The number of threads that compute the initial ordering. If zero, one thread per hardware
+     * thread is used.
+     */
+    HierarchyConstructor(Graph& graph, const Coefficients& coefficients, int num_threads = 0);
+
+    /**
+     * Contracts all the vertices in the provided graph. Note that this mutates the graph. If a checkpoint file is set and
+     * exists, the contraction resumes from it; the graph must then be the same uncontracted graph that the interrupted
+     * contraction started from.
+     * @return Returns true once the graph is contracted, or false if the contraction was stopped, see stop.
+     */
+    bool contractGraph();
+
+    /**
+     * Makes contractGraph write a checkpoint every time the given number of vertices has been contracted, so that a
+     * contraction that is interrupted can be resumed by calling contractGraph with the same checkpoint file. The file is
+     * a flat file, see FlatWriter, and is removed once the contraction has finished.
+     * @param filename The name of the checkpoint file.
+     * @param interval The number of vertices that are contracted between two checkpoints.
+     */
+    void setCheckpoint(const std::string& filename, uint32_t interval);
+
+    /**
+     * Stops the contraction once the vertex that is being contracted is done. If a checkpoint file is set, a checkpoint
+     * is written first. Safe to call from another thread or from a signal handler, e.g. when an instance is preempted.
+     */
+    void stop() { stop_requested_ = true; }
+
+    /**
+     * Chooses how the next vertex to contract is found. Must be called before contractGraph.
+     * @param ordering The way of ordering the vertices. GREEDY unless set.
+     */
+    void setOrdering(const Ordering ordering) { ordering_ = ordering; }
+
+    /**
+     * Sets the limits of the witness searches. The limits are chosen anew for every vertex, by the average degree of
+     * the vertices that have not been contracted yet. Tighter limits make the contraction faster but may add shortcuts
+     * that are not needed; the distances are correct either way. Must be called before contractGraph.
+     * @param limits The limits, by increasing average degree, e.g. STAGED_WITNESS_LIMITS. Throws an exception if empty.
      */
-    explicit HierarchyConstructor(Graph& graph, int edge_difference_coefficient = 170, int deleted_neighbors_coefficient = 190);
+    void setWitnessLimits(std::vector<WitnessLimit> limits);
 
     /**
-     * Contracts all the vertices in the provided graph. Note that this mutates the graph.
+     * Retrieves how long the phases of the last contraction took.
+     * @return The duration of every phase, in seconds.
      */
-    void contractGraph();
+    const Timings& getTimings() const { return timings_; }
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <stdexcept>
+#include "FlatArray.h"
+
+/**
+* A file that is mapped read-only into memory. The pages of the file are shared by every process that maps it, so many
+* processes can search the same graph while only one copy of it occupies physical memory.
+*/
+class MappedFile {
+
+private:
+
+    // The first byte of the mapped file.
+    const uint8_t* data_ = nullptr;
+
+    // The size of the file in bytes.
+    size_t size_ = 0;
+
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+
+public:
+
+    /**
+     * A constructor for the MappedFile class. Throws an exception if the file cannot be mapped.
+     * @param filename The name of the file to be mapped.
+     */
+    explicit MappedFile(const char* filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+
+    size_t size() const { return size_; }
+};
+
+/**
+* Writes arrays to a flat file that can be mapped into memory with MappedFile and read back with FlatReader. Every array
+* is stored as its number of elements followed by its elements, starting at a multiple of ALIGNMENT bytes. The elements
+* are stored in the byte order of the machine that writes the file.
+*/
+class FlatWriter {
+
+private:
+
+    std::ofstream os_;
+
+    uint64_t position_ = 0;
+
+    void write(const void* data, size_t size);
+
+public:
+
+    // The alignment of every array in the file. A cache line, so that arrays start on a cache line boundary.
+    static constexpr size_t ALIGNMENT = 64;
+
+    // Identifies flat graph files. The last two bytes hold the version of the file format.
+    static constexpr uint64_t MAGIC = 0x3130544c4652534fULL;
+
+    // Identifies flat files that hold the graphs of several routing profiles, see Graph::saveProfilesFlat.
+    static constexpr uint64_t PROFILES_MAGIC = 0x313046525052534fULL;
+
+    /**
+     * A constructor for the FlatWriter class. Throws an exception if the file cannot be created.
+     * @param filename The name of the file to be written.
+     * @param magic Identifies the kind of flat file.
+     */
+    explicit FlatWriter(const char* filename, uint64_t magic = MAGIC);
+
+    /**
+     * Writes an array to the file.
+     * @tparam T The type of the elements.
+     * @param array The array to be written.
+     */
+    template <class T>
+    void writeArray(const FlatArray<T>& array) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable elements can be mapped.");
+        const uint64_t size = array.size();
+        write(&size, sizeof(size));
+        // Pads the file so that the elements start at an aligned position.
+        const uint8_t padding[ALIGNMENT] = {};
+        write(padding, (ALIGNMENT - position_ % ALIGNMENT) % ALIGNMENT);
+        write(array.data(), array.getNumBytes());
+    }
+};
+
+/**
+* Reads the arrays of a mapped flat file in the order in which they were written by FlatWriter. The arrays refer to the
+* mapped file and do not copy it, so the file must remain mapped for as long as they are used.
+*/
+class FlatReader {
+
+private:
+
+    const MappedFile& file_;
+
+    uint64_t position_ = 0;
+
+    // Checks that some number of elements follow the current position. Divides rather than multiplies, so that the
+    // number of elements read from a corrupt file cannot overflow.
+    void check(uint64_t count, size_t element_size) const {
+        if (position_ > file_.size() || count > (file_.size() - position_) / element_size) { throw std::logic_error("The flat file is truncated."); }
+    }
+
+public:
+
+    /**
+     * A constructor for the FlatReader class. Throws an exception if the file is not a flat file of the expected kind.
+     * @param file The mapped file.
+     * @param magic Identifies the kind of flat file.
+     */
+    explicit FlatReader(const MappedFile& file, uint64_t magic = FlatWriter::MAGIC);
+
+    /**
+     * Reads the number that identifies the kind of a flat file.
+     * @param file The mapped file.
+     * @return The magic number at the start of the file, or 0 if the file is too small to hold one.
+     */
+    static uint64_t readMagic(const MappedFile& file);
+
+    /**
+     * Reads the next array of the file.
+     * @tparam T The type of the elements. Must match the type that was written.
+     * @return An array that refers to the mapped file.
+     */
+    template <class T>
+    FlatArray<T> readArray() {
+        check(1, sizeof(uint64_t));
+        uint64_t size;
+        std::copy(file_.data() + position_, file_.data() + position_ + sizeof(size), reinterpret_cast<uint8_t*>(&size));
+        position_ += sizeof(size);
+        position_ += (FlatWriter::ALIGNMENT - position_ % FlatWriter::ALIGNMENT) % FlatWriter::ALIGNMENT;
+        check(size, sizeof(T));
+        const auto* data = reinterpret_cast<const T*>(file_.data() + position_);
+        position_ += size * sizeof(T);
+        return FlatArray<T>::view(data, size);
+    }
+};
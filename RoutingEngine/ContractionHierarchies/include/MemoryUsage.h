@@ -0,0 +1,109 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "FlatHashMap.h"
+
+/**
+* A report of the memory used by the components of a graph. The payload of a component is the size of the data itself,
+* and the overhead is everything that its containers add on top of it: hash table nodes and buckets, keys that repeat
+* data stored elsewhere, allocator headers, and unused capacity.
+*
+* The heap usage of node based containers cannot be queried, so it is estimated from the layout that libstdc++ and
+* glibc use: every node holds a pointer to the next node followed by the element, and every allocation is rounded up to
+* a multiple of 16 bytes after adding an 8 byte header.
+*/
+struct MemoryUsage {
+
+    // The memory used by one component.
+    struct Component {
+
+        // The name of the component, e.g. "edges".
+        std::string name;
+
+        // The size of the data and of everything that is stored on top of it, in bytes.
+        uint64_t payload = 0, overhead = 0;
+
+        // Indicates whether the component refers to a memory mapped file. The pages of a mapped file are shared by
+        // every process that maps it, and are only loaded once they are read.
+        bool mapped = false;
+
+        // Indicates whether the component is shared with other graphs, such as the graphs of other routing profiles.
+        // A shared component should only be counted once when the reports of those graphs are added up.
+        bool shared = false;
+
+        uint64_t getTotal() const { return payload + overhead; }
+    };
+
+    // The components, in the order in which they were added.
+    std::vector<Component> components;
+
+    /**
+     * Adds a component to the report.
+     * @param name The name of the component.
+     * @param payload The size of the data, in bytes.
+     * @param allocated The number of bytes allocated for the component. Everything beyond the payload is overhead.
+     * @param mapped Indicates whether the component refers to a memory mapped file.
+     * @param shared Indicates whether the component is shared with other graphs.
+     */
+    void add(const std::string& name, uint64_t payload, uint64_t allocated, bool mapped = false, bool shared = false) {
+        components.push_back({name, payload, allocated > payload ? allocated - payload : 0, mapped, shared});
+    }
+
+    /**
+     * Retrieves a component of the report.
+     * @param name The name of the component.
+     * @return The component, or an empty component if there is no component with the given name.
+     */
+    Component get(const std::string& name) const {
+        const auto it = std::find_if(components.begin(), components.end(), [&](const Component& component) { return component.name == name; });
+        return it == components.end() ? Component{name} : *it;
+    }
+
+    uint64_t getPayload() const {
+        uint64_t payload = 0;
+        for (const auto& component : components) { payload += component.payload; }
+        return payload;
+    }
+
+    uint64_t getOverhead() const {
+        uint64_t overhead = 0;
+        for (const auto& component : components) { overhead += component.overhead; }
+        return overhead;
+    }
+
+    uint64_t getTotal() const { return getPayload() + getOverhead(); }
+
+    /**
+     * Estimates the number of bytes that the allocator reserves for a single allocation.
+     * @param size The requested number of bytes.
+     * @return The requested number of bytes, plus the header of the allocation, rounded up to the allocator's alignment.
+     */
+    static uint64_t getAllocationSize(const uint64_t size) {
+        return std::max<uint64_t>(32, (size + sizeof(size_t) + 15) / 16 * 16);
+    }
+
+    /**
+     * Estimates the number of bytes that a hash map has allocated, not counting any memory owned by its elements.
+     * @param map The hash map.
+     * @return The number of bytes used by the nodes and the buckets of the hash map.
+     */
+    template <class Key, class Value, class... Rest>
+    static uint64_t getAllocatedBytes(const std::unordered_map<Key, Value, Rest...>& map) {
+        const uint64_t node_size = sizeof(void*) + sizeof(std::pair<const Key, Value>);
+        const uint64_t buckets = map.bucket_count() > 1 ? getAllocationSize(map.bucket_count() * sizeof(void*)) : 0;
+        return map.size() * getAllocationSize(node_size) + buckets;
+    }
+
+    /**
+     * Estimates the number of bytes that a flat hash map has allocated, not counting any memory owned by its elements.
+     * @param map The hash map.
+     * @return The number of bytes used by the slots of the hash map.
+     */
+    template <class Key, class Value, class... Rest>
+    static uint64_t getAllocatedBytes(const FlatHashMap<Key, Value, Rest...>& map) {
+        return map.getNumAllocatedBytes() > 0 ? getAllocationSize(map.getNumAllocatedBytes()) : 0;
+    }
+};
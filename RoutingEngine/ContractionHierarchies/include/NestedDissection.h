@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <cstdint>
+#include "ContractionGraph.h"
+
+/**
+* Computes a contraction order by nested dissection. The graph is split in two by a small separator, the two halves are
+* split recursively, and every separator is contracted after the vertices that it separates. The depth of the resulting
+* hierarchy is predictable, about the logarithm of the number of vertices, and the halves are independent of each other,
+* so they are dissected on several threads at once.
+*
+* The separators are found with inertial flow: the vertices are sorted along a line through the map, the first and the
+* last quarter become the sources and the sinks of a max flow problem with unit capacities, and the minimum cut is turned
+* into a vertex separator. Several lines are tried and the smallest cut is kept. Road networks are nearly planar, so the
+* cuts are small, e.g. the bridges over a river.
+*/
+class NestedDissection {
+
+private:
+
+    // Cells with at most this many vertices are not dissected any further.
+    static constexpr uint32_t LEAF_SIZE = 16;
+
+    static constexpr uint32_t INVALID = UINT32_MAX;
+
+    // The undirected graph: the neighbors of vertex v are found in [first_[v], first_[v + 1]) of neighbors_.
+    std::vector<uint32_t> first_, neighbors_;
+
+    // The coordinates of every vertex, projected so that distances in both directions are comparable.
+    std::vector<std::array<double, 2>> coordinates_;
+
+    // The scratch space of a thread. Only the entries of the cell being dissected are set, and they are reset afterwards.
+    struct Workspace {
+
+        explicit Workspace(uint32_t num_vertices);
+
+        // The position of every vertex of the cell in the cell, or INVALID.
+        std::vector<uint32_t> local;
+
+        // The undirected graph of the cell, with the reverse of every arc.
+        std::vector<uint32_t> first, heads, reverse;
+
+        // The flow on every arc, the arc that a vertex was reached by, and the role of every vertex in the flow problem.
+        std::vector<int8_t> flow;
+        std::vector<uint32_t> parent;
+        std::vector<uint8_t> role, reached;
+    };
+
+    /**
+     * Finds a small set of vertices whose removal splits a cell in two.
+     * @param cell The vertices of the cell.
+     * @param workspace The scratch space of the calling thread. Its local positions must be set for the cell.
+     * @return The positions in the cell of the vertices of the separator.
+     */
+    std::vector<uint32_t> findSeparator(const std::vector<uint32_t>& cell, Workspace& workspace) const;
+
+    /**
+     * Dissects a cell once: the vertices of its separator, or of the whole cell if it is a leaf, are assigned the depth
+     * of the cell.
+     * @param cell The vertices of the cell.
+     * @param depth The depth of the cell.
+     * @param workspace The scratch space of the calling thread.
+     * @param depths The depth of every vertex.
+     * @return The connected parts that the cell is split into by its separator.
+     */
+    std::vector<std::vector<uint32_t>> dissect(const std::vector<uint32_t>& cell, uint32_t depth, Workspace& workspace,
+                                               std::vector<uint32_t>* depths) const;
+
+public:
+
+    /**
+     * A constructor for the NestedDissection class.
+     * @param graph The graph that will be contracted. The direction and the weight of the edges are ignored.
+     * @param coordinates The latitude and longitude of every vertex of the graph.
+     */
+    NestedDissection(const ContractionGraph& graph, const std::vector<std::array<double, 2>>& coordinates);
+
+    /**
+     * Computes the order in which the vertices are contracted. A separator comes after all the vertices of the cell
+     * that it separates.
+     * @param num_threads The number of threads that dissect cells. If zero, one thread per hardware thread is used.
+     * @return The vertices in the order of contraction.
+     */
+    std::vector<uint32_t> computeOrder(int num_threads = 0) const;
+};
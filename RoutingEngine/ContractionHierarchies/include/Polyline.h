@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <string>
+#include <cstdint>
+
+/**
+* The purpose of this class is to produce compact route geometry. Routes are encoded with the encoded polyline algorithm
+* format used by Google Maps and most map libraries: every coordinate is rounded to a fixed number of decimal places and
+* stored as the difference to the previous coordinate, in printable ASCII characters. See
+* https://developers.google.com/maps/documentation/utilities/polylinealgorithm for further details.
+*
+* A polyline is built one point at a time, so a route can be encoded while its geometry is being decoded from the graph.
+*/
+class Polyline {
+
+private:
+
+    // The encoded points.
+    std::string encoded_;
+
+    // The number of fixed point units per degree.
+    double factor_;
+
+    // The previous point, in fixed point units.
+    int64_t previous_lat_, previous_lon_;
+
+    /**
+     * Appends a signed value to an encoded polyline.
+     * @param value The value to be encoded.
+     * @param encoded The encoded polyline.
+     */
+    static void encodeValue(int64_t value, std::string* encoded);
+
+public:
+
+    /**
+     * A constructor for the Polyline class.
+     * @param precision The number of decimal places that are kept. Google Maps uses 5, OSRM and Valhalla also offer 6.
+     */
+    explicit Polyline(int precision = 5);
+
+    /**
+     * Appends a point to the polyline.
+     * @param coordinates The latitude and longitude of the point.
+     */
+    void addPoint(const std::array<double, 2>& coordinates);
+
+    /**
+     * Retrieves the encoded polyline.
+     * @return The points added so far, encoded as a string.
+     */
+    const std::string& getEncoded() const { return encoded_; }
+
+    /**
+     * Encodes a sequence of coordinates.
+     * @param coordinates The coordinates (latitude and longitude) to be encoded.
+     * @param precision The number of decimal places that are kept.
+     * @return The encoded polyline.
+     */
+    static std::string encode(const std::vector<std::array<double, 2>>& coordinates, int precision = 5);
+
+    /**
+     * Decodes an encoded polyline. Throws an exception if the polyline is malformed.
+     * @param encoded The encoded polyline.
+     * @param precision The number of decimal places that were kept when the polyline was encoded.
+     * @return The coordinates (latitude and longitude) that make up the polyline.
+     */
+    static std::vector<std::array<double, 2>> decode(const std::string& encoded, int precision = 5);
+
+    /**
+     * Simplifies a sequence of coordinates with the Douglas-Peucker algorithm: a point is dropped if it lies within the
+     * tolerance of the line between the points that are kept around it. The first and last points are always kept.
+     * @param coordinates The coordinates (latitude and longitude) to be simplified.
+     * @param tolerance The largest distance, in meters, that a dropped point may lie from the simplified line.
+     * @return The points that are kept, in their original order.
+     */
+    static std::vector<std::array<double, 2>> simplify(const std::vector<std::array<double, 2>>& coordinates, double tolerance);
+};
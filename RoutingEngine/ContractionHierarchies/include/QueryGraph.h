@@ -0,0 +1,373 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <limits>
+#include <cstdint>
+#include <cereal/types/array.hpp>
+#include <cereal/types/vector.hpp>
+#include "FlatArray.h"
+
+// Hints the processor to fetch the cache line containing the given address. Used to hide memory latency during searches.
+#if defined(__GNUC__) || defined(__clang__)
+#define CH_PREFETCH(address) __builtin_prefetch(address)
+#else
+#include <xmmintrin.h>
+#define CH_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#endif
+
+struct Vertex;
+struct Edge;
+class FlatWriter;
+class FlatReader;
+
+// An edge in the query graph. Only edges leading to a vertex of higher order are stored.
+struct QueryEdge {
+
+    // The index of the vertex at the other end of the edge.
+    uint32_t head;
+
+    // The index of the vertex that a shortcut edge goes through, or QueryGraph::INVALID_INDEX if the edge is an
+    // original edge. Stored inline so that unpacking a shortcut needs no hash table lookups.
+    uint32_t middle;
+
+    // The weight of the edge.
+    double weight;
+
+    /**
+     * Serializes necessary information so that the graph can be saved in a binary file. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void serialize(Archive& ar) { ar(head, middle, weight); }
+};
+
+// An original edge (i.e. a road segment) that is part of an edge of the query graph.
+struct OriginalEdge {
+
+    // The segment in the geometry store of the graph that holds the OSM nodes of the edge.
+    uint32_t geometry;
+
+    // The index of the vertex that the edge leads to.
+    uint32_t head;
+
+    // Indicates whether the edge traverses its segment in reverse.
+    bool reversed;
+
+    /**
+     * Serializes necessary information so that the graph can be saved in a binary file. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void serialize(Archive& ar) { ar(geometry, head, reversed); }
+};
+
+// An upward edge of a contracted graph, as it is given to the query graph when the query graph is built.
+struct HierarchyEdge {
+
+    // The index of the vertex at the other end of the edge.
+    uint32_t vertex;
+
+    // The index of the vertex that a shortcut edge goes through, or QueryGraph::INVALID_INDEX if the edge is an
+    // original edge.
+    uint32_t middle;
+
+    // The segment in the geometry store that holds the OSM nodes of an original edge, and whether the edge traverses
+    // its segment in reverse. Not used for shortcut edges.
+    uint32_t geometry;
+    bool reversed;
+
+    // The weight of the edge.
+    double weight;
+};
+
+/**
+ * The purpose of this class is to store a contracted graph in a form that is fast to search. The vertices are numbered
+ * densely and the upward edges of every vertex are stored contiguously in a single array (i.e. a compressed sparse row
+ * layout), so that a search touches a handful of cache lines per vertex rather than a chain of hash table nodes.
+ *
+ * The numbering of the vertices is chosen when the query graph is built. Numbering the vertices in depth first order of
+ * the downward graph, starting at the most important vertex, places the vertices that a typical upward search settles
+ * next to one another in memory.
+ *
+ * The query graph also holds everything that is needed to turn a path of query graph edges into a path of original
+ * edges, whose OSM nodes are then decoded from the geometry store of the graph. Original edges always store a reference
+ * to their geometry, and shortcut edges are unpacked through their middle vertex. Optionally, long shortcuts store the
+ * original edges they represent as well, in which case unpacking them is a single copy.
+ *
+ * Every array of the query graph is a FlatArray, so the query graph can either own its arrays or refer to a memory
+ * mapped flat file (see saveFlat and mapFlat). A mapped query graph is shared by every process that maps the same file.
+ */
+class QueryGraph {
+
+public:
+
+    // The strategies that can be used to number the vertices of the query graph.
+    enum class Layout {
+        // Vertices are numbered in the order in which they are stored in the graph (i.e. effectively random).
+        INPUT,
+        // Vertices are numbered by decreasing order (i.e. the most important vertex first).
+        RANK,
+        // Vertices are numbered in depth first order of the downward graph, starting at the most important vertex.
+        DFS
+    };
+
+    // Indicates that a vertex is not present in the query graph.
+    static const uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+    // A contiguous range of edges that belong to a single vertex.
+    struct EdgeRange {
+        const QueryEdge* first;
+        const QueryEdge* last;
+        const QueryEdge* begin() const { return first; }
+        const QueryEdge* end() const { return last; }
+    };
+
+private:
+
+    // The position of the first outgoing and incoming edge of every vertex in out_edges_ and in_edges_. The edges of
+    // vertex v are found in the range [first_out_[v], first_out_[v + 1]).
+    FlatArray<uint32_t> first_out_, first_in_;
+
+    // The upward edges used by the forward search and the upward edges used by the backward search.
+    FlatArray<QueryEdge> out_edges_, in_edges_;
+
+    // The position of the original edges of every edge in geometry_. The original edges of out_edges_[e] are found in
+    // the range [out_geometry_[e], out_geometry_[e + 1]), and likewise for in_edges_.
+    FlatArray<uint32_t> out_geometry_, in_geometry_;
+
+    // The original edges that make up the edges.
+    FlatArray<OriginalEdge> geometry_;
+
+    // Maps the index of a vertex to its vertex ID.
+    FlatArray<uint64_t> ids_;
+
+    // The vertex IDs in ascending order and the index of each of them. Used to look up the index of a vertex by binary
+    // search, which unlike a hash table can be mapped from a file as is.
+    FlatArray<uint64_t> sorted_ids_;
+    FlatArray<uint32_t> sorted_indices_;
+
+    // The coordinates (latitude and longitude) of every vertex. NaN if the location of a vertex is unknown.
+    FlatArray<std::array<double, 2>> locations_;
+
+    // Sorts the vertex IDs so that the index of a vertex can be looked up.
+    void buildIndex();
+
+    /**
+     * Numbers the vertices according to the given layout.
+     * @param ids The ID of every vertex.
+     * @param orders The order of every vertex.
+     * @param out_edges The upward edges of every vertex that are used by the forward search.
+     * @param in_edges The upward edges of every vertex that are used by the backward search.
+     * @param layout The strategy used to number the vertices.
+     * @return A vector containing the given index of every vertex in order of its new index.
+     */
+    static std::vector<uint32_t> computeLayout(const std::vector<uint64_t>& ids, const std::vector<uint64_t>& orders,
+                                               const std::vector<std::vector<HierarchyEdge>>& out_edges,
+                                               const std::vector<std::vector<HierarchyEdge>>& in_edges, Layout layout);
+
+    // Builds the query graph from a contracted graph that is given as arrays. See the constructor that takes arrays.
+    void build(const std::vector<uint64_t>& ids, const std::vector<uint64_t>& orders, const std::vector<std::vector<HierarchyEdge>>& out_edges,
+               const std::vector<std::vector<HierarchyEdge>>& in_edges, const std::vector<std::array<double, 2>>& locations,
+               Layout layout, uint32_t unpack_threshold);
+
+    /**
+     * Finds the position of an edge of a vertex.
+     * @param index The index of the vertex that stores the edge.
+     * @param head The index of the vertex at the other end of the edge.
+     * @param backward Indicates whether the edge is stored with the edges of the backward or the forward search.
+     * @return The position of the edge in in_edges_ (if backward) or out_edges_ (otherwise).
+     */
+    uint32_t findEdge(uint32_t index, uint32_t head, bool backward) const;
+
+    /**
+     * Stores the original edges of every shortcut edge that represents at least the given number of original edges.
+     * @param unpack_threshold The minimum number of original edges that a shortcut edge must represent for its
+     * original edges to be stored.
+     */
+    void precomputeShortcutGeometry(uint32_t unpack_threshold);
+
+public:
+
+    QueryGraph() = default;
+
+    /**
+     * A constructor for the QueryGraph class. The vertices must already be contracted and optimized (i.e. the edges of
+     * every vertex only lead to vertices of higher order).
+     * @param vertices The vertices of the contracted graph.
+     * @param shortcuts The shortcut edges of the contracted graph, mapped to the vertex that they go through.
+     * @param edges The original edges of the graph.
+     * @param locations The coordinates of the vertices. Vertices without a known location are allowed.
+     * @param layout The strategy used to number the vertices.
+     * @param unpack_threshold If non-zero, the original edges of every shortcut edge that represents at least this many
+     * original edges are stored, which makes unpacking long routes faster at the cost of memory.
+     */
+    QueryGraph(const std::unordered_map<uint64_t, Vertex>& vertices,
+               const std::unordered_map<uint64_t, std::unordered_map<uint64_t, uint64_t>>& shortcuts,
+               const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>& edges,
+               const std::unordered_map<uint64_t, std::array<double, 2>>& locations,
+               Layout layout = Layout::DFS, uint32_t unpack_threshold = 0);
+
+    /**
+     * A constructor for the QueryGraph class that takes the contracted graph as arrays, with the vertices numbered from
+     * 0 to n - 1 in any order. Used for graphs whose original edges are not stored as Edge objects, see RoadNetwork.
+     * @param ids The ID of every vertex.
+     * @param orders The order of every vertex.
+     * @param out_edges The upward edges of every vertex that are used by the forward search, i.e. the edges from the
+     * vertex to a vertex of higher order.
+     * @param in_edges The upward edges of every vertex that are used by the backward search, i.e. the edges from a
+     * vertex of higher order to the vertex.
+     * @param locations The coordinates of every vertex. NaN if the location of a vertex is unknown.
+     * @param layout The strategy used to number the vertices.
+     * @param unpack_threshold See the constructor above.
+     */
+    QueryGraph(const std::vector<uint64_t>& ids, const std::vector<uint64_t>& orders, const std::vector<std::vector<HierarchyEdge>>& out_edges,
+               const std::vector<std::vector<HierarchyEdge>>& in_edges, const std::vector<std::array<double, 2>>& locations,
+               Layout layout = Layout::DFS, uint32_t unpack_threshold = 0);
+
+    /**
+     * Indicates whether the query graph has been built or not.
+     * @return Returns true if the query graph contains no vertices, otherwise false.
+     */
+    bool empty() const { return ids_.empty(); }
+
+    /**
+     * This method gets the number of vertices present in the query graph.
+     * @return an integer that denotes how many vertices are in the query graph.
+     */
+    uint32_t getNumVertices() const { return uint32_t(ids_.size()); }
+
+    /**
+     * Retrieves the index of a vertex.
+     * @param id The ID of the vertex.
+     * @return The index of the vertex, or INVALID_INDEX if the vertex is not in the query graph.
+     */
+    uint32_t getIndex(uint64_t id) const;
+
+    /**
+     * Retrieves the ID of a vertex.
+     * @param index The index of the vertex.
+     * @return The ID of the vertex.
+     */
+    uint64_t getId(uint32_t index) const { return ids_[index]; }
+
+    /**
+     * Retrieves the location of a vertex.
+     * @param index The index of the vertex.
+     * @return The latitude and longitude of the vertex, or NaN if its location is unknown.
+     */
+    const std::array<double, 2>& getLocation(uint32_t index) const { return locations_[index]; }
+
+    /**
+     * Retrieves the upward edges of a vertex that are relevant to the given search direction.
+     * @param index The index of the vertex.
+     * @param backward If true, the edges used by the backward search are returned. Otherwise, the edges used by the
+     * forward search are returned.
+     * @return The edges of the vertex.
+     */
+    EdgeRange getEdges(uint32_t index, bool backward) const {
+        if (backward) { return EdgeRange{in_edges_.data() + first_in_[index], in_edges_.data() + first_in_[index + 1]}; }
+        return EdgeRange{out_edges_.data() + first_out_[index], out_edges_.data() + first_out_[index + 1]};
+    }
+
+    /**
+     * Retrieves the position of an edge in the edges used by the given search direction.
+     * @param edge A pointer to an edge that was obtained from getEdges.
+     * @param backward Indicates whether the edge belongs to the edges of the backward or the forward search.
+     * @return The position of the edge.
+     */
+    uint32_t getEdgePosition(const QueryEdge* edge, bool backward) const {
+        return uint32_t(edge - (backward ? in_edges_.data() : out_edges_.data()));
+    }
+
+    /**
+     * Appends the original edges that make up an edge to a path. Shortcut edges are unpacked into the original edges
+     * that they represent.
+     * @param tail The index of the vertex that the edge starts at, in the direction of travel.
+     * @param head The index of the vertex that the edge ends at, in the direction of travel.
+     * @param position The position of the edge in the edges used by the given search direction.
+     * @param backward Indicates whether the edge belongs to the edges of the backward or the forward search. Edges of
+     * the backward search are stored with their head vertex.
+     * @param path The path that the original edges are appended to.
+     * @param weights If not null, the weight of every original edge is appended to it. The stored original edges of
+     * long shortcuts have no weights, so the shortcuts are then unpacked through their middle vertex instead.
+     */
+    void unpackEdge(uint32_t tail, uint32_t head, uint32_t position, bool backward, std::vector<OriginalEdge>* path,
+                    std::vector<double>* weights = nullptr) const;
+
+    /**
+     * Retrieves the number of original edges stored for the edges.
+     * @return The number of original edges stored for the edges.
+     */
+    uint64_t getGeometrySize() const { return geometry_.size(); }
+
+    /**
+     * Retrieves the number of bytes occupied by the arrays of the query graph.
+     * @return The number of bytes occupied by the query graph.
+     */
+    uint64_t getNumBytes() const;
+
+    /**
+     * Retrieves the number of bytes allocated for the arrays of the query graph.
+     * @return The number of bytes allocated by the query graph, including unused capacity, or 0 if it is mapped.
+     */
+    uint64_t getNumAllocatedBytes() const;
+
+    /**
+     * Writes the query graph to a flat file.
+     * @param writer The flat file that the arrays of the query graph are written to.
+     */
+    void saveFlat(FlatWriter& writer) const;
+
+    /**
+     * Reads a query graph that was written with saveFlat from a mapped flat file. The arrays of the query graph refer
+     * to the mapped file, which must remain mapped for as long as the query graph is used. Throws an exception if any
+     * offset or index of the query graph lies outside the arrays that it refers to.
+     * @param reader The mapped flat file, positioned at the first array of the query graph.
+     * @param num_segments The number of segments in the geometry store that the original edges refer to.
+     */
+    void mapFlat(FlatReader& reader, uint32_t num_segments);
+
+    /**
+     * Hints the processor to fetch the position of the edges of a vertex. Reading the edge range of a vertex shortly
+     * afterwards will not stall on memory.
+     * @param index The index of the vertex.
+     * @param backward Indicates whether the edges of the backward search or the forward search will be read.
+     */
+    void prefetchVertex(uint32_t index, bool backward) const {
+        if (backward) { CH_PREFETCH(first_in_.data() + index); }
+        else { CH_PREFETCH(first_out_.data() + index); }
+    }
+
+    /**
+     * Hints the processor to fetch the first cache lines of the edges of a vertex.
+     * @param index The index of the vertex.
+     * @param backward Indicates whether the edges of the backward search or the forward search will be read.
+     */
+    void prefetchEdges(uint32_t index, bool backward) const {
+        const auto edges = getEdges(index, backward);
+        CH_PREFETCH(edges.first);
+        if (edges.last - edges.first > 4) { CH_PREFETCH(edges.first + 4); }
+    }
+
+    /**
+     * Serializes necessary information so that the graph can be saved in a binary file. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void save(Archive& ar) const { ar(first_out_, first_in_, out_edges_, in_edges_, out_geometry_, in_geometry_, geometry_, ids_, locations_); }
+
+    /**
+     * Serializes necessary information so that the graph can be loaded from a binary file. See cereal documentation.
+     * @tparam Archive See cereal documentation.
+     * @param ar See cereal documentation.
+     */
+    template <class Archive>
+    void load(Archive& ar) {
+        ar(first_out_, first_in_, out_edges_, in_edges_, out_geometry_, in_geometry_, geometry_, ids_, locations_);
+        buildIndex();
+    }
+};
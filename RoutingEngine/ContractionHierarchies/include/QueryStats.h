@@ -0,0 +1,82 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+/**
+* Counters and phase timings of a single shortest path query. Used to find out why some queries take much longer than
+* others. Statistics are only collected if the library is built with CH_QUERY_STATS defined (the CMake option of the
+* same name). Otherwise, the instrumentation is compiled out entirely and the statistics of every query remain zero.
+*/
+struct QueryStats {
+
+    // Indicates whether statistics are collected by this build of the library.
+#ifdef CH_QUERY_STATS
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    // The number of vertices settled by the forward and by the backward search.
+    uint64_t settled_forward = 0, settled_backward = 0;
+
+    // The number of edges relaxed by both searches.
+    uint64_t relaxed_edges = 0;
+
+    // The number of elements pushed onto and popped from the priority queue.
+    uint64_t heap_pushes = 0, heap_pops = 0;
+
+    // The number of shortcut edges that were replaced by the two edges they consist of.
+    uint64_t unpacked_shortcuts = 0;
+
+    // The number of OSM nodes (or coordinates) in the resulting path.
+    uint64_t path_nodes = 0;
+
+    // The time spent in each phase of the query, in nanoseconds: the search itself, following the parent pointers from
+    // the meeting vertex to the source and target, unpacking the shortcut edges, and decoding the geometry of the path.
+    uint64_t search_ns = 0, reconstruct_ns = 0, unpack_ns = 0, geometry_ns = 0;
+
+    // Adds the time between its construction and its destruction to a phase timing, if there is one.
+    class Timer {
+
+    private:
+
+        uint64_t* elapsed_;
+
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+
+        /**
+         * A constructor for the Timer class.
+         * @param elapsed The phase timing that the elapsed time is added to, or nullptr.
+         */
+        explicit Timer(uint64_t* elapsed) : elapsed_(elapsed) {
+            if (elapsed_) { start_ = std::chrono::steady_clock::now(); }
+        }
+
+        ~Timer() {
+            if (elapsed_) {
+                *elapsed_ += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+            }
+        }
+
+        Timer(const Timer&) = delete;
+
+        Timer& operator=(const Timer&) = delete;
+    };
+};
+
+/**
+* Instrumentation hooks used by the searches. CH_STATS runs a statement on the statistics of the current query, and
+* CH_STATS_TIMER adds the time until the end of the enclosing scope to a phase timing. The statistics are given as a
+* QueryStats pointer that is null if they are not requested. If CH_QUERY_STATS is not defined, both hooks only discard
+* the statistics pointer, so that the statement is not evaluated and a parameter used only for statistics is not reported
+* as unused.
+*/
+#ifdef CH_QUERY_STATS
+#define CH_STATS(stats, statement) do { if (stats) { (stats)->statement; } } while (false)
+#define CH_STATS_TIMER(stats, phase) QueryStats::Timer phase##_timer((stats) ? &(stats)->phase##_ns : nullptr)
+#else
+#define CH_STATS(stats, statement) do { (void)(stats); } while (false)
+#define CH_STATS_TIMER(stats, phase) (void)(stats)
+#endif
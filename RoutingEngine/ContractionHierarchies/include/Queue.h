@@ -182,5 +182,12 @@ namespace Queue {
          * @return The size of the heap.
          */
         [[nodiscard]] uint64_t size() const { return heap_.size(); }
+
+        /**
+         * Retrieves the elements of the heap in the order in which they are stored. Passing them to makeHeap restores
+         * the heap.
+         * @return The elements of the heap.
+         */
+        [[nodiscard]] const std::vector<T>& getElements() const { return heap_; }
     };
 }
\ No newline at end of file
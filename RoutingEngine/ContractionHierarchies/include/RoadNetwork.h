@@ -0,0 +1,162 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include "QueryGraph.h"
+#include "GeometryStore.h"
+#include "FlatArray.h"
+
+class FlatWriter;
+class FlatReader;
+
+/**
+* The road network that the graphs of several routing profiles are built from. Every road that any of the profiles can
+* use is stored once, as a directed edge between two intersections, so a profile only needs the weight of every edge
+* (see Graph). A profile cannot use an edge whose weight is infinite.
+*
+* The edges are numbered in the order in which they were added, so the weights of every profile can be recorded while
+* the roads are split into edges. The outgoing edges of every vertex are found through their numbers, which are stored
+* contiguously for every vertex (i.e. a compressed sparse row layout). The vertices are numbered in the order of their IDs.
+*
+* Every array of the road network is a FlatArray, so that the road network can be stored once in a flat file along with
+* the graphs of all profiles and mapped from it (see Graph::saveProfilesFlat).
+*/
+class RoadNetwork {
+
+public:
+
+    // Indicates that a vertex or an edge is not present in the road network.
+    static const uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+    // An edge as it is added to the road network.
+    struct InputEdge {
+
+        // The IDs of the vertices at the start and at the end of the edge, in the direction of travel.
+        uint64_t start;
+        uint64_t end;
+
+        // The segment in the geometry store that holds the OSM nodes of the edge.
+        uint32_t geometry;
+
+        // Indicates whether the edge traverses its segment in reverse.
+        bool reversed;
+
+        // The length of the edge in distance units.
+        double distance;
+    };
+
+    // The numbers of the outgoing edges of a vertex.
+    struct EdgeNumberRange {
+        const uint32_t* first;
+        const uint32_t* last;
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+    };
+
+private:
+
+    // The vertex IDs in ascending order.
+    FlatArray<uint64_t> ids_;
+
+    // The position of the first outgoing edge of every vertex in out_edges_. The numbers of the outgoing edges of
+    // vertex v are found in the range [first_out_[v], first_out_[v + 1]).
+    FlatArray<uint32_t> first_out_;
+    FlatArray<uint32_t> out_edges_;
+
+    // The index of the vertex that every edge starts at.
+    FlatArray<uint32_t> tails_;
+
+    // The segment, the direction and the index of the vertex that every edge leads to.
+    FlatArray<OriginalEdge> edges_;
+
+    // The length of every edge in distance units.
+    FlatArray<double> distances_;
+
+    // The coordinates of the vertices and the geometry of the edges. The coordinates of a mapped road network are stored
+    // in the query graphs of the profiles instead, so its map of locations is empty.
+    std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>> locations_;
+    std::shared_ptr<GeometryStore> geometry_;
+
+public:
+
+    RoadNetwork() = default;
+
+    /**
+     * A constructor for the RoadNetwork class.
+     * @param edges The edges of the road network. Edge i of the road network is edges[i].
+     * @param locations The coordinates of the vertices.
+     * @param geometry The geometry store that holds the segments of the edges.
+     */
+    RoadNetwork(const std::vector<InputEdge>& edges, std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>> locations,
+                std::shared_ptr<GeometryStore> geometry);
+
+    uint32_t getNumVertices() const { return uint32_t(ids_.size()); }
+
+    uint32_t getNumEdges() const { return uint32_t(edges_.size()); }
+
+    /**
+     * Retrieves the index of a vertex.
+     * @param id The ID of the vertex.
+     * @return The index of the vertex, or INVALID_INDEX if the vertex is not in the road network.
+     */
+    uint32_t getIndex(uint64_t id) const;
+
+    uint64_t getId(uint32_t index) const { return ids_[index]; }
+
+    // Retrieves the vertex IDs in ascending order.
+    const FlatArray<uint64_t>& getIds() const { return ids_; }
+
+    EdgeNumberRange getOutEdges(uint32_t index) const {
+        return EdgeNumberRange{out_edges_.data() + first_out_[index], out_edges_.data() + first_out_[index + 1]};
+    }
+
+    uint32_t getTail(uint32_t edge) const { return tails_[edge]; }
+
+    const OriginalEdge& getEdge(uint32_t edge) const { return edges_[edge]; }
+
+    double getDistance(uint32_t edge) const { return distances_[edge]; }
+
+    /**
+     * Finds the edge from one vertex to another that a profile uses. If there are several such edges, the profile uses
+     * the one with the lowest weight.
+     * @param tail The index of the vertex that the edge starts at.
+     * @param head The index of the vertex that the edge leads to.
+     * @param weights The weight of every edge for the profile.
+     * @return The number of the edge, or INVALID_INDEX if the profile cannot travel from tail to head directly.
+     */
+    uint32_t findEdge(uint32_t tail, uint32_t head, const FlatArray<double>& weights) const;
+
+    const std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>>& getLocations() const { return locations_; }
+
+    const std::shared_ptr<GeometryStore>& getGeometry() const { return geometry_; }
+
+    /**
+     * Retrieves the number of bytes occupied by the vertices and the edges, without the locations and the geometry.
+     * @return The number of bytes occupied by the road network.
+     */
+    uint64_t getNumBytes() const;
+
+    /**
+     * Retrieves the number of bytes allocated for the vertices and the edges, without the locations and the geometry.
+     * @return The number of bytes allocated by the road network, including unused capacity.
+     */
+    uint64_t getNumAllocatedBytes() const;
+
+    /**
+     * Writes the vertices and the edges to a flat file. The locations and the geometry are not written.
+     * @param writer The writer of the flat file.
+     */
+    void saveFlat(FlatWriter& writer) const;
+
+    /**
+     * Reads a road network that was written with saveFlat from a mapped flat file. The arrays of the road network refer
+     * to the mapped file, which must remain mapped for as long as the road network is used. Throws an exception if the
+     * arrays do not form a valid road network.
+     * @param reader The reader of the flat file.
+     * @param geometry The geometry store that holds the segments of the edges.
+     */
+    void mapFlat(FlatReader& reader, std::shared_ptr<GeometryStore> geometry);
+};
@@ -0,0 +1,129 @@
+#include "BatchSearch.h"
+#include <algorithm>
+
+namespace {
+    const uint32_t REACHED[2] = {1, 2};
+    const uint32_t SETTLED[2] = {4, 8};
+    const uint32_t INITIAL_TABLE_SIZE = 1024;
+}
+
+BatchSearch::LabelTable::LabelTable() : slots_(INITIAL_TABLE_SIZE, Label{QueryGraph::INVALID_INDEX, 0, {0, 0}}) {
+    used_.reserve(INITIAL_TABLE_SIZE / 2);
+}
+
+BatchSearch::Label& BatchSearch::LabelTable::get(const uint32_t index) {
+    // The table is kept at most half full so that probe sequences stay short.
+    if (2 * (used_.size() + 1) > slots_.size()) { grow(); }
+    const auto mask = uint32_t(slots_.size() - 1);
+    // Fibonacci hashing spreads consecutive indices across the table.
+    uint32_t slot = uint32_t((uint64_t(index) * 11400714819323198485ull) >> 32) & mask;
+    while (slots_[slot].index != index) {
+        if (slots_[slot].index == QueryGraph::INVALID_INDEX) {
+            slots_[slot] = Label{index, 0, {0, 0}};
+            used_.push_back(slot);
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slots_[slot];
+}
+
+void BatchSearch::LabelTable::grow() {
+    std::vector<Label> labels;
+    labels.reserve(used_.size());
+    for (const auto slot : used_) { labels.push_back(slots_[slot]); }
+    slots_.assign(slots_.size() * 2, Label{QueryGraph::INVALID_INDEX, 0, {0, 0}});
+    used_.clear();
+    for (const auto& label : labels) { get(label.index) = label; }
+}
+
+void BatchSearch::LabelTable::clear() {
+    for (const auto slot : used_) { slots_[slot].index = QueryGraph::INVALID_INDEX; }
+    used_.clear();
+}
+
+BatchSearch::BatchSearch(const QueryGraph* graph, const int batch_size) : graph_(graph), lanes_(std::max(batch_size, 1)) {}
+
+void BatchSearch::startQuery(Lane& lane, const size_t query, const uint32_t source, const uint32_t target) const {
+    lane.query = query;
+    lane.best = INF_;
+    lane.active = true;
+    lane.queue.clear();
+    lane.labels.clear();
+    auto& source_label = lane.labels.get(source);
+    source_label.flags |= REACHED[0];
+    source_label.dist[0] = 0;
+    auto& target_label = lane.labels.get(target);
+    target_label.flags |= REACHED[1];
+    target_label.dist[1] = 0;
+    lane.queue.push(HeapElement(source, 0, 1));
+    lane.queue.push(HeapElement(target, 0, 0));
+    graph_->prefetchEdges(source, false);
+    graph_->prefetchEdges(target, true);
+}
+
+bool BatchSearch::step(Lane& lane) const {
+    if (lane.queue.empty()) { return false; }
+    const HeapElement element = lane.queue.pop();
+    // Neither search can improve the shortest path found so far once the smallest distance estimate exceeds it.
+    if (lane.best <= element.value) { return false; }
+    const auto u = uint32_t(element.id);
+    const bool backward = !bool(element.direction);
+
+    auto& label = lane.labels.get(u);
+    // A vertex may be present in the queue more than once. Only the first occurrence is settled.
+    if (label.flags & SETTLED[backward]) { return true; }
+    label.flags |= SETTLED[backward];
+    if ((label.flags & REACHED[!backward]) && label.dist[0] + label.dist[1] < lane.best) {
+        lane.best = label.dist[0] + label.dist[1];
+    }
+
+    // The label may move while relaxing the edges, so the distance is copied first.
+    const double dist_u = label.dist[backward];
+    for (const auto& edge : graph_->getEdges(u, backward)) {
+        auto& head = lane.labels.get(edge.head);
+        if (head.flags & SETTLED[backward]) { continue; }
+        if (!(head.flags & REACHED[backward]) || head.dist[backward] > dist_u + edge.weight) {
+            head.flags |= REACHED[backward];
+            head.dist[backward] = dist_u + edge.weight;
+            lane.queue.push(HeapElement(edge.head, head.dist[backward], int(!backward)));
+            // The position of the edges is needed once the vertex reaches the front of the queue.
+            graph_->prefetchVertex(edge.head, backward);
+        }
+    }
+
+    // The edges of the next vertex are fetched while the other queries in the batch are being processed.
+    if (!lane.queue.empty()) { graph_->prefetchEdges(uint32_t(lane.queue.peek().id), !bool(lane.queue.peek().direction)); }
+    return true;
+}
+
+std::vector<double> BatchSearch::computeDistances(const std::vector<std::pair<uint64_t, uint64_t>>& queries) {
+    std::vector<double> distances(queries.size(), -1);
+    size_t next_query = 0, active = 0;
+
+    for (auto& lane : lanes_) {
+        lane.active = false;
+        if (next_query < queries.size()) {
+            startQuery(lane, next_query, graph_->getIndex(queries[next_query].first), graph_->getIndex(queries[next_query].second));
+            next_query++;
+            active++;
+        }
+    }
+
+    // The queries advance in lock-step. A lane that finishes its query immediately starts the next one.
+    while (active > 0) {
+        for (auto& lane : lanes_) {
+            if (!lane.active || step(lane)) { continue; }
+            if (lane.best != INF_) { distances[lane.query] = lane.best; }
+            if (next_query < queries.size()) {
+                startQuery(lane, next_query, graph_->getIndex(queries[next_query].first), graph_->getIndex(queries[next_query].second));
+                next_query++;
+            }
+            else {
+                lane.active = false;
+                active--;
+            }
+        }
+    }
+    return distances;
+}
@@ -2,13 +2,50 @@
 #include <algorithm>
 #include <cassert>
 
+namespace {
+    // Every thread reuses its own workspace, so the modified search does not allocate any memory for the search state.
+    SearchWorkspace& getThreadWorkspace() {
+        thread_local SearchWorkspace workspace;
+        return workspace;
+    }
+
+    // The workspace of the searches that check alternative routes, which must not overwrite the search spaces that the
+    // routes were found in.
+    SearchWorkspace& getThreadCheckWorkspace() {
+        thread_local SearchWorkspace workspace;
+        return workspace;
+    }
+}
+
+void SearchWorkspace::reset(const uint32_t num_vertices) {
+    timestamp++;
+    // Once the timestamp wraps around, stale entries could be mistaken for valid ones.
+    if (timestamp == 0) {
+        for (int i = 0; i < 2; i++) {
+            std::fill(reached[i].begin(), reached[i].end(), 0);
+            std::fill(settled[i].begin(), settled[i].end(), 0);
+        }
+        timestamp = 1;
+    }
+    if (dist[0].size() < num_vertices) {
+        for (int i = 0; i < 2; i++) {
+            dist[i].resize(num_vertices);
+            prev[i].resize(num_vertices);
+            prev_edge[i].resize(num_vertices);
+            reached[i].resize(num_vertices, 0);
+            settled[i].resize(num_vertices, 0);
+        }
+    }
+}
+
 BidirectionalSearch::BidirectionalSearch(const std::unordered_map<uint64_t, Vertex>*vertices,
-                                         const std::unordered_map<uint64_t, std::unordered_map<uint64_t, uint64_t>>*shortcuts,
-                                         const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>*edges)
-        : vertices_(vertices), shortcuts_(shortcuts), edges_(edges), queue_(100)
+                                         const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>*edges,
+                                         const GeometryStore* geometry, const QueryGraph* query_graph)
+        : vertices_(vertices), query_graph_(query_graph), workspace_(&getThreadWorkspace()), edges_(edges),
+          geometry_(geometry), queue_(100)
 {}
 
-const std::unordered_map<uint64_t, double>& BidirectionalSearch::getAllowedEdges(const uint64_t vertex_id, const bool backward) {
+const FlatHashMap<uint64_t, double>& BidirectionalSearch::getAllowedEdges(const uint64_t vertex_id, const bool backward) {
     if (backward) {
         const auto& edges = vertices_->at(vertex_id).in_edges;
         return edges;
@@ -45,6 +82,8 @@ std::unordered_map<uint64_t, uint64_t>& BidirectionalSearch::getAllowedPrev(bool
 }
 
 std::pair<std::vector<uint64_t>, double> BidirectionalSearch::executeSearch(uint64_t source, uint64_t target, bool standard) {
+    if (!standard) { return executeHierarchySearch(source, target); }
+
     // u is the Vertex being settled and intersection is the Vertex at which the forward and backwards search meet.
     uint64_t u  = 0;
     uint64_t intersection = 0;
@@ -56,39 +95,43 @@ std::pair<std::vector<uint64_t>, double> BidirectionalSearch::executeSearch(uint
     prev_target_[target] = -1;
     queue_.push(HeapElement(source, 0, 1));
     queue_.push(HeapElement(target, 0, 0));
+    CH_STATS(stats_, heap_pushes += 2);
 
-    while (!queue_.empty()) {
-        u = queue_.peek().id;
-        relax_edge(u, !bool(queue_.peek().direction), standard);
-        /**
-        * It is not sufficient to abort the search as soon as the backward search and forward search meet.
-        * We instead abort the search when the length of the shortest path found so far is less than or
-        * equal to the distance to the next Vertex in the MinHeap.
-        */
-        if (visited_source_.find(u) != visited_source_.end() && visited_target_.find(u) != visited_target_.end()
-            && dist_source_[u] + dist_target_[u] < best) {
-            intersection = u;
-            best = dist_source_[u] + dist_target_[u];
-            if (queue_.empty() || best <= queue_.peek().value) { break; }
+    {
+        CH_STATS_TIMER(stats_, search);
+        while (!queue_.empty()) {
+            u = queue_.peek().id;
+            relax_edge(u, !bool(queue_.peek().direction));
+            /**
+            * It is not sufficient to abort the search as soon as the backward search and forward search meet.
+            * We instead abort the search when the length of the shortest path found so far is less than or
+            * equal to the distance to the next Vertex in the MinHeap.
+            */
+            if (visited_source_.find(u) != visited_source_.end() && visited_target_.find(u) != visited_target_.end()
+                && dist_source_[u] + dist_target_[u] < best) {
+                intersection = u;
+                best = dist_source_[u] + dist_target_[u];
+                if (queue_.empty() || best <= queue_.peek().value) { break; }
+            }
         }
     }
 
     if (intersection != 0) {
-        auto path = reconstructPath(source, target, intersection);
+        std::vector<uint64_t> path;
+        {
+            CH_STATS_TIMER(stats_, reconstruct);
+            path = reconstructPath(source, target, intersection);
+        }
         // Path should never have a negative distance.
         assert(dist_source_[intersection] + dist_target_[intersection] >= 0);
-        if (standard) {
-            return std::make_pair(insertEdgeNodes(path), dist_source_[intersection] + dist_target_[intersection]);
-        } else {
-            return std::make_pair(insertEdgeNodes(unpackPath(&path)), dist_source_[intersection] + dist_target_[intersection]);
-        }
+        return std::make_pair(insertEdgeNodes(path), dist_source_[intersection] + dist_target_[intersection]);
     }
     else {
         return std::make_pair(std::vector<uint64_t>{}, -1);
     }
 }
 
-void BidirectionalSearch::relax_edge(const uint64_t vertex_id, const bool backward, const bool standard) {
+void BidirectionalSearch::relax_edge(const uint64_t vertex_id, const bool backward) {
     // Gets the relevant edges, distances, parent pointers, and visited data depending on whether it is a forward or backward search.
     auto& edges = getAllowedEdges(vertex_id, backward);
     auto& dist = getAllowedDists(backward);
@@ -96,36 +139,109 @@ void BidirectionalSearch::relax_edge(const uint64_t vertex_id, const bool backwa
     auto& visited = getAllowedVisited(backward);
     visited.insert(vertex_id);
     queue_.pop();
+    CH_STATS(stats_, heap_pops++);
+    if (backward) { CH_STATS(stats_, settled_backward++); }
+    else { CH_STATS(stats_, settled_forward++); }
+    CH_STATS(stats_, relaxed_edges += edges.size());
 
-    // If standard is set to true, then a standard, bidirectional Dijkstra search is being performed and the relaxation process is different.
-    if (!standard) {
-        // Relaxes the incoming/outgoing edges to the vertex depending on whether it is a forward or backward search.
-        for (const auto&[id, weight]: edges) {
-            // We only relax edges leading to a higher priority Vertex.
-            if (visited.find(id) != visited.end() || vertices_->at(id).order < vertices_->at(vertex_id).order) {
-                continue;
-            }
-            // A new best distance estimate has been found.
-            if (dist.find(id) == dist.end() || dist[id] > dist[vertex_id] + weight) {
-                dist[id] = dist[vertex_id] + weight;
-                queue_.push(HeapElement(id, dist[id], int(!backward)));
-                prev[id] = vertex_id;
-            }
+    // Relaxes the incoming/outgoing edges to the vertex depending on whether it is a forward or backward search.
+    for (const auto&[id, weight]: edges) {
+        if (visited.find(id) != visited.end()) {
+            continue;
+        }
+        // A new best distance estimate has been found.
+        if (dist.find(id) == dist.end() || dist[id] > dist[vertex_id] + weight) {
+            dist[id] = dist[vertex_id] + weight;
+            queue_.push(HeapElement(id, dist[id], int(!backward)));
+            CH_STATS(stats_, heap_pushes++);
+            prev[id] = vertex_id;
         }
     }
-    else {
-        // Relaxes the incoming/outgoing edges to the vertex depending on whether it is a forward or backward search.
-        for (const auto&[id, weight]: edges) {
-            // We only relax edges leading to a higher priority Vertex.
-            if (visited.find(id) != visited.end()) {
-                continue;
-            }
-            // A new best distance estimate has been found.
-            if (dist.find(id) == dist.end() || dist[id] > dist[vertex_id] + weight) {
-                dist[id] = dist[vertex_id] + weight;
-                queue_.push(HeapElement(id, dist[id], int(!backward)));
-                prev[id] = vertex_id;
-            }
+}
+
+std::pair<std::vector<uint64_t>, double> BidirectionalSearch::executeHierarchySearch(uint64_t source, uint64_t target) {
+    double best;
+    const uint32_t intersection = searchHierarchy(source, target, &best);
+    if (intersection == QueryGraph::INVALID_INDEX) { return std::make_pair(std::vector<uint64_t>{}, -1); }
+    return std::make_pair(unpackHierarchyPath(intersection), best);
+}
+
+double BidirectionalSearch::findOriginalEdges(uint64_t source, uint64_t target, std::vector<OriginalEdge>* edges, uint32_t* source_index) {
+    double best;
+    const uint32_t intersection = searchHierarchy(source, target, &best);
+    if (intersection == QueryGraph::INVALID_INDEX) { return -1; }
+    *source_index = collectOriginalEdges(intersection, edges);
+    return best;
+}
+
+uint32_t BidirectionalSearch::searchHierarchy(uint64_t source, uint64_t target, double* length, const double bound,
+                                              std::vector<uint32_t>* settled_vertices) {
+    auto& ws = *workspace_;
+    const uint32_t source_index = query_graph_->getIndex(source);
+    const uint32_t target_index = query_graph_->getIndex(target);
+    ws.reset(query_graph_->getNumVertices());
+
+    // intersection is the vertex at which the forward and backwards search meet.
+    uint32_t intersection = QueryGraph::INVALID_INDEX;
+    // length of the shortest path found so far.
+    double best = INF_;
+    ws.dist[0][source_index] = 0;
+    ws.dist[1][target_index] = 0;
+    ws.prev[0][source_index] = QueryGraph::INVALID_INDEX;
+    ws.prev[1][target_index] = QueryGraph::INVALID_INDEX;
+    ws.reached[0][source_index] = ws.timestamp;
+    ws.reached[1][target_index] = ws.timestamp;
+    queue_.clear();
+    queue_.push(HeapElement(source_index, 0, 1));
+    queue_.push(HeapElement(target_index, 0, 0));
+    CH_STATS(stats_, heap_pushes += 2);
+    CH_STATS_TIMER(stats_, search);
+
+    while (!queue_.empty()) {
+        const HeapElement element = queue_.pop();
+        CH_STATS(stats_, heap_pops++);
+        // Neither search can improve the shortest path found so far once the smallest distance estimate exceeds it.
+        if (best * bound <= element.value) { break; }
+        const auto u = uint32_t(element.id);
+        const bool backward = !bool(element.direction);
+        // A vertex may be present in the queue more than once. Only the first occurrence is settled.
+        if (ws.isSettled(u, backward)) { continue; }
+        ws.settled[backward][u] = ws.timestamp;
+        if (settled_vertices) { settled_vertices->push_back(u); }
+        if (backward) { CH_STATS(stats_, settled_backward++); }
+        else { CH_STATS(stats_, settled_forward++); }
+
+        if (ws.isReached(u, !backward) && ws.dist[0][u] + ws.dist[1][u] < best) {
+            intersection = u;
+            best = ws.dist[0][u] + ws.dist[1][u];
+        }
+        relaxUpwardEdges(u, backward);
+    }
+
+    // Path should never have a negative distance.
+    assert(intersection == QueryGraph::INVALID_INDEX || best >= 0);
+    *length = best;
+    return intersection;
+}
+
+void BidirectionalSearch::relaxUpwardEdges(const uint32_t index, const bool backward) {
+    auto& ws = *workspace_;
+    auto& dist = ws.dist[backward];
+    const double dist_u = dist[index];
+    const auto edges = query_graph_->getEdges(index, backward);
+    CH_STATS(stats_, relaxed_edges += edges.last - edges.first);
+
+    // The query graph only contains edges that lead to a vertex of higher order.
+    for (const auto& edge : edges) {
+        if (ws.isSettled(edge.head, backward)) { continue; }
+        // A new best distance estimate has been found.
+        if (!ws.isReached(edge.head, backward) || dist[edge.head] > dist_u + edge.weight) {
+            dist[edge.head] = dist_u + edge.weight;
+            ws.prev[backward][edge.head] = index;
+            ws.prev_edge[backward][edge.head] = query_graph_->getEdgePosition(&edge, backward);
+            ws.reached[backward][edge.head] = ws.timestamp;
+            queue_.push(HeapElement(edge.head, dist[edge.head], int(!backward)));
+            CH_STATS(stats_, heap_pushes++);
         }
     }
 }
@@ -155,59 +271,173 @@ std::vector<uint64_t> BidirectionalSearch::reconstructPath(uint64_t source, uint
     return path;
 }
 
-std::vector<uint64_t> BidirectionalSearch::unpackShortcut(uint64_t start, uint64_t end) {
-    std::vector<uint64_t> stack;
-    std::vector<uint64_t> unpacked_shortcuts;
-    stack.push_back(end);
-
-    while (!stack.empty()) {
-        auto next_id = stack.back();
-        if (isShortcut(start, next_id)) {
-            stack.push_back(shortcuts_->at(start).at(next_id));
+uint32_t BidirectionalSearch::collectOriginalEdges(const uint32_t intersection, std::vector<OriginalEdge>* edges, std::vector<double>* weights) const {
+    const auto& ws = *workspace_;
+    std::vector<uint32_t> forward_path, backward_path;
+    uint32_t source;
+    {
+        CH_STATS_TIMER(stats_, reconstruct);
+        // The forward search leads from the intersection back to the source.
+        for (uint32_t index = intersection; ws.prev[0][index] != QueryGraph::INVALID_INDEX; index = ws.prev[0][index]) {
+            forward_path.push_back(index);
         }
-        else {
-            unpacked_shortcuts.push_back(next_id);
-            stack.pop_back();
-            start = next_id;
+        source = forward_path.empty() ? intersection : ws.prev[0][forward_path.back()];
+        // The backward search leads from the intersection to the target.
+        for (uint32_t index = intersection; ws.prev[1][index] != QueryGraph::INVALID_INDEX; index = ws.prev[1][index]) {
+            backward_path.push_back(index);
         }
     }
-    return unpacked_shortcuts;
+
+    CH_STATS_TIMER(stats_, unpack);
+#ifdef CH_QUERY_STATS
+    const size_t first = edges->size();
+#endif
+    for (auto it = forward_path.rbegin(); it != forward_path.rend(); ++it) {
+        query_graph_->unpackEdge(ws.prev[0][*it], *it, ws.prev_edge[0][*it], false, edges, weights);
+    }
+    // The edges of the backward search are stored with the vertex they lead to.
+    for (const auto& index : backward_path) {
+        query_graph_->unpackEdge(index, ws.prev[1][index], ws.prev_edge[1][index], true, edges, weights);
+    }
+    // Every unpacked shortcut adds one edge to the path.
+    CH_STATS(stats_, unpacked_shortcuts += edges->size() - first - forward_path.size() - backward_path.size());
+    return source;
 }
 
-std::vector<uint64_t> BidirectionalSearch::unpackPath(std::vector<uint64_t>* shortest_path) {
-    int i = 0;
-    std::vector<uint64_t> path;
-    path.push_back(shortest_path->at(0));
+std::vector<AlternativePath> BidirectionalSearch::findAlternativePaths(uint64_t source, uint64_t target, const AlternativeRouteOptions& options) {
+    std::vector<AlternativePath> paths;
+    std::vector<uint32_t> settled;
+    double best;
+    const uint32_t intersection = searchHierarchy(source, target, &best, 1 + options.max_stretch, &settled);
+    if (intersection == QueryGraph::INVALID_INDEX) { return paths; }
+    const auto& ws = *workspace_;
+
+    // Every vertex that both searches reach is the via vertex of a path. A vertex settled by both searches is found twice.
+    std::sort(settled.begin(), settled.end());
+    settled.erase(std::unique(settled.begin(), settled.end()), settled.end());
+    std::vector<std::pair<double, uint32_t>> candidates;
+    for (const auto& vertex : settled) {
+        if (vertex == intersection || !ws.isReached(vertex, false) || !ws.isReached(vertex, true)) { continue; }
+        const double length = ws.dist[0][vertex] + ws.dist[1][vertex];
+        if (length <= (1 + options.max_stretch) * best) { candidates.emplace_back(length, vertex); }
+    }
+    std::sort(candidates.begin(), candidates.end());
 
-    // Unpacks all shortcuts in the path.
-    while (i < shortest_path->size() - 1) {
-        if (isShortcut(shortest_path->at(i), shortest_path->at(i + 1))) {
-            auto unpacked_shortcuts = unpackShortcut(shortest_path->at(i), shortest_path->at(i + 1));
-            path.insert(path.end(), unpacked_shortcuts.begin(), unpacked_shortcuts.end());
+    // The original edges and the query graph edges of the accepted paths, by their tail and head.
+    std::unordered_set<uint64_t> accepted_edges, accepted_query_edges;
+    std::vector<double> weights;
+    std::vector<uint32_t> vertices;
+    // Calls a function with the tail, the head, and the weight of every query graph edge of the path through a vertex.
+    const auto for_each_query_edge = [&ws](uint32_t via, auto function) {
+        for (uint32_t index = via; ws.prev[0][index] != QueryGraph::INVALID_INDEX; index = ws.prev[0][index]) {
+            function(ws.prev[0][index], index, ws.dist[0][index] - ws.dist[0][ws.prev[0][index]]);
         }
-        else {
-            path.push_back(shortest_path->at(i + 1));
+        for (uint32_t index = via; ws.prev[1][index] != QueryGraph::INVALID_INDEX; index = ws.prev[1][index]) {
+            function(index, ws.prev[1][index], ws.dist[1][index] - ws.dist[1][ws.prev[1][index]]);
         }
-        i++;
+    };
+    const auto unpack = [&](uint32_t via, AlternativePath* path) {
+        weights.clear();
+        path->source_index = collectOriginalEdges(via, &path->edges, &weights);
+        path->length = ws.dist[0][via] + ws.dist[1][via];
+    };
+    const auto accept = [&](uint32_t via, AlternativePath&& path) {
+        uint32_t tail = path.source_index;
+        for (const auto& edge : path.edges) {
+            accepted_edges.insert(uint64_t(tail) << 32 | edge.head);
+            tail = edge.head;
+        }
+        for_each_query_edge(via, [&](uint32_t tail, uint32_t head, double) { accepted_query_edges.insert(uint64_t(tail) << 32 | head); });
+        paths.push_back(std::move(path));
+    };
+
+    AlternativePath shortest;
+    unpack(intersection, &shortest);
+    accept(intersection, std::move(shortest));
+    for (const auto& [length, via] : candidates) {
+        if (paths.size() > size_t(std::max(options.max_alternatives, 0))) { break; }
+
+        // A query graph edge that an accepted path has as well stands for the same original edges, so most candidates
+        // are rejected before they are unpacked.
+        double shared_query_edges = 0;
+        for_each_query_edge(via, [&](uint32_t tail, uint32_t head, double weight) {
+            if (accepted_query_edges.count(uint64_t(tail) << 32 | head)) { shared_query_edges += weight; }
+        });
+        if (shared_query_edges > options.max_sharing * best) { continue; }
+        AlternativePath path;
+        unpack(via, &path);
+
+        // Limited sharing: most of the path must differ from the paths accepted so far.
+        double shared = 0;
+        uint32_t tail = path.source_index;
+        vertices.assign(1, tail);
+        for (size_t i = 0; i < path.edges.size(); i++) {
+            if (accepted_edges.count(uint64_t(tail) << 32 | path.edges[i].head)) { shared += weights[i]; }
+            tail = path.edges[i].head;
+            vertices.push_back(tail);
+        }
+        if (shared > options.max_sharing * best) { continue; }
+
+        // The path to the via vertex and the path from it may cross, which makes a loop.
+        std::sort(vertices.begin(), vertices.end());
+        if (std::adjacent_find(vertices.begin(), vertices.end()) != vertices.end()) { continue; }
+
+        if (!isLocallyOptimal(path, weights, ws.dist[0][via], options.local_optimality * best)) { continue; }
+        accept(via, std::move(path));
+    }
+    return paths;
+}
+
+bool BidirectionalSearch::isLocallyOptimal(const AlternativePath& path, const std::vector<double>& weights, const double via_distance,
+                                           const double window) {
+    // Finds the last vertex at least window before the via vertex and the first vertex at least window after it, or the
+    // ends of the path.
+    uint32_t first = path.source_index, last = path.source_index;
+    double first_distance = 0, last_distance = 0, distance = 0;
+    for (size_t i = 0; i < path.edges.size(); i++) {
+        if (distance <= via_distance - window) {
+            first = last;
+            first_distance = distance;
+        }
+        distance += weights[i];
+        last = path.edges[i].head;
+        last_distance = distance;
+        if (distance >= via_distance + window) { break; }
     }
+    if (first == last) { return true; }
+
+    SearchWorkspace* workspace = workspace_;
+    workspace_ = &getThreadCheckWorkspace();
+    double length;
+    searchHierarchy(query_graph_->getId(first), query_graph_->getId(last), &length);
+    workspace_ = workspace;
+    // The weights are added up in a different order than the search adds them.
+    return length >= (last_distance - first_distance) * (1 - 1e-9);
+}
 
+std::vector<uint64_t> BidirectionalSearch::unpackHierarchyPath(const uint32_t intersection) const {
+    std::vector<OriginalEdge> edges;
+    const uint32_t source = collectOriginalEdges(intersection, &edges);
+    CH_STATS_TIMER(stats_, geometry);
+    std::vector<uint64_t> path{query_graph_->getId(source)};
+    for (const auto& edge : edges) {
+        geometry_->decodeNodes(edge.geometry, edge.reversed, &path);
+        path.push_back(query_graph_->getId(edge.head));
+    }
+    CH_STATS(stats_, path_nodes += path.size());
     return path;
 }
 
 std::vector<uint64_t> BidirectionalSearch::insertEdgeNodes(const std::vector<uint64_t>& path) {
+    CH_STATS_TIMER(stats_, geometry);
     std::vector<uint64_t> complete_path{path[0]};
     int i = 0;
     while (i + 1 < path.size()) {
-        complete_path.insert(complete_path.end(), edges_->at(path[i]).at(path[i + 1]).nodes.begin(), edges_->at(path[i]).at(path[i + 1]).nodes.end());
-        complete_path.push_back(edges_->at(path[i]).at(path[i + 1]).end);
+        const Edge& edge = edges_->at(path[i]).at(path[i + 1]);
+        geometry_->decodeNodes(edge.geometry, edge.reversed, &complete_path);
+        complete_path.push_back(edge.end);
         i++;
     }
+    CH_STATS(stats_, path_nodes += complete_path.size());
     return complete_path;
 }
-
-bool BidirectionalSearch::isShortcut(uint64_t start, uint64_t end) {
-    if (shortcuts_->find(start) != shortcuts_->end() && shortcuts_->at(start).find(end) != shortcuts_->at(start).end()) {
-        return true;
-    }
-    return false;
-}
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "ContractionGraph.h"
+#include <algorithm>
+#include <stdexcept>
+
+ContractionGraph::ContractionGraph(const Graph& graph) {
+    std::vector<std::vector<Arc>> out_arcs, in_arcs;
+    if (graph.getNetwork()) {
+        // The vertices of a road network are already numbered in the order of their IDs. A profile cannot use the edges
+        // of infinite weight, and of several edges between the same vertices, it only uses the one of lowest weight.
+        const RoadNetwork& network = *graph.getNetwork();
+        const FlatArray<double>& weights = graph.getWeights();
+        ids_.assign(network.getIds().begin(), network.getIds().end());
+        out_arcs.resize(ids_.size());
+        in_arcs.resize(ids_.size());
+        for (uint32_t tail = 0; tail < ids_.size(); tail++) {
+            for (const auto& edge : network.getOutEdges(tail)) {
+                const uint32_t head = network.getEdge(edge).head;
+                if (network.findEdge(tail, head, weights) != edge) { continue; }
+                out_arcs[tail].push_back({head, 1, NO_MIDDLE, weights[edge]});
+                in_arcs[head].push_back({tail, 1, NO_MIDDLE, weights[edge]});
+            }
+        }
+    }
+    else {
+        ids_.assign(graph.getVertexIds().begin(), graph.getVertexIds().end());
+        // The vertices are numbered in the order of their IDs, so that the numbering does not depend on the hash map.
+        std::sort(ids_.begin(), ids_.end());
+        const auto index = [&](uint64_t id) { return uint32_t(std::lower_bound(ids_.begin(), ids_.end(), id) - ids_.begin()); };
+        out_arcs.resize(ids_.size());
+        in_arcs.resize(ids_.size());
+        for (uint32_t vertex = 0; vertex < ids_.size(); vertex++) {
+            const auto& original = graph.getVertex(ids_[vertex]);
+            for (const auto& [head, weight] : original.out_edges) { out_arcs[vertex].push_back({index(head), 1, NO_MIDDLE, weight}); }
+            for (const auto& [tail, weight] : original.in_edges) { in_arcs[vertex].push_back({index(tail), 1, NO_MIDDLE, weight}); }
+        }
+    }
+
+    // The pool is allocated at once, so that it is not copied while it is filled.
+    uint64_t pool_size = 0;
+    for (uint32_t vertex = 0; vertex < ids_.size(); vertex++) {
+        pool_size += getCapacity(uint32_t(out_arcs[vertex].size())) + getCapacity(uint32_t(in_arcs[vertex].size()));
+    }
+    arcs_.reserve(pool_size);
+    out_blocks_.resize(ids_.size());
+    in_blocks_.resize(ids_.size());
+    deleted_neighbors_.assign(ids_.size(), 0);
+    levels_.assign(ids_.size(), 0);
+    num_remaining_ = uint32_t(ids_.size());
+    num_arcs_ = 0;
+    for (uint32_t vertex = 0; vertex < ids_.size(); vertex++) {
+        out_blocks_[vertex] = allocate(out_arcs[vertex].begin(), out_arcs[vertex].end());
+        num_arcs_ += out_arcs[vertex].size();
+        in_blocks_[vertex] = allocate(in_arcs[vertex].begin(), in_arcs[vertex].end());
+    }
+}
+
+uint32_t ContractionGraph::getCapacity(const uint32_t size) {
+    uint32_t capacity = MIN_CAPACITY;
+    while (capacity <= size) { capacity *= 2; }
+    return capacity;
+}
+
+ContractionGraph::Block ContractionGraph::allocate(const uint32_t capacity) {
+    size_t size_class = 0;
+    while ((1u << size_class) < capacity) { size_class++; }
+    if (size_class >= free_blocks_.size()) { free_blocks_.resize(size_class + 1); }
+    Block block;
+    block.capacity = capacity;
+    if (!free_blocks_[size_class].empty()) {
+        block.first = free_blocks_[size_class].back();
+        free_blocks_[size_class].pop_back();
+    }
+    else {
+        block.first = arcs_.size();
+        arcs_.resize(arcs_.size() + capacity);
+    }
+    return block;
+}
+
+void ContractionGraph::append(Block* block, const Arc& arc) {
+    if (block->size == block->capacity) {
+        Block larger = allocate(block->capacity * 2);
+        std::copy(arcs_.begin() + block->first, arcs_.begin() + block->first + block->size, arcs_.begin() + larger.first);
+        larger.size = block->size;
+        size_t size_class = 0;
+        while ((1u << size_class) < block->capacity) { size_class++; }
+        free_blocks_[size_class].push_back(block->first);
+        *block = larger;
+    }
+    arcs_[block->first + block->size++] = arc;
+}
+
+bool ContractionGraph::erase(Block* block, const uint32_t vertex) {
+    const auto begin = arcs_.begin() + block->first;
+    const auto end = begin + block->size;
+    const auto it = std::find_if(begin, end, [&](const Arc& arc) { return arc.vertex == vertex; });
+    if (it == end) { return false; }
+    std::copy(it + 1, end, it);
+    block->size--;
+    return true;
+}
+
+const double* ContractionGraph::findArc(const uint32_t tail, const uint32_t head) const {
+    for (const auto& arc : getOutArcs(tail)) {
+        if (arc.vertex == head) { return &arc.weight; }
+    }
+    return nullptr;
+}
+
+void ContractionGraph::setArc(const uint32_t tail, const uint32_t head, const double weight, const uint32_t original_edges,
+                              const uint32_t middle) {
+    // Returns true if the edge was added rather than replaced.
+    const auto update = [&](Block* block, uint32_t vertex) {
+        for (uint64_t i = block->first; i < block->first + block->size; i++) {
+            if (arcs_[i].vertex == vertex) {
+                arcs_[i] = {vertex, original_edges, middle, weight};
+                return false;
+            }
+        }
+        append(block, {vertex, original_edges, middle, weight});
+        return true;
+    };
+    if (update(&out_blocks_[tail], head)) { num_arcs_++; }
+    update(&in_blocks_[head], tail);
+}
+
+void ContractionGraph::removeVertex(const uint32_t vertex) {
+    num_arcs_ -= out_blocks_[vertex].size;
+    for (const auto& arc : getInArcs(vertex)) {
+        if (arc.vertex != vertex && erase(&out_blocks_[arc.vertex], vertex)) { num_arcs_--; }
+    }
+    for (const auto& arc : getOutArcs(vertex)) {
+        if (arc.vertex != vertex) { erase(&in_blocks_[arc.vertex], vertex); }
+    }
+    num_remaining_--;
+}
+
+uint64_t ContractionGraph::getNumAllocatedBytes() const {
+    uint64_t bytes = arcs_.capacity() * sizeof(Arc) + (out_blocks_.capacity() + in_blocks_.capacity()) * sizeof(Block);
+    for (const auto& blocks : free_blocks_) { bytes += blocks.capacity() * sizeof(uint64_t); }
+    return bytes;
+}
+
+void ContractionGraph::saveFlat(FlatWriter& writer) const {
+    // The edges are written as one array per direction, along with the position of the first edge of every vertex.
+    const auto flatten = [&](const std::vector<Block>& blocks) {
+        std::vector<uint64_t> first{0};
+        std::vector<Arc> all;
+        for (const auto& block : blocks) {
+            const auto arcs = getArcs(block);
+            all.insert(all.end(), arcs.begin(), arcs.end());
+            first.push_back(all.size());
+        }
+        writer.writeArray(FlatArray<uint64_t>(std::move(first)));
+        writer.writeArray(FlatArray<Arc>(std::move(all)));
+    };
+    writer.writeArray(FlatArray<uint64_t>(ids_));
+    writer.writeArray(FlatArray<int>(deleted_neighbors_));
+    writer.writeArray(FlatArray<uint32_t>(levels_));
+    // The edges of the contracted vertices are kept, so the number of edges between the others is written as well.
+    writer.writeArray(FlatArray<uint64_t>(std::vector<uint64_t>{num_remaining_, num_arcs_}));
+    flatten(out_blocks_);
+    flatten(in_blocks_);
+}
+
+void ContractionGraph::loadFlat(FlatReader& reader) {
+    const auto ids = reader.readArray<uint64_t>();
+    if (!std::equal(ids.begin(), ids.end(), ids_.begin(), ids_.end())) {
+        throw std::logic_error("The working graph was written for a graph with different vertices.");
+    }
+    const auto deleted_neighbors = reader.readArray<int>();
+    const auto levels = reader.readArray<uint32_t>();
+    const auto counts = reader.readArray<uint64_t>();
+    const auto out_first = reader.readArray<uint64_t>();
+    const auto out_arcs = reader.readArray<Arc>();
+    const auto in_first = reader.readArray<uint64_t>();
+    const auto in_arcs = reader.readArray<Arc>();
+    // The edges of every vertex must lie within the edges of their direction and lead to vertices of the graph.
+    const auto is_valid = [&](const FlatArray<uint64_t>& first, const FlatArray<Arc>& all) {
+        if (first.size() != ids_.size() + 1 || first[0] != 0 || first[ids_.size()] != all.size()) { return false; }
+        for (size_t vertex = 0; vertex < ids_.size(); vertex++) {
+            if (first[vertex] > first[vertex + 1]) { return false; }
+        }
+        return std::all_of(all.begin(), all.end(), [&](const Arc& arc) { return arc.vertex < ids_.size(); });
+    };
+    if (deleted_neighbors.size() != ids_.size() || levels.size() != ids_.size() || counts.size() != 2 || counts[0] > ids_.size() ||
+        !is_valid(out_first, out_arcs) || !is_valid(in_first, in_arcs)) {
+        throw std::runtime_error("The working graph is corrupt.");
+    }
+    deleted_neighbors_.assign(deleted_neighbors.begin(), deleted_neighbors.end());
+    levels_.assign(levels.begin(), levels.end());
+    num_remaining_ = uint32_t(counts[0]);
+    num_arcs_ = counts[1];
+
+    // The pool is built again, with room for shortcuts in every block.
+    arcs_.clear();
+    free_blocks_.clear();
+    for (size_t vertex = 0; vertex < ids_.size(); vertex++) {
+        out_blocks_[vertex] = allocate(out_arcs.begin() + out_first[vertex], out_arcs.begin() + out_first[vertex + 1]);
+        in_blocks_[vertex] = allocate(in_arcs.begin() + in_first[vertex], in_arcs.begin() + in_first[vertex + 1]);
+    }
+}
@@ -0,0 +1,95 @@
+#include "GeometryStore.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace {
+    // Writes a signed integer as a zigzag encoded variable length integer: 7 bits per byte, least significant first.
+    void writeVarint(const int64_t value, std::vector<uint8_t>* buffer) {
+        uint64_t zigzag = (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+        while (zigzag >= 0x80) {
+            buffer->push_back(uint8_t(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        buffer->push_back(uint8_t(zigzag));
+    }
+
+    // Reads a zigzag encoded variable length integer and advances the position past it. Never reads at or beyond end, so
+    // a corrupt segment cannot be decoded past its bounds.
+    int64_t readVarint(const uint8_t*& position, const uint8_t* end) {
+        uint64_t zigzag = 0;
+        for (int shift = 0; position < end && shift < 64; shift += 7) {
+            const uint8_t byte = *position++;
+            zigzag |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) { break; }
+        }
+        return int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+    }
+
+    int64_t toFixedPoint(const double degrees) { return std::llround(degrees * GeometryStore::COORDINATE_PRECISION); }
+}
+
+uint32_t GeometryStore::addSegment(const std::vector<uint64_t>& nodes, const std::vector<std::array<double, 2>>& coordinates) {
+    assert(nodes.size() == coordinates.size());
+    if (nodes.empty()) { return NO_GEOMETRY; }
+
+    std::vector<uint8_t> encoded;
+    writeVarint(int64_t(nodes.size()), &encoded);
+    int64_t previous_id = 0, previous_lat = 0, previous_lon = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const int64_t lat = toFixedPoint(coordinates[i][0]), lon = toFixedPoint(coordinates[i][1]);
+        writeVarint(int64_t(nodes[i]) - previous_id, &encoded);
+        writeVarint(lat - previous_lat, &encoded);
+        writeVarint(lon - previous_lon, &encoded);
+        previous_id = int64_t(nodes[i]);
+        previous_lat = lat;
+        previous_lon = lon;
+    }
+    buffer_.append(encoded.begin(), encoded.end());
+    offsets_.push_back(buffer_.size());
+    return uint32_t(offsets_.size() - 2);
+}
+
+template <class Function>
+void GeometryStore::decode(const uint32_t segment, Function function) const {
+    const uint8_t* position = buffer_.data() + offsets_[segment];
+    const uint8_t* end = buffer_.data() + offsets_[segment + 1];
+    const int64_t num_nodes = readVarint(position, end);
+    int64_t id = 0, lat = 0, lon = 0;
+    for (int64_t i = 0; i < num_nodes && position < end; i++) {
+        id += readVarint(position, end);
+        lat += readVarint(position, end);
+        lon += readVarint(position, end);
+        function(uint64_t(id), std::array<double, 2>{double(lat) / COORDINATE_PRECISION, double(lon) / COORDINATE_PRECISION});
+    }
+}
+
+void GeometryStore::decodeNodes(const uint32_t segment, const bool reversed, std::vector<uint64_t>* path) const {
+    if (segment == NO_GEOMETRY) { return; }
+    const auto first = path->size();
+    decode(segment, [path](uint64_t id, const std::array<double, 2>&) { path->push_back(id); });
+    // The differences can only be decoded from the front, so a reversed segment is decoded first and then flipped.
+    if (reversed) { std::reverse(path->begin() + long(first), path->end()); }
+}
+
+void GeometryStore::decodeCoordinates(const uint32_t segment, const bool reversed, std::vector<std::array<double, 2>>* path) const {
+    if (segment == NO_GEOMETRY) { return; }
+    const auto first = path->size();
+    decode(segment, [path](uint64_t, const std::array<double, 2>& coordinates) { path->push_back(coordinates); });
+    if (reversed) { std::reverse(path->begin() + long(first), path->end()); }
+}
+
+void GeometryStore::saveFlat(FlatWriter& writer) const {
+    writer.writeArray(buffer_);
+    writer.writeArray(offsets_);
+}
+
+void GeometryStore::mapFlat(FlatReader& reader) {
+    buffer_ = reader.readArray<uint8_t>();
+    offsets_ = reader.readArray<uint64_t>();
+    // Every segment must lie within the buffer. Segments are decoded within their bounds, see readVarint.
+    bool valid = !offsets_.empty() && offsets_.size() <= NO_GEOMETRY && offsets_[0] == 0 && offsets_.back() == buffer_.size();
+    for (size_t segment = 0; valid && segment + 1 < offsets_.size(); segment++) { valid = offsets_[segment] <= offsets_[segment + 1]; }
+    if (!valid) { throw std::logic_error("The flat file does not contain a valid geometry store."); }
+}
@@ -1,20 +1,47 @@
 #include "BidirectionalSearch.h"
+#include "BatchSearch.h"
 #include "Graph.h"
+#include "Polyline.h"
+#include "MappedFile.h"
 #include <algorithm>
 #include <cassert>
+#include <limits>
 #include <utility>
 
 Vertex::Vertex(const uint64_t id, const uint64_t order, const bool contracted) : id(id), order(order), deleted_neighbors(0) {}
 Vertex::Vertex() : id(0), order(0), deleted_neighbors(0) {}
 
-Edge::Edge(const uint64_t start, const uint64_t end, std::vector<uint64_t>& nodes, const double time_weight, const double distance_weight) : start(start), end(end), nodes(std::move(nodes)), time_weight(time_weight), distance_weight(distance_weight), weight(0) {}
-Edge::Edge(const uint64_t start, const uint64_t end, const double weight) : start(start), end(end), time_weight(0), distance_weight(0), weight(weight) {}
-Edge::Edge() : start(0), end(0), time_weight(0), distance_weight(0), weight(0) {}
+Edge::Edge(const uint64_t start, const uint64_t end, const uint32_t geometry, const bool reversed, const double time_weight, const double distance_weight) : geometry(geometry), reversed(reversed), start(start), end(end), time_weight(time_weight), distance_weight(distance_weight), weight(0) {}
+Edge::Edge(const uint64_t start, const uint64_t end, const double weight) : geometry(GeometryStore::NO_GEOMETRY), reversed(false), start(start), end(end), time_weight(0), distance_weight(0), weight(weight) {}
+Edge::Edge() : geometry(GeometryStore::NO_GEOMETRY), reversed(false), start(0), end(0), time_weight(0), distance_weight(0), weight(0) {}
 
-Graph::Graph(std::unordered_map<uint64_t, std::array<double, 2>> locations) : locations_(std::move(locations)), num_edges_(0) {}
-Graph::Graph() : num_edges_(0) {}
+Graph::Graph(std::unordered_map<uint64_t, std::array<double, 2>> locations)
+        : num_edges_(0), locations_(std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>(std::move(locations))),
+          geometry_(std::make_shared<GeometryStore>())
+{}
+Graph::Graph(std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>> locations, std::shared_ptr<GeometryStore> geometry)
+        : num_edges_(0), locations_(std::move(locations)), geometry_(std::move(geometry))
+{}
+Graph::Graph(std::shared_ptr<const RoadNetwork> network, std::vector<double> weights)
+        : num_edges_(0), locations_(network->getLocations()), geometry_(network->getGeometry()), network_(std::move(network)),
+          weights_(std::move(weights)) {
+    if (weights_.size() != network_->getNumEdges()) { throw std::logic_error("Every edge of the road network needs a weight."); }
+    for (const auto& weight : weights_) {
+        if (weight != std::numeric_limits<double>::infinity()) { num_edges_++; }
+    }
+}
+Graph::Graph() : Graph(std::unordered_map<uint64_t, std::array<double, 2>>()) {}
 
 void Graph::addEdge(uint64_t start, uint64_t end, std::vector<uint64_t> *nodes, double time_weight, double distance_weight, bool bidirectional, bool time) {
+    // The geometry is stored once and shared by both directions of a two way road.
+    std::vector<std::array<double, 2>> coordinates;
+    coordinates.reserve(nodes->size());
+    for (const auto& node : *nodes) { coordinates.push_back(locations_->at(node)); }
+    addEdge(start, end, geometry_->addSegment(*nodes, coordinates), time_weight, distance_weight, bidirectional, time);
+}
+
+void Graph::addEdge(uint64_t start, uint64_t end, uint32_t geometry, double time_weight, double distance_weight, bool bidirectional, bool time) {
+    if (network_) { throw std::logic_error("The edges of a graph that has a road network cannot be changed."); }
     if (vertices_.find(start) == vertices_.end()) { vertices_.emplace(start, start); }
     if (vertices_.find(end) == vertices_.end()) { vertices_.emplace(end, end); }
 
@@ -22,7 +49,7 @@ void Graph::addEdge(uint64_t start, uint64_t end, std::vector<uint64_t> *nodes,
     assert(time_weight >= 0);
     assert(distance_weight >= 0);
 
-    edges_[start][end] = Edge(start, end, *nodes, time_weight, distance_weight);
+    edges_[start][end] = Edge(start, end, geometry, false, time_weight, distance_weight);
     if (time) {
         vertices_[start].out_edges[end] = time_weight;
         vertices_[end].in_edges[start] = time_weight;
@@ -34,8 +61,7 @@ void Graph::addEdge(uint64_t start, uint64_t end, std::vector<uint64_t> *nodes,
     num_edges_++;
 
     if (bidirectional) {
-        std::reverse(nodes->begin(), nodes->end());
-        edges_[end][start] = Edge(end, start, *nodes, time_weight, distance_weight);
+        edges_[end][start] = Edge(end, start, geometry, true, time_weight, distance_weight);
         if (time) {
             vertices_[start].in_edges[end] = time_weight;
             vertices_[end].out_edges[start] = time_weight;
@@ -49,6 +75,7 @@ void Graph::addEdge(uint64_t start, uint64_t end, std::vector<uint64_t> *nodes,
 }
 
 void Graph::addEdge(uint64_t start, uint64_t end, double weight, bool bidirectional) {
+    if (network_) { throw std::logic_error("The edges of a graph that has a road network cannot be changed."); }
     // The edge weight should never be negative.
     assert(weight >= 0);
     if (vertices_.find(start) == vertices_.end()) { vertices_.emplace(start, start); }
@@ -124,27 +151,406 @@ void Graph::optimizeEdges() {
     }
 }
 
+void Graph::buildQueryGraph(const QueryGraph::Layout layout, const uint32_t unpack_threshold) {
+    if (network_) { throw std::logic_error("The query graph of a graph that has a road network is built by its contraction."); }
+    query_graph_ = QueryGraph(vertices_, shortcuts_, edges_, *locations_, layout, unpack_threshold);
+}
+
+void Graph::setQueryGraph(QueryGraph query_graph, const uint64_t num_shortcuts) {
+    query_graph_ = std::move(query_graph);
+    num_edges_ += num_shortcuts;
+}
+
+uint64_t Graph::getNumVertices() const {
+    if (mapping_) { return query_graph_.getNumVertices(); }
+    return network_ ? network_->getNumVertices() : vertices_.size();
+}
+
+MemoryUsage Graph::getMemoryUsage() const {
+    MemoryUsage usage;
+
+    // The ID of a vertex is stored both as its key and in the Vertex itself. The adjacency maps embedded in every
+    // Vertex are counted with the adjacency.
+    const uint64_t vertex_payload = sizeof(Vertex::id) + sizeof(Vertex::deleted_neighbors) + sizeof(Vertex::order);
+    uint64_t adjacency_payload = 0, adjacency_allocated = 0;
+    for (const auto& [id, vertex] : vertices_) {
+        adjacency_payload += (vertex.in_edges.size() + vertex.out_edges.size()) * (sizeof(uint64_t) + sizeof(double));
+        adjacency_allocated += 2 * sizeof(vertex.in_edges) + MemoryUsage::getAllocatedBytes(vertex.in_edges) +
+                               MemoryUsage::getAllocatedBytes(vertex.out_edges);
+    }
+    usage.add("vertices", vertices_.size() * vertex_payload,
+              MemoryUsage::getAllocatedBytes(vertices_) - vertices_.size() * 2 * sizeof(Vertex::in_edges));
+    usage.add("adjacency", adjacency_payload, adjacency_allocated);
+
+    // An Edge stores its end vertices, which are repeated by the keys of both maps.
+    uint64_t num_edges = 0, edges_allocated = MemoryUsage::getAllocatedBytes(edges_);
+    for (const auto& [start, edges] : edges_) {
+        num_edges += edges.size();
+        edges_allocated += MemoryUsage::getAllocatedBytes(edges);
+    }
+    usage.add("edges", num_edges * sizeof(Edge), edges_allocated);
+
+    uint64_t num_shortcuts = 0, shortcuts_allocated = MemoryUsage::getAllocatedBytes(shortcuts_);
+    for (const auto& [start, shortcuts] : shortcuts_) {
+        num_shortcuts += shortcuts.size();
+        shortcuts_allocated += MemoryUsage::getAllocatedBytes(shortcuts);
+    }
+    usage.add("shortcuts", num_shortcuts * 3 * sizeof(uint64_t), shortcuts_allocated);
+
+    // The locations and the geometry may be shared with the graphs of other profiles, in which case every graph reports them.
+    usage.add("locations", locations_->size() * (sizeof(uint64_t) + sizeof(std::array<double, 2>)),
+              MemoryUsage::getAllocatedBytes(*locations_), false, locations_.use_count() > 1);
+
+    // The arrays of a mapped graph are stored in the mapped file, so nothing is allocated for them.
+    const bool mapped = isMapped();
+    usage.add("geometry", geometry_->getNumBytes(), mapped ? geometry_->getNumBytes() : geometry_->getNumAllocatedBytes(), mapped,
+              geometry_.use_count() > 1);
+    usage.add("query_graph", query_graph_.getNumBytes(), mapped ? query_graph_.getNumBytes() : query_graph_.getNumAllocatedBytes(), mapped);
+
+    // The road network is shared with the graphs of the other profiles as well, so a profile only adds its weights.
+    const uint64_t network_payload = network_ ? network_->getNumBytes() : 0;
+    usage.add("network", network_payload, mapped ? network_payload : network_ ? network_->getNumAllocatedBytes() : 0, mapped,
+              network_.use_count() > 1);
+    usage.add("weights", weights_.getNumBytes(), mapped ? weights_.getNumBytes() : weights_.getNumAllocatedBytes(), mapped);
+    return usage;
+}
+
 void Graph::addOrdering(uint64_t vertex, uint64_t ordering) {
     // The ordering should never be negative.
     assert(ordering >= 0);
     if (vertices_.find(vertex) != vertices_.end()) { vertices_[vertex].order = ordering; }
 }
 
-std::pair<std::vector<uint64_t>, double> Graph::getShortestPath(uint64_t source, uint64_t target, bool standard) {
-    if (vertices_.find(source) == vertices_.end() || vertices_.find(target) == vertices_.end()) {
+const Vertex& Graph::getVertex(const uint64_t id) const {
+    const auto it = vertices_.find(id);
+    if (it == vertices_.end()) { throw std::logic_error("Invalid vertex ID. Make sure that the vertex exists."); }
+    return it->second;
+}
+
+bool Graph::containsVertex(const uint64_t id) const {
+    if (mapping_) { return query_graph_.getIndex(id) != QueryGraph::INVALID_INDEX; }
+    if (network_) { return network_->getIndex(id) != RoadNetwork::INVALID_INDEX; }
+    return vertices_.find(id) != vertices_.end();
+}
+
+std::pair<std::vector<uint64_t>, double> Graph::getShortestPath(uint64_t source, uint64_t target, bool standard, QueryStats* stats) const {
+    if (!containsVertex(source) || !containsVertex(target)) {
         throw std::logic_error("Invalid vertex ID. Make sure that the source and target vertices exist.");
     }
-    BidirectionalSearch searcher(&vertices_, &shortcuts_, &edges_);
+    if (mapping_ && standard) { throw std::logic_error("A mapped graph cannot be searched with the standard search."); }
+    if (network_ && (standard || query_graph_.empty())) {
+        throw std::logic_error("A graph that has a road network can only be searched with the modified search once it has been contracted.");
+    }
+    BidirectionalSearch searcher(&vertices_, &edges_, geometry_.get(), &query_graph_);
+    searcher.setStats(stats);
     // If standard is set to true, then a standard bidirectional Dijkstra search is performed. The standard search is primarily used for testing.
-    return searcher.executeSearch(source, target, standard);
+    // A graph that has not been contracted has no query graph, and every vertex has the same order, so the two searches are equivalent.
+    return searcher.executeSearch(source, target, standard || query_graph_.empty());
+}
+
+std::vector<double> Graph::getShortestPathLengths(const std::vector<std::pair<uint64_t, uint64_t>>& queries, const int batch_size) const {
+    for (const auto& [source, target] : queries) {
+        if (!containsVertex(source) || !containsVertex(target)) {
+            throw std::logic_error("Invalid vertex ID. Make sure that the source and target vertices exist.");
+        }
+    }
+    if (query_graph_.empty()) {
+        std::vector<double> lengths;
+        lengths.reserve(queries.size());
+        for (const auto& [source, target] : queries) { lengths.push_back(getShortestPath(source, target, true).second); }
+        return lengths;
+    }
+    BatchSearch searcher(&query_graph_, batch_size);
+    return searcher.computeDistances(queries);
+}
+
+void Graph::discardNodeLocations() {
+    if (network_) { return; }
+    if (locations_.use_count() > 1) {
+        auto locations = std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>();
+        locations->reserve(vertices_.size());
+        for (const auto& [id, vertex] : vertices_) { locations->emplace(id, locations_->at(id)); }
+        locations_ = std::move(locations);
+        return;
+    }
+    for (auto it = locations_->begin(); it != locations_->end();) {
+        if (vertices_.find(it->first) == vertices_.end()) { it = locations_->erase(it); }
+        else { ++it; }
+    }
 }
 
-std::vector<std::array<double, 2>> Graph::convertPathToCoordinates(const std::vector<uint64_t>& path) {
+template <class Function>
+void Graph::decodePath(const std::vector<uint64_t>& path, Function function) const {
     std::vector<std::array<double, 2>> coordinates;
-    coordinates.reserve(path.size());
-    for (const auto& id : path) {
-        coordinates.push_back(locations_.at(id));
+    size_t i = 0;
+    while (i < path.size()) {
+        coordinates.assign(1, locations_->at(path[i]));
+        function(coordinates);
+        // Skips the OSM nodes that make up the edge to the next vertex. Their coordinates are decoded from the edge.
+        size_t j = i + 1;
+        while (j < path.size() && !containsVertex(path[j])) { j++; }
+        if (j == path.size()) { break; }
+        coordinates.clear();
+        if (network_) {
+            const auto& edge = network_->getEdge(network_->findEdge(network_->getIndex(path[i]), network_->getIndex(path[j]), weights_));
+            geometry_->decodeCoordinates(edge.geometry, edge.reversed, &coordinates);
+        }
+        else {
+            const Edge& edge = edges_.at(path[i]).at(path[j]);
+            geometry_->decodeCoordinates(edge.geometry, edge.reversed, &coordinates);
+        }
+        function(coordinates);
+        i = j;
     }
+}
+
+std::vector<std::array<double, 2>> Graph::convertPathToCoordinates(const std::vector<uint64_t>& path) const {
+    std::vector<std::array<double, 2>> coordinates;
+    coordinates.reserve(path.size());
+    decodePath(path, [&coordinates](const std::vector<std::array<double, 2>>& points) {
+        coordinates.insert(coordinates.end(), points.begin(), points.end());
+    });
     return coordinates;
 }
 
+std::string Graph::convertPathToPolyline(const std::vector<uint64_t>& path, const double tolerance, const int precision) const {
+    // Simplification needs the whole path at once.
+    if (tolerance > 0) { return Polyline::encode(Polyline::simplify(convertPathToCoordinates(path), tolerance), precision); }
+    Polyline polyline(precision);
+    decodePath(path, [&polyline](const std::vector<std::array<double, 2>>& points) {
+        for (const auto& point : points) { polyline.addPoint(point); }
+    });
+    return polyline.getEncoded();
+}
+
+
+template <class Function>
+double Graph::decodeShortestRoute(const uint64_t source, const uint64_t target, Function function, QueryStats* stats) const {
+    if (!containsVertex(source) || !containsVertex(target)) {
+        throw std::logic_error("Invalid vertex ID. Make sure that the source and target vertices exist.");
+    }
+    BidirectionalSearch searcher(&vertices_, &edges_, geometry_.get(), &query_graph_);
+    searcher.setStats(stats);
+    std::vector<OriginalEdge> edges;
+    uint32_t source_index;
+    const double length = searcher.findOriginalEdges(source, target, &edges, &source_index);
+    if (length < 0) { return length; }
+    decodeOriginalEdges(source_index, edges, function, stats);
+    return length;
+}
+
+template <class Function>
+void Graph::decodeOriginalEdges(const uint32_t source_index, const std::vector<OriginalEdge>& edges, Function function, QueryStats* stats) const {
+    CH_STATS_TIMER(stats, geometry);
+    std::vector<std::array<double, 2>> coordinates{query_graph_.getLocation(source_index)};
+    function(coordinates);
+    CH_STATS(stats, path_nodes += coordinates.size());
+    for (const auto& edge : edges) {
+        coordinates.clear();
+        geometry_->decodeCoordinates(edge.geometry, edge.reversed, &coordinates);
+        coordinates.push_back(query_graph_.getLocation(edge.head));
+        function(coordinates);
+        CH_STATS(stats, path_nodes += coordinates.size());
+    }
+}
+
+std::pair<std::vector<std::array<double, 2>>, double> Graph::getWaypointRoute(const std::vector<uint64_t>& waypoints, std::vector<double>* leg_weights,
+                                                                              std::vector<uint64_t>* waypoint_offsets, QueryStats* stats) const {
+    if (waypoints.size() < 2) { throw std::logic_error("A route needs at least two waypoints."); }
+    for (const auto& waypoint : waypoints) {
+        if (!containsVertex(waypoint)) { throw std::logic_error("Invalid vertex ID. Make sure that every waypoint exists."); }
+    }
+    BidirectionalSearch searcher(&vertices_, &edges_, geometry_.get(), &query_graph_);
+    searcher.setStats(stats);
+    std::vector<std::array<double, 2>> coordinates, leg;
+    std::vector<OriginalEdge> edges;
+    leg_weights->clear();
+    waypoint_offsets->assign(1, 0);
+    double weight = 0;
+    for (size_t i = 0; i + 1 < waypoints.size(); i++) {
+        double leg_weight;
+        leg.clear();
+        // A graph that has not been contracted has no query graph, so its legs are found with the standard search, whose
+        // search state cannot be reused.
+        if (query_graph_.empty()) {
+            const auto route = getShortestPath(waypoints[i], waypoints[i + 1], true, stats);
+            leg_weight = route.second;
+            if (leg_weight >= 0) { leg = convertPathToCoordinates(route.first); }
+        }
+        else {
+            edges.clear();
+            uint32_t source_index;
+            leg_weight = searcher.findOriginalEdges(waypoints[i], waypoints[i + 1], &edges, &source_index);
+            if (leg_weight >= 0) {
+                decodeOriginalEdges(source_index, edges, [&leg](const std::vector<std::array<double, 2>>& points) {
+                    leg.insert(leg.end(), points.begin(), points.end());
+                }, stats);
+            }
+        }
+        leg_weights->push_back(leg_weight);
+        // The weights of the remaining legs are still reported, but there is no route.
+        if (leg_weight < 0 || weight < 0) {
+            weight = -1;
+            continue;
+        }
+        weight += leg_weight;
+        // The first point of a leg is the last point of the leg before it.
+        coordinates.insert(coordinates.end(), leg.begin() + (coordinates.empty() ? 0 : 1), leg.end());
+        waypoint_offsets->push_back(coordinates.size() - 1);
+    }
+    if (weight < 0) {
+        coordinates.clear();
+        waypoint_offsets->clear();
+    }
+    return std::make_pair(coordinates, weight);
+}
+
+std::vector<std::pair<std::vector<std::array<double, 2>>, double>> Graph::getAlternativeRoutes(const uint64_t source, const uint64_t target,
+                                                                                              const AlternativeRouteOptions& options) const {
+    if (!containsVertex(source) || !containsVertex(target)) {
+        throw std::logic_error("Invalid vertex ID. Make sure that the source and target vertices exist.");
+    }
+    if (query_graph_.empty()) { throw std::logic_error("Alternative routes can only be computed on a contracted graph."); }
+    BidirectionalSearch searcher(&vertices_, &edges_, geometry_.get(), &query_graph_);
+    std::vector<std::pair<std::vector<std::array<double, 2>>, double>> routes;
+    for (const auto& path : searcher.findAlternativePaths(source, target, options)) {
+        std::vector<std::array<double, 2>> coordinates;
+        decodeOriginalEdges(path.source_index, path.edges, [&coordinates](const std::vector<std::array<double, 2>>& points) {
+            coordinates.insert(coordinates.end(), points.begin(), points.end());
+        }, nullptr);
+        routes.emplace_back(std::move(coordinates), path.length);
+    }
+    return routes;
+}
+
+std::pair<std::vector<std::array<double, 2>>, double> Graph::getShortestRoute(const uint64_t source, const uint64_t target, const bool standard, QueryStats* stats) const {
+    if (standard || query_graph_.empty()) {
+        const auto route = getShortestPath(source, target, standard, stats);
+        CH_STATS_TIMER(stats, geometry);
+        return std::make_pair(convertPathToCoordinates(route.first), route.second);
+    }
+    std::vector<std::array<double, 2>> coordinates;
+    const double length = decodeShortestRoute(source, target, [&coordinates](const std::vector<std::array<double, 2>>& points) {
+        coordinates.insert(coordinates.end(), points.begin(), points.end());
+    }, stats);
+    return std::make_pair(coordinates, length);
+}
+
+std::pair<std::string, double> Graph::getEncodedRoute(const uint64_t source, const uint64_t target, const double tolerance,
+                                                      const int precision, const bool standard) const {
+    if (standard || query_graph_.empty()) {
+        const auto route = getShortestPath(source, target, standard);
+        return std::make_pair(convertPathToPolyline(route.first, tolerance, precision), route.second);
+    }
+    // Simplification needs the whole path at once.
+    if (tolerance > 0) {
+        const auto route = getShortestRoute(source, target);
+        return std::make_pair(Polyline::encode(Polyline::simplify(route.first, tolerance), precision), route.second);
+    }
+    Polyline polyline(precision);
+    const double length = decodeShortestRoute(source, target, [&polyline](const std::vector<std::array<double, 2>>& points) {
+        for (const auto& point : points) { polyline.addPoint(point); }
+    });
+    return std::make_pair(polyline.getEncoded(), length);
+}
+
+void Graph::saveFlat(const char* filename) const {
+    if (query_graph_.empty()) { throw std::logic_error("Only a contracted graph can be saved as a flat file."); }
+    FlatWriter writer(filename);
+    geometry_->saveFlat(writer);
+    query_graph_.saveFlat(writer);
+}
+
+void Graph::mapFlat(const char* filename) {
+    mapFlat(std::make_shared<const MappedFile>(filename));
+}
+
+void Graph::mapFlat(std::shared_ptr<const MappedFile> mapping) {
+    FlatReader reader(*mapping);
+    GeometryStore geometry;
+    QueryGraph query_graph;
+    geometry.mapFlat(reader);
+    query_graph.mapFlat(reader, geometry.getNumSegments());
+
+    // The mutable representation of the graph is not stored in a flat file.
+    vertices_.clear();
+    edges_.clear();
+    shortcuts_.clear();
+    locations_ = std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>();
+    num_edges_ = 0;
+    geometry_ = std::make_shared<GeometryStore>(std::move(geometry));
+    query_graph_ = std::move(query_graph);
+    mapping_ = std::move(mapping);
+    network_.reset();
+    weights_ = FlatArray<double>();
+}
+
+void Graph::saveProfilesFlat(const char* filename, const std::vector<std::pair<std::string, const Graph*>>& profiles) {
+    if (profiles.empty()) { throw std::logic_error("At least one profile is needed."); }
+    const auto& network = profiles.front().second->network_;
+    std::vector<uint64_t> name_offsets{0}, num_edges;
+    std::vector<char> names;
+    for (const auto& [name, graph] : profiles) {
+        if (!network || graph->network_ != network) { throw std::logic_error("The graphs of the profiles must share a road network."); }
+        if (graph->query_graph_.empty()) { throw std::logic_error("Only contracted graphs can be saved as a flat file."); }
+        for (size_t i = 0; i + 1 < name_offsets.size(); i++) {
+            if (std::string(names.begin() + name_offsets[i], names.begin() + name_offsets[i + 1]) == name) {
+                throw std::logic_error("Every profile needs a different name.");
+            }
+        }
+        names.insert(names.end(), name.begin(), name.end());
+        name_offsets.push_back(names.size());
+        num_edges.push_back(graph->num_edges_);
+    }
+
+    // The geometry and the road network are shared by every profile, so they are only written once.
+    FlatWriter writer(filename, FlatWriter::PROFILES_MAGIC);
+    network->getGeometry()->saveFlat(writer);
+    network->saveFlat(writer);
+    writer.writeArray(FlatArray<uint64_t>(std::move(name_offsets)));
+    writer.writeArray(FlatArray<char>(std::move(names)));
+    writer.writeArray(FlatArray<uint64_t>(std::move(num_edges)));
+    for (const auto& [name, graph] : profiles) {
+        writer.writeArray(graph->weights_);
+        graph->query_graph_.saveFlat(writer);
+    }
+}
+
+std::vector<std::pair<std::string, Graph>> Graph::mapProfilesFlat(const char* filename) {
+    auto mapping = std::make_shared<const MappedFile>(filename);
+    std::vector<std::pair<std::string, Graph>> profiles;
+    if (FlatReader::readMagic(*mapping) != FlatWriter::PROFILES_MAGIC) {
+        profiles.emplace_back("", Graph());
+        profiles.back().second.mapFlat(std::move(mapping));
+        return profiles;
+    }
+
+    FlatReader reader(*mapping, FlatWriter::PROFILES_MAGIC);
+    auto geometry = std::make_shared<GeometryStore>();
+    geometry->mapFlat(reader);
+    auto network = std::make_shared<RoadNetwork>();
+    network->mapFlat(reader, geometry);
+    const auto name_offsets = reader.readArray<uint64_t>();
+    const auto names = reader.readArray<char>();
+    const auto num_edges = reader.readArray<uint64_t>();
+    bool valid = !num_edges.empty() && name_offsets.size() == num_edges.size() + 1 && name_offsets[0] == 0 &&
+                 name_offsets.back() == names.size();
+    for (size_t i = 0; valid && i < num_edges.size(); i++) { valid = name_offsets[i] <= name_offsets[i + 1]; }
+    if (!valid) { throw std::logic_error("The flat file does not contain valid routing profiles."); }
+
+    for (size_t i = 0; i < num_edges.size(); i++) {
+        Graph graph;
+        graph.weights_ = reader.readArray<double>();
+        graph.query_graph_.mapFlat(reader, geometry->getNumSegments());
+        // The query graph of a profile holds every vertex of the road network, and a weight is never negative.
+        valid = graph.weights_.size() == network->getNumEdges() && graph.query_graph_.getNumVertices() == network->getNumVertices();
+        for (size_t edge = 0; valid && edge < graph.weights_.size(); edge++) { valid = graph.weights_[edge] >= 0; }
+        if (!valid) { throw std::logic_error("The flat file does not contain valid routing profiles."); }
+        graph.num_edges_ = num_edges[i];
+        graph.geometry_ = geometry;
+        graph.network_ = network;
+        graph.mapping_ = mapping;
+        profiles.emplace_back(std::string(names.begin() + name_offsets[i], names.begin() + name_offsets[i + 1]), std::move(graph));
+    }
+    return profiles;
+}
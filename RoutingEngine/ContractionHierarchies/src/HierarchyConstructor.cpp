@@ -1,19 +1,77 @@
 #include "HierarchyConstructor.h"
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <fstream>
+#include "MappedFile.h"
+#include "NestedDissection.h"
 
-HierarchyConstructor::HierarchyConstructor(Graph& graph, const int edge_difference_coefficient, const int deleted_neigbhors_coefficient)
-    : graph_(graph), total_edges_added_(0), edge_difference_coefficient(edge_difference_coefficient), deleted_neighbors_coefficient(deleted_neigbhors_coefficient) { vertices_ = graph_.getVertices(); }
+const std::vector<HierarchyConstructor::WitnessLimit> HierarchyConstructor::STAGED_WITNESS_LIMITS{
+    {3.3, 1, HOP_LIMIT}, {5.0, 3, HOP_LIMIT}, {std::numeric_limits<double>::infinity(), std::numeric_limits<int>::max(), HOP_LIMIT}};
 
-void HierarchyConstructor::contractGraph() {
-    // We construct the priority MinHeap by simulating the contraction of all vertices.
-    Queue::MinHeap<HeapElement> queue = getInitialOrdering();
+HierarchyConstructor::WitnessSearch::WitnessSearch(const uint32_t num_vertices)
+    : distances(num_vertices, std::numeric_limits<double>::infinity()), settled(num_vertices, 0), targets(num_vertices, 0),
+      hops(num_vertices, 0)
+{}
+
+HierarchyConstructor::HierarchyConstructor(Graph& graph, const int edge_difference_coefficient, const int deleted_neigbhors_coefficient,
+                                           const int num_threads)
+    : graph_(graph), total_edges_added_(0), edge_difference_coefficient(edge_difference_coefficient),
+      deleted_neighbors_coefficient(deleted_neigbhors_coefficient), original_edges_coefficient(0), level_coefficient(0),
+      num_threads_(num_threads), working_graph_(graph),
+      witness_search_(working_graph_.getNumVertices()),
+      witness_limits_{{std::numeric_limits<double>::infinity(), std::numeric_limits<int>::max(), HOP_LIMIT}},
+      orders_(working_graph_.getNumVertices(), NOT_CONTRACTED)
+{}
+
+HierarchyConstructor::HierarchyConstructor(Graph& graph, const Coefficients& coefficients, const int num_threads)
+    : HierarchyConstructor(graph, coefficients.edge_difference, coefficients.deleted_neighbors, num_threads) {
+    original_edges_coefficient = coefficients.original_edges;
+    level_coefficient = coefficients.level;
+}
+
+void HierarchyConstructor::setWitnessLimits(std::vector<WitnessLimit> limits) {
+    if (limits.empty()) { throw std::logic_error("At least one witness search limit is required."); }
+    witness_limits_ = std::move(limits);
+}
+
+const HierarchyConstructor::WitnessLimit& HierarchyConstructor::getWitnessLimit() const {
+    const double average_degree = working_graph_.getAverageDegree();
+    for (const auto& limit : witness_limits_) {
+        if (average_degree <= limit.max_average_degree) { return limit; }
+    }
+    return witness_limits_.back();
+}
+
+void HierarchyConstructor::setCheckpoint(const std::string& filename, const uint32_t interval) {
+    checkpoint_filename_ = filename;
+    checkpoint_interval_ = interval;
+}
+
+bool HierarchyConstructor::contractGraph() {
+    // We construct the priority MinHeap by simulating the contraction of all vertices, unless an interrupted contraction
+    // is resumed from its checkpoint.
+    const auto start = std::chrono::steady_clock::now();
+    Queue::MinHeap<HeapElement> queue;
     // The order in which the vertices are contracted must be recorded for route finding later on.
     uint64_t ordering_count = 0;
+    if (!loadCheckpoint(&queue, &ordering_count)) {
+        queue = ordering_ == Ordering::NESTED_DISSECTION ? getNestedDissectionOrdering() : getInitialOrdering();
+    }
+    const auto ordered = std::chrono::steady_clock::now();
+    timings_.initial_ordering = std::chrono::duration<double>(ordered - start).count();
 
     while (!queue.empty()) {
-        const auto contracted_vertex = getNext(&queue);
-        graph_.addOrdering(contracted_vertex, ordering_count);
+        // A nested dissection order is fixed, so its priorities are never updated.
+        const auto contracted_vertex = ordering_ == Ordering::NESTED_DISSECTION ? uint32_t(queue.pop().id) : getNext(&queue);
+        orders_[contracted_vertex] = ordering_count;
         ordering_count++;
-        contractVertex(contracted_vertex);
+        contractVertex(witness_search_, contracted_vertex);
 
         // We update the deleted neighbors counter of all vertices adjacent to the Vertex being contracted.
         contractedNeighbors(contracted_vertex);
@@ -26,44 +84,143 @@ void HierarchyConstructor::contractGraph() {
         * contracted or not, and simply ignoring those vertices that have "contracted" set to true during the contraction process
         * would be faster than removing the edges to a Vertex and deleting the Vertex. Testing has show that this is not the case.
         */
-        for (const auto& [incoming_id, incoming_weight] : vertices_[contracted_vertex].in_edges) {
-            vertices_[incoming_id].out_edges.erase(contracted_vertex);
-        }
+        working_graph_.removeVertex(contracted_vertex);
 
-        for (const auto& [outgoing_id, outgoing_weight] : vertices_[contracted_vertex].out_edges) {
-            vertices_[outgoing_id].in_edges.erase(contracted_vertex);
+        if (queue.empty()) { break; }
+        const bool stopping = stop_requested_.exchange(false);
+        if (!checkpoint_filename_.empty() && (stopping || (checkpoint_interval_ > 0 && ordering_count % checkpoint_interval_ == 0))) {
+            saveCheckpoint(queue, ordering_count);
+        }
+        if (stopping) {
+            timings_.contraction = std::chrono::duration<double>(std::chrono::steady_clock::now() - ordered).count();
+            return false;
         }
+    }
+
+    buildHierarchy();
+    timings_.contraction = std::chrono::duration<double>(std::chrono::steady_clock::now() - ordered).count();
+    // The checkpoint is of no use once the graph is contracted.
+    if (!checkpoint_filename_.empty()) { std::remove(checkpoint_filename_.c_str()); }
+    return true;
+}
 
-        vertices_.erase(contracted_vertex);
+void HierarchyConstructor::saveCheckpoint(const Queue::MinHeap<HeapElement>& queue, const uint64_t ordering_count) const {
+    const std::string temporary = checkpoint_filename_ + ".tmp";
+    {
+        FlatWriter writer(temporary.c_str());
+        writer.writeArray(FlatArray<uint64_t>(std::vector<uint64_t>{CHECKPOINT_VERSION, ordering_count, uint64_t(total_edges_added_)}));
+        working_graph_.saveFlat(writer);
+        writer.writeArray(FlatArray<uint64_t>(orders_));
+        writer.writeArray(FlatArray<HeapElement>(queue.getElements()));
+    }
+    // Renaming a file replaces the previous checkpoint in a single step.
+    if (std::rename(temporary.c_str(), checkpoint_filename_.c_str()) != 0) {
+        throw std::logic_error("Cannot replace the checkpoint " + checkpoint_filename_ + ".");
     }
+}
+
+bool HierarchyConstructor::loadCheckpoint(Queue::MinHeap<HeapElement>* queue, uint64_t* ordering_count) {
+    if (checkpoint_filename_.empty() || !std::ifstream(checkpoint_filename_)) { return false; }
+    const MappedFile file(checkpoint_filename_.c_str());
+    FlatReader reader(file);
+    const auto header = reader.readArray<uint64_t>();
+    if (header.size() != 3 || header[0] != CHECKPOINT_VERSION) { throw std::logic_error("The file " + checkpoint_filename_ + " is not a contraction checkpoint."); }
+    working_graph_.loadFlat(reader);
+    const auto orders = reader.readArray<uint64_t>();
+    const auto elements = reader.readArray<HeapElement>();
+    if (orders.size() != orders_.size()) { throw std::logic_error("The checkpoint is corrupt."); }
+    *ordering_count = header[1];
+    total_edges_added_ = int64_t(header[2]);
+    // The graph itself is only changed once the contraction is done, so the working graph is all there is to restore.
+    orders_.assign(orders.begin(), orders.end());
+    queue->makeHeap(std::vector<HeapElement>(elements.begin(), elements.end()));
+    return true;
+}
 
+void HierarchyConstructor::buildHierarchy() {
+    if (graph_.getNetwork()) {
+        buildProfileHierarchy();
+        return;
+    }
+    // The edges that a vertex had when it was contracted all lead to vertices of a higher order, so every edge of the
+    // hierarchy is found exactly once: in the edges of its lower end.
+    for (uint32_t vertex = 0; vertex < working_graph_.getNumVertices(); vertex++) {
+        const uint64_t id = working_graph_.getId(vertex);
+        graph_.addOrdering(id, orders_[vertex]);
+        for (const auto& arc : working_graph_.getOutArcs(vertex)) {
+            if (arc.middle != ContractionGraph::NO_MIDDLE) {
+                graph_.addShortcut(id, working_graph_.getId(arc.vertex), working_graph_.getId(arc.middle), arc.weight);
+            }
+        }
+        for (const auto& arc : working_graph_.getInArcs(vertex)) {
+            if (arc.middle != ContractionGraph::NO_MIDDLE) {
+                graph_.addShortcut(working_graph_.getId(arc.vertex), id, working_graph_.getId(arc.middle), arc.weight);
+            }
+        }
+    }
     // Optimizing the graph removes any edges that go from a Vertex of higher order to a Vertex of lower order, as these will never be on the shortest path.
     graph_.optimizeEdges();
+    graph_.buildQueryGraph();
 }
 
-int HierarchyConstructor::contractVertex(uint64_t contracted_vertex, bool simulated) {
-    std::vector<std::tuple<uint64_t, uint64_t, double>> shortcuts_to_add;
+void HierarchyConstructor::buildProfileHierarchy() {
+    // The working graph numbers the vertices like the road network does. The original edges of the hierarchy are the
+    // edges that the profile uses, whose geometry is found in the road network.
+    const RoadNetwork& network = *graph_.getNetwork();
+    const uint32_t num_vertices = working_graph_.getNumVertices();
+    std::vector<std::vector<HierarchyEdge>> out_edges(num_vertices), in_edges(num_vertices);
+    std::vector<std::array<double, 2>> locations;
+    locations.reserve(num_vertices);
+    uint64_t num_shortcuts = 0;
+    const auto to_edge = [&](uint32_t tail, uint32_t head, const ContractionGraph::Arc& arc) {
+        HierarchyEdge edge{arc.vertex, QueryGraph::INVALID_INDEX, GeometryStore::NO_GEOMETRY, false, arc.weight};
+        if (arc.middle != ContractionGraph::NO_MIDDLE) {
+            edge.middle = arc.middle;
+            num_shortcuts++;
+        }
+        else {
+            const auto& original = network.getEdge(network.findEdge(tail, head, graph_.getWeights()));
+            edge.geometry = original.geometry;
+            edge.reversed = original.reversed;
+        }
+        return edge;
+    };
+    for (uint32_t vertex = 0; vertex < num_vertices; vertex++) {
+        for (const auto& arc : working_graph_.getOutArcs(vertex)) { out_edges[vertex].push_back(to_edge(vertex, arc.vertex, arc)); }
+        for (const auto& arc : working_graph_.getInArcs(vertex)) { in_edges[vertex].push_back(to_edge(arc.vertex, vertex, arc)); }
+        locations.push_back(graph_.getLocation(working_graph_.getId(vertex)));
+    }
+    const std::vector<uint64_t> ids(network.getIds().begin(), network.getIds().end());
+    graph_.setQueryGraph(QueryGraph(ids, orders_, out_edges, in_edges, locations), num_shortcuts);
+}
+
+int HierarchyConstructor::contractVertex(WitnessSearch& search, uint32_t contracted_vertex, bool simulated, int* added_original_edges) {
+    std::vector<std::tuple<uint32_t, uint32_t, double, uint32_t>> shortcuts_to_add;
     shortcuts_to_add.reserve(5);
     int added_shortcuts = 0;
+    if (added_original_edges) { *added_original_edges = 0; }
     const double max_out_distance = getMaxOutDistance(contracted_vertex);
+    const WitnessLimit& limit = getWitnessLimit();
 
     // Loops through the incoming vertices of the contracted Vertex.
-    for (const auto& [incoming_id, incoming_weight] : vertices_[contracted_vertex].in_edges) {
+    for (const auto& [incoming_id, incoming_original_edges, incoming_middle, incoming_weight] : working_graph_.getInArcs(contracted_vertex)) {
         // We ignore the Vertex that is currently being contracted.
         if (incoming_id == contracted_vertex) { continue; }
 
-        auto dists = witnessSearch(incoming_id, contracted_vertex, incoming_weight + max_out_distance);
+        const auto& dists = witnessSearch(search, incoming_id, contracted_vertex, incoming_weight + max_out_distance, limit);
 
         // Loops through the outgoing vertices of the contracted Vertex.
-        for (const auto& [outgoing_id, outgoing_weight] : vertices_[contracted_vertex].out_edges) {
+        for (const auto& [outgoing_id, outgoing_original_edges, outgoing_middle, outgoing_weight] : working_graph_.getOutArcs(contracted_vertex)) {
             // We ignore the Vertex that is currently being contracted.
             if (outgoing_id == contracted_vertex || incoming_id == outgoing_id) { continue; }
 
             // If no witness path was found, then we need to add a shortcut. Adding unnecessary shortcuts does not invalidate the algorithm.
-            if (dists.find(outgoing_id) == dists.end() || dists.at(outgoing_id) > incoming_weight + outgoing_weight) {
-                if (vertices_[incoming_id].out_edges.find(outgoing_id) == vertices_[incoming_id].out_edges.end() || vertices_[incoming_id].out_edges[outgoing_id] > incoming_weight + outgoing_weight) {
+            if (dists[outgoing_id] > incoming_weight + outgoing_weight) {
+                const double* existing_weight = working_graph_.findArc(incoming_id, outgoing_id);
+                if (!existing_weight || *existing_weight > incoming_weight + outgoing_weight) {
                     added_shortcuts++;
-                    if (!simulated) { shortcuts_to_add.emplace_back(incoming_id, outgoing_id, incoming_weight + outgoing_weight); }
+                    if (added_original_edges) { *added_original_edges += int(incoming_original_edges + outgoing_original_edges); }
+                    if (!simulated) { shortcuts_to_add.emplace_back(incoming_id, outgoing_id, incoming_weight + outgoing_weight, incoming_original_edges + outgoing_original_edges); }
                 }
             }
         }
@@ -72,32 +229,52 @@ int HierarchyConstructor::contractVertex(uint64_t contracted_vertex, bool simula
     return added_shortcuts;
 }
 
-std::unordered_map<uint64_t, double>
-HierarchyConstructor::witnessSearch(uint64_t source, uint64_t contracted_vertex, double max_distance) {
-    Queue::MinHeap<HeapElement> queue;
-    std::unordered_map<uint64_t, double> dists;
-    std::unordered_set<uint64_t> visited, targets;
-    int hops = 0, targets_seen = 0;
-    queue.push(HeapElement(source, 0));
-    dists[source] = 0;
+const std::vector<double>& HierarchyConstructor::witnessSearch(WitnessSearch& search, uint32_t source, uint32_t contracted_vertex, double max_distance,
+                                                               const WitnessLimit& limit) const {
+    auto& dists = search.distances;
 
-    for (const auto& [outgoing_id, outgoing_weight] : vertices_[contracted_vertex].out_edges) {
-        if (outgoing_id != contracted_vertex) { targets.insert(outgoing_id); }
+    // Resets the entries changed by the previous search.
+    for (const auto& vertex : search.touched) {
+        dists[vertex] = std::numeric_limits<double>::infinity();
+        search.settled[vertex] = 0;
+        search.targets[vertex] = 0;
     }
+    search.touched.clear();
+    search.queue.clear();
+
+    int num_settled = 0, targets_seen = 0, num_targets = 0;
+    for (const auto& arc : working_graph_.getOutArcs(contracted_vertex)) {
+        const uint32_t outgoing_id = arc.vertex;
+        if (outgoing_id != contracted_vertex && !search.targets[outgoing_id]) {
+            search.targets[outgoing_id] = 1;
+            search.touched.push_back(outgoing_id);
+            num_targets++;
+        }
+    }
+    search.queue.push(HeapElement(source, 0));
+    dists[source] = 0;
+    search.hops[source] = 0;
+    search.touched.push_back(source);
 
     // Standard Dijkstra search.
-    while (!queue.empty() && targets_seen < targets.size() && queue.peek().value <= max_distance && hops < HOP_LIMIT) {
-        HeapElement u = queue.pop();
-        hops++;
-        visited.insert(u.id);
-
-        if (targets.find(u.id) != targets.end()) { targets_seen++; }
-
-        for (const auto& [outgoing_id, outgoing_weight] : vertices_[u.id].out_edges) {
-            if (visited.find(outgoing_id) != visited.end() || outgoing_id == contracted_vertex) { continue; }
-            if (dists.find(outgoing_id) == dists.end() || dists[outgoing_id] > dists[u.id] + outgoing_weight) {
-                dists[outgoing_id] = dists[u.id] + outgoing_weight;
-                queue.push(HeapElement(outgoing_id, dists[outgoing_id]));
+    while (!search.queue.empty() && targets_seen < num_targets && search.queue.peek().value <= max_distance && num_settled < limit.settled_limit) {
+        const auto u = uint32_t(search.queue.pop().id);
+        // A vertex is pushed again whenever its distance decreases. Only the first time it is popped counts.
+        if (search.settled[u]) { continue; }
+        num_settled++;
+        search.settled[u] = 1;
+
+        if (search.targets[u]) { targets_seen++; }
+        // The edges of a vertex at the hop limit are not relaxed.
+        if (search.hops[u] >= limit.hop_limit) { continue; }
+
+        for (const auto& [outgoing_id, outgoing_original_edges, outgoing_middle, outgoing_weight] : working_graph_.getOutArcs(u)) {
+            if (search.settled[outgoing_id] || outgoing_id == contracted_vertex) { continue; }
+            if (dists[outgoing_id] > dists[u] + outgoing_weight) {
+                if (dists[outgoing_id] == std::numeric_limits<double>::infinity()) { search.touched.push_back(outgoing_id); }
+                dists[outgoing_id] = dists[u] + outgoing_weight;
+                search.hops[outgoing_id] = search.hops[u] + 1;
+                search.queue.push(HeapElement(outgoing_id, dists[outgoing_id]));
             }
         }
     }
@@ -105,78 +282,124 @@ HierarchyConstructor::witnessSearch(uint64_t source, uint64_t contracted_vertex,
 }
 
 Queue::MinHeap<HeapElement> HierarchyConstructor::getInitialOrdering() {
-    Queue::MinHeap<HeapElement> queue(int(vertices_.size()));
-    // We simulate the contraction of all vertices in the graph to get a good node ordering.
-    for (const auto& [id, vertex] : vertices_) {
-        queue.push(HeapElement(id, getPriorityTerm(id, true)));
+    // Vertices are handed out in blocks, since the cost of a simulated contraction varies a lot between vertices.
+    const uint32_t BLOCK_SIZE = 256;
+    const uint32_t num_vertices = working_graph_.getNumVertices();
+    const uint32_t num_blocks = (num_vertices + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t num_threads = std::max(1u, std::min(num_threads_ > 0 ? uint32_t(num_threads_) : hardware_threads, num_blocks));
+
+    // We simulate the contraction of all vertices in the graph to get a good node ordering. Every thread has its own
+    // witness search state; the working graph is only read.
+    std::vector<HeapElement> elements(num_vertices, HeapElement(0, 0));
+    std::atomic<uint32_t> next_block(0);
+    const auto simulate = [&](WitnessSearch& search) {
+        for (uint32_t block = next_block++; block < num_blocks; block = next_block++) {
+            for (uint32_t vertex = block * BLOCK_SIZE; vertex < std::min(num_vertices, (block + 1) * BLOCK_SIZE); vertex++) {
+                elements[vertex] = HeapElement(vertex, getPriorityTerm(search, vertex, true));
+            }
+        }
+    };
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> threads;
+    for (uint32_t thread = 1; thread < num_threads; thread++) {
+        threads.emplace_back([&, thread]() {
+            try {
+                WitnessSearch search(num_vertices);
+                simulate(search);
+            }
+            catch (...) { errors[thread] = std::current_exception(); }
+        });
     }
+    try { simulate(witness_search_); }
+    catch (...) { errors[0] = std::current_exception(); }
+    for (auto& thread : threads) { thread.join(); }
+    for (const auto& error : errors) {
+        if (error) { std::rethrow_exception(error); }
+    }
+
+    Queue::MinHeap<HeapElement> queue;
+    queue.makeHeap(elements);
+    return queue;
+}
+
+Queue::MinHeap<HeapElement> HierarchyConstructor::getNestedDissectionOrdering() {
+    std::vector<std::array<double, 2>> coordinates;
+    coordinates.reserve(working_graph_.getNumVertices());
+    for (uint32_t vertex = 0; vertex < working_graph_.getNumVertices(); vertex++) {
+        coordinates.push_back(graph_.getLocation(working_graph_.getId(vertex)));
+    }
+    const auto order = NestedDissection(working_graph_, coordinates).computeOrder(num_threads_);
+    std::vector<HeapElement> elements;
+    elements.reserve(order.size());
+    for (uint32_t position = 0; position < order.size(); position++) { elements.emplace_back(order[position], position); }
+    Queue::MinHeap<HeapElement> queue;
+    queue.makeHeap(elements);
     return queue;
 }
 
-uint64_t HierarchyConstructor::getNext(Queue::MinHeap<HeapElement> *queue) {
-    uint64_t temp_vertex = 0;
+uint32_t HierarchyConstructor::getNext(Queue::MinHeap<HeapElement> *queue) {
+    uint64_t temp_vertex = std::numeric_limits<uint64_t>::max();
     while (temp_vertex != queue->peek().id) {
         temp_vertex = queue->peek().id;
         // Lazy update.
-        queue->lazyUpdate(HeapElement(queue->peek().id, getPriorityTerm(queue->peek().id)));
+        queue->lazyUpdate(HeapElement(queue->peek().id, getPriorityTerm(witness_search_, uint32_t(queue->peek().id))));
     }
-    const uint64_t contracted_vertex = queue->pop().id;
-    return contracted_vertex;
+    return uint32_t(queue->pop().id);
 }
 
-void HierarchyConstructor::addShortcuts(uint64_t contracted_vertex, const std::vector<std::tuple<uint64_t, uint64_t, double>>* shortcuts) {
-    for (const auto & it : *shortcuts) {
-        graph_.addShortcut(std::get<0>(it), std::get<1>(it), contracted_vertex, std::get<2>(it));
-        vertices_[std::get<0>(it)].out_edges[std::get<1>(it)] =  std::get<2>(it);
-        vertices_[std::get<1>(it)].in_edges[std::get<0>(it)] = std::get<2>(it);
+void HierarchyConstructor::addShortcuts(uint32_t contracted_vertex, const std::vector<std::tuple<uint32_t, uint32_t, double, uint32_t>>* shortcuts) {
+    for (const auto& [start, end, weight, original_edges] : *shortcuts) {
+        working_graph_.setArc(start, end, weight, original_edges, contracted_vertex);
         total_edges_added_++;
     }
 }
 
-void HierarchyConstructor::contractedNeighbors(uint64_t contracted_vertex) {
-    // We use an unordered set to keep track of vertices that have already been incremented to avoid over counting.
-    std::unordered_set<uint64_t> seen;
-
-    // Updates the cost of all the incoming neighbors of the contracted Vertex.
-    for (const auto& [incoming_id, incoming_weight] : vertices_[contracted_vertex].in_edges) {
-        if (seen.find(incoming_id) == seen.end() && incoming_id != contracted_vertex) {
-            seen.insert(incoming_id);
-            vertices_[incoming_id].deleted_neighbors++;
-        }
-    }
-
-    // Updates the cost of all the outgoing neighbors of the contracted Vertex.
-    for (const auto& [outgoing_id, outgoing_weight] : vertices_[contracted_vertex].out_edges) {
-        if (seen.find(outgoing_id) == seen.end() && outgoing_id != contracted_vertex) {
-            seen.insert(outgoing_id);
-            vertices_[outgoing_id].deleted_neighbors++;
+void HierarchyConstructor::contractedNeighbors(uint32_t contracted_vertex) {
+    // A neighbor that is both an incoming and an outgoing neighbor is only counted once.
+    std::vector<uint32_t> neighbors;
+    for (const auto& arc : working_graph_.getInArcs(contracted_vertex)) { neighbors.push_back(arc.vertex); }
+    for (const auto& arc : working_graph_.getOutArcs(contracted_vertex)) { neighbors.push_back(arc.vertex); }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    for (const auto& neighbor : neighbors) {
+        if (neighbor != contracted_vertex) {
+            working_graph_.incrementDeletedNeighbors(neighbor);
+            working_graph_.raiseLevel(neighbor, working_graph_.getLevel(contracted_vertex) + 1);
         }
     }
 }
 
-double HierarchyConstructor::getMaxOutDistance(uint64_t contracted_vertex) const {
+double HierarchyConstructor::getMaxOutDistance(uint32_t contracted_vertex) const {
     double max_out = 0.0;
-    for (const auto& [outgoing_id, outgoing_weight] : vertices_.at(contracted_vertex).out_edges) {
+    for (const auto& [outgoing_id, outgoing_original_edges, outgoing_middle, outgoing_weight] : working_graph_.getOutArcs(contracted_vertex)) {
         if ((outgoing_weight > max_out) && (outgoing_id != contracted_vertex)) { max_out = outgoing_weight; }
     }
     return max_out;
 }
 
-int HierarchyConstructor::getEdgeDifference(uint64_t contracted_vertex) {
+int HierarchyConstructor::getEdgeDifference(WitnessSearch& search, uint32_t contracted_vertex, int* original_edges_difference) {
     // original_edges is the total number of incoming and outgoing edges that a Vertex has before contraction.
-    uint64_t original_edges = vertices_[contracted_vertex].in_edges.size() + vertices_[contracted_vertex].out_edges.size();
+    uint64_t original_edges = working_graph_.getInArcs(contracted_vertex).size() + working_graph_.getOutArcs(contracted_vertex).size();
     // added_shortcuts is the number of shortcuts that must be added after contraction of a Vertex.
-    int added_shortcuts = contractVertex(contracted_vertex,true);
+    int added_shortcuts = contractVertex(search, contracted_vertex, true, original_edges_difference);
 
+    if (original_edges_difference) {
+        for (const auto& arc : working_graph_.getInArcs(contracted_vertex)) { *original_edges_difference -= int(arc.original_edges); }
+        for (const auto& arc : working_graph_.getOutArcs(contracted_vertex)) { *original_edges_difference -= int(arc.original_edges); }
+    }
     return int(added_shortcuts - original_edges);
 }
 
-int HierarchyConstructor::getPriorityTerm(uint64_t contracted_vertex, bool simulated) {
+int HierarchyConstructor::getPriorityTerm(WitnessSearch& search, uint32_t contracted_vertex, bool simulated) {
     if (simulated) {
-        return getEdgeDifference(contracted_vertex);
+        return getEdgeDifference(search, contracted_vertex);
     }
     else {
-        return edge_difference_coefficient * getEdgeDifference(contracted_vertex) + deleted_neighbors_coefficient * vertices_[contracted_vertex].deleted_neighbors;
+        // The original edges are only counted if their term is used.
+        int original_edges_difference = 0;
+        const int edge_difference = getEdgeDifference(search, contracted_vertex, original_edges_coefficient ? &original_edges_difference : nullptr);
+        return edge_difference_coefficient * edge_difference + deleted_neighbors_coefficient * working_graph_.getDeletedNeighbors(contracted_vertex) +
+               original_edges_coefficient * original_edges_difference + level_coefficient * int(working_graph_.getLevel(contracted_vertex));
     }
 }
-
@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char* filename) {
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) { throw std::logic_error("Cannot open " + std::string(filename) + "."); }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = size_t(size.QuadPart);
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr) {
+        CloseHandle(file_);
+        throw std::logic_error("Cannot map " + std::string(filename) + ".");
+    }
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+        CloseHandle(mapping_);
+        CloseHandle(file_);
+        throw std::logic_error("Cannot map " + std::string(filename) + ".");
+    }
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+}
+#else
+MappedFile::MappedFile(const char* filename) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd == -1) { throw std::logic_error("Cannot open " + std::string(filename) + "."); }
+    struct stat status{};
+    if (fstat(fd, &status) == -1 || status.st_size == 0) {
+        close(fd);
+        throw std::logic_error("Cannot map " + std::string(filename) + ".");
+    }
+    size_ = size_t(status.st_size);
+    // A shared, read-only mapping is backed by the page cache, which every process that maps the file shares.
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { throw std::logic_error("Cannot map " + std::string(filename) + "."); }
+    data_ = static_cast<const uint8_t*>(data);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<uint8_t*>(data_), size_);
+}
+#endif
+
+FlatWriter::FlatWriter(const char* filename, const uint64_t magic) : os_(filename, std::ios::binary) {
+    if (!os_) { throw std::logic_error("Cannot create " + std::string(filename) + "."); }
+    write(&magic, sizeof(magic));
+}
+
+void FlatWriter::write(const void* data, const size_t size) {
+    os_.write(static_cast<const char*>(data), std::streamsize(size));
+    if (!os_) { throw std::logic_error("Failed to write the flat file."); }
+    position_ += size;
+}
+
+FlatReader::FlatReader(const MappedFile& file, const uint64_t magic) : file_(file) {
+    check(1, sizeof(magic));
+    if (readMagic(file_) != magic) { throw std::logic_error("The file is not a flat graph file, or was written by a different version."); }
+    position_ = sizeof(magic);
+}
+
+uint64_t FlatReader::readMagic(const MappedFile& file) {
+    uint64_t magic = 0;
+    if (file.size() < sizeof(magic)) { return 0; }
+    std::copy(file.data(), file.data() + sizeof(magic), reinterpret_cast<uint8_t*>(&magic));
+    return magic;
+}
@@ -0,0 +1,233 @@
+#include "NestedDissection.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace {
+    const double PI = 3.14159265358979323846;
+}
+
+NestedDissection::Workspace::Workspace(const uint32_t num_vertices) : local(num_vertices, INVALID) {}
+
+NestedDissection::NestedDissection(const ContractionGraph& graph, const std::vector<std::array<double, 2>>& coordinates) {
+    const uint32_t num_vertices = graph.getNumVertices();
+    first_.reserve(num_vertices + 1);
+    first_.push_back(0);
+    std::vector<uint32_t> adjacent;
+    for (uint32_t vertex = 0; vertex < num_vertices; vertex++) {
+        adjacent.clear();
+        for (const auto& arc : graph.getOutArcs(vertex)) { adjacent.push_back(arc.vertex); }
+        for (const auto& arc : graph.getInArcs(vertex)) { adjacent.push_back(arc.vertex); }
+        std::sort(adjacent.begin(), adjacent.end());
+        adjacent.erase(std::unique(adjacent.begin(), adjacent.end()), adjacent.end());
+        adjacent.erase(std::remove(adjacent.begin(), adjacent.end(), vertex), adjacent.end());
+        neighbors_.insert(neighbors_.end(), adjacent.begin(), adjacent.end());
+        first_.push_back(uint32_t(neighbors_.size()));
+    }
+
+    // A degree of longitude is shorter than a degree of latitude away from the equator.
+    coordinates_.reserve(coordinates.size());
+    for (const auto& [latitude, longitude] : coordinates) {
+        coordinates_.push_back({latitude, longitude * std::cos(latitude * PI / 180)});
+    }
+}
+
+std::vector<uint32_t> NestedDissection::findSeparator(const std::vector<uint32_t>& cell, Workspace& workspace) const {
+    const auto size = uint32_t(cell.size());
+    auto& first = workspace.first;
+    auto& heads = workspace.heads;
+    auto& flow = workspace.flow;
+
+    // The graph of the cell only has the edges between vertices of the cell.
+    first.assign(1, 0);
+    heads.clear();
+    for (const uint32_t vertex : cell) {
+        for (uint32_t i = first_[vertex]; i < first_[vertex + 1]; i++) {
+            if (workspace.local[neighbors_[i]] != INVALID) { heads.push_back(workspace.local[neighbors_[i]]); }
+        }
+        first.push_back(uint32_t(heads.size()));
+    }
+    workspace.reverse.resize(heads.size());
+    for (uint32_t tail = 0; tail < size; tail++) {
+        for (uint32_t arc = first[tail]; arc < first[tail + 1]; arc++) {
+            const uint32_t head = heads[arc];
+            for (uint32_t back = first[head]; back < first[head + 1]; back++) {
+                if (heads[back] == tail) {
+                    workspace.reverse[arc] = back;
+                    break;
+                }
+            }
+        }
+    }
+
+    // The lines that the vertices are sorted along: north to south, west to east and the two diagonals.
+    const std::array<std::array<double, 2>, 4> directions{{{1, 0}, {0, 1}, {1, 1}, {1, -1}}};
+    const uint32_t num_terminals = std::max(1u, size / 4);
+    const uint8_t SOURCE = 1, SINK = 2;
+    std::vector<uint32_t> order(size), queue;
+    std::vector<double> projections(size);
+    std::vector<uint8_t> best_side;
+    uint32_t best_cut = INVALID;
+    for (const auto& direction : directions) {
+        for (uint32_t i = 0; i < size; i++) {
+            projections[i] = direction[0] * coordinates_[cell[i]][0] + direction[1] * coordinates_[cell[i]][1];
+        }
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return projections[a] < projections[b] || (projections[a] == projections[b] && a < b);
+        });
+        workspace.role.assign(size, 0);
+        for (uint32_t i = 0; i < num_terminals; i++) {
+            workspace.role[order[i]] = SOURCE;
+            workspace.role[order[size - 1 - i]] = SINK;
+        }
+
+        // Every edge has a capacity of one in both directions. Paths are augmented until the sinks cannot be reached,
+        // or until the flow is no smaller than the best cut found so far.
+        flow.assign(heads.size(), 0);
+        workspace.parent.assign(size, INVALID);
+        uint32_t total_flow = 0;
+        while (total_flow < best_cut) {
+            workspace.reached.assign(size, 0);
+            queue.clear();
+            for (uint32_t i = 0; i < num_terminals; i++) {
+                workspace.reached[order[i]] = 1;
+                queue.push_back(order[i]);
+            }
+            uint32_t sink = INVALID;
+            for (size_t i = 0; i < queue.size() && sink == INVALID; i++) {
+                const uint32_t tail = queue[i];
+                for (uint32_t arc = first[tail]; arc < first[tail + 1]; arc++) {
+                    const uint32_t head = heads[arc];
+                    if (flow[arc] >= 1 || workspace.reached[head]) { continue; }
+                    workspace.reached[head] = 1;
+                    workspace.parent[head] = arc;
+                    if (workspace.role[head] == SINK) {
+                        sink = head;
+                        break;
+                    }
+                    queue.push_back(head);
+                }
+            }
+            if (sink == INVALID) { break; }
+            for (uint32_t vertex = sink; workspace.role[vertex] != SOURCE; vertex = heads[workspace.reverse[workspace.parent[vertex]]]) {
+                flow[workspace.parent[vertex]]++;
+                flow[workspace.reverse[workspace.parent[vertex]]]--;
+            }
+            total_flow++;
+        }
+        // The vertices that are still reached from the sources make up the source side of a minimum cut.
+        if (total_flow < best_cut) {
+            best_cut = total_flow;
+            best_side = workspace.reached;
+        }
+    }
+
+    // Either end of the cut edges separates the cell. The smaller end is used.
+    std::vector<uint32_t> inner, outer;
+    for (uint32_t tail = 0; tail < size; tail++) {
+        for (uint32_t arc = first[tail]; arc < first[tail + 1]; arc++) {
+            if (best_side[tail] != best_side[heads[arc]]) {
+                (best_side[tail] ? inner : outer).push_back(tail);
+                break;
+            }
+        }
+    }
+    return inner.size() <= outer.size() ? inner : outer;
+}
+
+std::vector<std::vector<uint32_t>> NestedDissection::dissect(const std::vector<uint32_t>& cell, const uint32_t depth,
+                                                             Workspace& workspace, std::vector<uint32_t>* depths) const {
+    std::vector<std::vector<uint32_t>> parts;
+    if (cell.size() <= LEAF_SIZE) {
+        for (const uint32_t vertex : cell) { (*depths)[vertex] = depth; }
+        return parts;
+    }
+    for (uint32_t i = 0; i < cell.size(); i++) { workspace.local[cell[i]] = i; }
+    const auto separator = findSeparator(cell, workspace);
+
+    // The remaining vertices are split into their connected parts.
+    std::vector<uint8_t> visited(cell.size(), 0);
+    for (const uint32_t position : separator) {
+        visited[position] = 1;
+        (*depths)[cell[position]] = depth;
+    }
+    for (uint32_t start = 0; start < cell.size(); start++) {
+        if (visited[start]) { continue; }
+        std::vector<uint32_t> part{start};
+        visited[start] = 1;
+        for (size_t i = 0; i < part.size(); i++) {
+            for (uint32_t arc = workspace.first[part[i]]; arc < workspace.first[part[i] + 1]; arc++) {
+                if (!visited[workspace.heads[arc]]) {
+                    visited[workspace.heads[arc]] = 1;
+                    part.push_back(workspace.heads[arc]);
+                }
+            }
+        }
+        for (auto& position : part) { position = cell[position]; }
+        parts.push_back(std::move(part));
+    }
+    for (const uint32_t vertex : cell) { workspace.local[vertex] = INVALID; }
+    return parts;
+}
+
+std::vector<uint32_t> NestedDissection::computeOrder(const int num_threads) const {
+    const auto num_vertices = uint32_t(first_.size() - 1);
+    std::vector<uint32_t> depths(num_vertices, 0);
+
+    // The cells that have yet to be dissected, along with their depth. A thread takes a cell, dissects it, and adds its
+    // parts. Every vertex gets its depth from exactly one cell, so the threads never write the same depth.
+    std::vector<std::pair<std::vector<uint32_t>, uint32_t>> cells;
+    std::vector<uint32_t> all(num_vertices);
+    std::iota(all.begin(), all.end(), 0);
+    cells.emplace_back(std::move(all), 0);
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint32_t busy = 0;
+    std::exception_ptr error;
+    const auto work = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool working = false;
+        try {
+            Workspace workspace(num_vertices);
+            while (true) {
+                changed.wait(lock, [&]() { return !cells.empty() || busy == 0 || error; });
+                if (cells.empty() || error) { return; }
+                auto [cell, depth] = std::move(cells.back());
+                cells.pop_back();
+                busy++;
+                working = true;
+                lock.unlock();
+                auto parts = dissect(cell, depth, workspace, &depths);
+                lock.lock();
+                for (auto& part : parts) { cells.emplace_back(std::move(part), depth + 1); }
+                busy--;
+                working = false;
+                changed.notify_all();
+            }
+        }
+        catch (...) {
+            if (!lock.owns_lock()) { lock.lock(); }
+            if (working) { busy--; }
+            if (!error) { error = std::current_exception(); }
+            changed.notify_all();
+        }
+    };
+    const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t num_workers = std::max(1u, num_threads > 0 ? uint32_t(num_threads) : hardware_threads);
+    std::vector<std::thread> threads;
+    for (uint32_t thread = 1; thread < num_workers; thread++) { threads.emplace_back(work); }
+    work();
+    for (auto& thread : threads) { thread.join(); }
+    if (error) { std::rethrow_exception(error); }
+
+    // The deepest vertices are contracted first, so every separator comes after the cells below it.
+    std::vector<uint32_t> order(num_vertices);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return depths[a] > depths[b]; });
+    return order;
+}
@@ -0,0 +1,107 @@
+#include "Polyline.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    const double EARTH_RADIUS_METERS = 6371008.8;
+    const double PI = 3.14159265358979323846;
+}
+
+Polyline::Polyline(const int precision) : factor_(std::pow(10.0, precision)), previous_lat_(0), previous_lon_(0) {}
+
+void Polyline::encodeValue(const int64_t value, std::string* encoded) {
+    // The value is shifted left and inverted if negative, so that the sign ends up in the lowest bit.
+    uint64_t shifted = value < 0 ? ~(uint64_t(value) << 1) : uint64_t(value) << 1;
+    // The value is split into 5 bit chunks, least significant first. Every chunk but the last is flagged with 0x20.
+    while (shifted >= 0x20) {
+        encoded->push_back(char((0x20 | (shifted & 0x1f)) + 63));
+        shifted >>= 5;
+    }
+    encoded->push_back(char(shifted + 63));
+}
+
+void Polyline::addPoint(const std::array<double, 2>& coordinates) {
+    const auto lat = int64_t(std::llround(coordinates[0] * factor_));
+    const auto lon = int64_t(std::llround(coordinates[1] * factor_));
+    encodeValue(lat - previous_lat_, &encoded_);
+    encodeValue(lon - previous_lon_, &encoded_);
+    previous_lat_ = lat;
+    previous_lon_ = lon;
+}
+
+std::string Polyline::encode(const std::vector<std::array<double, 2>>& coordinates, const int precision) {
+    Polyline polyline(precision);
+    for (const auto& point : coordinates) { polyline.addPoint(point); }
+    return polyline.getEncoded();
+}
+
+std::vector<std::array<double, 2>> Polyline::decode(const std::string& encoded, const int precision) {
+    const double factor = std::pow(10.0, precision);
+    std::vector<std::array<double, 2>> coordinates;
+    int64_t value[2] = {0, 0};
+    size_t i = 0;
+    while (i < encoded.size()) {
+        for (auto& component : value) {
+            uint64_t shifted = 0;
+            int shift = 0;
+            int chunk;
+            do {
+                if (i == encoded.size()) { throw std::logic_error("Malformed polyline. The last value is incomplete."); }
+                // A coordinate difference fits in seven chunks. Any more would shift bits out of the value.
+                if (shift > 30) { throw std::logic_error("Malformed polyline. A value has too many chunks."); }
+                chunk = encoded[i++] - 63;
+                if (chunk < 0 || chunk > 0x3f) { throw std::logic_error("Malformed polyline. Invalid character."); }
+                shifted |= uint64_t(chunk & 0x1f) << shift;
+                shift += 5;
+            } while (chunk >= 0x20);
+            component += (shifted & 1) ? ~int64_t(shifted >> 1) : int64_t(shifted >> 1);
+        }
+        coordinates.push_back({double(value[0]) / factor, double(value[1]) / factor});
+    }
+    return coordinates;
+}
+
+std::vector<std::array<double, 2>> Polyline::simplify(const std::vector<std::array<double, 2>>& coordinates, const double tolerance) {
+    if (coordinates.size() < 3 || tolerance <= 0) { return coordinates; }
+
+    // Routes span a small part of the globe, so the points are projected onto a plane that is tangent at the first point.
+    const double scale_y = EARTH_RADIUS_METERS * PI / 180;
+    const double scale_x = scale_y * std::cos(coordinates.front()[0] * PI / 180);
+    auto x = [&](size_t i) { return coordinates[i][1] * scale_x; };
+    auto y = [&](size_t i) { return coordinates[i][0] * scale_y; };
+
+    std::vector<bool> keep(coordinates.size(), false);
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> stack{{0, coordinates.size() - 1}};
+    while (!stack.empty()) {
+        const auto [first, last] = stack.back();
+        stack.pop_back();
+        const double dx = x(last) - x(first), dy = y(last) - y(first);
+        const double length_squared = dx * dx + dy * dy;
+
+        // Finds the point farthest from the segment between the first and last point.
+        double max_distance = 0;
+        size_t farthest = first;
+        for (size_t i = first + 1; i < last; i++) {
+            double t = length_squared > 0 ? ((x(i) - x(first)) * dx + (y(i) - y(first)) * dy) / length_squared : 0;
+            t = std::max(0.0, std::min(1.0, t));
+            const double distance = std::hypot(x(i) - x(first) - t * dx, y(i) - y(first) - t * dy);
+            if (distance > max_distance) {
+                max_distance = distance;
+                farthest = i;
+            }
+        }
+        if (max_distance > tolerance) {
+            keep[farthest] = true;
+            stack.emplace_back(first, farthest);
+            stack.emplace_back(farthest, last);
+        }
+    }
+
+    std::vector<std::array<double, 2>> simplified;
+    for (size_t i = 0; i < coordinates.size(); i++) {
+        if (keep[i]) { simplified.push_back(coordinates[i]); }
+    }
+    return simplified;
+}
@@ -0,0 +1,325 @@
+#include "QueryGraph.h"
+#include "Graph.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <stdexcept>
+
+QueryGraph::QueryGraph(const std::unordered_map<uint64_t, Vertex>& vertices,
+                       const std::unordered_map<uint64_t, std::unordered_map<uint64_t, uint64_t>>& shortcuts,
+                       const std::unordered_map<uint64_t, std::unordered_map<uint64_t, Edge>>& edges,
+                       const std::unordered_map<uint64_t, std::array<double, 2>>& locations,
+                       const Layout layout, const uint32_t unpack_threshold) {
+    // The vertices are numbered in the order in which they are stored in the graph.
+    std::vector<uint64_t> ids, orders;
+    std::unordered_map<uint64_t, uint32_t> indices;
+    ids.reserve(vertices.size());
+    orders.reserve(vertices.size());
+    indices.reserve(vertices.size());
+    for (const auto& [id, vertex] : vertices) {
+        indices.emplace(id, uint32_t(ids.size()));
+        ids.push_back(id);
+        orders.push_back(vertex.order);
+    }
+
+    // Shortcut edges record their middle vertex, and original edges record the segment that holds the OSM nodes that
+    // connect start and end.
+    auto to_edge = [&](uint64_t start, uint64_t end, uint64_t other, double weight) {
+        HierarchyEdge edge{indices.at(other), INVALID_INDEX, GeometryStore::NO_GEOMETRY, false, weight};
+        const auto shortcut = shortcuts.find(start);
+        if (shortcut != shortcuts.end() && shortcut->second.find(end) != shortcut->second.end()) {
+            edge.middle = indices.at(shortcut->second.at(end));
+        }
+        else {
+            const auto& original = edges.at(start).at(end);
+            edge.geometry = original.geometry;
+            edge.reversed = original.reversed;
+        }
+        return edge;
+    };
+    std::vector<std::vector<HierarchyEdge>> out_edges(ids.size()), in_edges(ids.size());
+    std::vector<std::array<double, 2>> vertex_locations;
+    vertex_locations.reserve(ids.size());
+    for (uint32_t i = 0; i < ids.size(); i++) {
+        const auto& vertex = vertices.at(ids[i]);
+        for (const auto& [head, weight] : vertex.out_edges) { out_edges[i].push_back(to_edge(ids[i], head, head, weight)); }
+        for (const auto& [head, weight] : vertex.in_edges) { in_edges[i].push_back(to_edge(head, ids[i], head, weight)); }
+        const auto location = locations.find(ids[i]);
+        if (location != locations.end()) { vertex_locations.push_back(location->second); }
+        else { vertex_locations.push_back({std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()}); }
+    }
+    build(ids, orders, out_edges, in_edges, vertex_locations, layout, unpack_threshold);
+}
+
+QueryGraph::QueryGraph(const std::vector<uint64_t>& ids, const std::vector<uint64_t>& orders, const std::vector<std::vector<HierarchyEdge>>& out_edges,
+                       const std::vector<std::vector<HierarchyEdge>>& in_edges, const std::vector<std::array<double, 2>>& locations,
+                       const Layout layout, const uint32_t unpack_threshold) {
+    build(ids, orders, out_edges, in_edges, locations, layout, unpack_threshold);
+}
+
+void QueryGraph::build(const std::vector<uint64_t>& ids, const std::vector<uint64_t>& orders, const std::vector<std::vector<HierarchyEdge>>& out_edges,
+                       const std::vector<std::vector<HierarchyEdge>>& in_edges, const std::vector<std::array<double, 2>>& locations,
+                       const Layout layout, const uint32_t unpack_threshold) {
+    // The vertices are stored in the order of the layout, and indices maps the given index of a vertex to its new index.
+    const std::vector<uint32_t> vertices = computeLayout(ids, orders, out_edges, in_edges, layout);
+    std::vector<uint32_t> indices(ids.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) { indices[vertices[i]] = i; }
+
+    std::vector<uint32_t> first_out{0}, first_in{0}, out_geometry{0}, in_geometry{0};
+    std::vector<QueryEdge> query_out_edges, query_in_edges;
+    std::vector<OriginalEdge> geometry;
+    first_out.reserve(ids.size() + 1);
+    first_in.reserve(ids.size() + 1);
+
+    // Adds an edge that leads to the vertex with the given new index when it is traveled.
+    auto add_edge = [&](const HierarchyEdge& edge, uint32_t end, std::vector<QueryEdge>* query_edges, std::vector<uint32_t>* offsets) {
+        uint32_t middle = INVALID_INDEX;
+        if (edge.middle != INVALID_INDEX) { middle = indices[edge.middle]; }
+        else { geometry.push_back(OriginalEdge{edge.geometry, end, edge.reversed}); }
+        query_edges->push_back(QueryEdge{indices[edge.vertex], middle, edge.weight});
+        offsets->push_back(uint32_t(geometry.size()));
+    };
+
+    // The edges of each vertex are stored contiguously in the order of the new vertex numbering. The geometry of the
+    // forward edges is stored before the geometry of the backward edges so that the geometry of every edge is contiguous.
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        for (const auto& edge : out_edges[vertices[i]]) { add_edge(edge, indices[edge.vertex], &query_out_edges, &out_geometry); }
+        first_out.push_back(uint32_t(query_out_edges.size()));
+    }
+    in_geometry.front() = uint32_t(geometry.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        for (const auto& edge : in_edges[vertices[i]]) { add_edge(edge, i, &query_in_edges, &in_geometry); }
+        first_in.push_back(uint32_t(query_in_edges.size()));
+    }
+
+    std::vector<uint64_t> vertex_ids;
+    std::vector<std::array<double, 2>> vertex_locations;
+    vertex_ids.reserve(ids.size());
+    vertex_locations.reserve(ids.size());
+    for (const auto& vertex : vertices) {
+        vertex_ids.push_back(ids[vertex]);
+        vertex_locations.push_back(locations[vertex]);
+    }
+
+    first_out_ = std::move(first_out);
+    first_in_ = std::move(first_in);
+    out_edges_ = std::move(query_out_edges);
+    in_edges_ = std::move(query_in_edges);
+    out_geometry_ = std::move(out_geometry);
+    in_geometry_ = std::move(in_geometry);
+    geometry_ = std::move(geometry);
+    ids_ = std::move(vertex_ids);
+    locations_ = std::move(vertex_locations);
+    buildIndex();
+
+    if (unpack_threshold > 0) { precomputeShortcutGeometry(unpack_threshold); }
+}
+
+void QueryGraph::buildIndex() {
+    std::vector<uint32_t> indices(ids_.size());
+    for (uint32_t i = 0; i < ids_.size(); i++) { indices[i] = i; }
+    std::sort(indices.begin(), indices.end(), [this](uint32_t a, uint32_t b) { return ids_[a] < ids_[b]; });
+    std::vector<uint64_t> sorted_ids;
+    sorted_ids.reserve(ids_.size());
+    for (const auto& index : indices) { sorted_ids.push_back(ids_[index]); }
+    sorted_ids_ = std::move(sorted_ids);
+    sorted_indices_ = std::move(indices);
+}
+
+uint32_t QueryGraph::getIndex(const uint64_t id) const {
+    const auto it = std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), id);
+    if (it == sorted_ids_.end() || *it != id) { return INVALID_INDEX; }
+    return sorted_indices_[it - sorted_ids_.begin()];
+}
+
+uint64_t QueryGraph::getNumBytes() const {
+    return first_out_.getNumBytes() + first_in_.getNumBytes() + out_edges_.getNumBytes() + in_edges_.getNumBytes() +
+           out_geometry_.getNumBytes() + in_geometry_.getNumBytes() + geometry_.getNumBytes() + ids_.getNumBytes() +
+           sorted_ids_.getNumBytes() + sorted_indices_.getNumBytes() + locations_.getNumBytes();
+}
+
+uint64_t QueryGraph::getNumAllocatedBytes() const {
+    return first_out_.getNumAllocatedBytes() + first_in_.getNumAllocatedBytes() + out_edges_.getNumAllocatedBytes() +
+           in_edges_.getNumAllocatedBytes() + out_geometry_.getNumAllocatedBytes() + in_geometry_.getNumAllocatedBytes() +
+           geometry_.getNumAllocatedBytes() + ids_.getNumAllocatedBytes() + sorted_ids_.getNumAllocatedBytes() +
+           sorted_indices_.getNumAllocatedBytes() + locations_.getNumAllocatedBytes();
+}
+
+void QueryGraph::saveFlat(FlatWriter& writer) const {
+    writer.writeArray(first_out_);
+    writer.writeArray(first_in_);
+    writer.writeArray(out_edges_);
+    writer.writeArray(in_edges_);
+    writer.writeArray(out_geometry_);
+    writer.writeArray(in_geometry_);
+    writer.writeArray(geometry_);
+    writer.writeArray(ids_);
+    writer.writeArray(sorted_ids_);
+    writer.writeArray(sorted_indices_);
+    writer.writeArray(locations_);
+}
+
+void QueryGraph::mapFlat(FlatReader& reader, const uint32_t num_segments) {
+    first_out_ = reader.readArray<uint32_t>();
+    first_in_ = reader.readArray<uint32_t>();
+    out_edges_ = reader.readArray<QueryEdge>();
+    in_edges_ = reader.readArray<QueryEdge>();
+    out_geometry_ = reader.readArray<uint32_t>();
+    in_geometry_ = reader.readArray<uint32_t>();
+    geometry_ = reader.readArray<OriginalEdge>();
+    ids_ = reader.readArray<uint64_t>();
+    sorted_ids_ = reader.readArray<uint64_t>();
+    sorted_indices_ = reader.readArray<uint32_t>();
+    locations_ = reader.readArray<std::array<double, 2>>();
+
+    // A search trusts every offset and index, so a corrupt file must be rejected here rather than read out of bounds.
+    const size_t num_vertices = ids_.size();
+    const auto is_valid_offsets = [](const FlatArray<uint32_t>& offsets, size_t size, size_t first, size_t last) {
+        if (offsets.size() != size + 1 || offsets[0] != first || offsets[size] != last) { return false; }
+        for (size_t i = 0; i < size; i++) {
+            if (offsets[i] > offsets[i + 1]) { return false; }
+        }
+        return true;
+    };
+    const auto is_valid_edge = [num_vertices](const QueryEdge& edge) {
+        return edge.head < num_vertices && (edge.middle == INVALID_INDEX || edge.middle < num_vertices);
+    };
+    const auto is_valid_original_edge = [num_vertices, num_segments](const OriginalEdge& edge) {
+        return edge.head < num_vertices && (edge.geometry == GeometryStore::NO_GEOMETRY || edge.geometry < num_segments);
+    };
+    bool valid = num_vertices < INVALID_INDEX && sorted_ids_.size() == num_vertices && sorted_indices_.size() == num_vertices &&
+                 locations_.size() == num_vertices && is_valid_offsets(first_out_, num_vertices, 0, out_edges_.size()) &&
+                 is_valid_offsets(first_in_, num_vertices, 0, in_edges_.size()) && !in_geometry_.empty() &&
+                 // The original edges of the backward edges follow those of the forward edges.
+                 is_valid_offsets(out_geometry_, out_edges_.size(), 0, in_geometry_[0]) &&
+                 is_valid_offsets(in_geometry_, in_edges_.size(), in_geometry_[0], geometry_.size()) &&
+                 std::all_of(out_edges_.begin(), out_edges_.end(), is_valid_edge) &&
+                 std::all_of(in_edges_.begin(), in_edges_.end(), is_valid_edge) &&
+                 std::all_of(geometry_.begin(), geometry_.end(), is_valid_original_edge);
+    // The index must map every vertex ID back to its vertex.
+    for (size_t i = 0; valid && i < num_vertices; i++) {
+        valid = sorted_indices_[i] < num_vertices && ids_[sorted_indices_[i]] == sorted_ids_[i] && (i == 0 || sorted_ids_[i - 1] < sorted_ids_[i]);
+    }
+    if (!valid) { throw std::logic_error("The flat file does not contain a valid query graph."); }
+}
+
+void QueryGraph::precomputeShortcutGeometry(const uint32_t unpack_threshold) {
+    std::vector<OriginalEdge> geometry, unpacked;
+    std::vector<uint32_t> out_geometry{0}, in_geometry;
+    geometry.reserve(geometry_.size());
+
+    // Copies the geometry of every edge into the new geometry array, unpacking the shortcut edges that are long enough.
+    auto copy_edges = [&](bool backward, std::vector<uint32_t>* new_offsets) {
+        const auto& query_edges = backward ? in_edges_ : out_edges_;
+        const auto& offsets = backward ? in_geometry_ : out_geometry_;
+        const auto& first = backward ? first_in_ : first_out_;
+        for (uint32_t index = 0; index < ids_.size(); index++) {
+            for (uint32_t position = first[index]; position < first[index + 1]; position++) {
+                if (query_edges[position].middle == INVALID_INDEX) {
+                    geometry.insert(geometry.end(), geometry_.begin() + offsets[position], geometry_.begin() + offsets[position + 1]);
+                }
+                else {
+                    // Edges of the backward search are traveled from their head to the vertex that stores them.
+                    const uint32_t tail = backward ? query_edges[position].head : index;
+                    const uint32_t head = backward ? index : query_edges[position].head;
+                    unpacked.clear();
+                    unpackEdge(tail, head, position, backward, &unpacked);
+                    if (unpacked.size() >= unpack_threshold) { geometry.insert(geometry.end(), unpacked.begin(), unpacked.end()); }
+                }
+                new_offsets->push_back(uint32_t(geometry.size()));
+            }
+        }
+    };
+    copy_edges(false, &out_geometry);
+    in_geometry.push_back(uint32_t(geometry.size()));
+    copy_edges(true, &in_geometry);
+
+    geometry_ = std::move(geometry);
+    out_geometry_ = std::move(out_geometry);
+    in_geometry_ = std::move(in_geometry);
+}
+
+uint32_t QueryGraph::findEdge(const uint32_t index, const uint32_t head, const bool backward) const {
+    const auto edges = getEdges(index, backward);
+    for (const auto& edge : edges) {
+        if (edge.head == head) { return getEdgePosition(&edge, backward); }
+    }
+    throw std::logic_error("The query graph does not contain an edge that a shortcut goes through.");
+}
+
+void QueryGraph::unpackEdge(const uint32_t tail, const uint32_t head, const uint32_t position, const bool backward, std::vector<OriginalEdge>* path,
+                            std::vector<double>* weights) const {
+    struct PendingEdge { uint32_t tail, head, position; bool backward; };
+    std::vector<PendingEdge> stack{PendingEdge{tail, head, position, backward}};
+
+    while (!stack.empty()) {
+        const auto pending = stack.back();
+        stack.pop_back();
+        const auto& edge = pending.backward ? in_edges_[pending.position] : out_edges_[pending.position];
+        const auto& offsets = pending.backward ? in_geometry_ : out_geometry_;
+
+        // Original edges and shortcut edges with precomputed geometry can be copied as is.
+        if (edge.middle == INVALID_INDEX || (!weights && offsets[pending.position] != offsets[pending.position + 1])) {
+            path->insert(path->end(), geometry_.begin() + offsets[pending.position], geometry_.begin() + offsets[pending.position + 1]);
+            if (weights) { weights->push_back(edge.weight); }
+            continue;
+        }
+
+        /**
+        * A shortcut tail -> head that goes through middle is made up of the edges tail -> middle and middle -> head. The
+        * middle vertex was contracted before both tail and head, so it stores both edges: tail -> middle with the edges
+        * of the backward search and middle -> head with the edges of the forward search. The second edge is pushed first
+        * so that the first edge is unpacked first.
+        */
+        const uint32_t middle = edge.middle;
+        stack.push_back(PendingEdge{middle, pending.head, findEdge(middle, pending.head, false), false});
+        stack.push_back(PendingEdge{pending.tail, middle, findEdge(middle, pending.tail, true), true});
+    }
+}
+
+std::vector<uint32_t> QueryGraph::computeLayout(const std::vector<uint64_t>& ids, const std::vector<uint64_t>& orders,
+                                                const std::vector<std::vector<HierarchyEdge>>& out_edges,
+                                                const std::vector<std::vector<HierarchyEdge>>& in_edges, const Layout layout) {
+    std::vector<uint32_t> vertices(ids.size());
+    for (uint32_t i = 0; i < ids.size(); i++) { vertices[i] = i; }
+    if (layout == Layout::INPUT) { return vertices; }
+
+    // The most important vertices come first. Ties are broken by ID so that the layout is deterministic.
+    std::sort(vertices.begin(), vertices.end(), [&](uint32_t a, uint32_t b) {
+        return orders[a] != orders[b] ? orders[a] > orders[b] : ids[a] < ids[b];
+    });
+    if (layout == Layout::RANK) { return vertices; }
+
+    /**
+    * The downward graph contains an edge u -> v for every upward edge v -> u of the query graph. A depth first
+    * traversal of the downward graph visits the vertices below u right after u, which means that the vertices settled
+    * by an upward search starting anywhere below u end up close together.
+    */
+    std::vector<uint32_t> rank(ids.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) { rank[vertices[i]] = i; }
+    std::vector<std::vector<uint32_t>> downward(ids.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        for (const auto& edge : out_edges[vertices[i]]) { downward[rank[edge.vertex]].push_back(i); }
+        for (const auto& edge : in_edges[vertices[i]]) { downward[rank[edge.vertex]].push_back(i); }
+    }
+
+    std::vector<uint32_t> layout_vertices;
+    std::vector<bool> visited(ids.size(), false);
+    std::vector<uint32_t> stack;
+    layout_vertices.reserve(ids.size());
+    for (uint32_t root = 0; root < ids.size(); root++) {
+        if (visited[root]) { continue; }
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const uint32_t u = stack.back();
+            stack.pop_back();
+            if (visited[u]) { continue; }
+            visited[u] = true;
+            layout_vertices.push_back(vertices[u]);
+            // Children are pushed in reverse so that the most important child is visited first.
+            for (auto it = downward[u].rbegin(); it != downward[u].rend(); ++it) {
+                if (!visited[*it]) { stack.push_back(*it); }
+            }
+        }
+    }
+    return layout_vertices;
+}
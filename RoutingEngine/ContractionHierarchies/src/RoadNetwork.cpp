@@ -0,0 +1,114 @@
+#include "RoadNetwork.h"
+#include "MappedFile.h"
+#include <algorithm>
+
+RoadNetwork::RoadNetwork(const std::vector<InputEdge>& edges, std::shared_ptr<std::unordered_map<uint64_t, std::array<double, 2>>> locations,
+                         std::shared_ptr<GeometryStore> geometry)
+        : locations_(std::move(locations)), geometry_(std::move(geometry)) {
+    std::vector<uint64_t> ids;
+    ids.reserve(2 * edges.size());
+    for (const auto& edge : edges) {
+        ids.push_back(edge.start);
+        ids.push_back(edge.end);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    ids.shrink_to_fit();
+    ids_ = FlatArray<uint64_t>(std::move(ids));
+
+    std::vector<uint32_t> tails, first_out(ids_.size() + 1, 0);
+    std::vector<OriginalEdge> original_edges;
+    std::vector<double> distances;
+    tails.reserve(edges.size());
+    original_edges.reserve(edges.size());
+    distances.reserve(edges.size());
+    for (const auto& edge : edges) {
+        const uint32_t tail = getIndex(edge.start);
+        tails.push_back(tail);
+        original_edges.push_back(OriginalEdge{edge.geometry, getIndex(edge.end), edge.reversed});
+        distances.push_back(edge.distance);
+        first_out[tail + 1]++;
+    }
+
+    // The numbers of the edges of every vertex are sorted, since the edges are placed in the order of their numbers.
+    for (size_t vertex = 0; vertex < ids_.size(); vertex++) { first_out[vertex + 1] += first_out[vertex]; }
+    std::vector<uint32_t> out_edges(original_edges.size());
+    std::vector<uint32_t> next(first_out.begin(), first_out.end() - 1);
+    for (uint32_t edge = 0; edge < original_edges.size(); edge++) { out_edges[next[tails[edge]]++] = edge; }
+
+    first_out_ = FlatArray<uint32_t>(std::move(first_out));
+    out_edges_ = FlatArray<uint32_t>(std::move(out_edges));
+    tails_ = FlatArray<uint32_t>(std::move(tails));
+    edges_ = FlatArray<OriginalEdge>(std::move(original_edges));
+    distances_ = FlatArray<double>(std::move(distances));
+}
+
+uint32_t RoadNetwork::getIndex(const uint64_t id) const {
+    const auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+    if (it == ids_.end() || *it != id) { return INVALID_INDEX; }
+    return uint32_t(it - ids_.begin());
+}
+
+uint32_t RoadNetwork::findEdge(const uint32_t tail, const uint32_t head, const FlatArray<double>& weights) const {
+    uint32_t found = INVALID_INDEX;
+    for (const auto& edge : getOutEdges(tail)) {
+        if (edges_[edge].head != head || weights[edge] == std::numeric_limits<double>::infinity()) { continue; }
+        if (found == INVALID_INDEX || weights[edge] < weights[found]) { found = edge; }
+    }
+    return found;
+}
+
+uint64_t RoadNetwork::getNumBytes() const {
+    return ids_.getNumBytes() + first_out_.getNumBytes() + out_edges_.getNumBytes() + tails_.getNumBytes() +
+           edges_.getNumBytes() + distances_.getNumBytes();
+}
+
+uint64_t RoadNetwork::getNumAllocatedBytes() const {
+    return ids_.getNumAllocatedBytes() + first_out_.getNumAllocatedBytes() + out_edges_.getNumAllocatedBytes() +
+           tails_.getNumAllocatedBytes() + edges_.getNumAllocatedBytes() + distances_.getNumAllocatedBytes();
+}
+
+void RoadNetwork::saveFlat(FlatWriter& writer) const {
+    writer.writeArray(ids_);
+    writer.writeArray(first_out_);
+    writer.writeArray(out_edges_);
+    writer.writeArray(tails_);
+    writer.writeArray(edges_);
+    writer.writeArray(distances_);
+}
+
+void RoadNetwork::mapFlat(FlatReader& reader, std::shared_ptr<GeometryStore> geometry) {
+    auto ids = reader.readArray<uint64_t>();
+    auto first_out = reader.readArray<uint32_t>();
+    auto out_edges = reader.readArray<uint32_t>();
+    auto tails = reader.readArray<uint32_t>();
+    auto edges = reader.readArray<OriginalEdge>();
+    auto distances = reader.readArray<double>();
+
+    // A corrupt file must not make the searches read out of bounds, so every offset and index is checked once here.
+    const size_t num_vertices = ids.size(), num_edges = edges.size();
+    bool valid = num_vertices < INVALID_INDEX && num_edges < INVALID_INDEX && first_out.size() == num_vertices + 1 &&
+                 out_edges.size() == num_edges && tails.size() == num_edges && distances.size() == num_edges &&
+                 first_out[0] == 0 && first_out.back() == num_edges;
+    for (size_t vertex = 1; valid && vertex < num_vertices; vertex++) { valid = ids[vertex - 1] < ids[vertex]; }
+    for (size_t vertex = 0; valid && vertex < num_vertices; vertex++) {
+        valid = first_out[vertex] <= first_out[vertex + 1];
+        for (uint32_t i = first_out[vertex]; valid && i < first_out[vertex + 1]; i++) {
+            valid = out_edges[i] < num_edges && tails[out_edges[i]] == vertex;
+        }
+    }
+    for (size_t edge = 0; valid && edge < num_edges; edge++) {
+        valid = edges[edge].head < num_vertices &&
+                (edges[edge].geometry == GeometryStore::NO_GEOMETRY || edges[edge].geometry < geometry->getNumSegments());
+    }
+    if (!valid) { throw std::logic_error("The flat file does not contain a valid road network."); }
+
+    ids_ = std::move(ids);
+    first_out_ = std::move(first_out);
+    out_edges_ = std::move(out_edges);
+    tails_ = std::move(tails);
+    edges_ = std::move(edges);
+    distances_ = std::move(distances);
+    locations_ = std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>();
+    geometry_ = std::move(geometry);
+}
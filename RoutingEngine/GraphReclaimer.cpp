@@ -0,0 +1,45 @@
+#include "GraphReclaimer.h"
+
+using namespace OSM;
+
+GraphReclaimer::GraphReclaimer() : thread_([this]() { run(); }) {}
+
+GraphReclaimer::~GraphReclaimer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_one();
+    thread_.join();
+    for (const auto* graph : pending_) { delete graph; }
+}
+
+void GraphReclaimer::run() {
+    std::vector<const Graph*> graphs;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [&]() { return stopping_ || !pending_.empty(); });
+            if (stopping_) { return; }
+            graphs.swap(pending_);
+        }
+        // The graphs are freed without holding the lock, so that releasing another graph never waits for them.
+        for (const auto* graph : graphs) { delete graph; }
+        graphs.clear();
+    }
+}
+
+void GraphReclaimer::release(const Graph* graph) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(graph);
+    }
+    queued_.notify_one();
+}
+
+std::shared_ptr<const Graph> GraphReclaimer::adopt(std::unique_ptr<const Graph> graph) {
+    // The deleter keeps the reclaimer alive until the graph has been queued.
+    return std::shared_ptr<const Graph>(graph.release(), [reclaimer = shared_from_this()](const Graph* released) {
+        reclaimer->release(released);
+    });
+}
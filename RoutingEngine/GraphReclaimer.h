@@ -0,0 +1,65 @@
+#ifndef OSMROUTINGENGINE_GRAPHRECLAIMER_H
+#define OSMROUTINGENGINE_GRAPHRECLAIMER_H
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "Graph.h"
+
+namespace OSM {
+
+    /**
+    * Frees replaced routing graphs on a background thread. A graph is freed by whichever thread drops the last reference
+    * to it, which is usually a query that started before the graph was replaced. Freeing a large graph takes a while, so
+    * a graph owned by the reclaimer is queued once it is no longer used, and the query that released it returns at once.
+    *
+    * Every graph holds a reference to the reclaimer, so the reclaimer outlives the graphs it owns even if they outlive
+    * the RoutingEngine. Graphs that are still queued when the reclaimer is destroyed are freed by its destructor.
+    */
+    class GraphReclaimer : public std::enable_shared_from_this<GraphReclaimer> {
+
+    private:
+
+        std::mutex mutex_;
+
+        // Signaled when a graph is queued or the reclaimer is stopped.
+        std::condition_variable queued_;
+
+        // The graphs that are no longer used and have not been freed yet.
+        std::vector<const Graph*> pending_;
+
+        bool stopping_ = false;
+
+        // Frees the queued graphs until the reclaimer is stopped.
+        std::thread thread_;
+
+        // Frees the queued graphs, waiting for more until the reclaimer is stopped.
+        void run();
+
+        /**
+         * Queues a graph that is no longer used, so that it is freed on the background thread.
+         * @param graph The graph.
+         */
+        void release(const Graph* graph);
+
+    public:
+
+        GraphReclaimer();
+
+        // Stops the background thread and frees any graphs that are still queued.
+        ~GraphReclaimer();
+
+        GraphReclaimer(const GraphReclaimer&) = delete;
+
+        GraphReclaimer& operator=(const GraphReclaimer&) = delete;
+
+        /**
+         * Takes ownership of a graph, so that it is freed on the background thread once the last reference to it is dropped.
+         * @param graph The graph.
+         * @return A shared pointer to the graph.
+         */
+        std::shared_ptr<const Graph> adopt(std::unique_ptr<const Graph> graph);
+    };
+}
+#endif //OSMROUTINGENGINE_GRAPHRECLAIMER_H
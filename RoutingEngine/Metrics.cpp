@@ -0,0 +1,215 @@
+#include "Metrics.h"
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace OSM;
+
+namespace {
+    // The upper bounds of the exported histogram buckets, in seconds: 1, 2.5, and 5 times every power of ten from one
+    // microsecond to ten seconds.
+    std::vector<double> getExportBounds() {
+        std::vector<double> bounds;
+        for (int exponent = -6; exponent < 1; exponent++) {
+            for (const double step : {1.0, 2.5, 5.0}) { bounds.push_back(step * std::pow(10.0, exponent)); }
+        }
+        bounds.push_back(10);
+        return bounds;
+    }
+
+    /**
+     * Formats a value as required by the Prometheus text format.
+     * @param value The value.
+     * @return The value, without trailing zeros.
+     */
+    std::string formatValue(const double value) {
+        if (std::isinf(value)) { return value > 0 ? "+Inf" : "-Inf"; }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+        return buffer;
+    }
+
+    /**
+     * Splits a metric name into the name of its family and its labels.
+     * @param name The metric name, e.g. graph_memory_bytes{component="geometry"}.
+     * @return The name of the family and the labels without braces, e.g. component="geometry".
+     */
+    std::pair<std::string, std::string> splitName(const std::string& name) {
+        const size_t brace = name.find('{');
+        if (brace == std::string::npos) { return {name, ""}; }
+        return {name.substr(0, brace), name.substr(brace + 1, name.size() - brace - 2)};
+    }
+
+    /**
+     * Builds the name of a sample with an additional label.
+     * @param name The name of the sample.
+     * @param labels The labels of the metric, which may be empty.
+     * @param extra An additional label, which may be empty.
+     * @return The name and labels of the sample.
+     */
+    std::string makeSeries(const std::string& name, const std::string& labels, const std::string& extra = "") {
+        if (labels.empty() && extra.empty()) { return name; }
+        if (labels.empty() || extra.empty()) { return name + "{" + labels + extra + "}"; }
+        return name + "{" + labels + "," + extra + "}";
+    }
+}
+
+size_t Metrics::getStripe() {
+    // Threads are assigned to stripes in turn, so that up to NUM_STRIPES threads never share one.
+    static std::atomic<size_t> next_stripe{0};
+    thread_local const size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) % NUM_STRIPES;
+    return stripe;
+}
+
+uint64_t Counter::get() const {
+    uint64_t value = 0;
+    for (const auto& stripe : stripes_) { value += stripe.value.load(std::memory_order_relaxed); }
+    return value;
+}
+
+LatencyHistogram::LatencyHistogram() : stripes_(std::make_unique<Stripe[]>(Metrics::NUM_STRIPES)) {}
+
+size_t LatencyHistogram::getBucket(const uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKETS) { return size_t(nanoseconds); }
+    // The position of the highest set bit selects the power of two, and the three bits below it the linear sub-bucket.
+    int magnitude = 63;
+    while (!(nanoseconds >> magnitude)) { magnitude--; }
+    const int shift = magnitude - 3;
+    return size_t(SUB_BUCKETS + uint64_t(shift) * SUB_BUCKETS + ((nanoseconds >> shift) - SUB_BUCKETS));
+}
+
+uint64_t LatencyHistogram::getUpperBound(const size_t bucket) {
+    if (bucket < SUB_BUCKETS) { return bucket; }
+    const uint64_t shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    const uint64_t sub_bucket = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub_bucket) << shift) + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(const uint64_t nanoseconds) {
+    auto& stripe = stripes_[Metrics::getStripe()];
+    stripe.counts[getBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const {
+    Snapshot snapshot;
+    snapshot.counts.assign(NUM_BUCKETS, 0);
+    for (size_t i = 0; i < Metrics::NUM_STRIPES; i++) {
+        const auto& stripe = stripes_[i];
+        for (size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+            snapshot.counts[bucket] += stripe.counts[bucket].load(std::memory_order_relaxed);
+        }
+        snapshot.sum += stripe.sum.load(std::memory_order_relaxed);
+    }
+    for (const auto& count : snapshot.counts) { snapshot.count += count; }
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::Snapshot::getQuantile(const double quantile) const {
+    if (count == 0) { return 0; }
+    // The rank of the quantile, counting from one.
+    const auto rank = std::max<uint64_t>(1, uint64_t(std::ceil(quantile * double(count))));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < counts.size(); bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank) { return getUpperBound(bucket); }
+    }
+    return getUpperBound(counts.size() - 1);
+}
+
+uint64_t LatencyHistogram::Snapshot::countAtMost(const uint64_t bound) const {
+    uint64_t total = 0;
+    for (size_t bucket = 0; bucket < counts.size() && getUpperBound(bucket) <= bound; bucket++) { total += counts[bucket]; }
+    return total;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::registerMetric(const std::string& name, const std::string& type, const std::string& help) {
+    auto& entry = entries_[name];
+    if (entry.type.empty()) {
+        entry.type = type;
+        entry.help = help;
+    }
+    else if (entry.type != type) { throw std::logic_error("The metric " + name + " is already registered as a " + entry.type + "."); }
+    return entry;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = registerMetric(name, "counter", help);
+    if (entry.gauge) { throw std::logic_error("The metric " + name + " is not a counter."); }
+    if (!entry.counter) { entry.counter = std::make_unique<Counter>(); }
+    return *entry.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = registerMetric(name, type, help);
+    if (entry.counter || entry.histogram) { throw std::logic_error("The metric " + name + " is not a gauge."); }
+    if (!entry.gauge) { entry.gauge = std::make_unique<Gauge>(); }
+    return *entry.gauge;
+}
+
+LatencyHistogram& MetricsRegistry::histogram(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = registerMetric(name, "histogram", help);
+    if (!entry.histogram) { entry.histogram = std::make_unique<LatencyHistogram>(); }
+    return *entry.histogram;
+}
+
+std::string MetricsRegistry::exportPrometheus() const {
+    static const std::vector<double> bounds = getExportBounds();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Metrics that differ only in their labels belong to the same family, which must be exported in one piece.
+    std::map<std::string, std::vector<std::pair<std::string, const Entry*>>> families;
+    for (const auto& entry : entries_) {
+        const auto name = splitName(entry.first);
+        families[name.first].emplace_back(name.second, &entry.second);
+    }
+
+    std::string text;
+    for (const auto& family : families) {
+        const auto& name = family.first;
+        const Entry& first = *family.second.front().second;
+        text += "# HELP " + name + " " + first.help + "\n";
+        text += "# TYPE " + name + " " + first.type + "\n";
+        for (const auto& metric : family.second) {
+            const auto& labels = metric.first;
+            const Entry& entry = *metric.second;
+            if (entry.counter) { text += makeSeries(name, labels) + " " + std::to_string(entry.counter->get()) + "\n"; }
+            else if (entry.gauge) { text += makeSeries(name, labels) + " " + formatValue(entry.gauge->get()) + "\n"; }
+            else {
+                const auto snapshot = entry.histogram->getSnapshot();
+                for (const auto& bound : bounds) {
+                    const auto count = snapshot.countAtMost(uint64_t(std::llround(bound * 1e9)));
+                    text += makeSeries(name + "_bucket", labels, "le=\"" + formatValue(bound) + "\"") + " " + std::to_string(count) + "\n";
+                }
+                text += makeSeries(name + "_bucket", labels, "le=\"+Inf\"") + " " + std::to_string(snapshot.count) + "\n";
+                text += makeSeries(name + "_sum", labels) + " " + formatValue(double(snapshot.sum) / 1e9) + "\n";
+                text += makeSeries(name + "_count", labels) + " " + std::to_string(snapshot.count) + "\n";
+            }
+        }
+    }
+    return text;
+}
+
+std::map<std::string, double> MetricsRegistry::getValues() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, double> values;
+    for (const auto& entry : entries_) {
+        const auto& name = entry.first;
+        if (entry.second.counter) { values[name] = double(entry.second.counter->get()); }
+        else if (entry.second.gauge) { values[name] = entry.second.gauge->get(); }
+        else {
+            const auto snapshot = entry.second.histogram->getSnapshot();
+            values[name + "_count"] = double(snapshot.count);
+            values[name + "_sum"] = double(snapshot.sum) / 1e9;
+            values[name + "_p50"] = double(snapshot.getQuantile(0.5)) / 1e9;
+            values[name + "_p90"] = double(snapshot.getQuantile(0.9)) / 1e9;
+            values[name + "_p99"] = double(snapshot.getQuantile(0.99)) / 1e9;
+            values[name + "_p999"] = double(snapshot.getQuantile(0.999)) / 1e9;
+        }
+    }
+    return values;
+}
@@ -0,0 +1,252 @@
+#ifndef OSMROUTINGENGINE_METRICS_H
+#define OSMROUTINGENGINE_METRICS_H
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace OSM {
+
+    namespace Metrics {
+
+        // The number of independent parts that every counter and histogram is split into. Each thread records into its
+        // own part, so threads rarely write to the same cache line.
+        const size_t NUM_STRIPES = 16;
+
+        /**
+         * Retrieves the part of the counters and histograms that the calling thread records into.
+         * @return The index of the part, which is fixed for the lifetime of the thread.
+         */
+        size_t getStripe();
+    }
+
+    // A monotonically increasing counter. Incrementing it is lock-free.
+    class Counter {
+
+    private:
+
+        struct alignas(64) Stripe { std::atomic<uint64_t> value{0}; };
+
+        std::array<Stripe, Metrics::NUM_STRIPES> stripes_;
+
+    public:
+
+        void add(uint64_t value = 1) { stripes_[Metrics::getStripe()].value.fetch_add(value, std::memory_order_relaxed); }
+
+        /**
+         * Retrieves the value of the counter.
+         * @return The sum of all increments so far.
+         */
+        uint64_t get() const;
+    };
+
+    // A value that can go up and down, such as the size of the graph.
+    class Gauge {
+
+    private:
+
+        std::atomic<double> value_{0};
+
+    public:
+
+        void set(double value) { value_.store(value, std::memory_order_relaxed); }
+
+        double get() const { return value_.load(std::memory_order_relaxed); }
+    };
+
+    /**
+    * A histogram of latencies in the style of HdrHistogram: the buckets are spaced logarithmically, and every power of two
+    * is split into SUB_BUCKETS linearly spaced buckets. Any latency from one nanosecond to several centuries is recorded
+    * with a relative error of at most 1 / SUB_BUCKETS, in a fixed amount of memory. Recording a latency is lock-free.
+    */
+    class LatencyHistogram {
+
+    public:
+
+        // The number of buckets per power of two.
+        static constexpr uint64_t SUB_BUCKETS = 8;
+
+        // The total number of buckets.
+        static constexpr size_t NUM_BUCKETS = SUB_BUCKETS + (64 - 3) * SUB_BUCKETS;
+
+        // The counts of a histogram at one point in time.
+        struct Snapshot {
+
+            // The number of latencies recorded in every bucket.
+            std::vector<uint64_t> counts;
+
+            // The number of latencies recorded and their sum, in nanoseconds.
+            uint64_t count = 0, sum = 0;
+
+            /**
+             * Estimates a quantile of the recorded latencies.
+             * @param quantile The quantile, between 0 and 1 (e.g. 0.99 for the 99th percentile).
+             * @return The upper bound of the bucket that contains the quantile, in nanoseconds, or 0 if nothing was recorded.
+             */
+            uint64_t getQuantile(double quantile) const;
+
+            /**
+             * Counts the latencies that are certainly no larger than a bound.
+             * @param bound The bound, in nanoseconds.
+             * @return The number of latencies recorded in buckets whose upper bound does not exceed the bound.
+             */
+            uint64_t countAtMost(uint64_t bound) const;
+        };
+
+    private:
+
+        struct alignas(64) Stripe {
+            std::array<std::atomic<uint64_t>, NUM_BUCKETS> counts{};
+            std::atomic<uint64_t> sum{0};
+        };
+
+        std::unique_ptr<Stripe[]> stripes_;
+
+    public:
+
+        LatencyHistogram();
+
+        /**
+         * Determines the bucket that a latency is recorded in.
+         * @param nanoseconds The latency.
+         * @return The index of the bucket.
+         */
+        static size_t getBucket(uint64_t nanoseconds);
+
+        /**
+         * Retrieves the largest latency that is recorded in a bucket.
+         * @param bucket The index of the bucket.
+         * @return The largest latency in the bucket, in nanoseconds.
+         */
+        static uint64_t getUpperBound(size_t bucket);
+
+        /**
+         * Records a latency.
+         * @param nanoseconds The latency.
+         */
+        void record(uint64_t nanoseconds);
+
+        /**
+         * Retrieves the counts of the histogram. Latencies recorded while the snapshot is taken may or may not be included.
+         * @return The counts of the histogram.
+         */
+        Snapshot getSnapshot() const;
+    };
+
+    /**
+    * Counts a request when it is constructed and, when it goes out of scope, either records the latency of the request
+    * or counts it as failed if the scope is left by an exception.
+    */
+    class RequestTimer {
+
+    private:
+
+        LatencyHistogram& latency_;
+
+        Counter& errors_;
+
+        std::chrono::steady_clock::time_point start_;
+
+        int exceptions_;
+
+    public:
+
+        /**
+         * A constructor for the RequestTimer class.
+         * @param requests The counter of requests, which is incremented immediately.
+         * @param latency The histogram that the latency of a successful request is recorded in.
+         * @param errors The counter of failed requests.
+         */
+        RequestTimer(Counter& requests, LatencyHistogram& latency, Counter& errors)
+            : latency_(latency), errors_(errors), start_(std::chrono::steady_clock::now()), exceptions_(std::uncaught_exceptions()) {
+            requests.add();
+        }
+
+        ~RequestTimer() {
+            if (std::uncaught_exceptions() > exceptions_) { errors_.add(); return; }
+            latency_.record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()));
+        }
+
+        RequestTimer(const RequestTimer&) = delete;
+
+        RequestTimer& operator=(const RequestTimer&) = delete;
+    };
+
+    /**
+    * A collection of named metrics that can be exported in the Prometheus text exposition format. Metrics are registered
+    * once, which takes a lock, and the returned reference is then used to record values without any locking.
+    *
+    * A metric name may carry labels in the Prometheus syntax, e.g. graph_memory_bytes{component="geometry"}. Metrics that
+    * share a name but differ in their labels are exported as one metric family.
+    */
+    class MetricsRegistry {
+
+    private:
+
+        // The type, help text, and value of a metric. Exactly one of the values is set.
+        struct Entry {
+            std::string type;
+            std::string help;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Gauge> gauge;
+            std::unique_ptr<LatencyHistogram> histogram;
+        };
+
+        mutable std::mutex mutex_;
+
+        // The metrics, ordered by name so that the export is deterministic.
+        std::map<std::string, Entry> entries_;
+
+        Entry& registerMetric(const std::string& name, const std::string& type, const std::string& help);
+
+    public:
+
+        /**
+         * Registers a counter, or retrieves it if it has already been registered.
+         * @param name The name of the counter, optionally with labels. By convention, the name ends in _total.
+         * @param help A description of the counter.
+         * @return The counter. Remains valid for the lifetime of the registry.
+         */
+        Counter& counter(const std::string& name, const std::string& help);
+
+        /**
+         * Registers a gauge, or retrieves it if it has already been registered.
+         * @param name The name of the gauge, optionally with labels.
+         * @param help A description of the gauge.
+         * @param type The type under which the gauge is exported. A value that is copied from a counter maintained
+         * elsewhere can be exported as a "counter".
+         * @return The gauge. Remains valid for the lifetime of the registry.
+         */
+        Gauge& gauge(const std::string& name, const std::string& help, const std::string& type = "gauge");
+
+        /**
+         * Registers a latency histogram, or retrieves it if it has already been registered.
+         * @param name The name of the histogram. By convention, the name ends in _seconds.
+         * @param help A description of the histogram.
+         * @return The histogram. Remains valid for the lifetime of the registry.
+         */
+        LatencyHistogram& histogram(const std::string& name, const std::string& help);
+
+        /**
+         * Exports all metrics in the Prometheus text exposition format. Histograms are exported in seconds with a fixed
+         * set of buckets from one microsecond to ten seconds.
+         * @return The metrics, one sample per line.
+         */
+        std::string exportPrometheus() const;
+
+        /**
+         * Retrieves the current value of all metrics. Every histogram is summarized by its count, its sum in seconds, and
+         * its median, 90th, 99th, and 99.9th percentiles in seconds, reported as <name>_count, <name>_sum, <name>_p50,
+         * <name>_p90, <name>_p99, and <name>_p999.
+         * @return A map from metric names to values.
+         */
+        std::map<std::string, double> getValues() const;
+    };
+}
+#endif //OSMROUTINGENGINE_METRICS_H
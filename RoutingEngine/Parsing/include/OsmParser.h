@@ -4,8 +4,10 @@
 #include <vector>
 #include <string>
 #include <array>
+#include <cstdint>
 #include "pugixml.hpp"
 #include "Graph.h"
+#include "Profile.h"
 
 // The way struct is used to store all the basic information found in an OSM way.
 struct Way {
@@ -28,6 +30,71 @@ struct Way {
     Way(std::vector<uint64_t>   way_node_refs, std::unordered_map<std::string, std::string>   way_tags);
 };
 
+// Assigns a small integer code to every distinct string that it is given, so that a string is stored and hashed once
+// and can then be compared by its code.
+class StringTable {
+
+private:
+
+    // Maps every string to its code.
+    std::unordered_map<std::string, uint32_t> codes_;
+
+    // The strings in the order of their codes.
+    std::vector<std::string> strings_;
+
+public:
+
+    // The code that is returned for a string that is not in the table.
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    /**
+     * Retrieves the code of a string, adding the string to the table if it is not in it yet.
+     * @param string The string.
+     * @return The code of the string.
+     */
+    uint32_t intern(const char* string);
+
+    /**
+     * Retrieves the code of a string without adding it to the table.
+     * @param string The string.
+     * @return The code of the string, or NONE if the string is not in the table.
+     */
+    uint32_t find(const std::string& string) const;
+
+    const std::string& get(uint32_t code) const { return strings_[code]; }
+
+    uint32_t size() const { return uint32_t(strings_.size()); }
+};
+
+/**
+* The ways that are used for routing, stored in a few flat arrays instead of in a Way for every way. The node
+* references of all ways are appended to one array, and the values of the tags that matter for routing are interned.
+*/
+struct WayStore {
+
+    // The tags that are kept for routing. A tag is identified by its position in this list.
+    enum Tag { HIGHWAY, ONEWAY, MAXSPEED, ACCESS, VEHICLE, MOTOR_VEHICLE, MOTORCAR, HGV, BICYCLE, NUM_TAGS };
+    static constexpr std::array<const char*, NUM_TAGS> TAG_KEYS{"highway", "oneway", "maxspeed", "access", "vehicle",
+                                                                "motor_vehicle", "motorcar", "hgv", "bicycle"};
+
+    // The node references of every way. The references of way i are stored in node_refs, from position first_ref[i]
+    // up to (but not including) position first_ref[i + 1].
+    std::vector<uint64_t> node_refs;
+    std::vector<size_t> first_ref{0};
+
+    // The codes of the tag values of every way in tag_values, or StringTable::NONE if the way does not have the tag.
+    std::vector<std::array<uint32_t, NUM_TAGS>> tags;
+
+    // The values of the tags.
+    StringTable tag_values;
+
+    size_t size() const { return tags.size(); }
+
+    const uint64_t* getNodeRefsBegin(const size_t way) const { return node_refs.data() + first_ref[way]; }
+
+    const uint64_t* getNodeRefsEnd(const size_t way) const { return node_refs.data() + first_ref[way + 1]; }
+};
+
 /**
 * The primary purpose of this class is to gather the relevant data for route planning from an OpenStreetMaps (OSM) file.
 * Note that an OSM file is an identical to an XML file. See https://www.openstreetmap.org/#map=18/30.26889/-97.74373 in
@@ -61,12 +128,29 @@ private:
                                                                      {"busway", 35},
                                                                  };
 
-    // Way tags that are important for preparing the routing data.
-    const std::unordered_set<std::string> ACCEPTED_TAGS{ "highway", "oneway", "maxspeed"};
-
     // The OSM file to be parsed.
     pugi::xml_document doc;
 
+    /**
+     * Splits the ways that any of the profiles can use into edges between intersections, and stores the OSM nodes of
+     * every edge in the geometry store. Throws an exception if a profile uses an unknown access tag.
+     * @tparam Function A callable that accepts the IDs of the start and end vertex of an edge, the segment that holds its
+     * OSM nodes, whether it is bidirectional, its travel time for every profile (infinite if a profile cannot use it),
+     * and its length.
+     * @param ways The ways that are used for routing, see getRoutingData.
+     * @param locations The coordinates of the OSM nodes.
+     * @param node_links The number of times that every OSM node appears in the ways.
+     * @param profiles The routing profiles.
+     * @param time_units The type of time units to use (i.e. "seconds", "minutes", or "hours").
+     * @param distance_units The type of distance units to use (i.e. "kilometers" or "miles").
+     * @param geometry The geometry store that the segments are added to.
+     * @param function The function that is called for every edge.
+     */
+    template <class Function>
+    void splitWays(const WayStore& ways, const std::unordered_map<uint64_t, std::array<double, 2>>& locations,
+                   const std::unordered_map<uint64_t, int>& node_links, const std::vector<Profile>& profiles,
+                   const std::string& time_units, const std::string& distance_units, GeometryStore* geometry, Function function) const;
+
 public:
 
     /**
@@ -89,11 +173,12 @@ public:
     std::vector<Way> getAllWays() const;
 
     /**
-     * This function will only retrieve the ways and locations that will be used in the road network graph.
+     * This function will only retrieve the ways and locations that will be used in the road network graph. Only the
+     * tags in WayStore::TAG_KEYS are kept.
      * @return a tuple that contains the ways and locations that will be used for routing, as well as an unordered map
      * that maps OSM Node IDs to the number of times that they appear in the ways (used for way splitting).
      */
-    std::tuple<std::vector<Way>, std::unordered_map<uint64_t, std::array<double, 2>>, std::unordered_map<uint64_t, int>> getRoutingData() const;
+    std::tuple<WayStore, std::unordered_map<uint64_t, std::array<double, 2>>, std::unordered_map<uint64_t, int>> getRoutingData() const;
 
     /**
      * This function will construct a weighted, directed graph from the data in the OSM file.
@@ -107,4 +192,30 @@ public:
      * @return A road network graph that can be used for routing.
      */
     Graph constructRoadNetworkGraph(bool time = true, const std::string& time_units = "minutes", const std::string& distance_units = "miles") const;
+
+    /**
+     * This function will construct a road network graph that only contains the roads that a routing profile can use,
+     * weighted by the speeds of the profile. Unlike the graphs built by constructRoadNetworkGraphs, the graph stores its
+     * own vertices and edges, so it can be modified and searched with the standard search. Throws an exception if the
+     * profile uses an unknown access tag.
+     * @param profile The routing profile.
+     * @param time_units The type of time units to use (i.e. "seconds", "minutes", or "hours").
+     * @param distance_units The type of distance units to use (i.e. "kilometers" or "miles").
+     * @return A road network graph that can be used for routing.
+     */
+    Graph constructRoadNetworkGraph(const Profile& profile, const std::string& time_units = "minutes", const std::string& distance_units = "miles") const;
+
+    /**
+     * This function will construct a road network graph for every routing profile from the data in the OSM file. The
+     * OSM file is only parsed once, and the graphs share a single road network (see RoadNetwork) that holds every road
+     * that any of the profiles can use, along with the locations of the vertices and the geometry of the roads. Every
+     * profile only adds the weight of every road, and later its own query graph. The graphs must be contracted before
+     * they are searched. Throws an exception if a profile uses an unknown access tag.
+     * @param profiles The routing profiles.
+     * @param time_units The type of time units to use (i.e. "seconds", "minutes", or "hours").
+     * @param distance_units The type of distance units to use (i.e. "kilometers" or "miles").
+     * @return A road network graph for every profile, in the same order as the profiles.
+     */
+    std::vector<Graph> constructRoadNetworkGraphs(const std::vector<Profile>& profiles, const std::string& time_units = "minutes",
+                                                  const std::string& distance_units = "miles") const;
 };
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <string>
+
+/**
+* A routing profile describes how one kind of vehicle uses the road network: how fast it travels on every type of road,
+* which roads it may not use, and which access tags apply to it. Several profiles can be built from one OSM file at
+* once, see Parser::constructRoadNetworkGraphs.
+*/
+struct Profile {
+
+    // The name of the profile, e.g. "car".
+    std::string name;
+
+    // The speed limit in miles per hour for the values of the highway tag. Used since OSM files often do not include
+    // speed limits.
+    std::unordered_map<std::string, int> speed_mph;
+
+    // The speed limit of roads whose highway value is not in speed_mph.
+    int default_speed_mph = 35;
+
+    // The values of the highway tag of roads that cannot be used, e.g. "motorway" for bicycles.
+    std::unordered_set<std::string> excluded_highways;
+
+    // The access tags that apply, from the most general to the most specific, e.g. "access", "vehicle" and
+    // "motor_vehicle". The most specific tag that a way has decides whether the way can be used. Every tag must be
+    // one of WayStore::TAG_KEYS.
+    std::vector<std::string> access_tags;
+
+    // The values of an access tag that forbid using a way.
+    std::unordered_set<std::string> denied_access{"no", "private"};
+
+    // Indicates whether the edges are weighted by time rather than by distance.
+    bool time = true;
+
+    /**
+     * Retrieves the speed limit of a type of road.
+     * @param highway The value of the highway tag of the road.
+     * @return The speed limit in miles per hour.
+     */
+    int getSpeed(const std::string& highway) const;
+
+    // Profiles for cars, trucks and bicycles.
+    static Profile car();
+    static Profile truck();
+    static Profile bicycle();
+};
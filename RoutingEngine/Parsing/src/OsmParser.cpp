@@ -1,11 +1,25 @@
 #include "Weighting.h"
 #include "OsmParser.h"
 #include <utility>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 
 Way::Way(std::vector<uint64_t> way_node_refs, std::unordered_map<std::string, std::string> way_tags)
         : node_refs(std::move(way_node_refs)), tags(std::move(way_tags))
 {}
 
+uint32_t StringTable::intern(const char* string) {
+    const auto [it, inserted] = codes_.emplace(string, uint32_t(strings_.size()));
+    if (inserted) { strings_.push_back(it->first); }
+    return it->second;
+}
+
+uint32_t StringTable::find(const std::string& string) const {
+    const auto it = codes_.find(string);
+    return it == codes_.end() ? NONE : it->second;
+}
+
 Parser::Parser(const char* osm_filename) {
     if (!doc.load_file(osm_filename)) { throw std::runtime_error("Could not open OSM file."); }
 }
@@ -49,113 +63,219 @@ std::vector<Way> Parser::getAllWays() const {
     return ways;
 }
 
-std::tuple<std::vector<Way>, std::unordered_map<uint64_t, std::array<double, 2>>, std::unordered_map<uint64_t, int>> Parser::getRoutingData() const {
-    std::vector<Way> ways;
+std::tuple<WayStore, std::unordered_map<uint64_t, std::array<double, 2>>, std::unordered_map<uint64_t, int>> Parser::getRoutingData() const {
+    WayStore ways;
     std::unordered_map<uint64_t, int> node_links;
     auto locations = getLocations();
     auto xpath_ways = doc.select_nodes("/osm/way");
     node_links.reserve(locations.size());
-    ways.reserve(xpath_ways.size());
+    ways.first_ref.reserve(xpath_ways.size() + 1);
+    ways.tags.reserve(xpath_ways.size());
 
     /**
     * Loops through all of the ways in the data. Records their node references and any important tags.
     * This is essentially identical to the getAllWays method. However, in this case, we throw out any ways
-    * that are not useful for routing and only record accepted tags.
+    * that are not useful for routing and only record accepted tags. The node references are appended to the
+    * references of the previous ways, and are dropped again if the way is thrown out.
     */
     for (const auto& xpath_way : xpath_ways) {
-        std::unordered_map<std::string, std::string> way_tags;
-        std::vector<uint64_t> way_node_refs;
         auto way = xpath_way.node();
-        way_node_refs.reserve(std::distance(way.children("nd").begin(), way.children("nd").end()));
-
+        const size_t first_ref = ways.node_refs.size();
         for (const auto& node : way.children("nd")) {
             // We ignore any node references that do not have a corresponding node.
-            if (locations.find(node.attribute("ref").as_ullong()) != locations.end()) {
-                way_node_refs.push_back(node.attribute("ref").as_ullong());
-            }
+            const uint64_t node_ref = node.attribute("ref").as_ullong();
+            if (locations.find(node_ref) != locations.end()) { ways.node_refs.push_back(node_ref); }
         }
 
         // We ignore any ways that contain less than two nodes.
-        if (way_node_refs.size() < 2) { continue; }
+        if (ways.node_refs.size() - first_ref < 2) {
+            ways.node_refs.resize(first_ref);
+            continue;
+        }
 
         /**
         * We need to record how many times a node is seen for the splitting process later on.
         * A node that is seen more than once is an intersection and will be used as a Vertex in the graph data structure.
         */
-        for (const auto& node_ref : way_node_refs) {
-            node_links[node_ref]++;
+        for (size_t i = first_ref; i < ways.node_refs.size(); i++) {
+            node_links[ways.node_refs[i]]++;
         }
+
+        // The tag keys are matched against the few accepted keys, and only the values of accepted tags are interned.
+        std::array<uint32_t, WayStore::NUM_TAGS> way_tags;
+        way_tags.fill(StringTable::NONE);
         for (const auto& tag : way.children("tag")) {
-            std::string tag_key = tag.attribute("k").value(), tag_value = tag.attribute("v").value();
-            if (ACCEPTED_TAGS.find(tag_key) != ACCEPTED_TAGS.end()) { way_tags[tag_key] = tag_value; }
+            const char* tag_key = tag.attribute("k").value();
+            for (int key = 0; key < WayStore::NUM_TAGS; key++) {
+                if (std::strcmp(tag_key, WayStore::TAG_KEYS[key]) == 0) { way_tags[key] = ways.tag_values.intern(tag.attribute("v").value()); }
+            }
         }
 
         // If the way has no highway tag, then it cannot be used for routing.
-        if (way_tags.find("highway") != way_tags.end()) { ways.emplace_back(way_node_refs, way_tags); }
+        if (way_tags[WayStore::HIGHWAY] == StringTable::NONE) {
+            ways.node_refs.resize(first_ref);
+            continue;
+        }
+        ways.first_ref.push_back(ways.node_refs.size());
+        ways.tags.push_back(way_tags);
     }
 
-    return std::make_tuple(ways, locations, node_links);
+    return std::make_tuple(std::move(ways), std::move(locations), std::move(node_links));
 }
 
-Graph Parser::constructRoadNetworkGraph(bool time, const std::string& time_units, const std::string& distance_units) const {
-    auto routing_data = getRoutingData();
-    std::vector<Way>* ways = &std::get<0>(routing_data);
-    std::unordered_map<uint64_t, std::array<double, 2>>* locations = &std::get<1>(routing_data);
-    Graph graph(*locations);
-    std::unordered_map<uint64_t, int>* node_links = &std::get<2>(routing_data);
-    std::vector<uint64_t> edge_nodes;
+template <class Function>
+void Parser::splitWays(const WayStore& ways, const std::unordered_map<uint64_t, std::array<double, 2>>& locations,
+                       const std::unordered_map<uint64_t, int>& node_links, const std::vector<Profile>& profiles,
+                       const std::string& time_units, const std::string& distance_units, GeometryStore* geometry, Function function) const {
+    // The rules of every profile are resolved once for every distinct tag value, rather than once for every way.
+    struct ResolvedProfile {
+        std::vector<int> speed_mph;
+        std::vector<bool> excluded, denied;
+        std::vector<int> access_tags;
+    };
+    std::vector<ResolvedProfile> resolved(profiles.size());
+    for (size_t i = 0; i < profiles.size(); i++) {
+        const Profile& profile = profiles[i];
+        for (uint32_t value = 0; value < ways.tag_values.size(); value++) {
+            const std::string& string = ways.tag_values.get(value);
+            resolved[i].speed_mph.push_back(profile.getSpeed(string));
+            resolved[i].excluded.push_back(profile.excluded_highways.count(string) > 0);
+            resolved[i].denied.push_back(profile.denied_access.count(string) > 0);
+        }
+        for (const auto& access_tag : profile.access_tags) {
+            const auto it = std::find_if(WayStore::TAG_KEYS.begin(), WayStore::TAG_KEYS.end(), [&](const char* key) { return access_tag == key; });
+            if (it == WayStore::TAG_KEYS.end()) { throw std::logic_error("Access tag " + access_tag + " of profile " + profile.name + " is not supported."); }
+            resolved[i].access_tags.push_back(int(it - WayStore::TAG_KEYS.begin()));
+        }
+    }
+    const uint32_t oneway_no = ways.tag_values.find("no");
+
+    // Indicates whether a profile may use a way. The most specific access tag of the way decides.
+    const auto isAccessible = [&](const ResolvedProfile& profile, const std::array<uint32_t, WayStore::NUM_TAGS>& tags) {
+        if (profile.excluded[tags[WayStore::HIGHWAY]]) { return false; }
+        for (auto tag = profile.access_tags.rbegin(); tag != profile.access_tags.rend(); ++tag) {
+            if (tags[*tag] != StringTable::NONE) { return !profile.denied[tags[*tag]]; }
+        }
+        return true;
+    };
 
     /**
     * We now split the ways into edges that will be used in a weighted, directed graph. A split is made if a node is present in more than one
-    * way (i.e. an intersection).
+    * way (i.e. an intersection). The split points are the same for every profile, so the edges of a road share a segment of the geometry.
     */
-    int counter = 0;
-    for (auto & way : *ways) {
-        int right_idx = 1;
-        int left_idx = 0;
-        double time_weight = 0.0;
+    std::vector<uint64_t> edge_nodes;
+    std::vector<std::array<double, 2>> edge_coordinates;
+    std::vector<size_t> way_profiles;
+    std::vector<double> time_weights(profiles.size());
+    for (size_t way = 0; way < ways.size(); way++) {
+        const auto& tags = ways.tags[way];
+        way_profiles.clear();
+        for (size_t i = 0; i < profiles.size(); i++) {
+            if (isAccessible(resolved[i], tags)) { way_profiles.push_back(i); }
+        }
+        if (way_profiles.empty()) { continue; }
+
+        const uint64_t* node_refs = ways.getNodeRefsBegin(way);
+        const size_t num_node_refs = ways.getNodeRefsEnd(way) - node_refs;
+        // Checking if Edge is bidirectional.
+        const bool bidirectional = tags[WayStore::ONEWAY] == StringTable::NONE || tags[WayStore::ONEWAY] == oneway_no;
+        size_t right_idx = 1;
+        size_t left_idx = 0;
+        // The profiles that cannot use the way keep an infinite travel time.
+        std::fill(time_weights.begin(), time_weights.end(), std::numeric_limits<double>::infinity());
+        for (const size_t i : way_profiles) { time_weights[i] = 0.0; }
         double distance_weight = 0.0;
-        counter++;
 
-        while (right_idx < way.node_refs.size()) {
-            int speed_mph = 35;
-            if (DEFAULT_SPEED_MPH.find(way.tags.at("highway")) != DEFAULT_SPEED_MPH.end()) {
-                speed_mph = DEFAULT_SPEED_MPH.at(way.tags.at("highway"));
-            }
+        while (right_idx < num_node_refs) {
+            const auto& previous = locations.at(node_refs[right_idx - 1]);
+            const auto& current = locations.at(node_refs[right_idx]);
             // Travel time between intersections in time_units.
-            time_weight += Weighting::time(locations->at(way.node_refs[right_idx - 1])[0],
-                                           locations->at(way.node_refs[right_idx - 1])[1],
-                                            locations->at(way.node_refs[right_idx])[0],
-                                            locations->at(way.node_refs[right_idx])[1],
-                                            speed_mph, time_units);
+            for (const size_t i : way_profiles) {
+                time_weights[i] += Weighting::time(previous[0], previous[1], current[0], current[1],
+                                                   resolved[i].speed_mph[tags[WayStore::HIGHWAY]], time_units);
+            }
             // Distance between intersections in distance_units.
-            distance_weight += Weighting::haversineDist(locations->at(way.node_refs[right_idx - 1])[0],
-                                                        locations->at(way.node_refs[right_idx - 1])[1],
-                                                        locations->at(way.node_refs[right_idx])[0],
-                                                        locations->at(way.node_refs[right_idx])[1],
-                                                        distance_units);
-
-            if (node_links->at(way.node_refs[right_idx]) > 1 || right_idx == way.node_refs.size() - 1) {
-                // The start and end node IDs of an edge.
-                uint64_t start = way.node_refs[left_idx];
-                uint64_t end = way.node_refs[right_idx];
-
-                // The node IDs that make up the edge.
-                edge_nodes = std::vector<uint64_t>(way.node_refs.begin() + left_idx + 1, way.node_refs.begin() + right_idx );
-
-                // Checking if Edge is bidirectional.
-                if (way.tags.find("oneway") == way.tags.end() || way.tags.at("oneway") == "no") {
-                    graph.addEdge(start, end, &edge_nodes, time_weight, distance_weight, true, time);
-                }
-                else {
-                    graph.addEdge(start, end, &edge_nodes, time_weight, distance_weight, false, time);
-                }
+            distance_weight += Weighting::haversineDist(previous[0], previous[1], current[0], current[1], distance_units);
+
+            if (node_links.at(node_refs[right_idx]) > 1 || right_idx == num_node_refs - 1) {
+                // The node IDs that make up the edge are stored once and shared by every profile.
+                edge_nodes.assign(node_refs + left_idx + 1, node_refs + right_idx);
+                edge_coordinates.clear();
+                for (const auto& node : edge_nodes) { edge_coordinates.push_back(locations.at(node)); }
+                const uint32_t segment = geometry->addSegment(edge_nodes, edge_coordinates);
+
+                function(node_refs[left_idx], node_refs[right_idx], segment, bidirectional, time_weights, distance_weight);
+                for (const size_t i : way_profiles) { time_weights[i] = 0.0; }
                 left_idx = right_idx;
-                time_weight = 0.0;
                 distance_weight = 0.0;
             }
             right_idx++;
         }
     }
+}
+
+Graph Parser::constructRoadNetworkGraph(bool time, const std::string& time_units, const std::string& distance_units) const {
+    // Every road that has a highway tag is used, whatever its access tags.
+    Profile profile;
+    profile.name = "default";
+    profile.speed_mph = DEFAULT_SPEED_MPH;
+    profile.time = time;
+    return constructRoadNetworkGraph(profile, time_units, distance_units);
+}
+
+Graph Parser::constructRoadNetworkGraph(const Profile& profile, const std::string& time_units, const std::string& distance_units) const {
+    auto routing_data = getRoutingData();
+    auto locations = std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>(std::move(std::get<1>(routing_data)));
+    auto geometry = std::make_shared<GeometryStore>();
+    Graph graph(locations, geometry);
+    splitWays(std::get<0>(routing_data), *locations, std::get<2>(routing_data), {profile}, time_units, distance_units, geometry.get(),
+              [&](uint64_t start, uint64_t end, uint32_t segment, bool bidirectional, const std::vector<double>& time_weights, double distance_weight) {
+        graph.addEdge(start, end, segment, time_weights[0], distance_weight, bidirectional, profile.time);
+    });
+
+    // The coordinates of the OSM nodes between intersections are now stored with the edges. Only the locations of
+    // the vertices are kept.
+    locations.reset();
+    graph.discardNodeLocations();
     return graph;
 }
+
+std::vector<Graph> Parser::constructRoadNetworkGraphs(const std::vector<Profile>& profiles, const std::string& time_units,
+                                                      const std::string& distance_units) const {
+    auto routing_data = getRoutingData();
+    auto locations = std::make_shared<std::unordered_map<uint64_t, std::array<double, 2>>>(std::move(std::get<1>(routing_data)));
+    auto geometry = std::make_shared<GeometryStore>();
+
+    // Every road that any of the profiles can use is added to the road network once, and the weight of the road for
+    // every profile is recorded in the weights of that profile. The weight of a road that a profile cannot use is infinite.
+    std::vector<RoadNetwork::InputEdge> edges;
+    std::vector<std::vector<double>> weights(profiles.size());
+    splitWays(std::get<0>(routing_data), *locations, std::get<2>(routing_data), profiles, time_units, distance_units, geometry.get(),
+              [&](uint64_t start, uint64_t end, uint32_t segment, bool bidirectional, const std::vector<double>& time_weights, double distance_weight) {
+        edges.push_back(RoadNetwork::InputEdge{start, end, segment, false, distance_weight});
+        if (bidirectional) { edges.push_back(RoadNetwork::InputEdge{end, start, segment, true, distance_weight}); }
+        for (size_t i = 0; i < profiles.size(); i++) {
+            double weight = profiles[i].time ? time_weights[i] : distance_weight;
+            if (time_weights[i] == std::numeric_limits<double>::infinity()) { weight = time_weights[i]; }
+            weights[i].insert(weights[i].end(), bidirectional ? 2 : 1, weight);
+        }
+    });
+
+    // The coordinates of the OSM nodes between intersections are now stored with the edges. Only the locations of
+    // the vertices of the road network are kept.
+    std::unordered_set<uint64_t> vertex_ids;
+    for (const auto& edge : edges) {
+        vertex_ids.insert(edge.start);
+        vertex_ids.insert(edge.end);
+    }
+    for (auto it = locations->begin(); it != locations->end();) {
+        if (vertex_ids.find(it->first) == vertex_ids.end()) { it = locations->erase(it); }
+        else { ++it; }
+    }
+
+    const auto network = std::make_shared<const RoadNetwork>(edges, locations, geometry);
+    std::vector<Graph> graphs;
+    graphs.reserve(profiles.size());
+    for (size_t i = 0; i < profiles.size(); i++) { graphs.emplace_back(network, std::move(weights[i])); }
+    return graphs;
+}
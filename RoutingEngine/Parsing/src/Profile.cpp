@@ -0,0 +1,44 @@
+#include "Profile.h"
+
+int Profile::getSpeed(const std::string& highway) const {
+    const auto it = speed_mph.find(highway);
+    return it == speed_mph.end() ? default_speed_mph : it->second;
+}
+
+Profile Profile::car() {
+    Profile profile;
+    profile.name = "car";
+    profile.speed_mph = {{"motorway", 60}, {"trunk", 45}, {"primary", 35}, {"secondary", 30}, {"residential", 25},
+                         {"tertiary", 25}, {"unclassified", 25}, {"living_street", 10}, {"motorway_link", 30},
+                         {"trunk_link", 30}, {"primary_link", 30}, {"secondary_link", 30}, {"tertiary_link", 25},
+                         {"service", 10}, {"road", 35}, {"track", 15}};
+    profile.excluded_highways = {"footway", "path", "cycleway", "bridleway", "steps", "pedestrian", "corridor",
+                                 "bus_guideway", "busway", "escape", "construction", "proposed", "platform"};
+    profile.access_tags = {"access", "vehicle", "motor_vehicle", "motorcar"};
+    return profile;
+}
+
+Profile Profile::truck() {
+    Profile profile = car();
+    profile.name = "truck";
+    profile.speed_mph = {{"motorway", 55}, {"trunk", 40}, {"primary", 30}, {"secondary", 25}, {"residential", 20},
+                         {"tertiary", 20}, {"unclassified", 20}, {"living_street", 5}, {"motorway_link", 25},
+                         {"trunk_link", 25}, {"primary_link", 25}, {"secondary_link", 25}, {"tertiary_link", 20},
+                         {"service", 5}, {"road", 30}};
+    profile.default_speed_mph = 30;
+    profile.excluded_highways.insert("track");
+    profile.access_tags = {"access", "vehicle", "motor_vehicle", "hgv"};
+    return profile;
+}
+
+Profile Profile::bicycle() {
+    Profile profile;
+    profile.name = "bicycle";
+    profile.speed_mph = {{"living_street", 8}, {"service", 10}, {"track", 8}, {"path", 8}, {"footway", 5},
+                         {"pedestrian", 5}, {"bridleway", 5}, {"steps", 2}};
+    profile.default_speed_mph = 12;
+    profile.excluded_highways = {"motorway", "motorway_link", "trunk", "trunk_link", "bus_guideway", "busway",
+                                 "escape", "construction", "proposed", "corridor", "platform"};
+    profile.access_tags = {"access", "vehicle", "bicycle"};
+    return profile;
+}
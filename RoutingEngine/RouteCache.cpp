@@ -0,0 +1,116 @@
+#include "RouteCache.h"
+#include "Polyline.h"
+#include <algorithm>
+
+using namespace OSM;
+
+size_t RouteCache::KeyHash::operator()(const Key& key) const {
+    // Mixes both IDs and the profile so that routes from the same source are spread over all shards.
+    uint64_t hash = key.source * 0x9e3779b97f4a7c15ULL ^ (key.target + 0x632be59bd9b4e019ULL) ^ key.profile * 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 31;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 29;
+    return size_t(hash);
+}
+
+RouteCache::RouteCache(const size_t capacity, const size_t num_shards) {
+    const size_t shards = std::max<size_t>(1, std::min(num_shards, capacity));
+    shard_capacity_ = std::max<size_t>(1, capacity / shards);
+    shards_.reserve(shards);
+    for (size_t i = 0; i < shards; i++) { shards_.push_back(std::make_unique<Shard>()); }
+}
+
+bool RouteCache::find(const uint64_t source, const uint64_t target, const uint64_t generation,
+                      std::pair<std::vector<std::array<double, 2>>, double>* route, const uint32_t profile) {
+    const Key key{source, target, profile};
+    auto& shard = getShard(key);
+    std::string geometry;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.positions.find(key);
+        // An entry computed on a previous graph is stale. It is overwritten once the route is inserted again.
+        if (it == shard.positions.end() || shard.entries[it->second].generation != generation) {
+            shard.statistics.misses++;
+            return false;
+        }
+        auto& entry = shard.entries[it->second];
+        entry.referenced = true;
+        shard.statistics.hits++;
+        route->second = entry.cost;
+        geometry = entry.geometry;
+    }
+    // The geometry is decoded after the lock is released.
+    route->first = Polyline::decode(geometry, PRECISION);
+    return true;
+}
+
+void RouteCache::insert(const uint64_t source, const uint64_t target, const uint64_t generation,
+                        const std::pair<std::vector<std::array<double, 2>>, double>& route, const uint32_t profile) {
+    const Key key{source, target, profile};
+    auto& shard = getShard(key);
+    Entry entry{key, generation, route.second, Polyline::encode(route.first, PRECISION), false};
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.positions.find(key);
+    if (it != shard.positions.end()) {
+        shard.entries[it->second] = std::move(entry);
+        shard.statistics.overwrites++;
+        return;
+    }
+    shard.statistics.insertions++;
+    if (shard.entries.size() < shard_capacity_) {
+        shard.positions.emplace(key, shard.entries.size());
+        shard.entries.push_back(std::move(entry));
+        return;
+    }
+
+    // The clock hand skips entries that were used since it last passed them, and clears their reference bit.
+    while (shard.entries[shard.hand].referenced) {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+    shard.positions.erase(shard.entries[shard.hand].key);
+    shard.positions.emplace(key, shard.hand);
+    shard.entries[shard.hand] = std::move(entry);
+    shard.hand = (shard.hand + 1) % shard.entries.size();
+    shard.statistics.evictions++;
+}
+
+void RouteCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->entries.clear();
+        shard->positions.clear();
+        shard->hand = 0;
+    }
+}
+
+RouteCache::Statistics RouteCache::getStatistics() const {
+    Statistics statistics;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        statistics.hits += shard->statistics.hits;
+        statistics.misses += shard->statistics.misses;
+        statistics.insertions += shard->statistics.insertions;
+        statistics.evictions += shard->statistics.evictions;
+        statistics.overwrites += shard->statistics.overwrites;
+        statistics.size += shard->entries.size();
+    }
+    return statistics;
+}
+
+MemoryUsage RouteCache::getMemoryUsage() const {
+    uint64_t payload = 0, allocated = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        allocated += sizeof(Shard) + shard->entries.capacity() * sizeof(Entry) + MemoryUsage::getAllocatedBytes(shard->positions);
+        for (const auto& entry : shard->entries) {
+            payload += entry.geometry.size() + sizeof(entry.cost);
+            // Short strings are stored inside the entry itself.
+            if (entry.geometry.capacity() >= sizeof(std::string)) { allocated += MemoryUsage::getAllocationSize(entry.geometry.capacity() + 1); }
+        }
+    }
+    MemoryUsage usage;
+    usage.add("route_cache", payload, allocated);
+    return usage;
+}
@@ -0,0 +1,141 @@
+#ifndef OSMROUTINGENGINE_ROUTECACHE_H
+#define OSMROUTINGENGINE_ROUTECACHE_H
+#include <vector>
+#include <array>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include "MemoryUsage.h"
+
+namespace OSM {
+
+    /**
+    * A bounded cache of computed routes. Many requests repeat the same source and target, and a cached route is returned
+    * without searching or decoding any geometry.
+    *
+    * The cache is split into shards, each with its own lock, so that concurrent queries rarely wait for one another.
+    * Every shard evicts its entries with the CLOCK algorithm, an approximation of least recently used eviction that does
+    * not need to reorder anything on a hit. Routes are stored as encoded polylines with seven decimal places, the
+    * precision of OSM coordinates.
+    *
+    * Every entry records the generation of the graph it was computed on. Looking up a route with a different generation
+    * is a miss, so replacing the graph invalidates all entries at once without touching them. The routes of different
+    * routing profiles are cached separately.
+    */
+    class RouteCache {
+
+    public:
+
+        // Counters describing how well the cache works. Summed over all shards.
+        struct Statistics {
+
+            // The number of lookups that found a route and that did not.
+            uint64_t hits = 0, misses = 0;
+
+            // The number of routes that were added and the number of routes that were evicted to make room for them.
+            uint64_t insertions = 0, evictions = 0;
+
+            // The number of inserted routes that replaced a cached route for the same source and target.
+            uint64_t overwrites = 0;
+
+            // The number of routes currently cached.
+            uint64_t size = 0;
+
+            /**
+             * Retrieves the fraction of lookups that found a route.
+             * @return The hit rate, or 0 if there were no lookups.
+             */
+            double getHitRate() const { return hits + misses == 0 ? 0 : double(hits) / double(hits + misses); }
+        };
+
+    private:
+
+        // The number of decimal places kept in the cached geometry.
+        static const int PRECISION = 7;
+
+        struct Key {
+            uint64_t source, target;
+            uint32_t profile;
+            bool operator==(const Key& other) const { return source == other.source && target == other.target && profile == other.profile; }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        struct Entry {
+            Key key;
+            uint64_t generation;
+            double cost;
+            std::string geometry;
+            // Set on every hit and cleared by the clock hand. Entries that are not referenced are evicted.
+            bool referenced;
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            std::vector<Entry> entries;
+            std::unordered_map<Key, size_t, KeyHash> positions;
+            size_t hand = 0;
+            Statistics statistics;
+        };
+
+        // The maximum number of routes in every shard.
+        size_t shard_capacity_;
+
+        std::vector<std::unique_ptr<Shard>> shards_;
+
+        Shard& getShard(const Key& key) const { return *shards_[KeyHash()(key) % shards_.size()]; }
+
+    public:
+
+        /**
+         * A constructor for the RouteCache class.
+         * @param capacity The maximum number of routes that are cached.
+         * @param num_shards The number of independently locked parts the cache is split into. More shards allow more
+         * threads to use the cache at the same time.
+         */
+        explicit RouteCache(size_t capacity, size_t num_shards = 16);
+
+        /**
+         * Looks up a route.
+         * @param source The OSM Node ID of the start point of the route.
+         * @param target The OSM Node ID of the end point of the route.
+         * @param generation The generation of the graph that the route must have been computed on.
+         * @param route Receives the cached route and its cost, if there is one.
+         * @param profile The index of the routing profile that the route must have been computed for.
+         * @return Returns true if the route was found, otherwise false.
+         */
+        bool find(uint64_t source, uint64_t target, uint64_t generation, std::pair<std::vector<std::array<double, 2>>, double>* route,
+                  uint32_t profile = 0);
+
+        /**
+         * Adds a route to the cache, evicting a route that has not been used recently if the cache is full.
+         * @param source The OSM Node ID of the start point of the route.
+         * @param target The OSM Node ID of the end point of the route.
+         * @param generation The generation of the graph that the route was computed on.
+         * @param route The route and its cost.
+         * @param profile The index of the routing profile that the route was computed for.
+         */
+        void insert(uint64_t source, uint64_t target, uint64_t generation, const std::pair<std::vector<std::array<double, 2>>, double>& route,
+                    uint32_t profile = 0);
+
+        // Removes all routes from the cache. The counters are kept.
+        void clear();
+
+        /**
+         * Retrieves the counters of the cache.
+         * @return The counters, summed over all shards.
+         */
+        Statistics getStatistics() const;
+
+        /**
+         * Reports how much memory the cached routes use. The payload is the encoded geometry and the cost of every route.
+         * @return A report with a single component named "route_cache".
+         */
+        MemoryUsage getMemoryUsage() const;
+    };
+}
+#endif //OSMROUTINGENGINE_ROUTECACHE_H
@@ -1,37 +1,365 @@
 #include "RoutingEngine.h"
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace OSM;
 
+namespace {
+    /**
+     * Determines how many chunks a batch of items is split into, one per thread.
+     * @param size The number of items to process.
+     * @param num_threads The number of threads to use. If zero, one thread per hardware thread is used.
+     * @return The number of chunks.
+     */
+    size_t getNumChunks(const size_t size, const int num_threads) {
+        const size_t threads = num_threads > 0 ? size_t(num_threads) : std::max(1u, std::thread::hardware_concurrency());
+        return std::max<size_t>(1, std::min(size, threads));
+    }
+}
+
+uint32_t RoutingEngine::ProfileSet::find(const std::string& profile) const {
+    if (profile.empty()) { return 0; }
+    const auto it = std::find(names.begin(), names.end(), profile);
+    if (it == names.end()) { throw std::logic_error("Unknown routing profile: " + profile + "."); }
+    return uint32_t(it - names.begin());
+}
+
+std::unique_ptr<RoutingEngine::ProfileSet> RoutingEngine::readGraphs(const char* filename, const bool mapped) {
+    auto profiles = std::make_unique<ProfileSet>();
+    if (!mapped) {
+        profiles->names.emplace_back();
+        profiles->graphs.push_back(reclaimer->adopt(std::make_unique<const Graph>(Serialize::load<Graph>(filename))));
+        return profiles;
+    }
+    for (auto& [name, graph] : Graph::mapProfilesFlat(filename)) {
+        profiles->names.push_back(name);
+        profiles->graphs.push_back(reclaimer->adopt(std::make_unique<const Graph>(std::move(graph))));
+    }
+    return profiles;
+}
+
+std::unique_ptr<RoutingEngine::ProfileSet> RoutingEngine::loadGraphs(const char* filename, const bool mapped) {
+    const auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<ProfileSet> profiles;
+    try { profiles = readGraphs(filename, mapped); }
+    catch (...) {
+        graph_load_errors.add();
+        throw;
+    }
+    graph_loads.add();
+    graph_load_seconds.set(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return profiles;
+}
+
+void RoutingEngine::updateGraphMetrics(const ProfileSet& profiles) {
+    const std::string help = "Memory used by each component of the routing graph, split into the data and the overhead of its containers.";
+    for (size_t i = 0; i < profiles.graphs.size(); i++) {
+        // A graph that was not built for a named profile is reported without a profile label.
+        const std::string profile = profiles.names[i].empty() ? "" : "profile=\"" + profiles.names[i] + "\",";
+        for (const auto& component : profiles.graphs[i]->getMemoryUsage().components) {
+            const std::string labels = "{" + profile + "component=\"" + component.name + "\",kind=";
+            metrics.gauge("routing_graph_memory_bytes" + labels + "\"payload\"}", help).set(double(component.payload));
+            metrics.gauge("routing_graph_memory_bytes" + labels + "\"overhead\"}", help).set(double(component.overhead));
+        }
+    }
+    graph_generation.set(double(generation));
+}
+
+void RoutingEngine::updateCacheMetrics() {
+    const auto statistics = getRouteCacheStatistics();
+    metrics.gauge("routing_route_cache_hits_total", "Routes found in the route cache.", "counter").set(double(statistics.hits));
+    metrics.gauge("routing_route_cache_misses_total", "Routes not found in the route cache.", "counter").set(double(statistics.misses));
+    metrics.gauge("routing_route_cache_evictions_total", "Routes evicted from the route cache.", "counter").set(double(statistics.evictions));
+    metrics.gauge("routing_route_cache_size", "Routes in the route cache.").set(double(statistics.size));
+}
+
 RoutingEngine::RoutingEngine(const char *filename, bool time, const std::string &time_units,
                              const std::string &distance_units, bool contracted) {
     // Parses the OSM file.
     Parser parser(filename);
-    auto routing_data = parser.constructRoadNetworkGraph(time, time_units, distance_units);
-
-    routing_graph = *std::make_unique<Graph>(routing_data);
+    auto routing_data = std::make_unique<Graph>(parser.constructRoadNetworkGraph(time, time_units, distance_units));
 
     // Contracts the graph.
     if (contracted) {
-        HierarchyConstructor builder(routing_graph, 170, 190);
+        HierarchyConstructor builder(*routing_data, 170, 190);
+        builder.contractGraph();
+    }
+    publishGraph(std::move(routing_data));
+}
+
+RoutingEngine::RoutingEngine(const char *filename, const std::vector<Profile>& profiles, const std::string &time_units,
+                             const std::string &distance_units) {
+    // Parses the OSM file once for all profiles and contracts the graph of every profile.
+    Parser parser(filename);
+    auto graphs = parser.constructRoadNetworkGraphs(profiles, time_units, distance_units);
+    auto routing_profiles = std::make_unique<ProfileSet>();
+    for (size_t i = 0; i < profiles.size(); i++) {
+        HierarchyConstructor builder(graphs[i], 170, 190);
         builder.contractGraph();
+        routing_profiles->names.push_back(profiles[i].name);
+        routing_profiles->graphs.push_back(reclaimer->adopt(std::make_unique<const Graph>(std::move(graphs[i]))));
     }
+    publishProfiles(std::move(routing_profiles));
+}
+
+RoutingEngine::RoutingEngine(const char* filename) {
+    publishProfiles(loadGraphs(filename, false));
+}
+
+RoutingEngine::RoutingEngine() {
+    publishGraph(std::make_unique<const Graph>());
+}
+
+std::shared_ptr<const RoutingEngine::ProfileSet> RoutingEngine::getProfileSet() const {
+    return std::atomic_load(&routing_profiles);
+}
+
+std::shared_ptr<const Graph> RoutingEngine::getGraph(const std::string& profile) const {
+    const auto profiles = getProfileSet();
+    return profiles->graphs[profiles->find(profile)];
+}
+
+std::vector<std::string> RoutingEngine::getProfiles() const {
+    return getProfileSet()->names;
 }
 
-RoutingEngine::RoutingEngine(const char* filename) : routing_graph(*std::make_unique<Graph>(Serialize::load<Graph>(filename))) {}
+void RoutingEngine::publishProfiles(std::unique_ptr<ProfileSet> profiles) {
+    for (size_t i = 0; i < profiles->names.size(); i++) {
+        if (std::count(profiles->names.begin(), profiles->names.end(), profiles->names[i]) > 1) {
+            throw std::logic_error("Every routing profile needs a different name.");
+        }
+    }
+    const std::shared_ptr<const ProfileSet> published = std::move(profiles);
+    /**
+    * Queries that started before the graphs were replaced still hold a reference to the previous graphs and finish on
+    * them. Whichever of them drops the last reference hands a previous graph to the reclaimer, which frees it on its own
+    * thread, so that freeing a large graph never adds latency to a query.
+    */
+    std::atomic_store(&routing_profiles, published);
+    /**
+    * Queries read the generation before they take a snapshot of the graphs. Incrementing the generation after the graphs
+    * are replaced means that a query never caches a route of the previous graphs under the new generation.
+    */
+    generation++;
+    updateGraphMetrics(*published);
+}
 
-RoutingEngine::RoutingEngine() = default;
+void RoutingEngine::publishGraph(std::unique_ptr<const Graph> graph) {
+    auto profiles = std::make_unique<ProfileSet>();
+    profiles->names.emplace_back();
+    profiles->graphs.push_back(reclaimer->adopt(std::move(graph)));
+    publishProfiles(std::move(profiles));
+}
 
 void RoutingEngine::saveRoutingData(const char *filename) {
-    Serialize::save(filename, routing_graph);
+    const auto profiles = getProfileSet();
+    if (profiles->graphs.size() > 1) { throw std::logic_error("Several routing profiles can only be saved as a flat file."); }
+    Serialize::save(filename, *profiles->graphs.front());
 }
 
 void RoutingEngine::loadRoutingData(const char *filename) {
-    routing_graph = *std::make_unique<Graph>(Serialize::load<Graph>(filename));
+    publishProfiles(loadGraphs(filename, false));
+}
+
+void RoutingEngine::saveMappedRoutingData(const char *filename) {
+    const auto profiles = getProfileSet();
+    // The graphs of profiles share a road network, which is stored once along with all of them.
+    if (!profiles->graphs.front()->getNetwork()) {
+        profiles->graphs.front()->saveFlat(filename);
+        return;
+    }
+    std::vector<std::pair<std::string, const Graph*>> graphs;
+    for (size_t i = 0; i < profiles->graphs.size(); i++) { graphs.emplace_back(profiles->names[i], profiles->graphs[i].get()); }
+    Graph::saveProfilesFlat(filename, graphs);
+}
+
+void RoutingEngine::mapRoutingData(const char *filename) {
+    publishProfiles(loadGraphs(filename, true));
+}
+
+std::future<void> RoutingEngine::reloadRoutingData(const std::string& filename, const bool mapped) {
+    return std::async(std::launch::async, [this, filename, mapped]() { publishProfiles(loadGraphs(filename.c_str(), mapped)); });
+}
+
+void RoutingEngine::enableRouteCache(const size_t capacity, const size_t num_shards) {
+    std::atomic_store(&route_cache, capacity > 0 ? std::make_shared<RouteCache>(capacity, num_shards) : nullptr);
+}
+
+RouteCache::Statistics RoutingEngine::getRouteCacheStatistics() const {
+    const auto cache = std::atomic_load(&route_cache);
+    return cache ? cache->getStatistics() : RouteCache::Statistics();
+}
+
+MemoryUsage RoutingEngine::getMemoryUsage(const std::string& profile) const {
+    auto usage = getGraph(profile)->getMemoryUsage();
+    if (const auto cache = std::atomic_load(&route_cache)) {
+        const auto cache_usage = cache->getMemoryUsage();
+        usage.components.insert(usage.components.end(), cache_usage.components.begin(), cache_usage.components.end());
+    }
+    return usage;
+}
+
+std::string RoutingEngine::exportMetrics() {
+    updateCacheMetrics();
+    return metrics.exportPrometheus();
+}
+
+std::map<std::string, double> RoutingEngine::getMetrics() {
+    updateCacheMetrics();
+    return metrics.getValues();
+}
+
+std::pair<std::vector<std::array<double, 2>>, double> RoutingEngine::computeCachedRoute(const Graph& graph, RouteCache* cache,
+                                                                                        const uint64_t graph_generation, const uint32_t profile,
+                                                                                        const uint64_t source, const uint64_t target,
+                                                                                        QueryStats* stats) {
+    std::pair<std::vector<std::array<double, 2>>, double> route;
+    if (cache && cache->find(source, target, graph_generation, &route, profile)) { return route; }
+    route = graph.getShortestRoute(source, target, false, stats);
+    if (cache) { cache->insert(source, target, graph_generation, route, profile); }
+    return route;
+}
+
+std::pair<std::vector<std::array<double, 2>>, double> RoutingEngine::computeRoute(uint64_t source, uint64_t target, bool standard,
+                                                                                  const std::string& profile) {
+    return computeRoute(source, target, standard, nullptr, profile);
+}
+
+std::pair<std::vector<std::array<double, 2>>, double> RoutingEngine::computeRoute(uint64_t source, uint64_t target, bool standard,
+                                                                                  QueryStats* stats, const std::string& profile) {
+    RequestTimer timer(route_requests, route_latency, route_errors);
+    const uint64_t graph_generation = generation;
+    const auto profiles = getProfileSet();
+    const uint32_t index = profiles->find(profile);
+    const Graph& graph = *profiles->graphs[index];
+    if (standard) { return graph.getShortestRoute(source, target, true, stats); }
+    return computeCachedRoute(graph, std::atomic_load(&route_cache).get(), graph_generation, index, source, target, stats);
 }
 
-std::pair<std::vector<std::array<double, 2>>, double> RoutingEngine::computeRoute(uint64_t source, uint64_t target, bool standard) {
-    auto routing_data = routing_graph.getShortestPath(source, target, standard);
-    return std::make_pair(routing_graph.convertPathToCoordinates(routing_data.first), routing_data.second);
+WaypointRoute RoutingEngine::computeRoute(const std::vector<uint64_t>& waypoints, const int num_threads, const std::string& profile) {
+    RequestTimer timer(route_requests, route_latency, route_errors);
+    if (waypoints.size() < 2) { throw std::logic_error("A route needs at least two waypoints."); }
+    const auto graph = getGraph(profile);
+
+    // Every chunk is the route through a contiguous part of the waypoints. Consecutive chunks share a waypoint.
+    const size_t num_legs = waypoints.size() - 1;
+    const size_t num_chunks = getNumChunks(num_legs, num_threads);
+    std::vector<WaypointRoute> chunks(num_chunks);
+    workers.parallelFor(num_legs, num_chunks, [&](size_t begin, size_t end, size_t chunk) {
+        const std::vector<uint64_t> chunk_waypoints(waypoints.begin() + begin, waypoints.begin() + end + 1);
+        auto route = graph->getWaypointRoute(chunk_waypoints, &chunks[chunk].leg_costs, &chunks[chunk].waypoint_offsets);
+        chunks[chunk].coordinates = std::move(route.first);
+        chunks[chunk].cost = route.second;
+    });
+    if (num_chunks == 1) { return std::move(chunks.front()); }
+
+    WaypointRoute route;
+    route.cost = 0;
+    route.waypoint_offsets.push_back(0);
+    for (const auto& chunk : chunks) {
+        route.leg_costs.insert(route.leg_costs.end(), chunk.leg_costs.begin(), chunk.leg_costs.end());
+        if (chunk.cost < 0 || route.cost < 0) {
+            route.cost = -1;
+            continue;
+        }
+        route.cost += chunk.cost;
+        // The first point of a chunk is the last point of the chunk before it.
+        const uint64_t base = route.coordinates.empty() ? 0 : route.coordinates.size() - 1;
+        route.coordinates.insert(route.coordinates.end(), chunk.coordinates.begin() + (route.coordinates.empty() ? 0 : 1), chunk.coordinates.end());
+        for (size_t i = 1; i < chunk.waypoint_offsets.size(); i++) { route.waypoint_offsets.push_back(base + chunk.waypoint_offsets[i]); }
+    }
+    if (route.cost < 0) {
+        route.coordinates.clear();
+        route.waypoint_offsets.clear();
+    }
+    return route;
+}
+
+std::vector<std::pair<std::vector<std::array<double, 2>>, double>> RoutingEngine::computeAlternativeRoutes(uint64_t source, uint64_t target,
+                                                                                                          const AlternativeRouteOptions& options,
+                                                                                                          const std::string& profile) {
+    RequestTimer timer(route_requests, route_latency, route_errors);
+    return getGraph(profile)->getAlternativeRoutes(source, target, options);
+}
+
+std::pair<std::string, double> RoutingEngine::computeEncodedRoute(uint64_t source, uint64_t target, double tolerance, int precision, bool standard,
+                                                                  const std::string& profile) {
+    RequestTimer timer(route_requests, route_latency, route_errors);
+    return getGraph(profile)->getEncodedRoute(source, target, tolerance, precision, standard);
+}
+
+std::vector<double> RoutingEngine::computeRouteCosts(const std::vector<std::pair<uint64_t, uint64_t>>& queries, const std::string& profile) {
+    RequestTimer timer(distance_requests, distance_latency, distance_errors);
+    distance_queries.add(queries.size());
+    return getGraph(profile)->getShortestPathLengths(queries);
 }
 
+std::vector<std::vector<double>> RoutingEngine::computeCostMatrix(const std::vector<uint64_t>& sources, const std::vector<uint64_t>& targets,
+                                                                  const std::string& profile) {
+    RequestTimer timer(distance_requests, distance_latency, distance_errors);
+    distance_queries.add(sources.size() * targets.size());
+    std::vector<std::pair<uint64_t, uint64_t>> queries;
+    queries.reserve(sources.size() * targets.size());
+    for (const auto& source : sources) {
+        for (const auto& target : targets) { queries.emplace_back(source, target); }
+    }
+    auto costs = getGraph(profile)->getShortestPathLengths(queries);
+
+    std::vector<std::vector<double>> matrix;
+    matrix.reserve(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        matrix.emplace_back(costs.begin() + i * targets.size(), costs.begin() + (i + 1) * targets.size());
+    }
+    return matrix;
+}
+
+void RoutingEngine::computeRouteCosts(const uint64_t* sources, const uint64_t* targets, const size_t num_queries,
+                                      double* costs, const int num_threads, const std::string& profile) {
+    RequestTimer timer(distance_requests, distance_latency, distance_errors);
+    distance_queries.add(num_queries);
+    // Every thread searches the same snapshot, even if a new graph is published in the meantime.
+    const auto graph = getGraph(profile);
+    workers.parallelFor(num_queries, getNumChunks(num_queries, num_threads), [&](size_t begin, size_t end, size_t) {
+        std::vector<std::pair<uint64_t, uint64_t>> queries;
+        queries.reserve(end - begin);
+        for (size_t i = begin; i < end; i++) { queries.emplace_back(sources[i], targets[i]); }
+        const auto chunk_costs = graph->getShortestPathLengths(queries);
+        std::copy(chunk_costs.begin(), chunk_costs.end(), costs + begin);
+    });
+}
+
+RouteBatch RoutingEngine::computeRoutes(const uint64_t* sources, const uint64_t* targets, const size_t num_queries,
+                                        const int num_threads, const std::string& profile) {
+    const uint64_t graph_generation = generation;
+    const auto profiles = getProfileSet();
+    const uint32_t index = profiles->find(profile);
+    const Graph& graph = *profiles->graphs[index];
+    const auto cache = std::atomic_load(&route_cache);
+    RouteBatch batch;
+    batch.costs.resize(num_queries);
+    batch.offsets.resize(num_queries + 1, 0);
+
+    // Every chunk collects the coordinates of its routes separately. They are concatenated once all routes are known.
+    const size_t num_chunks = getNumChunks(num_queries, num_threads);
+    std::vector<std::vector<double>> chunk_coordinates(num_chunks);
+    workers.parallelFor(num_queries, num_chunks, [&](size_t begin, size_t end, size_t chunk) {
+        auto& coordinates = chunk_coordinates[chunk];
+        for (size_t i = begin; i < end; i++) {
+            RequestTimer timer(route_requests, route_latency, route_errors);
+            const auto route = computeCachedRoute(graph, cache.get(), graph_generation, index, sources[i], targets[i]);
+            for (const auto& point : route.first) { coordinates.insert(coordinates.end(), point.begin(), point.end()); }
+            batch.costs[i] = route.second;
+            // The number of points is stored for now and turned into an offset below.
+            batch.offsets[i + 1] = route.first.size();
+        }
+    });
 
+    for (size_t i = 0; i < num_queries; i++) { batch.offsets[i + 1] += batch.offsets[i]; }
+    batch.coordinates.reserve(2 * batch.offsets.back());
+    for (const auto& coordinates : chunk_coordinates) {
+        batch.coordinates.insert(batch.coordinates.end(), coordinates.begin(), coordinates.end());
+    }
+    return batch;
+}
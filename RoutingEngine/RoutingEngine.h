@@ -2,18 +2,171 @@
 #define OSMROUTINGENGINE_ROUTINGENGINE_H
 #include <string>
 #include <memory>
+#include <future>
+#include <atomic>
 #include "Serialize.h"
 #include "Graph.h"
 #include "HierarchyConstructor.h"
 #include "OsmParser.h"
+#include "RouteCache.h"
+#include "GraphReclaimer.h"
+#include "Metrics.h"
+#include "WorkerPool.h"
 
 namespace OSM {
+
+    // The routes computed by a batch query, stored contiguously so that they can be handed over without copying.
+    struct RouteBatch {
+
+        // The distance/time cost of every route, or -1 if there is no route.
+        std::vector<double> costs;
+
+        // The latitude and longitude of every point of every route, one route after another.
+        std::vector<double> coordinates;
+
+        // Route i is made up of the points [offsets[i], offsets[i + 1]) in coordinates. Empty if there is no route.
+        std::vector<uint64_t> offsets;
+    };
+
+    // A route through several waypoints.
+    struct WaypointRoute {
+
+        // The distance/time cost of the route, or -1 if some leg has no route.
+        double cost = -1;
+
+        // The distance/time cost of every leg: leg i goes from waypoint i to waypoint i + 1. The cost is -1 if there
+        // is no route for the leg.
+        std::vector<double> leg_costs;
+
+        // The latitude and longitude of every point of the route. Empty if some leg has no route.
+        std::vector<std::array<double, 2>> coordinates;
+
+        // The position of every waypoint in coordinates: leg i is made up of the points [waypoint_offsets[i],
+        // waypoint_offsets[i + 1]]. Empty if some leg has no route.
+        std::vector<uint64_t> waypoint_offsets;
+    };
+
     class RoutingEngine {
 
     private:
 
-        // The road network graph that will be used for routing.
-        Graph routing_graph;
+        // The routing graphs of the profiles that the engine serves, which are published together.
+        struct ProfileSet {
+
+            // The name of every profile. A graph that was not built for a named profile has an empty name.
+            std::vector<std::string> names;
+
+            // The routing graph of every profile, in the order of the names.
+            std::vector<std::shared_ptr<const Graph>> graphs;
+
+            /**
+             * Finds a profile by its name. Throws an exception if there is no such profile.
+             * @param profile The name of the profile, or an empty string for the first profile.
+             * @return The index of the profile.
+             */
+            uint32_t find(const std::string& profile) const;
+        };
+
+        /**
+         * The road network graphs that will be used for routing, one per routing profile. A published graph is never
+         * modified; loading new graphs publishes a new snapshot instead. Always read and replaced atomically, so that
+         * queries can run while new graphs are loaded.
+         */
+        std::shared_ptr<const ProfileSet> routing_profiles;
+
+        // Frees the published graphs on a background thread once they are no longer used.
+        std::shared_ptr<GraphReclaimer> reclaimer = std::make_shared<GraphReclaimer>();
+
+        // Incremented every time the graphs are published. Cached routes are only valid for the generation they were computed on.
+        std::atomic<uint64_t> generation{0};
+
+        // The cache of computed routes, or null if routes are not cached. Read and replaced atomically.
+        std::shared_ptr<RouteCache> route_cache;
+
+        // The threads that process the chunks of the batch and waypoint queries. They are kept between queries, so that
+        // every thread reuses its search workspace.
+        WorkerPool workers;
+
+        // The metrics of the engine. The metrics below are registered once and then recorded without locking.
+        MetricsRegistry metrics;
+
+        Counter& route_requests = metrics.counter("routing_route_requests_total", "Routes requested.");
+        Counter& route_errors = metrics.counter("routing_route_errors_total", "Route requests that failed.");
+        LatencyHistogram& route_latency = metrics.histogram("routing_route_latency_seconds", "Time taken to compute a route.");
+
+        Counter& distance_requests = metrics.counter("routing_distance_requests_total", "Calls that compute the costs of many routes.");
+        Counter& distance_errors = metrics.counter("routing_distance_errors_total", "Calls that compute the costs of many routes and failed.");
+        Counter& distance_queries = metrics.counter("routing_distance_queries_total", "Route costs computed by calls that compute many routes.");
+        LatencyHistogram& distance_latency = metrics.histogram("routing_distance_latency_seconds", "Time taken by a call that computes the costs of many routes.");
+
+        Counter& graph_loads = metrics.counter("routing_graph_loads_total", "Routing graphs loaded or mapped.");
+        Counter& graph_load_errors = metrics.counter("routing_graph_load_errors_total", "Routing graphs that failed to load.");
+        Gauge& graph_load_seconds = metrics.gauge("routing_graph_load_duration_seconds", "Time taken to load or map the current routing graph.");
+        Gauge& graph_generation = metrics.gauge("routing_graph_generation", "The number of routing graphs published so far.");
+
+        /**
+         * Reads the routing graphs from a file and records how long it took.
+         * @param filename The name of the file to read the graphs from.
+         * @param mapped If true, the file is a flat file that is mapped into memory. Otherwise, it is a binary file that
+         * is loaded.
+         * @return The routing graphs.
+         */
+        std::unique_ptr<ProfileSet> loadGraphs(const char* filename, bool mapped);
+
+        /**
+         * Updates the metrics that describe the routing graphs.
+         * @param profiles The routing graphs that were just published.
+         */
+        void updateGraphMetrics(const ProfileSet& profiles);
+
+        /**
+         * Retrieves a snapshot of the routing graphs of all profiles.
+         * @return The current routing graphs.
+         */
+        std::shared_ptr<const ProfileSet> getProfileSet() const;
+
+        // Copies the counters of the route cache into the metrics, so that they are exported with them.
+        void updateCacheMetrics();
+
+        /**
+         * Computes a route on a snapshot of the graph, or retrieves it from the route cache.
+         * @param graph The snapshot of the graph.
+         * @param cache The route cache, or null.
+         * @param graph_generation The generation of the snapshot, read before the snapshot was taken.
+         * @param profile The index of the profile of the graph, so that the routes of every profile are cached separately.
+         * @param source The OSM Node ID that will serve as the start point in the route.
+         * @param target The OSM Node ID that will serve as the end point of the route.
+         * @param stats The statistics of the query, or nullptr.
+         * @return A pair containing the route as well as the distance/time cost of the route.
+         */
+        static std::pair<std::vector<std::array<double, 2>>, double> computeCachedRoute(const Graph& graph, RouteCache* cache,
+                                                                                        uint64_t graph_generation, uint32_t profile,
+                                                                                        uint64_t source, uint64_t target,
+                                                                                        QueryStats* stats = nullptr);
+
+        /**
+         * Atomically replaces the routing graphs of all profiles. Queries that started before the graphs were replaced
+         * finish on the previous graphs, which are then freed by the reclaimer. Throws an exception if two profiles have
+         * the same name.
+         * @param profiles The names and the graphs of the new profiles. The graphs must have been adopted by the reclaimer.
+         */
+        void publishProfiles(std::unique_ptr<ProfileSet> profiles);
+
+        /**
+         * Publishes a single routing graph that was not built for a named profile.
+         * @param graph The new routing graph.
+         */
+        void publishGraph(std::unique_ptr<const Graph> graph);
+
+        /**
+         * Reads the routing graphs from a file. A binary file holds a single graph, a flat file holds one graph or the
+         * graphs of several profiles.
+         * @param filename The name of the file to read the graphs from.
+         * @param mapped If true, the file is a flat file that is mapped into memory. Otherwise, it is a binary file that
+         * is loaded.
+         * @return The routing graphs.
+         */
+        std::unique_ptr<ProfileSet> readGraphs(const char* filename, bool mapped);
 
     public:
 
@@ -30,6 +183,18 @@ namespace OSM {
         explicit RoutingEngine(const char *filename, bool time = true, const std::string &time_units = "minutes",
                                const std::string &distance_units = "miles", bool contract = true);
 
+        /**
+         * A constructor for the RoutingEngine class that serves several routing profiles. The OSM file is parsed once, the
+         * graphs of the profiles share a single road network (see Parser::constructRoadNetworkGraphs), and every graph is
+         * contracted. Queries select a profile by its name.
+         * @param filename The filename of the OSM file that will be parsed and converted into road network graphs.
+         * @param profiles The routing profiles. No two profiles may have the same name.
+         * @param time_units The type of time units to be used (i.e. "seconds", "minutes", or "hours").
+         * @param distance_units The type of distance units to be used (i.e. "kilometers" or "miles").
+         */
+        RoutingEngine(const char *filename, const std::vector<Profile>& profiles, const std::string &time_units = "minutes",
+                      const std::string &distance_units = "miles");
+
         /**
          * A constructor for the RoutingEngine class.
          * @param filename The filename of a binary file that contains a routing graph.
@@ -39,27 +204,224 @@ namespace OSM {
         RoutingEngine();
 
         /**
-         * Saves the routing graph as a binary file.
+         * Retrieves a snapshot of the routing graph of a profile. The snapshot remains valid, and unchanged, even if a new
+         * graph is loaded in the meantime. Snapshots should not be held for longer than needed, since a previous graph is
+         * only released once every snapshot of it is gone. Throws an exception if there is no such profile.
+         * @param profile The name of the profile, or an empty string for the first profile.
+         * @return The current routing graph of the profile.
+         */
+        std::shared_ptr<const Graph> getGraph(const std::string& profile = "") const;
+
+        /**
+         * Retrieves the names of the routing profiles that the engine serves. A graph that was not built for a named
+         * profile, such as a graph loaded from a binary file, is served as a single profile with an empty name.
+         * @return The names of the profiles, the first of which is used when no profile is named.
+         */
+        std::vector<std::string> getProfiles() const;
+
+        /**
+         * Saves the routing graph as a binary file. The graphs of several profiles can only be saved with
+         * saveMappedRoutingData.
          * @param filename The name of the file to save the graph to.
          */
         void saveRoutingData(const char *filename);
 
         /**
-         * Loads the routing graph from the provided filename.
+         * Loads the routing graph from the provided filename. Safe to call while other threads compute routes: the new
+         * graph is loaded on the side and published once it is complete.
          * @param filename The name of the binary file to load the graph from.
          */
         void loadRoutingData(const char *filename);
 
+        /**
+         * Saves the contracted routing graph as a flat file that can be mapped with mapRoutingData. The graphs of several
+         * profiles are saved to a single file that stores their road network and geometry once, see
+         * Graph::saveProfilesFlat.
+         * @param filename The name of the file to save the graph to.
+         */
+        void saveMappedRoutingData(const char *filename);
+
+        /**
+         * Maps a flat file written by saveMappedRoutingData into memory read-only. Unlike loadRoutingData, nothing is
+         * copied, so mapping a graph is nearly instant and every process that maps the same file shares a single copy of
+         * the graph in physical memory. Routes can only be computed with the modified contraction hierarchies search.
+         * If the file holds several profiles, all of them are served.
+         * @param filename The name of the flat file to map the graph from.
+         */
+        void mapRoutingData(const char *filename);
+
+        /**
+         * Loads or maps a new routing graph on a background thread and publishes it once it is complete. Queries keep
+         * using the current graph until then, so the graph can be refreshed without draining traffic. If loading fails,
+         * the current graph stays in place. The RoutingEngine must outlive the returned future.
+         * @param filename The name of the file to load the graph from.
+         * @param mapped If true, the file is a flat file that is mapped as with mapRoutingData. Otherwise, it is loaded as
+         * with loadRoutingData.
+         * @return A future that becomes ready once the new graph is published. It does not wait for the previous graph,
+         * which is freed on a background thread once no query or snapshot uses it anymore. Rethrows any error that
+         * occurred.
+         */
+        std::future<void> reloadRoutingData(const std::string& filename, bool mapped = false);
+
+        /**
+         * Enables caching of the routes computed by computeRoute and computeRoutes, replacing any existing cache. Routes
+         * computed with the standard search are not cached. Cached routes are invalidated whenever a new graph is loaded.
+         * @param capacity The maximum number of routes that are cached. If zero, routes are no longer cached.
+         * @param num_shards The number of independently locked parts the cache is split into.
+         */
+        void enableRouteCache(size_t capacity, size_t num_shards = 16);
+
+        /**
+         * Retrieves the hit, miss, and eviction counters of the route cache.
+         * @return The counters of the route cache. All zero if routes are not cached.
+         */
+        RouteCache::Statistics getRouteCacheStatistics() const;
+
+        /**
+         * Reports how much memory every component of the routing graph of a profile uses, followed by the route cache if
+         * routes are cached. The components that the profile shares with other profiles are marked as shared. See
+         * Graph::getMemoryUsage.
+         * @param profile The name of the profile, or an empty string for the first profile.
+         * @return The payload and the overhead of every component, in bytes.
+         */
+        MemoryUsage getMemoryUsage(const std::string& profile = "") const;
+
+        /**
+         * Exports the metrics of the engine in the Prometheus text exposition format, so that they can be served to a
+         * Prometheus server as is. Covers the number, failures, and latency histograms of route and distance requests,
+         * the memory used by the components of the routing graph, how long the graph took to load, and the counters of
+         * the route cache.
+         * @return The metrics, one sample per line.
+         */
+        std::string exportMetrics();
+
+        /**
+         * Retrieves the current value of every metric of the engine. Latency histograms are summarized by their count,
+         * their sum, and their 50th, 90th, 99th, and 99.9th percentiles; see MetricsRegistry::getValues.
+         * @return A map from metric names to values. Times are in seconds.
+         */
+        std::map<std::string, double> getMetrics();
+
         /**
          * Computes the route between two points given an as OSM node IDs.
          * @param source The OSM Node ID that will serve as the start point in the route.
          * @param target The OSM Node ID that will serve as the end point of the route.
          * @param standard If standard is true, a bidirectional Dijkstra search algorithm will be used to compute the
          * route rather than the modified contraction hierarchies search algorithm.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return A pair containing the optimal route from the source to the target as well as distance/time cost
+         * of that route.
+         */
+        std::pair<std::vector<std::array<double, 2>>, double> computeRoute(uint64_t source, uint64_t target, bool standard = false,
+                                                                           const std::string& profile = "");
+
+        /**
+         * Computes the route between two points given as OSM node IDs and reports how the route was computed: how much
+         * of the graph was searched and how long each phase of the query took. The statistics are only collected if the
+         * library is built with the CH_QUERY_STATS option; see QueryStats. A route that is served from the route cache
+         * leaves the statistics untouched.
+         * @param source The OSM Node ID that will serve as the start point in the route.
+         * @param target The OSM Node ID that will serve as the end point of the route.
+         * @param standard If standard is true, a bidirectional Dijkstra search algorithm will be used to compute the
+         * route rather than the modified contraction hierarchies search algorithm.
+         * @param stats Receives the counters and timings of the query. They are added to its current values.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
          * @return A pair containing the optimal route from the source to the target as well as distance/time cost
          * of that route.
          */
-        std::pair<std::vector<std::array<double, 2>>, double> computeRoute(uint64_t source, uint64_t target, bool standard = false);
+        std::pair<std::vector<std::array<double, 2>>, double> computeRoute(uint64_t source, uint64_t target, bool standard,
+                                                                           QueryStats* stats, const std::string& profile = "");
+
+        /**
+         * Computes the route through a sequence of points given as OSM node IDs in a single call. The legs between
+         * consecutive points are searched one after another by the same searcher, or split among several threads, and
+         * stitched into one route. Legs are not cached. Throws an exception if there are fewer than two points or if
+         * any of the OSM Node IDs is invalid.
+         * @param waypoints The OSM Node IDs that the route goes through, in order.
+         * @param num_threads The number of threads that the legs are split among. If zero, one thread per hardware
+         * thread is used.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return The route, its distance/time cost, and the cost of every leg.
+         */
+        WaypointRoute computeRoute(const std::vector<uint64_t>& waypoints, int num_threads = 1, const std::string& profile = "");
+
+        /**
+         * Computes the route between two points given as OSM node IDs along with a few alternative routes, all from a
+         * single search. See Graph::getAlternativeRoutes.
+         * @param source The OSM Node ID that will serve as the start point in the routes.
+         * @param target The OSM Node ID that will serve as the end point of the routes.
+         * @param options The number of alternative routes and the criteria that they must meet.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return The optimal route followed by the alternative routes, by increasing cost. Every route is a pair of its
+         * coordinates and its distance/time cost. Empty if there is no route.
+         */
+        std::vector<std::pair<std::vector<std::array<double, 2>>, double>> computeAlternativeRoutes(
+                uint64_t source, uint64_t target, const AlternativeRouteOptions& options = AlternativeRouteOptions(),
+                const std::string& profile = "");
+
+        /**
+         * Computes the route between two points given as OSM node IDs and returns it as an encoded polyline, which is
+         * much smaller than a list of coordinates.
+         * @param source The OSM Node ID that will serve as the start point in the route.
+         * @param target The OSM Node ID that will serve as the end point of the route.
+         * @param tolerance If positive, the route is simplified with the Douglas-Peucker algorithm: points that lie within
+         * this many meters of the simplified route are dropped.
+         * @param precision The number of decimal places that are kept in the polyline (5 for Google Maps, or 6).
+         * @param standard If standard is true, a bidirectional Dijkstra search algorithm will be used to compute the
+         * route rather than the modified contraction hierarchies search algorithm.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return A pair containing the optimal route from the source to the target as an encoded polyline as well as
+         * the distance/time cost of that route.
+         */
+        std::pair<std::string, double> computeEncodedRoute(uint64_t source, uint64_t target, double tolerance = 0,
+                                                           int precision = 5, bool standard = false, const std::string& profile = "");
+
+        /**
+         * Computes the distance/time cost of the route between many pairs of points. The routes are computed side by side
+         * in batches, which is considerably faster than computing them one at a time.
+         * @param queries Pairs of OSM Node IDs that serve as the start and end points of the routes.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return The distance/time cost of every route, in the same order as the queries. The cost is -1 if there is no
+         * route between the points.
+         */
+        std::vector<double> computeRouteCosts(const std::vector<std::pair<uint64_t, uint64_t>>& queries, const std::string& profile = "");
+
+        /**
+         * Computes the distance/time cost of the routes from every source to every target.
+         * @param sources The OSM Node IDs that serve as start points.
+         * @param targets The OSM Node IDs that serve as end points.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return A matrix in which entry [i][j] is the cost of the route from sources[i] to targets[j], or -1 if there is
+         * no route.
+         */
+        std::vector<std::vector<double>> computeCostMatrix(const std::vector<uint64_t>& sources, const std::vector<uint64_t>& targets,
+                                                           const std::string& profile = "");
+
+        /**
+         * Computes the distance/time cost of many routes using several threads. The arrays are read and written in
+         * place, so that callers such as the Python bindings do not need to convert them. Throws an exception if any of
+         * the OSM Node IDs is invalid.
+         * @param sources The OSM Node IDs that serve as the start points of the routes.
+         * @param targets The OSM Node IDs that serve as the end points of the routes.
+         * @param num_queries The number of routes.
+         * @param costs An array of num_queries entries that receives the cost of every route, or -1 if there is no route.
+         * @param num_threads The number of threads to use. If zero, one thread per hardware thread is used.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         */
+        void computeRouteCosts(const uint64_t* sources, const uint64_t* targets, size_t num_queries, double* costs,
+                               int num_threads = 0, const std::string& profile = "");
+
+        /**
+         * Computes many routes using several threads. Throws an exception if any of the OSM Node IDs is invalid.
+         * @param sources The OSM Node IDs that serve as the start points of the routes.
+         * @param targets The OSM Node IDs that serve as the end points of the routes.
+         * @param num_queries The number of routes.
+         * @param num_threads The number of threads to use. If zero, one thread per hardware thread is used.
+         * @param profile The name of the routing profile, or an empty string for the first profile.
+         * @return The cost and the coordinates of every route.
+         */
+        RouteBatch computeRoutes(const uint64_t* sources, const uint64_t* targets, size_t num_queries, int num_threads = 0,
+                                 const std::string& profile = "");
     };
 }
 #endif //OSMROUTINGENGINE_ROUTINGENGINE_H
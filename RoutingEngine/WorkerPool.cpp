@@ -0,0 +1,66 @@
+#include "WorkerPool.h"
+#include <exception>
+
+using namespace OSM;
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_all();
+    for (auto& thread : threads_) { thread.join(); }
+}
+
+void WorkerPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [&]() { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) { return; }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+void WorkerPool::parallelFor(const size_t size, const size_t num_chunks, const std::function<void(size_t, size_t, size_t)>& process) {
+    std::vector<std::exception_ptr> errors(num_chunks);
+    const auto run_chunk = [&](size_t chunk) {
+        try { process(size * chunk / num_chunks, size * (chunk + 1) / num_chunks, chunk); }
+        catch (...) { errors[chunk] = std::current_exception(); }
+    };
+
+    // The number of chunks that were handed to the threads and have not been processed yet. Guarded by mutex_.
+    size_t pending = num_chunks - 1;
+    if (pending > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (threads_.size() < pending) { threads_.emplace_back([this]() { run(); }); }
+            for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+                tasks_.emplace_back([&, chunk]() {
+                    run_chunk(chunk);
+                    // The caller, which owns pending, cannot return before the lock is released.
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (--pending == 0) { finished_.notify_all(); }
+                });
+            }
+        }
+        queued_.notify_all();
+    }
+    run_chunk(0);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        finished_.wait(lock, [&]() { return pending == 0; });
+    }
+    for (const auto& error : errors) {
+        if (error) { std::rethrow_exception(error); }
+    }
+}
+
+size_t WorkerPool::getNumThreads() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threads_.size();
+}
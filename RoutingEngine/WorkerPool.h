@@ -0,0 +1,70 @@
+#ifndef OSMROUTINGENGINE_WORKERPOOL_H
+#define OSMROUTINGENGINE_WORKERPOOL_H
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+namespace OSM {
+
+    /**
+    * Threads that process the chunks of batch queries. The threads are started when a query first needs them and are
+    * kept until the pool is destroyed, so that the search workspace that every thread allocates for itself (see
+    * BidirectionalSearch) is reused by every later query rather than allocated and cleared again for every call.
+    *
+    * Several queries can use the pool at the same time. Their chunks are processed in the order in which they were
+    * submitted.
+    */
+    class WorkerPool {
+
+    private:
+
+        std::mutex mutex_;
+
+        // Signaled when a chunk is queued or the pool is stopped.
+        std::condition_variable queued_;
+
+        // Signaled when a chunk has been processed.
+        std::condition_variable finished_;
+
+        // The chunks that have not been picked up by a thread yet.
+        std::deque<std::function<void()>> tasks_;
+
+        std::vector<std::thread> threads_;
+
+        bool stopping_ = false;
+
+        // Processes the queued chunks, waiting for more until the pool is stopped.
+        void run();
+
+    public:
+
+        WorkerPool() = default;
+
+        // Stops the threads once the queued chunks have been processed.
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool&) = delete;
+
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        /**
+         * Splits the range [0, size) into contiguous chunks and processes every chunk on its own thread. The first chunk
+         * is processed on the calling thread, so a single chunk does not involve the pool at all. The first exception
+         * thrown by any of the chunks is rethrown once all chunks have been processed.
+         * @param size The number of items to process.
+         * @param num_chunks The number of chunks. The pool grows to num_chunks - 1 threads if it has fewer.
+         * @param process A function that processes the items in the range [begin, end) and the index of its chunk.
+         */
+        void parallelFor(size_t size, size_t num_chunks, const std::function<void(size_t, size_t, size_t)>& process);
+
+        /**
+         * Retrieves the number of threads that the pool has started so far.
+         * @return The number of threads.
+         */
+        size_t getNumThreads();
+    };
+}
+#endif //OSMROUTINGENGINE_WORKERPOOL_H
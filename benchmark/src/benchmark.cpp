@@ -5,6 +5,20 @@
 #include <random>
 #include <fstream>
 #include <memory>
+#include <chrono>
+#include <iomanip>
+#include <numeric>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include "Queue.h"
 #include "HierarchyConstructor.h"
 #include "Serialize.h"
@@ -20,14 +34,219 @@ namespace {
 
     // Generates a vector of vertex IDs that will be chosen from when selecting random sources and targets.
     std::vector<uint64_t> generateIdVector(Graph* graph) {
-        // Generate a vector of all the vertex IDs in the graph.
-        auto vertices = graph->getVertices();
-        std::vector<uint64_t> id_vector;
-        id_vector.reserve(vertices.size());
-        for(const auto& kv : vertices) {
-            id_vector.push_back(kv.first);
+        const auto ids = graph->getVertexIds();
+        return std::vector<uint64_t>(ids.begin(), ids.end());
+    }
+
+    // Counts read misses in one level of the data cache for the calling thread. Counts nothing if the counter is unavailable
+    // (e.g. in a container without access to hardware counters, or on a platform other than Linux).
+    enum class Cache { L1D, LLC };
+#ifdef __linux__
+    class CacheMissCounter {
+        int fd_;
+    public:
+        explicit CacheMissCounter(Cache cache) {
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.size = sizeof(attr);
+            attr.config = (cache == Cache::L1D ? PERF_COUNT_HW_CACHE_L1D : PERF_COUNT_HW_CACHE_LL)
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+        ~CacheMissCounter() { if (fd_ != -1) { close(fd_); } }
+        bool available() const { return fd_ != -1; }
+        void start() const {
+            if (fd_ == -1) { return; }
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        uint64_t stop() const {
+            uint64_t count = 0;
+            if (fd_ == -1) { return count; }
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count)) { count = 0; }
+            return count;
+        }
+    };
+#else
+    class CacheMissCounter {
+    public:
+        explicit CacheMissCounter(Cache) {}
+        bool available() const { return false; }
+        void start() const {}
+        uint64_t stop() const { return 0; }
+    };
+#endif
+
+    // Runs the same random queries on every query graph layout and reports the query time and cache misses per query.
+    void layoutBench(ankerl::nanobench::Bench* bench, const char* filename, const std::string& title) {
+        const int NUM_QUERIES = 20000;
+        Graph graph = *std::make_unique<Graph>(Serialize::load<Graph>(filename));
+        std::vector<uint64_t> id_vector = generateIdVector(&graph);
+        std::vector<std::pair<uint64_t, uint64_t>> queries;
+        ankerl::nanobench::Rng rng(42);
+        queries.reserve(NUM_QUERIES);
+        for (int i = 0; i < NUM_QUERIES; i++) {
+            queries.emplace_back(id_vector[rng.bounded(id_vector.size())], id_vector[rng.bounded(id_vector.size())]);
+        }
+
+        std::vector<std::pair<QueryGraph::Layout, std::string>> layouts{{QueryGraph::Layout::INPUT, "input"},
+                                                                         {QueryGraph::Layout::RANK, "rank"},
+                                                                         {QueryGraph::Layout::DFS, "dfs"}};
+        CacheMissCounter l1_misses(Cache::L1D), llc_misses(Cache::LLC);
+        std::cout << "\n" << title << " query graph layouts (" << NUM_QUERIES << " queries)" << std::endl;
+        std::cout << std::setw(8) << "layout" << std::setw(16) << "us/query" << std::setw(16) << "L1D miss/query"
+                  << std::setw(16) << "LLC miss/query" << std::endl;
+        for (const auto& [layout, name] : layouts) {
+            graph.buildQueryGraph(layout);
+            l1_misses.start();
+            llc_misses.start();
+            const auto start = std::chrono::steady_clock::now();
+            for (const auto& [source, target] : queries) {
+                ankerl::nanobench::doNotOptimizeAway(graph.getShortestPath(source, target));
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            const uint64_t l1 = l1_misses.stop(), llc = llc_misses.stop();
+            std::cout << std::setw(8) << name
+                      << std::setw(16) << std::chrono::duration<double, std::micro>(elapsed).count() / NUM_QUERIES
+                      << std::setw(16) << (l1_misses.available() ? std::to_string(l1 / NUM_QUERIES) : "n/a")
+                      << std::setw(16) << (llc_misses.available() ? std::to_string(llc / NUM_QUERIES) : "n/a") << std::endl;
+
+            size_t i = 0;
+            bench->minEpochIterations(2000).run(title + " (" + name + " layout)", [&]() {
+                const auto& query = queries[i++ % queries.size()];
+                graph.getShortestPath(query.first, query.second);
+            });
+        }
+    }
+
+    // Compares the throughput of distance queries that are processed one at a time and side by side in batches.
+    void batchBench(ankerl::nanobench::Bench* bench, const char* filename, const std::string& title) {
+        const int NUM_QUERIES = 10000;
+        Graph graph = *std::make_unique<Graph>(Serialize::load<Graph>(filename));
+        std::vector<uint64_t> id_vector = generateIdVector(&graph);
+        std::vector<std::pair<uint64_t, uint64_t>> queries;
+        ankerl::nanobench::Rng rng(42);
+        queries.reserve(NUM_QUERIES);
+        for (int i = 0; i < NUM_QUERIES; i++) {
+            queries.emplace_back(id_vector[rng.bounded(id_vector.size())], id_vector[rng.bounded(id_vector.size())]);
+        }
+
+        bench->batch(NUM_QUERIES).unit("query");
+        for (const int batch_size : {1, 4, 8, 16, 32}) {
+            bench->minEpochIterations(5).run(title + " (batch size " + std::to_string(batch_size) + ")", [&]() {
+                ankerl::nanobench::doNotOptimizeAway(graph.getShortestPathLengths(queries, batch_size));
+            });
+        }
+    }
+
+    // Compares the time it takes to find a complete route for different shortcut unpacking thresholds.
+    void unpackBench(ankerl::nanobench::Bench* bench, const char* filename, const std::string& title) {
+        Graph graph = *std::make_unique<Graph>(Serialize::load<Graph>(filename));
+        std::vector<uint64_t> id_vector = generateIdVector(&graph);
+        ankerl::nanobench::Rng rng(42);
+
+        std::cout << title << ": " << graph.getGeometry().getNumSegments() << " road segments encoded in "
+                  << graph.getGeometry().getNumBytes() << " bytes" << std::endl;
+        for (const uint32_t threshold : {0, 32, 8, 2}) {
+            graph.buildQueryGraph(QueryGraph::Layout::DFS, threshold);
+            std::cout << title << " (unpack threshold " << threshold << "): "
+                      << graph.getQueryGraph().getGeometrySize() << " stored original edges" << std::endl;
+            bench->minEpochIterations(2000).run(title + " (unpack threshold " + std::to_string(threshold) + ")", [&]() {
+                ankerl::nanobench::doNotOptimizeAway(graph.getShortestPath(id_vector[rng.bounded(id_vector.size())], id_vector[rng.bounded(id_vector.size())]));
+            });
+        }
+    }
+
+    // Prints the payload and the overhead of every component of a graph, so that changes to the memory layout can be tracked.
+    void printMemoryUsage(const Graph& graph, const std::string& title) {
+        const auto usage = graph.getMemoryUsage();
+        const auto megabytes = [](uint64_t bytes) { return double(bytes) / (1024 * 1024); };
+        std::cout << "\n" << title << " memory usage (" << graph.getNumVertices() << " vertices)" << std::endl;
+        std::cout << std::setw(12) << "component" << std::setw(14) << "payload MB" << std::setw(14) << "overhead MB"
+                  << std::setw(14) << "total MB" << std::setw(12) << "overhead" << std::endl;
+        for (const auto& component : usage.components) {
+            std::cout << std::setw(12) << component.name << std::fixed << std::setprecision(2)
+                      << std::setw(14) << megabytes(component.payload) << std::setw(14) << megabytes(component.overhead)
+                      << std::setw(14) << megabytes(component.getTotal())
+                      << std::setw(11) << (component.payload ? 100.0 * double(component.overhead) / double(component.payload) : 0.0) << "%"
+                      << std::endl;
+        }
+        std::cout << std::setw(12) << "total" << std::setw(14) << megabytes(usage.getPayload()) << std::setw(14)
+                  << megabytes(usage.getOverhead()) << std::setw(14) << megabytes(usage.getTotal()) << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    // Counts the vertices that the forward or the backward search of a query may settle: those reachable from a vertex
+    // over upward edges. Unlike the settled vertices of an actual query, this does not depend on the other endpoint.
+    uint32_t getSearchSpaceSize(const QueryGraph& query_graph, uint32_t source, bool backward, std::vector<uint32_t>* visited, uint32_t mark) {
+        std::vector<uint32_t> stack{source};
+        (*visited)[source] = mark;
+        uint32_t size = 0;
+        while (!stack.empty()) {
+            const uint32_t vertex = stack.back();
+            stack.pop_back();
+            size++;
+            for (const auto& edge : query_graph.getEdges(vertex, backward)) {
+                if ((*visited)[edge.head] == mark) { continue; }
+                (*visited)[edge.head] = mark;
+                stack.push_back(edge.head);
+            }
+        }
+        return size;
+    }
+
+    // Contracts a graph with each of the given priority coefficients and reports the preprocessing time, the number of
+    // shortcuts, the size of the search space of random queries and, if the library collects query statistics, the
+    // number of vertices that the bidirectional search settles per query. The report is printed and also written to a
+    // CSV file, so that the coefficients can be tuned for a region.
+    void tuneBench(const Graph& original, const std::string& title, const std::vector<HierarchyConstructor::Coefficients>& coefficients,
+                   const std::string& report_filename) {
+        const int NUM_QUERIES = 2000;
+        std::ofstream report(report_filename);
+        report << "edge_difference,deleted_neighbors,original_edges,level,preprocessing_s,shortcuts,search_space_mean,"
+                  "search_space_p99,settled_mean" << std::endl;
+        std::cout << "\n" << title << " contraction coefficients (" << original.getNumVertices() << " vertices, "
+                  << NUM_QUERIES << " queries)" << std::endl;
+        std::cout << std::setw(10) << "edge diff" << std::setw(10) << "deleted" << std::setw(10) << "original"
+                  << std::setw(8) << "level" << std::setw(14) << "preprocess s" << std::setw(12) << "shortcuts"
+                  << std::setw(14) << "space mean" << std::setw(12) << "space p99" << std::setw(14) << "settled mean" << std::endl;
+        for (const auto& coefficient : coefficients) {
+            Graph graph = original;
+            const auto start = std::chrono::steady_clock::now();
+            HierarchyConstructor(graph, coefficient).contractGraph();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // The same queries are used for every set of coefficients.
+            const QueryGraph& query_graph = graph.getQueryGraph();
+            std::vector<uint32_t> visited(query_graph.getNumVertices(), 0), sizes;
+            ankerl::nanobench::Rng rng(42);
+            uint32_t mark = 0;
+            QueryStats stats;
+            for (int i = 0; i < NUM_QUERIES; i++) {
+                const auto source = uint32_t(rng.bounded(query_graph.getNumVertices()));
+                const auto target = uint32_t(rng.bounded(query_graph.getNumVertices()));
+                const uint32_t forward = getSearchSpaceSize(query_graph, source, false, &visited, ++mark);
+                sizes.push_back(forward + getSearchSpaceSize(query_graph, target, true, &visited, ++mark));
+                if (QueryStats::ENABLED) { graph.getShortestPath(query_graph.getId(source), query_graph.getId(target), false, &stats); }
+            }
+            std::sort(sizes.begin(), sizes.end());
+            const double mean = double(std::accumulate(sizes.begin(), sizes.end(), uint64_t(0))) / double(sizes.size());
+            const uint32_t p99 = sizes[sizes.size() * 99 / 100];
+            const uint64_t shortcuts = graph.getNumEdges() - original.getNumEdges();
+            const std::string settled = QueryStats::ENABLED ? std::to_string(double(stats.settled_forward + stats.settled_backward) / NUM_QUERIES) : "n/a";
+
+            std::cout << std::setw(10) << coefficient.edge_difference << std::setw(10) << coefficient.deleted_neighbors
+                      << std::setw(10) << coefficient.original_edges << std::setw(8) << coefficient.level
+                      << std::setw(14) << seconds << std::setw(12) << shortcuts << std::setw(14) << mean
+                      << std::setw(12) << p99 << std::setw(14) << settled << std::endl;
+            report << coefficient.edge_difference << "," << coefficient.deleted_neighbors << "," << coefficient.original_edges
+                   << "," << coefficient.level << "," << seconds << "," << shortcuts << "," << mean << "," << p99 << ","
+                   << settled << std::endl;
         }
-        return id_vector;
     }
 
     // Benchmarks how long it takes to find a route.
@@ -76,6 +295,255 @@ TEST_CASE( "Queue::MinHeap pop and push benchmark time complexity", "[MinHeap]")
     std::cout << bench.complexityBigO() << std::endl;
 }
 
+TEST_CASE("Memory usage of the input graphs", "[MemoryUsage]") {
+    const std::vector<std::pair<const char*, std::string>> files{
+            {"denver_graph.bin", "City of Denver"}, {"denver_graph_contracted.bin", "City of Denver (contracted)"},
+            {"massachusetts_graph_contracted.bin", "State of Massachusetts (contracted)"},
+            {"us_northeast_graph_contracted.bin", "US NorthEast (contracted)"}, {"us_south_graph_contracted.bin", "US South (contracted)"}};
+    for (const auto& [filename, title] : files) {
+        // The larger graphs are not part of the repository.
+        if (!std::ifstream(filename)) { continue; }
+        printMemoryUsage(Serialize::load<Graph>(filename), title);
+    }
+}
+
+TEST_CASE("Import and contraction of the example map", "[Preprocessing]") {
+    // The example map is found in the bin directory of the repository.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    const auto start = std::chrono::steady_clock::now();
+    Parser parser(filename);
+    Graph graph = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    const auto imported = std::chrono::steady_clock::now();
+    HierarchyConstructor builder(graph, 170, 190);
+    builder.contractGraph();
+    const auto contracted = std::chrono::steady_clock::now();
+    // The peak resident set size is only reported on Linux.
+    std::string peak_rss = "n/a";
+#ifdef __linux__
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    peak_rss = std::to_string(double(usage.ru_maxrss) / 1024) + " MB";
+#endif
+    std::cout << "\nExample map (" << graph.getNumVertices() << " vertices): import "
+              << std::chrono::duration<double>(imported - start).count() << " s, contraction "
+              << std::chrono::duration<double>(contracted - imported).count() << " s (initial ordering "
+              << builder.getTimings().initial_ordering << " s), peak RSS " << peak_rss << std::endl;
+}
+
+TEST_CASE("Contraction coefficients of the example map", "[Tuning]") {
+    // The map can be replaced by setting CH_TUNING_MAP to another OSM file, e.g. an extract of the region being tuned.
+    const char* filename = std::getenv("CH_TUNING_MAP") ? std::getenv("CH_TUNING_MAP") : "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    const Graph graph = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    std::vector<HierarchyConstructor::Coefficients> coefficients;
+    for (const int edge_difference : {0, 50, 100, 170, 250, 400}) {
+        for (const int deleted_neighbors : {0, 100, 190, 300}) {
+            coefficients.push_back({edge_difference, deleted_neighbors, 0, 0});
+        }
+    }
+    for (const int original_edges : {50, 100, 200}) {
+        for (const int level : {0, 100, 300}) {
+            coefficients.push_back({170, 190, original_edges, level});
+        }
+    }
+    for (const int level : {100, 300}) { coefficients.push_back({170, 190, 0, level}); }
+    tuneBench(graph, filename, coefficients, "contraction_tuning.csv");
+}
+
+TEST_CASE("Priority terms of the example map", "[Priority]") {
+    // Build the library with CH_QUERY_STATS to also report the vertices settled by the bidirectional search.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    const Graph graph = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    tuneBench(graph, "Priority terms of the example map", {{170, 190, 0, 0}, {170, 190, 100, 0}, {170, 190, 0, 100},
+                                                         {170, 190, 100, 100}}, "contraction_priority_terms.csv");
+}
+
+TEST_CASE("Contraction orderings of the example map", "[Ordering]") {
+    // The example map is found in the bin directory of the repository.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    const Graph original = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    ankerl::nanobench::Bench bench;
+    bench.title("Contraction orderings of the example map");
+    bench.timeUnit(std::chrono::microseconds(1), "us");
+    const std::vector<std::pair<HierarchyConstructor::Ordering, std::string>> orderings{
+        {HierarchyConstructor::Ordering::GREEDY, "greedy"}, {HierarchyConstructor::Ordering::NESTED_DISSECTION, "nested dissection"}};
+    for (const auto& [ordering, name] : orderings) {
+        Graph graph = original;
+        HierarchyConstructor builder(graph);
+        builder.setOrdering(ordering);
+        builder.contractGraph();
+        const QueryGraph& query_graph = graph.getQueryGraph();
+        std::vector<uint32_t> visited(query_graph.getNumVertices(), 0);
+        uint64_t search_space = 0;
+        for (uint32_t vertex = 0; vertex < query_graph.getNumVertices(); vertex++) {
+            search_space += getSearchSpaceSize(query_graph, vertex, false, &visited, vertex + 1);
+        }
+        std::cout << "\n" << name << ": ordering " << builder.getTimings().initial_ordering << " s, contraction "
+                  << builder.getTimings().contraction << " s, " << graph.getNumEdges() - original.getNumEdges()
+                  << " shortcuts, mean forward search space " << double(search_space) / query_graph.getNumVertices() << std::endl;
+
+        std::vector<uint64_t> id_vector = generateIdVector(&graph);
+        ankerl::nanobench::Rng rng(42);
+        bench.minEpochIterations(2000).run("Query (" + name + " ordering)", [&]() {
+            ankerl::nanobench::doNotOptimizeAway(graph.getShortestPath(id_vector[rng.bounded(id_vector.size())], id_vector[rng.bounded(id_vector.size())]));
+        });
+    }
+}
+
+TEST_CASE("Witness search limits of the example map", "[Witness]") {
+    // The example map is found in the bin directory of the repository.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    const Graph original = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    const std::vector<std::pair<std::vector<HierarchyConstructor::WitnessLimit>, std::string>> limits{
+        {{{std::numeric_limits<double>::infinity(), std::numeric_limits<int>::max(), 1000}}, "unstaged"},
+        {HierarchyConstructor::STAGED_WITNESS_LIMITS, "staged"}};
+    for (const auto& [limit, name] : limits) {
+        Graph graph = original;
+        HierarchyConstructor builder(graph);
+        builder.setWitnessLimits(limit);
+        builder.contractGraph();
+        std::cout << "\n" << name << " witness limits: initial ordering " << builder.getTimings().initial_ordering
+                  << " s, contraction " << builder.getTimings().contraction << " s, "
+                  << graph.getNumEdges() - original.getNumEdges() << " shortcuts" << std::endl;
+    }
+}
+
+TEST_CASE("Alternative routes on the example map", "[AlternativeRoutes]") {
+    // The example map is found in the bin directory of the repository.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    Graph graph = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    HierarchyConstructor(graph).contractGraph();
+    std::vector<uint64_t> id_vector = generateIdVector(&graph);
+
+    // The number of routes found for the same queries that are timed below.
+    const int NUM_QUERIES = 1000;
+    ankerl::nanobench::Rng count_rng(42);
+    size_t num_routes = 0;
+    for (int i = 0; i < NUM_QUERIES; i++) {
+        num_routes += graph.getAlternativeRoutes(id_vector[count_rng.bounded(id_vector.size())], id_vector[count_rng.bounded(id_vector.size())]).size();
+    }
+    std::cout << "\nAlternative routes of the example map: " << double(num_routes) / NUM_QUERIES << " routes per query" << std::endl;
+
+    ankerl::nanobench::Bench bench;
+    bench.title("Alternative routes on the example map");
+    bench.timeUnit(std::chrono::microseconds(1), "us");
+    ankerl::nanobench::Rng rng(42);
+    bench.minEpochIterations(2000).run("Shortest route", [&]() {
+        ankerl::nanobench::doNotOptimizeAway(graph.getShortestRoute(id_vector[rng.bounded(id_vector.size())], id_vector[rng.bounded(id_vector.size())]));
+    });
+    rng = ankerl::nanobench::Rng(42);
+    bench.minEpochIterations(2000).run("Shortest and alternative routes", [&]() {
+        ankerl::nanobench::doNotOptimizeAway(graph.getAlternativeRoutes(id_vector[rng.bounded(id_vector.size())], id_vector[rng.bounded(id_vector.size())]));
+    });
+}
+
+TEST_CASE("Waypoint routes on the example map", "[Waypoints]") {
+    // The example map is found in the bin directory of the repository.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    Graph graph = parser.constructRoadNetworkGraph(true, "minutes", "miles");
+    HierarchyConstructor(graph).contractGraph();
+    std::vector<uint64_t> id_vector = generateIdVector(&graph);
+    ankerl::nanobench::Rng rng(42);
+    std::vector<uint64_t> waypoints(10);
+
+    // Routes through ten stops, either leg by leg or in one call.
+    ankerl::nanobench::Bench bench;
+    bench.title("Waypoint routes on the example map");
+    bench.timeUnit(std::chrono::microseconds(1), "us");
+    bench.minEpochIterations(200).run("Leg by leg", [&]() {
+        for (auto& waypoint : waypoints) { waypoint = id_vector[rng.bounded(id_vector.size())]; }
+        std::vector<std::array<double, 2>> coordinates;
+        for (size_t i = 0; i + 1 < waypoints.size(); i++) {
+            const auto leg = graph.getShortestRoute(waypoints[i], waypoints[i + 1]);
+            if (leg.second < 0) { continue; }
+            coordinates.insert(coordinates.end(), leg.first.begin() + (coordinates.empty() ? 0 : 1), leg.first.end());
+        }
+        ankerl::nanobench::doNotOptimizeAway(coordinates);
+    });
+    rng = ankerl::nanobench::Rng(42);
+    std::vector<double> leg_weights;
+    std::vector<uint64_t> waypoint_offsets;
+    bench.minEpochIterations(200).run("One call", [&]() {
+        for (auto& waypoint : waypoints) { waypoint = id_vector[rng.bounded(id_vector.size())]; }
+        ankerl::nanobench::doNotOptimizeAway(graph.getWaypointRoute(waypoints, &leg_weights, &waypoint_offsets));
+    });
+}
+
+TEST_CASE("Memory usage of several routing profiles", "[Profile]") {
+    // The example map is found in the bin directory of the repository.
+    const char* filename = "example_map_data.osm";
+    if (!std::ifstream(filename)) { return; }
+    Parser parser(filename);
+    const std::vector<Profile> profiles{Profile::car(), Profile::truck(), Profile::bicycle()};
+    const auto megabytes = [](uint64_t bytes) { return double(bytes) / (1024 * 1024); };
+    // Components that are shared by the graphs are only counted once.
+    const auto shared_total = [](const std::vector<Graph>& graphs) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < graphs.size(); i++) {
+            for (const auto& component : graphs[i].getMemoryUsage().components) {
+                if (i == 0 || !component.shared) { total += component.getTotal(); }
+            }
+        }
+        return total;
+    };
+    const auto file_size = [](const std::string& name) { return uint64_t(std::ifstream(name, std::ios::binary | std::ios::ate).tellg()); };
+    std::cout << "\nCar, truck and bicycle profiles of the example map:" << std::fixed << std::setprecision(2) << std::endl;
+
+    // Every profile that is added to a shared road network should only add its weights and its query graph.
+    std::vector<Graph> graphs;
+    double previous = 0;
+    for (size_t num_profiles = 1; num_profiles <= profiles.size(); num_profiles++) {
+        graphs = parser.constructRoadNetworkGraphs(std::vector<Profile>(profiles.begin(), profiles.begin() + num_profiles));
+        for (auto& graph : graphs) { HierarchyConstructor(graph, 170, 190).contractGraph(); }
+        const MemoryUsage usage = graphs.back().getMemoryUsage();
+        const double total = megabytes(shared_total(graphs));
+        std::cout << num_profiles << " shared: " << total << " MB, +" << total - previous << " MB for " << profiles[num_profiles - 1].name
+                  << " (weights " << megabytes(usage.get("weights").getTotal()) << " MB, query graph "
+                  << megabytes(usage.get("query_graph").getTotal()) << " MB)" << std::endl;
+        previous = total;
+    }
+
+    // The baseline imports and contracts every profile on its own. Its graphs have the same compact layout as the shared
+    // graphs, but each of them holds its own road network and geometry.
+    std::vector<Graph> separate;
+    uint64_t separate_total = 0;
+    for (const auto& profile : profiles) {
+        separate.push_back(std::move(parser.constructRoadNetworkGraphs({profile}).front()));
+        HierarchyConstructor(separate.back(), 170, 190).contractGraph();
+        separate_total += separate.back().getMemoryUsage().getTotal();
+    }
+    std::cout << profiles.size() << " imported separately: " << megabytes(separate_total) << " MB" << std::endl;
+
+    // A deployment maps either one flat file of all profiles, or a flat file per profile.
+    const char* profiles_filename = "example_map_profiles.flat";
+    std::vector<std::pair<std::string, const Graph*>> named;
+    for (size_t i = 0; i < profiles.size(); i++) { named.emplace_back(profiles[i].name, &graphs[i]); }
+    Graph::saveProfilesFlat(profiles_filename, named);
+    uint64_t separate_size = 0;
+    for (size_t i = 0; i < profiles.size(); i++) {
+        const std::string separate_filename = "example_map_" + profiles[i].name + ".flat";
+        separate[i].saveFlat(separate_filename.c_str());
+        separate_size += file_size(separate_filename);
+        std::remove(separate_filename.c_str());
+    }
+    std::cout << "Flat files: " << megabytes(file_size(profiles_filename)) << " MB for all profiles, " << megabytes(separate_size)
+              << " MB for a file per profile" << std::endl;
+    std::remove(profiles_filename);
+    std::cout.unsetf(std::ios::fixed);
+}
+
 TEST_CASE("Bidirectional search on city of Denver", "[BidirectionalSearch]") {
     ankerl::nanobench::Bench bench;
     bench.title("Bidirectional search on city of Denver");
@@ -84,6 +552,32 @@ TEST_CASE("Bidirectional search on city of Denver", "[BidirectionalSearch]") {
     searchBench(&bench, "Bidirectional Search", &graph, false);
 }
 
+TEST_CASE("Query graph layout on city of Denver", "[QueryGraph]") {
+    ankerl::nanobench::Bench bench;
+    bench.title("Query graph layout on city of Denver");
+    bench.timeUnit(std::chrono::microseconds(1), "us");
+    layoutBench(&bench, "denver_graph_contracted.bin", "City of Denver");
+}
+
+TEST_CASE("Shortcut unpacking on city of Denver", "[QueryGraph]") {
+    ankerl::nanobench::Bench bench;
+    bench.title("Shortcut unpacking on city of Denver");
+    bench.timeUnit(std::chrono::microseconds(1), "us");
+    unpackBench(&bench, "denver_graph_contracted.bin", "City of Denver");
+}
+
+TEST_CASE("Batched distance queries on city of Denver", "[BatchSearch]") {
+    ankerl::nanobench::Bench bench;
+    bench.title("Batched distance queries on city of Denver");
+    batchBench(&bench, "denver_graph_contracted.bin", "City of Denver");
+}
+
+TEST_CASE("Batched distance queries on state of Massachusetts", "[BatchSearch]") {
+    ankerl::nanobench::Bench bench;
+    bench.title("Batched distance queries on state of Massachusetts");
+    batchBench(&bench, "massachusetts_graph_contracted.bin", "State of Massachusetts");
+}
+
 TEST_CASE("Bidirectional search on state of Massachusetts benchmark", "[BidirectionalSearch]") {
     ankerl::nanobench::Bench bench;
     bench.title("Bidirectional search on state of Massachusetts");
@@ -1,13 +1,169 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <stdexcept>
 #include "RoutingEngine.h"
 
 namespace py = pybind11;
 
+namespace {
+    // A one dimensional array of OSM Node IDs. Arrays of other integer types are converted, contiguous uint64 arrays
+    // are used as is.
+    using IdArray = py::array_t<uint64_t, py::array::c_style | py::array::forcecast>;
+
+    // Hands a vector over to NumPy without copying it. The array keeps the vector alive.
+    template <class T>
+    py::array_t<T> toArray(std::vector<T>&& values, std::vector<py::ssize_t> shape) {
+        auto* owner = new std::vector<T>(std::move(values));
+        py::capsule free_when_done(owner, [](void* pointer) { delete reinterpret_cast<std::vector<T>*>(pointer); });
+        return py::array_t<T>(shape, owner->data(), free_when_done);
+    }
+
+    void checkQueries(const IdArray& sources, const IdArray& targets) {
+        if (sources.ndim() != 1 || targets.ndim() != 1) { throw std::invalid_argument("Sources and targets must be one dimensional arrays."); }
+        if (sources.size() != targets.size()) { throw std::invalid_argument("Sources and targets must have the same length."); }
+    }
+}
+
 PYBIND11_MODULE(OSM, m) {
+    py::class_<QueryStats>(m, "QueryStats")
+            .def_readonly_static("enabled", &QueryStats::ENABLED)
+            .def_readonly("settled_forward", &QueryStats::settled_forward)
+            .def_readonly("settled_backward", &QueryStats::settled_backward)
+            .def_readonly("relaxed_edges", &QueryStats::relaxed_edges)
+            .def_readonly("heap_pushes", &QueryStats::heap_pushes)
+            .def_readonly("heap_pops", &QueryStats::heap_pops)
+            .def_readonly("unpacked_shortcuts", &QueryStats::unpacked_shortcuts)
+            .def_readonly("path_nodes", &QueryStats::path_nodes)
+            .def_readonly("search_ns", &QueryStats::search_ns)
+            .def_readonly("reconstruct_ns", &QueryStats::reconstruct_ns)
+            .def_readonly("unpack_ns", &QueryStats::unpack_ns)
+            .def_readonly("geometry_ns", &QueryStats::geometry_ns);
+
+    py::class_<OSM::RouteCache::Statistics>(m, "RouteCacheStatistics")
+            .def_readonly("hits", &OSM::RouteCache::Statistics::hits)
+            .def_readonly("misses", &OSM::RouteCache::Statistics::misses)
+            .def_readonly("insertions", &OSM::RouteCache::Statistics::insertions)
+            .def_readonly("evictions", &OSM::RouteCache::Statistics::evictions)
+            .def_readonly("overwrites", &OSM::RouteCache::Statistics::overwrites)
+            .def_readonly("size", &OSM::RouteCache::Statistics::size)
+            .def_property_readonly("hit_rate", &OSM::RouteCache::Statistics::getHitRate);
+
+    py::class_<MemoryUsage::Component>(m, "MemoryUsageComponent")
+            .def_readonly("name", &MemoryUsage::Component::name)
+            .def_readonly("payload", &MemoryUsage::Component::payload)
+            .def_readonly("overhead", &MemoryUsage::Component::overhead)
+            .def_readonly("mapped", &MemoryUsage::Component::mapped)
+            .def_readonly("shared", &MemoryUsage::Component::shared)
+            .def_property_readonly("total", &MemoryUsage::Component::getTotal);
+
+    py::class_<MemoryUsage>(m, "MemoryUsage")
+            .def_readonly("components", &MemoryUsage::components)
+            .def_property_readonly("payload", &MemoryUsage::getPayload)
+            .def_property_readonly("overhead", &MemoryUsage::getOverhead)
+            .def_property_readonly("total", &MemoryUsage::getTotal);
+
     py::class_<OSM::RoutingEngine>(m, "RoutingEngine")
             .def(py::init<>())
-            .def("loadRoutingData", &OSM::RoutingEngine::loadRoutingData)
-            .def("computeRoute", &OSM::RoutingEngine::computeRoute);
+            // Loading releases the GIL, so a graph can be refreshed from a background thread while other threads route.
+            .def("loadRoutingData", &OSM::RoutingEngine::loadRoutingData, py::call_guard<py::gil_scoped_release>())
+            // Maps a flat graph file read-only. Worker processes that map the same file share one copy of the graph.
+            .def("mapRoutingData", &OSM::RoutingEngine::mapRoutingData, py::call_guard<py::gil_scoped_release>())
+            // Every query takes the name of a routing profile. By default, the first profile is used.
+            .def("getProfiles", &OSM::RoutingEngine::getProfiles)
+            .def("computeRoute", py::overload_cast<uint64_t, uint64_t, bool, const std::string&>(&OSM::RoutingEngine::computeRoute),
+                 py::arg("source"), py::arg("target"), py::arg("standard") = false, py::arg("profile") = "",
+                 py::call_guard<py::gil_scoped_release>())
+            // Returns the route through all the waypoints, its cost, the cost of every leg, and the position of every
+            // waypoint in the route.
+            .def("computeRoute", [](OSM::RoutingEngine& engine, const std::vector<uint64_t>& waypoints, int num_threads, const std::string& profile) {
+                OSM::WaypointRoute route;
+                {
+                    py::gil_scoped_release release;
+                    route = engine.computeRoute(waypoints, num_threads, profile);
+                }
+                return py::make_tuple(route.coordinates, route.cost, route.leg_costs, route.waypoint_offsets);
+            }, py::arg("waypoints"), py::arg("num_threads") = 1, py::arg("profile") = "")
+            // Returns the route, its cost, and the statistics of the query (all zero unless built with CH_QUERY_STATS).
+            .def("computeRouteWithStats", [](OSM::RoutingEngine& engine, uint64_t source, uint64_t target, bool standard, const std::string& profile) {
+                QueryStats stats;
+                std::pair<std::vector<std::array<double, 2>>, double> route;
+                {
+                    py::gil_scoped_release release;
+                    route = engine.computeRoute(source, target, standard, &stats, profile);
+                }
+                return py::make_tuple(route.first, route.second, stats);
+            }, py::arg("source"), py::arg("target"), py::arg("standard") = false, py::arg("profile") = "")
+            // Returns a list of (route, cost) pairs: the optimal route followed by the alternative routes.
+            .def("computeAlternativeRoutes", [](OSM::RoutingEngine& engine, uint64_t source, uint64_t target, int max_alternatives,
+                                                double max_stretch, double max_sharing, double local_optimality, const std::string& profile) {
+                const AlternativeRouteOptions options{max_alternatives, max_stretch, max_sharing, local_optimality};
+                return engine.computeAlternativeRoutes(source, target, options, profile);
+            }, py::arg("source"), py::arg("target"), py::arg("max_alternatives") = 2, py::arg("max_stretch") = 0.25,
+                 py::arg("max_sharing") = 0.8, py::arg("local_optimality") = 0.25, py::arg("profile") = "",
+                 py::call_guard<py::gil_scoped_release>())
+            .def("computeEncodedRoute", &OSM::RoutingEngine::computeEncodedRoute, py::arg("source"), py::arg("target"),
+                 py::arg("tolerance") = 0.0, py::arg("precision") = 5, py::arg("standard") = false, py::arg("profile") = "",
+                 py::call_guard<py::gil_scoped_release>())
+            // Returns an array with the cost of every route, or -1 if there is no route.
+            .def("computeRouteCosts", [](OSM::RoutingEngine& engine, const IdArray& sources, const IdArray& targets, int num_threads,
+                                         const std::string& profile) {
+                checkQueries(sources, targets);
+                py::array_t<double> costs(sources.size());
+                const uint64_t* source_data = sources.data();
+                const uint64_t* target_data = targets.data();
+                double* cost_data = costs.mutable_data();
+                const auto num_queries = size_t(sources.size());
+                {
+                    py::gil_scoped_release release;
+                    engine.computeRouteCosts(source_data, target_data, num_queries, cost_data, num_threads, profile);
+                }
+                return costs;
+            }, py::arg("sources"), py::arg("targets"), py::arg("num_threads") = 0, py::arg("profile") = "")
+            // Returns a matrix in which entry [i, j] is the cost of the route from sources[i] to targets[j].
+            .def("computeCostMatrix", [](OSM::RoutingEngine& engine, const IdArray& sources, const IdArray& targets, int num_threads,
+                                         const std::string& profile) {
+                if (sources.ndim() != 1 || targets.ndim() != 1) { throw std::invalid_argument("Sources and targets must be one dimensional arrays."); }
+                const auto num_sources = size_t(sources.size()), num_targets = size_t(targets.size());
+                py::array_t<double> costs({py::ssize_t(num_sources), py::ssize_t(num_targets)});
+                const uint64_t* source_data = sources.data();
+                const uint64_t* target_data = targets.data();
+                double* cost_data = costs.mutable_data();
+                {
+                    py::gil_scoped_release release;
+                    std::vector<uint64_t> query_sources, query_targets;
+                    query_sources.reserve(num_sources * num_targets);
+                    query_targets.reserve(num_sources * num_targets);
+                    for (size_t i = 0; i < num_sources; i++) {
+                        query_sources.insert(query_sources.end(), num_targets, source_data[i]);
+                        query_targets.insert(query_targets.end(), target_data, target_data + num_targets);
+                    }
+                    engine.computeRouteCosts(query_sources.data(), query_targets.data(), query_sources.size(), cost_data, num_threads, profile);
+                }
+                return costs;
+            }, py::arg("sources"), py::arg("targets"), py::arg("num_threads") = 0, py::arg("profile") = "")
+            // Returns the cost of every route, the points of all routes as an (n, 2) array of latitudes and longitudes,
+            // and the offsets of the routes: route i is made up of the points [offsets[i], offsets[i + 1]).
+            .def("computeRoutes", [](OSM::RoutingEngine& engine, const IdArray& sources, const IdArray& targets, int num_threads,
+                                     const std::string& profile) {
+                checkQueries(sources, targets);
+                const uint64_t* source_data = sources.data();
+                const uint64_t* target_data = targets.data();
+                const auto num_queries = size_t(sources.size());
+                OSM::RouteBatch batch;
+                {
+                    py::gil_scoped_release release;
+                    batch = engine.computeRoutes(source_data, target_data, num_queries, num_threads, profile);
+                }
+                const auto num_points = py::ssize_t(batch.coordinates.size() / 2);
+                const auto num_offsets = py::ssize_t(batch.offsets.size());
+                return py::make_tuple(toArray(std::move(batch.costs), {py::ssize_t(num_queries)}),
+                                      toArray(std::move(batch.coordinates), {num_points, 2}),
+                                      toArray(std::move(batch.offsets), {num_offsets}));
+            }, py::arg("sources"), py::arg("targets"), py::arg("num_threads") = 0, py::arg("profile") = "")
+            .def("enableRouteCache", &OSM::RoutingEngine::enableRouteCache, py::arg("capacity"), py::arg("num_shards") = 16)
+            .def("getRouteCacheStatistics", &OSM::RoutingEngine::getRouteCacheStatistics)
+            .def("getMemoryUsage", &OSM::RoutingEngine::getMemoryUsage, py::arg("profile") = "")
+            .def("exportMetrics", &OSM::RoutingEngine::exportMetrics)
+            .def("getMetrics", &OSM::RoutingEngine::getMetrics);
 }
-
@@ -4,9 +4,84 @@
 #include "Graph.h"
 #include "OsmParser.h"
 #include "HierarchyConstructor.h"
+#include "Polyline.h"
+#include "RoutingEngine.h"
 #include <stdexcept>
 #include <random>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <limits>
+#include <functional>
+#include <set>
+
+namespace {
+    /**
+     * Retrieves the IDs of the vertices of a graph in increasing order, so that the vertices that a test draws do not
+     * depend on the order of a hash map.
+     * @param graph The graph.
+     * @return The sorted IDs of the vertices.
+     */
+    std::vector<uint64_t> getSortedIds(const Graph& graph) {
+        std::vector<uint64_t> ids(graph.getVertexIds().begin(), graph.getVertexIds().end());
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    /**
+     * Draws random pairs of vertices to route between.
+     * @param ids The IDs of the vertices to draw from.
+     * @param num_queries The number of pairs.
+     * @param seed The seed of the random number generator.
+     * @return The pairs of source and target IDs.
+     */
+    std::vector<std::pair<uint64_t, uint64_t>> getRandomQueries(const std::vector<uint64_t>& ids, const size_t num_queries, const unsigned seed) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<size_t> dist(0, ids.size() - 1);
+        std::vector<std::pair<uint64_t, uint64_t>> queries;
+        for (size_t i = 0; i < num_queries; i++) {
+            const uint64_t source = ids[dist(rng)];
+            queries.emplace_back(source, ids[dist(rng)]);
+        }
+        return queries;
+    }
+
+    // A contracted engine for test_input2.osm, shared by the tests of the engine.
+    class EngineFixture {
+
+    protected:
+
+        OSM::RoutingEngine engine{"test_input2.osm", true};
+
+        // The IDs of the vertices of the graph of the engine, in increasing order.
+        const std::vector<uint64_t> ids = getSortedIds(*engine.getGraph());
+    };
+
+    // The road network of test_input1.osm, which the tests of the contraction compare their hierarchies against.
+    class NetworkFixture {
+
+    protected:
+
+        // The graph as parsed, before it is contracted.
+        const Graph original = Parser("test_input1.osm").constructRoadNetworkGraph();
+
+        // The IDs of the vertices of the graph, in increasing order.
+        const std::vector<uint64_t> ids = getSortedIds(original);
+
+        /**
+         * Checks that a graph finds the same distances as the graph as parsed, between random vertices.
+         * @param graph The graph, usually a contracted copy of the graph as parsed.
+         * @param seed The seed of the random number generator that draws the vertices.
+         */
+        void requireOriginalDistances(const Graph& graph, const unsigned seed) const {
+            for (const auto& [source, target] : getRandomQueries(ids, 200, seed)) {
+                REQUIRE(graph.getShortestPath(source, target).second == Approx(original.getShortestPath(source, target).second));
+            }
+        }
+    };
+}
 
 TEST_CASE( "Queue::MinHeap pop and push test", "[MinHeap]") {
     Queue::MinHeap<int> Q1;
@@ -209,6 +284,91 @@ TEST_CASE( "Graph getNumVertices and getNumEdges test", "[Graph]") {
     REQUIRE(graph3.getNumVertices() == 0 );
 }
 
+TEST_CASE( "Graph getVertexIds, getVertex, and getEdges test", "[Graph]") {
+    Graph graph;
+    graph.addEdge(1, 2, 4, true);
+    graph.addEdge(2, 3, 5, false);
+    graph.addEdge(4, 5, 6, false);
+    graph.removeEdge(4, 5);
+    std::vector<uint64_t> ids(graph.getVertexIds().begin(), graph.getVertexIds().end());
+    std::sort(ids.begin(), ids.end());
+    REQUIRE(ids == std::vector<uint64_t>{1, 2, 3, 4, 5});
+    REQUIRE(graph.getVertexIds().size() == graph.getNumVertices());
+
+    REQUIRE(&graph.getVertex(2) == &graph.getVertex(2));
+    REQUIRE(graph.getVertex(2).out_edges.size() == 2);
+    REQUIRE(graph.getVertex(2).in_edges.at(1) == 4);
+    REQUIRE(graph.getVertex(4).out_edges.empty());
+    REQUIRE_THROWS_AS(graph.getVertex(6), std::logic_error);
+
+    // Every edge that was added is visited once. Removing an edge only removes it from the adjacency of its vertices.
+    std::vector<std::pair<uint64_t, uint64_t>> edges;
+    for (const auto& edge : graph.getEdges()) { edges.emplace_back(edge.start, edge.end); }
+    std::sort(edges.begin(), edges.end());
+    REQUIRE(edges == std::vector<std::pair<uint64_t, uint64_t>>{{1, 2}, {2, 1}, {2, 3}, {4, 5}});
+    const Graph empty;
+    REQUIRE(empty.getEdges().begin() == empty.getEdges().end());
+}
+
+TEST_CASE( "FlatHashMap test", "[FlatHashMap]") {
+    FlatHashMap<uint64_t, double> map;
+    std::unordered_map<uint64_t, double> expected;
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 20000; i++) {
+        const uint64_t key = rng() % 5000;
+        if (rng() % 3 == 0) {
+            REQUIRE(map.erase(key) == expected.erase(key));
+        }
+        else {
+            map[key] = double(i);
+            expected[key] = double(i);
+        }
+    }
+    REQUIRE(map.size() == expected.size());
+    for (const auto& [key, value] : expected) { REQUIRE(map.at(key) == value); }
+    REQUIRE(map.find(5000) == map.end());
+    REQUIRE_THROWS_AS(map.at(5000), std::out_of_range);
+
+    // Erasing while iterating visits every element once.
+    size_t num_visited = 0;
+    for (auto it = map.begin(); it != map.end();) {
+        num_visited++;
+        it = it->first % 2 == 0 ? map.erase(it) : std::next(it);
+    }
+    REQUIRE(num_visited == expected.size());
+    for (const auto& [key, value] : map) { REQUIRE(key % 2 == 1); }
+
+    // Like std::unordered_map, the keys cannot be changed through an iterator, but the values can.
+    static_assert(std::is_same_v<decltype(map.begin()->first), const uint64_t>);
+    for (auto& [key, value] : map) { value = double(key); }
+    const auto copy = map;
+    REQUIRE(copy.size() == map.size());
+    for (const auto& [key, value] : copy) { REQUIRE(value == double(key)); }
+
+    // Values that own memory are destroyed when they are erased, rehashed and cleared.
+    FlatHashMap<uint64_t, std::string> names;
+    for (uint64_t key = 0; key < 100; key++) { names.emplace(key, std::string(32, char('a' + key % 26))); }
+    for (uint64_t key = 0; key < 100; key += 2) { names.erase(key); }
+    REQUIRE(names.size() == 50);
+    REQUIRE(names.at(51) == std::string(32, char('a' + 51 % 26)));
+    names.clear();
+    REQUIRE(names.empty());
+
+    // The map is serialized in the same format as std::unordered_map.
+    std::stringstream stream;
+    {
+        cereal::BinaryOutputArchive archive(stream);
+        archive(expected);
+    }
+    FlatHashMap<uint64_t, double> loaded;
+    {
+        cereal::BinaryInputArchive archive(stream);
+        archive(loaded);
+    }
+    REQUIRE(loaded.size() == expected.size());
+    for (const auto& [key, value] : expected) { REQUIRE(loaded.at(key) == value); }
+}
+
 TEST_CASE( "Simple Bidirectional Dijkstra test", "[BidirectionalSearch]") {
     Graph graph1;
     graph1.addEdge(1, 2, 5, true);
@@ -430,3 +590,1098 @@ TEST_CASE( "Comprehensive contraction hierarchies test", "[BidirectionalSearch]"
         num_tests_conducted = 0;
     }
 }
+
+TEST_CASE_METHOD( NetworkFixture, "Parallel initial ordering test", "[HierarchyConstructor]") {
+    const auto queries = getRandomQueries(ids, 200, 3);
+
+    // The initial ordering does not depend on the number of threads that compute it, and neither do the distances.
+    std::vector<std::vector<double>> lengths;
+    for (const int num_threads : {1, 4}) {
+        Graph graph = original;
+        HierarchyConstructor builder(graph, 170, 190, num_threads);
+        builder.contractGraph();
+        REQUIRE(builder.getTimings().initial_ordering > 0);
+        REQUIRE(builder.getTimings().contraction > 0);
+        lengths.push_back(graph.getShortestPathLengths(queries));
+    }
+    for (size_t i = 0; i < queries.size(); i++) {
+        REQUIRE(lengths[0][i] == Approx(lengths[1][i]));
+        REQUIRE(lengths[0][i] == Approx(original.getShortestPath(queries[i].first, queries[i].second).second));
+    }
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Contraction checkpoint test", "[HierarchyConstructor]") {
+    const std::string checkpoint = "contraction_checkpoint.bin";
+    std::remove(checkpoint.c_str());
+
+    Graph expected = original;
+    HierarchyConstructor(expected).contractGraph();
+
+    // A contraction that is stopped three times and resumed from its checkpoint gives the same hierarchy.
+    Graph graph = original;
+    for (int i = 0; i < 3; i++) {
+        graph = original;
+        HierarchyConstructor builder(graph);
+        builder.setCheckpoint(checkpoint, 100);
+        builder.stop();
+        REQUIRE_FALSE(builder.contractGraph());
+        REQUIRE(std::ifstream(checkpoint).good());
+    }
+    graph = original;
+    HierarchyConstructor builder(graph);
+    builder.setCheckpoint(checkpoint, 100);
+    REQUIRE(builder.contractGraph());
+    REQUIRE_FALSE(std::ifstream(checkpoint).good());
+
+    REQUIRE(graph.getNumEdges() == expected.getNumEdges());
+    for (const uint64_t id : ids) { REQUIRE(graph.getVertex(id).order == expected.getVertex(id).order); }
+    requireOriginalDistances(graph, 5);
+
+    // A checkpoint cannot be resumed into a graph with different vertices.
+    graph = original;
+    HierarchyConstructor stopped(graph);
+    stopped.setCheckpoint(checkpoint, 100);
+    stopped.stop();
+    REQUIRE_FALSE(stopped.contractGraph());
+    Parser other_parser("test_input2.osm");
+    Graph other = other_parser.constructRoadNetworkGraph();
+    HierarchyConstructor other_builder(other);
+    other_builder.setCheckpoint(checkpoint, 100);
+    REQUIRE_THROWS_AS(other_builder.contractGraph(), std::logic_error);
+    std::remove(checkpoint.c_str());
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Priority terms test", "[HierarchyConstructor]") {
+
+    // The original edges and level terms change the ordering but not the distances.
+    for (const auto& coefficients : {HierarchyConstructor::Coefficients{170, 190, 100, 0}, HierarchyConstructor::Coefficients{170, 190, 0, 100},
+                                     HierarchyConstructor::Coefficients{0, 0, 100, 300}}) {
+        Graph graph = original;
+        HierarchyConstructor(graph, coefficients).contractGraph();
+        requireOriginalDistances(graph, 7);
+    }
+
+    // The default coefficients are those of the other constructor.
+    Graph graph1 = original, graph2 = original;
+    HierarchyConstructor(graph1).contractGraph();
+    HierarchyConstructor(graph2, HierarchyConstructor::Coefficients{}).contractGraph();
+    REQUIRE(graph1.getNumEdges() == graph2.getNumEdges());
+    for (const uint64_t id : ids) { REQUIRE(graph1.getVertex(id).order == graph2.getVertex(id).order); }
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Nested dissection ordering test", "[HierarchyConstructor]") {
+
+    // Every vertex is contracted exactly once, whatever the number of threads that dissect the graph.
+    for (const int num_threads : {1, 4}) {
+        Graph graph = original;
+        HierarchyConstructor builder(graph, 170, 190, num_threads);
+        builder.setOrdering(HierarchyConstructor::Ordering::NESTED_DISSECTION);
+        REQUIRE(builder.contractGraph());
+        std::vector<uint64_t> orders;
+        for (const uint64_t id : ids) { orders.push_back(graph.getVertex(id).order); }
+        std::sort(orders.begin(), orders.end());
+        for (size_t i = 0; i < orders.size(); i++) { REQUIRE(orders[i] == i); }
+        requireOriginalDistances(graph, 11);
+    }
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Staged witness limits test", "[HierarchyConstructor]") {
+
+    // Searches that give up early may add shortcuts that are not needed, but the distances do not change.
+    const std::vector<std::vector<HierarchyConstructor::WitnessLimit>> limits{HierarchyConstructor::STAGED_WITNESS_LIMITS,
+                                                                              {{std::numeric_limits<double>::infinity(), 1, 1}}};
+    for (const auto& limit : limits) {
+        Graph graph = original;
+        HierarchyConstructor builder(graph);
+        builder.setWitnessLimits(limit);
+        builder.contractGraph();
+        requireOriginalDistances(graph, 13);
+    }
+
+    Graph graph = original;
+    HierarchyConstructor builder(graph);
+    REQUIRE_THROWS_AS(builder.setWitnessLimits({}), std::logic_error);
+}
+
+TEST_CASE( "Contraction working graph test", "[ContractionGraph]") {
+    // A star around vertex 0, so that the blocks of the center outgrow their capacity.
+    Graph graph;
+    for (uint64_t leaf = 1; leaf <= 20; leaf++) { graph.addEdge(0, leaf, double(leaf), true); }
+    ContractionGraph working_graph(graph);
+    REQUIRE(working_graph.getOutArcs(0).size() == 20);
+    REQUIRE(working_graph.getAverageDegree() == Approx(80.0 / 21));
+
+    // The shortcuts between the leaves are added to blocks that were full, and replacing one does not add an edge.
+    for (uint32_t leaf = 2; leaf <= 20; leaf++) { working_graph.setArc(1, leaf, 100, 2, 0); }
+    working_graph.setArc(1, 2, 3, 2, 0);
+    REQUIRE(working_graph.getOutArcs(1).size() == 20);
+    REQUIRE(*working_graph.findArc(1, 2) == 3);
+    REQUIRE(working_graph.getInArcs(2).size() == 2);
+    REQUIRE(working_graph.getAverageDegree() == Approx(2.0 * 59 / 21));
+
+    // A contracted vertex keeps its own edges, but the other vertices no longer have edges to it.
+    working_graph.removeVertex(0);
+    REQUIRE(working_graph.getNumRemaining() == 20);
+    REQUIRE(working_graph.getOutArcs(0).size() == 20);
+    REQUIRE(working_graph.findArc(1, 0) == nullptr);
+    REQUIRE(working_graph.getOutArcs(1).size() == 19);
+    for (const auto& arc : working_graph.getOutArcs(1)) { REQUIRE(arc.middle == 0); }
+    REQUIRE(working_graph.getAverageDegree() == Approx(2.0 * 19 / 20));
+    REQUIRE(working_graph.getNumAllocatedBytes() > 0);
+
+    // The working graph is read back from a flat file, unless the positions of its edges are out of order or out of range.
+    const std::string filename = "working_graph.bin", corrupt_filename = "working_graph_corrupt.bin";
+    {
+        FlatWriter writer(filename.c_str());
+        working_graph.saveFlat(writer);
+    }
+    {
+        ContractionGraph loaded(graph);
+        const MappedFile file(filename.c_str());
+        FlatReader reader(file);
+        loaded.loadFlat(reader);
+        REQUIRE(loaded.getNumRemaining() == 20);
+        REQUIRE(loaded.getOutArcs(1).size() == 19);
+        REQUIRE(*loaded.findArc(1, 2) == 3);
+    }
+    const auto require_corrupt = [&](const std::function<void(std::vector<uint64_t>*)>& corrupt) {
+        {
+            const MappedFile file(filename.c_str());
+            FlatReader reader(file);
+            FlatWriter writer(corrupt_filename.c_str());
+            writer.writeArray(reader.readArray<uint64_t>());
+            writer.writeArray(reader.readArray<int>());
+            writer.writeArray(reader.readArray<uint32_t>());
+            writer.writeArray(reader.readArray<uint64_t>());
+            const auto out_first = reader.readArray<uint64_t>();
+            std::vector<uint64_t> first(out_first.begin(), out_first.end());
+            corrupt(&first);
+            writer.writeArray(FlatArray<uint64_t>(std::move(first)));
+            writer.writeArray(reader.readArray<ContractionGraph::Arc>());
+            writer.writeArray(reader.readArray<uint64_t>());
+            writer.writeArray(reader.readArray<ContractionGraph::Arc>());
+        }
+        ContractionGraph loaded(graph);
+        const MappedFile file(corrupt_filename.c_str());
+        FlatReader reader(file);
+        REQUIRE_THROWS_AS(loaded.loadFlat(reader), std::runtime_error);
+    };
+    require_corrupt([](std::vector<uint64_t>* first) { std::swap((*first)[1], (*first)[2]); });
+    require_corrupt([](std::vector<uint64_t>* first) { first->back() = 1000; });
+    require_corrupt([](std::vector<uint64_t>* first) { first->front() = 1; });
+    std::remove(filename.c_str());
+    std::remove(corrupt_filename.c_str());
+}
+
+TEST_CASE( "Parser getRoutingData test", "[Parser]") {
+    Parser parser("test_input1.osm");
+    const auto [ways, locations, node_links] = parser.getRoutingData();
+    REQUIRE(ways.first_ref.size() == ways.size() + 1);
+    REQUIRE(ways.first_ref.back() == ways.node_refs.size());
+
+    // The stored ways are the ways with a highway tag and at least two known nodes, in the order of the file.
+    size_t way = 0;
+    for (const auto& expected : parser.getAllWays()) {
+        std::vector<uint64_t> node_refs;
+        for (const auto& node_ref : expected.node_refs) {
+            if (locations.find(node_ref) != locations.end()) { node_refs.push_back(node_ref); }
+        }
+        if (node_refs.size() < 2 || expected.tags.find("highway") == expected.tags.end()) { continue; }
+        REQUIRE(std::vector<uint64_t>(ways.getNodeRefsBegin(way), ways.getNodeRefsEnd(way)) == node_refs);
+        for (int tag = 0; tag < WayStore::NUM_TAGS; tag++) {
+            const auto it = expected.tags.find(WayStore::TAG_KEYS[tag]);
+            if (it == expected.tags.end()) {
+                REQUIRE(ways.tags[way][tag] == StringTable::NONE);
+            }
+            else {
+                REQUIRE(ways.tag_values.get(ways.tags[way][tag]) == it->second);
+            }
+        }
+        way++;
+    }
+    REQUIRE(way == ways.size());
+
+    // Equal values share a code.
+    const uint32_t residential = ways.tag_values.find("residential");
+    REQUIRE(residential != StringTable::NONE);
+    REQUIRE(std::count_if(ways.tags.begin(), ways.tags.end(), [&](const auto& tags) { return tags[WayStore::HIGHWAY] == residential; }) > 1);
+    REQUIRE(ways.tag_values.find("no such value") == StringTable::NONE);
+}
+
+TEST_CASE( "Routing profiles test", "[Profile]") {
+    Parser parser("test_input2.osm");
+    auto graphs = parser.constructRoadNetworkGraphs({Profile::car(), Profile::truck(), Profile::bicycle()});
+    REQUIRE(graphs.size() == 3);
+    Graph& car = graphs[0];
+    Graph& bicycle = graphs[2];
+
+    // The road network, the geometry and the locations are stored once, and every profile only has its own weights.
+    const RoadNetwork& network = *car.getNetwork();
+    REQUIRE(bicycle.getNetwork() == car.getNetwork());
+    REQUIRE(&car.getGeometry() == &bicycle.getGeometry());
+    for (const auto& name : {"network", "geometry", "locations"}) { REQUIRE(car.getMemoryUsage().get(name).shared); }
+    REQUIRE(!car.getMemoryUsage().get("weights").shared);
+    REQUIRE(car.getMemoryUsage().get("weights").payload == network.getNumEdges() * sizeof(double));
+    REQUIRE(car.getMemoryUsage().get("edges").getTotal() == 0);
+    REQUIRE(car.getVertexIds().empty());
+    REQUIRE_THROWS_AS(car.addEdge(1, 2, 1.0), std::logic_error);
+
+    // A profile that uses every road has as many edges as the default import.
+    Profile all;
+    all.speed_mph = Profile::car().speed_mph;
+    const Graph expected = parser.constructRoadNetworkGraph();
+    const Graph unrestricted = std::move(parser.constructRoadNetworkGraphs({all}).front());
+    REQUIRE(unrestricted.getNumVertices() == expected.getNumVertices());
+    REQUIRE(unrestricted.getNumEdges() == expected.getNumEdges());
+    REQUIRE(car.getNumEdges() < unrestricted.getNumEdges());
+
+    // Every road is used by some profile, and bicycles are never faster than cars.
+    const auto infinity = std::numeric_limits<double>::infinity();
+    size_t num_common_edges = 0;
+    for (uint32_t edge = 0; edge < network.getNumEdges(); edge++) {
+        REQUIRE(std::any_of(graphs.begin(), graphs.end(), [&](const Graph& graph) { return graph.getWeights()[edge] != infinity; }));
+        if (car.getWeights()[edge] == infinity || bicycle.getWeights()[edge] == infinity) { continue; }
+        REQUIRE(bicycle.getWeights()[edge] >= car.getWeights()[edge]);
+        num_common_edges++;
+    }
+    REQUIRE(num_common_edges > 0);
+
+    // A profile must be contracted before it is searched, and is then as accurate as a graph of its own roads.
+    const uint64_t source = network.getId(0);
+    REQUIRE_THROWS_AS(bicycle.getShortestPath(source, source), std::logic_error);
+    HierarchyConstructor(bicycle, 170, 190).contractGraph();
+    REQUIRE_THROWS_AS(bicycle.getShortestPath(source, source, true), std::logic_error);
+    const Graph bicycle_roads = parser.constructRoadNetworkGraph(Profile::bicycle());
+    const std::vector<uint64_t> ids = getSortedIds(bicycle_roads);
+    for (size_t i = 1; i < ids.size(); i += ids.size() / 20) {
+        REQUIRE(bicycle.getShortestPath(ids[0], ids[i]).second == Approx(bicycle_roads.getShortestPath(ids[0], ids[i], true).second));
+        const auto route = bicycle.getShortestRoute(ids[0], ids[i]);
+        REQUIRE(route.first == bicycle_roads.getShortestRoute(ids[0], ids[i], true).first);
+        REQUIRE(bicycle.convertPathToCoordinates(bicycle.getShortestPath(ids[0], ids[i]).first) == route.first);
+    }
+
+    // Contracting a profile only adds its query graph.
+    const MemoryUsage usage = bicycle.getMemoryUsage();
+    uint64_t own = 0;
+    for (const auto& component : usage.components) {
+        if (!component.shared) { own += component.getTotal(); }
+    }
+    REQUIRE(usage.get("query_graph").payload > 0);
+    REQUIRE(own == usage.get("weights").getTotal() + usage.get("query_graph").getTotal());
+
+    Profile unknown;
+    unknown.access_tags = {"horse"};
+    REQUIRE_THROWS_AS(parser.constructRoadNetworkGraphs({unknown}), std::logic_error);
+}
+
+TEST_CASE( "Routing profile file test", "[Profile]") {
+    Parser parser("test_input2.osm");
+    auto graphs = parser.constructRoadNetworkGraphs({Profile::car(), Profile::truck(), Profile::bicycle()});
+    const char* filename = "test_profiles_graph.flat";
+    REQUIRE_THROWS_AS(Graph::saveProfilesFlat(filename, {{"car", &graphs[0]}}), std::logic_error);
+    for (auto& graph : graphs) { HierarchyConstructor(graph, 170, 190).contractGraph(); }
+    const Graph& car = graphs[0];
+    const Graph& bicycle = graphs[2];
+
+    // Every profile needs a different name, and the profiles must share a road network.
+    Graph classic = parser.constructRoadNetworkGraph();
+    HierarchyConstructor(classic, 170, 190).contractGraph();
+    REQUIRE_THROWS_AS(Graph::saveProfilesFlat(filename, {{"car", &car}, {"car", &bicycle}}), std::logic_error);
+    REQUIRE_THROWS_AS(Graph::saveProfilesFlat(filename, {{"car", &car}, {"default", &classic}}), std::logic_error);
+    REQUIRE_THROWS_AS(Graph::saveProfilesFlat(filename, {}), std::logic_error);
+
+    // The geometry and the road network are stored once, so another profile only adds its weights and its query graph.
+    const char* smaller_filename = "test_profiles_graph_small.flat";
+    const auto file_size = [](const std::string& name) { return uint64_t(std::ifstream(name, std::ios::binary | std::ios::ate).tellg()); };
+    Graph::saveProfilesFlat(smaller_filename, {{"car", &car}, {"truck", &graphs[1]}});
+    Graph::saveProfilesFlat(filename, {{"car", &car}, {"truck", &graphs[1]}, {"bicycle", &bicycle}});
+    const std::vector<std::string> separate_files{"test_profiles_car.flat", "test_profiles_truck.flat", "test_profiles_bicycle.flat"};
+    for (size_t i = 0; i < graphs.size(); i++) { graphs[i].saveFlat(separate_files[i].c_str()); }
+    const uint64_t profile_bytes = bicycle.getWeights().getNumBytes() + bicycle.getQueryGraph().getNumBytes();
+    REQUIRE(file_size(filename) - file_size(smaller_filename) >= profile_bytes);
+    REQUIRE(file_size(filename) - file_size(smaller_filename) < profile_bytes + bicycle.getGeometry().getNumBytes());
+    std::remove(smaller_filename);
+
+    auto profiles = Graph::mapProfilesFlat(filename);
+    REQUIRE(profiles.size() == 3);
+    REQUIRE(profiles[0].first == "car");
+    REQUIRE(profiles[2].first == "bicycle");
+    const Graph& mapped_car = profiles[0].second;
+    const Graph& mapped_bicycle = profiles[2].second;
+    REQUIRE(mapped_bicycle.isMapped());
+    REQUIRE(mapped_bicycle.getNetwork() == mapped_car.getNetwork());
+    REQUIRE(&mapped_bicycle.getGeometry() == &mapped_car.getGeometry());
+    REQUIRE(mapped_bicycle.getNumVertices() == bicycle.getNumVertices());
+    REQUIRE(mapped_bicycle.getNumEdges() == bicycle.getNumEdges());
+
+    // The mapped profiles find the same routes as the profiles they were written from.
+    const auto& network_ids = car.getNetwork()->getIds();
+    const auto queries = getRandomQueries(std::vector<uint64_t>(network_ids.begin(), network_ids.end()), 100, 11);
+    for (const auto& [source, target] : queries) {
+        REQUIRE(mapped_car.getShortestRoute(source, target) == car.getShortestRoute(source, target));
+        REQUIRE(mapped_bicycle.getShortestRoute(source, target) == bicycle.getShortestRoute(source, target));
+    }
+    REQUIRE(mapped_bicycle.getShortestPathLengths(queries) == bicycle.getShortestPathLengths(queries));
+
+    // A mapped profile shares the mapped road network and geometry, and only adds its weights and its query graph.
+    const MemoryUsage usage = mapped_bicycle.getMemoryUsage();
+    for (const auto& name : {"network", "geometry"}) {
+        REQUIRE(usage.get(name).shared);
+        REQUIRE(usage.get(name).mapped);
+    }
+    REQUIRE(usage.get("network").payload == car.getNetwork()->getNumBytes());
+    REQUIRE(usage.get("weights").mapped);
+    REQUIRE(usage.get("weights").payload == car.getNetwork()->getNumEdges() * sizeof(double));
+    REQUIRE(usage.get("query_graph").payload == bicycle.getQueryGraph().getNumBytes());
+
+    // The flat file of a single graph is mapped as a single profile without a name.
+    auto single = Graph::mapProfilesFlat(separate_files[2].c_str());
+    REQUIRE(single.size() == 1);
+    REQUIRE(single[0].first.empty());
+    REQUIRE(single[0].second.getShortestPathLengths(queries) == bicycle.getShortestPathLengths(queries));
+
+    // A file of several profiles is not mapped as a single graph, and a truncated file is rejected.
+    Graph graph;
+    REQUIRE_THROWS_AS(graph.mapFlat(filename), std::logic_error);
+    std::ifstream input(filename, std::ios::binary);
+    const std::vector<char> contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+    std::ofstream(filename, std::ios::binary).write(contents.data(), std::streamsize(contents.size() - 10));
+    REQUIRE_THROWS_AS(Graph::mapProfilesFlat(filename), std::logic_error);
+
+    profiles.clear();
+    single.clear();
+    std::remove(filename);
+    for (const auto& file : separate_files) { std::remove(file.c_str()); }
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Query graph layout test", "[QueryGraph]") {
+    Graph contracted_graph = original;
+    HierarchyConstructor builder(contracted_graph);
+    builder.contractGraph();
+    REQUIRE(contracted_graph.getQueryGraph().getNumVertices() == original.getNumVertices());
+    const auto queries = getRandomQueries(ids, 25, 7);
+
+    // The numbering of the vertices must not change the result of any query.
+    for (const auto layout : {QueryGraph::Layout::INPUT, QueryGraph::Layout::RANK, QueryGraph::Layout::DFS}) {
+        contracted_graph.buildQueryGraph(layout);
+        for (const auto& [source, target] : queries) {
+            auto path1 = contracted_graph.getShortestPath(source, target);
+            auto path2 = original.getShortestPath(source, target, true);
+            REQUIRE(path1.first == path2.first);
+            REQUIRE(std::abs(path1.second - path2.second) < 0.00001);
+        }
+    }
+}
+
+TEST_CASE( "Precomputed shortcut geometry test", "[QueryGraph]") {
+    Parser parser("test_input2.osm");
+    Graph graph = parser.constructRoadNetworkGraph();
+    Graph contracted_graph = graph;
+    HierarchyConstructor builder(contracted_graph);
+    builder.contractGraph();
+    const auto geometry_size = contracted_graph.getQueryGraph().getGeometrySize();
+    const auto queries = getRandomQueries(getSortedIds(graph), 25, 11);
+
+    // Storing the unpacked geometry of shortcuts must not change the result of any query.
+    for (const uint32_t threshold : {1, 5, 20}) {
+        contracted_graph.buildQueryGraph(QueryGraph::Layout::DFS, threshold);
+        REQUIRE(contracted_graph.getQueryGraph().getGeometrySize() >= geometry_size);
+        for (const auto& [source, target] : queries) {
+            auto path1 = contracted_graph.getShortestPath(source, target);
+            auto path2 = graph.getShortestPath(source, target, true);
+            REQUIRE(path1.first == path2.first);
+            REQUIRE(std::abs(path1.second - path2.second) < 0.00001);
+        }
+    }
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Alternative routes test", "[AlternativeRoutes]") {
+    REQUIRE_THROWS_AS(original.getAlternativeRoutes(*original.getVertexIds().begin(), *original.getVertexIds().begin()), std::logic_error);
+    Graph graph = original;
+    HierarchyConstructor builder(graph);
+    builder.contractGraph();
+
+    AlternativeRouteOptions options;
+    options.max_alternatives = 3;
+    size_t num_alternatives = 0;
+    for (const auto& [source, target] : getRandomQueries(ids, 300, 17)) {
+        const auto routes = graph.getAlternativeRoutes(source, target, options);
+        const double shortest = original.getShortestPath(source, target, true).second;
+        if (shortest < 0) {
+            REQUIRE(routes.empty());
+            continue;
+        }
+        // The first route is the shortest route, and the others are ranked by weight and bounded by the stretch.
+        REQUIRE(!routes.empty());
+        REQUIRE(routes.size() <= 4);
+        REQUIRE(routes[0].second == Approx(shortest));
+        REQUIRE(routes[0].first == graph.getShortestRoute(source, target).first);
+        for (size_t j = 1; j < routes.size(); j++) {
+            REQUIRE(routes[j].second >= routes[j - 1].second);
+            REQUIRE(routes[j].second <= (1 + options.max_stretch) * shortest + 1e-9);
+            REQUIRE(routes[j].first.front() == graph.getLocation(source));
+            REQUIRE(routes[j].first.back() == graph.getLocation(target));
+            REQUIRE(routes[j].first != routes[0].first);
+        }
+        num_alternatives += routes.size() - 1;
+    }
+    REQUIRE(num_alternatives > 0);
+
+    // Without any alternatives, only the shortest route is left.
+    options.max_alternatives = 0;
+    for (const auto& [source, target] : getRandomQueries(ids, 20, 19)) {
+        REQUIRE(graph.getAlternativeRoutes(source, target, options).size() <= 1);
+    }
+}
+
+TEST_CASE( "Geometry store test", "[GeometryStore]") {
+    GeometryStore store;
+    std::vector<uint64_t> nodes{6117575385, 7626017771, 6117574281, 2125468663};
+    std::vector<std::array<double, 2>> coordinates{{39.7392358, -104.990251}, {39.7391001, -104.9901232},
+                                                   {-33.8688197, 151.2092955}, {0.0, 0.0}};
+    REQUIRE(store.addSegment({}, {}) == GeometryStore::NO_GEOMETRY);
+    const uint32_t segment = store.addSegment(nodes, coordinates);
+    REQUIRE(store.getNumSegments() == 1);
+
+    std::vector<uint64_t> decoded_nodes{1};
+    store.decodeNodes(segment, false, &decoded_nodes);
+    store.decodeNodes(GeometryStore::NO_GEOMETRY, false, &decoded_nodes);
+    REQUIRE(decoded_nodes == std::vector<uint64_t>{1, 6117575385, 7626017771, 6117574281, 2125468663});
+    decoded_nodes.clear();
+    store.decodeNodes(segment, true, &decoded_nodes);
+    REQUIRE(decoded_nodes == std::vector<uint64_t>{2125468663, 6117574281, 7626017771, 6117575385});
+
+    std::vector<std::array<double, 2>> decoded_coordinates;
+    store.decodeCoordinates(segment, true, &decoded_coordinates);
+    REQUIRE(decoded_coordinates.size() == coordinates.size());
+    for (size_t i = 0; i < coordinates.size(); i++) {
+        REQUIRE(std::abs(decoded_coordinates[i][0] - coordinates[coordinates.size() - 1 - i][0]) < 1e-7);
+        REQUIRE(std::abs(decoded_coordinates[i][1] - coordinates[coordinates.size() - 1 - i][1]) < 1e-7);
+    }
+
+    // Routes are converted to coordinates from the compressed geometry of the edges, in both directions of travel.
+    Parser parser("test_input1.osm");
+    const auto locations = parser.getLocations();
+    Graph graph = parser.constructRoadNetworkGraph();
+    for (const auto& [source, target] : getRandomQueries(getSortedIds(graph), 10, 3)) {
+        const auto path = graph.getShortestPath(source, target).first;
+        const auto path_coordinates = graph.convertPathToCoordinates(path);
+        REQUIRE(path_coordinates.size() == path.size());
+        for (size_t j = 0; j < path.size(); j++) {
+            REQUIRE(std::abs(path_coordinates[j][0] - locations.at(path[j])[0]) < 1e-7);
+            REQUIRE(std::abs(path_coordinates[j][1] - locations.at(path[j])[1]) < 1e-7);
+        }
+    }
+}
+
+TEST_CASE_METHOD( NetworkFixture, "Encoded polyline test", "[Polyline]") {
+    // The example from the documentation of the encoded polyline algorithm format.
+    std::vector<std::array<double, 2>> coordinates{{38.5, -120.2}, {40.7, -120.95}, {43.252, -126.453}};
+    REQUIRE(Polyline::encode(coordinates) == "_p~iF~ps|U_ulLnnqC_mqNvxq`@");
+    const auto decoded = Polyline::decode("_p~iF~ps|U_ulLnnqC_mqNvxq`@");
+    REQUIRE(decoded.size() == coordinates.size());
+    for (size_t i = 0; i < coordinates.size(); i++) {
+        REQUIRE(std::abs(decoded[i][0] - coordinates[i][0]) < 1e-5);
+        REQUIRE(std::abs(decoded[i][1] - coordinates[i][1]) < 1e-5);
+    }
+    REQUIRE(Polyline::decode(Polyline::encode(coordinates, 6), 6).size() == coordinates.size());
+    REQUIRE_THROWS_AS(Polyline::decode("_p~iF~ps|U_"), std::logic_error);
+    // A string that ends after a latitude, or within a value, is incomplete.
+    REQUIRE_THROWS_AS(Polyline::decode("_p~iF"), std::logic_error);
+    REQUIRE_THROWS_AS(Polyline::decode("_p~iF~ps|"), std::logic_error);
+    // A value may not have more chunks than a coordinate difference needs, and every character must be in range.
+    REQUIRE_THROWS_AS(Polyline::decode(std::string(13, '_') + "??"), std::logic_error);
+    REQUIRE_THROWS_AS(Polyline::decode("_p~iF~ps|U "), std::logic_error);
+    REQUIRE(Polyline::decode(Polyline::encode({{90, 180}, {-90, -180}}, 7), 7).back()[1] == -180);
+
+    // Points that lie within the tolerance of a straight line are dropped.
+    std::vector<std::array<double, 2>> line{{40.0, -105.0}, {40.0001, -105.0}, {40.0002, -105.00001}, {40.0003, -105.0},
+                                            {40.0003, -104.999}};
+    REQUIRE(Polyline::simplify(line, 5).size() == 3);
+    REQUIRE(Polyline::simplify(line, 0.1).size() == 5);
+    REQUIRE(Polyline::simplify(line, 1000).size() == 2);
+
+    // Routes are encoded directly from the geometry of the graph.
+    for (const auto& [source, target] : getRandomQueries(ids, 10, 5)) {
+        const auto path = original.getShortestPath(source, target).first;
+        const auto path_coordinates = original.convertPathToCoordinates(path);
+        const auto polyline = Polyline::decode(original.convertPathToPolyline(path));
+        REQUIRE(polyline.size() == path_coordinates.size());
+        for (size_t j = 0; j < polyline.size(); j++) {
+            REQUIRE(std::abs(polyline[j][0] - path_coordinates[j][0]) < 1e-5);
+            REQUIRE(std::abs(polyline[j][1] - path_coordinates[j][1]) < 1e-5);
+        }
+        REQUIRE(Polyline::decode(original.convertPathToPolyline(path, 10)).size() <= polyline.size());
+    }
+}
+
+TEST_CASE( "Batched contraction hierarchies search test", "[BatchSearch]") {
+    Parser parser("test_input2.osm");
+    Graph graph = parser.constructRoadNetworkGraph();
+    HierarchyConstructor builder(graph);
+    builder.contractGraph();
+
+    const std::vector<uint64_t> ids = getSortedIds(graph);
+    auto queries = getRandomQueries(ids, 200, 11);
+    queries.emplace_back(ids[0], ids[0]);
+
+    // The batch size must not change the results, including batches larger than the number of queries.
+    for (const int batch_size : {1, 3, 16, 512}) {
+        auto lengths = graph.getShortestPathLengths(queries, batch_size);
+        REQUIRE(lengths.size() == queries.size());
+        for (size_t i = 0; i < queries.size(); i++) {
+            REQUIRE(std::abs(lengths[i] - graph.getShortestPath(queries[i].first, queries[i].second).second) < 0.00001);
+        }
+    }
+    REQUIRE(graph.getShortestPathLengths({}).empty());
+    REQUIRE_THROWS_AS(graph.getShortestPathLengths({{ids[0], 0}}), std::logic_error);
+}
+
+TEST_CASE_METHOD( EngineFixture, "Parallel batch routing test", "[RoutingEngine]") {
+    const auto queries = getRandomQueries(ids, 50, 13);
+    std::vector<uint64_t> sources, targets;
+    for (const auto& [source, target] : queries) {
+        sources.push_back(source);
+        targets.push_back(target);
+    }
+
+    // The results must not depend on the number of threads.
+    const auto expected = engine.computeRouteCosts(queries);
+    for (const int num_threads : {1, 3, 0}) {
+        std::vector<double> costs(queries.size());
+        engine.computeRouteCosts(sources.data(), targets.data(), queries.size(), costs.data(), num_threads);
+        for (size_t i = 0; i < queries.size(); i++) {
+            REQUIRE(std::abs(costs[i] - expected[i]) < 0.00001);
+        }
+
+        const auto batch = engine.computeRoutes(sources.data(), targets.data(), queries.size(), num_threads);
+        REQUIRE(batch.offsets.size() == queries.size() + 1);
+        REQUIRE(batch.coordinates.size() == 2 * batch.offsets.back());
+        for (size_t i = 0; i < queries.size(); i++) {
+            const auto route = engine.computeRoute(sources[i], targets[i]);
+            REQUIRE(std::abs(batch.costs[i] - route.second) < 0.00001);
+            REQUIRE(batch.offsets[i + 1] - batch.offsets[i] == route.first.size());
+            for (size_t j = 0; j < route.first.size(); j++) {
+                REQUIRE(batch.coordinates[2 * (batch.offsets[i] + j)] == route.first[j][0]);
+                REQUIRE(batch.coordinates[2 * (batch.offsets[i] + j) + 1] == route.first[j][1]);
+            }
+        }
+    }
+
+    // An invalid ID in any of the threads is reported to the caller.
+    sources[17] = 0;
+    std::vector<double> costs(queries.size());
+    REQUIRE_THROWS_AS(engine.computeRouteCosts(sources.data(), targets.data(), queries.size(), costs.data(), 4), std::logic_error);
+    REQUIRE_THROWS_AS(engine.computeRoutes(sources.data(), targets.data(), queries.size(), 4), std::logic_error);
+}
+
+TEST_CASE( "Worker pool test", "[RoutingEngine]") {
+    OSM::WorkerPool pool;
+    const auto caller = std::this_thread::get_id();
+
+    // A single chunk is processed on the calling thread without starting any threads.
+    pool.parallelFor(10, 1, [&](size_t begin, size_t end, size_t chunk) {
+        REQUIRE(begin == 0);
+        REQUIRE(end == 10);
+        REQUIRE(chunk == 0);
+        REQUIRE(std::this_thread::get_id() == caller);
+    });
+    REQUIRE(pool.getNumThreads() == 0);
+
+    // Every item is processed exactly once, and the threads are kept for the next call rather than started again.
+    std::set<std::thread::id> threads;
+    for (int call = 0; call < 5; call++) {
+        std::vector<int> processed(1000, 0);
+        std::vector<std::thread::id> chunk_threads(4);
+        pool.parallelFor(processed.size(), 4, [&](size_t begin, size_t end, size_t chunk) {
+            for (size_t i = begin; i < end; i++) { processed[i]++; }
+            chunk_threads[chunk] = std::this_thread::get_id();
+        });
+        REQUIRE(std::all_of(processed.begin(), processed.end(), [](int count) { return count == 1; }));
+        REQUIRE(chunk_threads[0] == caller);
+        threads.insert(chunk_threads.begin() + 1, chunk_threads.end());
+        REQUIRE(pool.getNumThreads() == 3);
+    }
+    REQUIRE(threads.size() <= 3);
+    REQUIRE(threads.count(caller) == 0);
+
+    // An exception thrown by any chunk is rethrown once every chunk has been processed.
+    std::atomic<int> num_processed(0);
+    REQUIRE_THROWS_AS(pool.parallelFor(8, 8, [&](size_t, size_t, size_t chunk) {
+        num_processed++;
+        if (chunk == 5) { throw std::logic_error("Chunk failed."); }
+    }), std::logic_error);
+    REQUIRE(num_processed == 8);
+    REQUIRE(pool.getNumThreads() == 7);
+}
+
+TEST_CASE_METHOD( EngineFixture, "Waypoint route test", "[RoutingEngine]") {
+    Parser parser("test_input2.osm");
+    const Graph graph = parser.constructRoadNetworkGraph();
+    std::mt19937 rng(29);
+    for (int i = 0; i < 20; i++) {
+        std::vector<uint64_t> waypoints;
+        for (int j = 0; j < 7; j++) { waypoints.push_back(ids[rng() % ids.size()]); }
+        // A waypoint may be repeated, which makes an empty leg.
+        waypoints[3] = waypoints[2];
+
+        // The route is the same as the routes of the legs one after another, whether the legs are split among threads or not.
+        for (const int num_threads : {1, 3, 0}) {
+            const auto route = engine.computeRoute(waypoints, num_threads);
+            REQUIRE(route.leg_costs.size() == waypoints.size() - 1);
+            double cost = 0;
+            for (size_t leg = 0; leg + 1 < waypoints.size(); leg++) {
+                const auto leg_route = engine.computeRoute(waypoints[leg], waypoints[leg + 1]);
+                REQUIRE(route.leg_costs[leg] == Approx(leg_route.second));
+                cost = cost < 0 || leg_route.second < 0 ? -1 : cost + leg_route.second;
+                if (route.cost < 0) { continue; }
+                const auto first = route.waypoint_offsets[leg], last = route.waypoint_offsets[leg + 1];
+                REQUIRE(last + 1 - first == leg_route.first.size());
+                REQUIRE(std::equal(leg_route.first.begin(), leg_route.first.end(), route.coordinates.begin() + first));
+            }
+            REQUIRE(route.cost == Approx(cost));
+            if (route.cost < 0) {
+                REQUIRE(route.coordinates.empty());
+                continue;
+            }
+            REQUIRE(route.waypoint_offsets.size() == waypoints.size());
+            REQUIRE(route.waypoint_offsets.back() + 1 == route.coordinates.size());
+        }
+
+        // A graph that has not been contracted finds the same legs with the standard search.
+        std::vector<double> leg_weights;
+        std::vector<uint64_t> waypoint_offsets;
+        const auto route = engine.computeRoute(waypoints);
+        REQUIRE(graph.getWaypointRoute(waypoints, &leg_weights, &waypoint_offsets).second == Approx(route.cost));
+    }
+
+    REQUIRE_THROWS_AS(engine.computeRoute(std::vector<uint64_t>{ids[0]}), std::logic_error);
+    REQUIRE_THROWS_AS(engine.computeRoute(std::vector<uint64_t>{ids[0], ids[1], 0}, 2), std::logic_error);
+}
+
+TEST_CASE( "Routing engine profiles test", "[RoutingEngine]") {
+    OSM::RoutingEngine engine("test_input2.osm", {Profile::car(), Profile::bicycle()});
+    REQUIRE(engine.getProfiles() == std::vector<std::string>{"car", "bicycle"});
+    REQUIRE(engine.getGraph() == engine.getGraph("car"));
+    REQUIRE_THROWS_AS(engine.getGraph("horse"), std::logic_error);
+    const auto car = engine.getGraph("car");
+    const auto bicycle = engine.getGraph("bicycle");
+    REQUIRE(car->getNetwork() == bicycle->getNetwork());
+
+    // Every query is answered by the graph of the profile that it names.
+    const auto& network_ids = car->getNetwork()->getIds();
+    const std::vector<uint64_t> ids(network_ids.begin(), network_ids.end());
+    REQUIRE_THROWS_AS(engine.computeRoute(ids[0], ids[1], false, "horse"), std::logic_error);
+    const auto queries = getRandomQueries(ids, 50, 13);
+    REQUIRE(engine.computeRouteCosts(queries, "bicycle") == bicycle->getShortestPathLengths(queries));
+    REQUIRE(engine.computeRouteCosts(queries) == car->getShortestPathLengths(queries));
+
+    // The routes of every profile are cached separately.
+    engine.enableRouteCache(1000);
+    for (size_t i = 1; i <= 20; i++) {
+        REQUIRE(engine.computeRoute(ids[0], ids[i], false, "car") == car->getShortestRoute(ids[0], ids[i]));
+        REQUIRE(engine.computeRoute(ids[0], ids[i], false, "bicycle") == bicycle->getShortestRoute(ids[0], ids[i]));
+    }
+    for (size_t i = 1; i <= 20; i++) {
+        REQUIRE(engine.computeRoute(ids[0], ids[i], false, "car") == car->getShortestRoute(ids[0], ids[i]));
+        REQUIRE(engine.computeRoute(ids[0], ids[i], false, "bicycle") == bicycle->getShortestRoute(ids[0], ids[i]));
+    }
+    REQUIRE(engine.getRouteCacheStatistics().hits == 40);
+    REQUIRE(engine.getRouteCacheStatistics().overwrites == 0);
+
+    // All profiles are saved to a single flat file, and every profile is served once it is mapped.
+    const char* filename = "test_profiles_engine.flat";
+    REQUIRE_THROWS_AS(engine.saveRoutingData("test_profiles_engine.bin"), std::logic_error);
+    engine.saveMappedRoutingData(filename);
+    OSM::RoutingEngine mapped;
+    mapped.mapRoutingData(filename);
+    REQUIRE(mapped.getProfiles() == engine.getProfiles());
+    REQUIRE(mapped.getGraph("bicycle")->isMapped());
+    REQUIRE(mapped.computeRouteCosts(queries, "bicycle") == bicycle->getShortestPathLengths(queries));
+    const auto batch = mapped.computeRoutes(&ids[0], &ids[1], 1, 1, "bicycle");
+    REQUIRE(batch.costs[0] == bicycle->getShortestRoute(ids[0], ids[1]).second);
+    auto values = mapped.getMetrics();
+    REQUIRE(values["routing_graph_memory_bytes{profile=\"bicycle\",component=\"weights\",kind=\"payload\"}"] ==
+            double(bicycle->getWeights().getNumBytes()));
+    std::remove(filename);
+}
+
+TEST_CASE( "Mapped graph test", "[MappedFile]") {
+    Parser parser("test_input2.osm");
+    Graph graph = parser.constructRoadNetworkGraph();
+    HierarchyConstructor builder(graph);
+    builder.contractGraph();
+    graph.saveFlat("test_mapped_graph.bin");
+
+    Graph mapped_graph;
+    mapped_graph.mapFlat("test_mapped_graph.bin");
+    REQUIRE(mapped_graph.isMapped());
+    REQUIRE(mapped_graph.getNumVertices() == graph.getNumVertices());
+
+    // Copies of a mapped graph keep the file mapped.
+    Graph copied_graph = mapped_graph;
+    mapped_graph = Graph();
+
+    const auto queries = getRandomQueries(getSortedIds(graph), 50, 21);
+    for (const auto& [source, target] : queries) {
+        const auto path = graph.getShortestPath(source, target);
+        const auto expected = graph.convertPathToCoordinates(path.first);
+        REQUIRE(copied_graph.getShortestPath(source, target).first == path.first);
+        const auto route = copied_graph.getShortestRoute(source, target);
+        REQUIRE(std::abs(route.second - path.second) < 0.00001);
+        REQUIRE(route.first == expected);
+        REQUIRE(graph.getShortestRoute(source, target).first == expected);
+        REQUIRE(copied_graph.getEncodedRoute(source, target).first == graph.convertPathToPolyline(path.first));
+    }
+    const auto costs = copied_graph.getShortestPathLengths(queries);
+    const auto expected_costs = graph.getShortestPathLengths(queries);
+    for (size_t i = 0; i < queries.size(); i++) {
+        REQUIRE(std::abs(costs[i] - expected_costs[i]) < 0.00001);
+    }
+
+    // A mapped graph only supports the modified search and cannot be saved again.
+    REQUIRE_THROWS_AS(copied_graph.getShortestPath(queries[0].first, queries[0].second, true), std::logic_error);
+    REQUIRE_THROWS_AS(copied_graph.getShortestRoute(0, queries[0].second), std::logic_error);
+    REQUIRE_THROWS_AS(Serialize::save("test_mapped_graph_copy.bin", copied_graph), std::logic_error);
+    REQUIRE_THROWS_AS(Graph().saveFlat("test_mapped_graph_copy.bin"), std::logic_error);
+    REQUIRE_THROWS_AS(mapped_graph.mapFlat("test_input2.osm"), std::logic_error);
+    std::remove("test_mapped_graph.bin");
+    std::remove("test_mapped_graph_copy.bin");
+}
+
+TEST_CASE( "Corrupt flat file test", "[MappedFile]") {
+    // The arrays of a flat file that holds a query graph of two vertices, 7 and 3, joined by an upward edge from 7 to 3.
+    struct Arrays {
+        std::vector<uint8_t> buffer;
+        std::vector<uint64_t> offsets{0};
+        std::vector<uint32_t> first_out{0, 1, 1}, first_in{0, 0, 0};
+        std::vector<QueryEdge> out_edges{{1, QueryGraph::INVALID_INDEX, 2.0}}, in_edges;
+        std::vector<uint32_t> out_geometry{0, 1}, in_geometry{1};
+        std::vector<OriginalEdge> geometry{{GeometryStore::NO_GEOMETRY, 1, false}};
+        std::vector<uint64_t> ids{7, 3}, sorted_ids{3, 7};
+        std::vector<uint32_t> sorted_indices{1, 0};
+        std::vector<std::array<double, 2>> locations{{{0.0, 0.0}}, {{1.0, 1.0}}};
+    };
+    const char* filename = "test_corrupt_graph.flat";
+    // Writes the arrays after applying a change to them, and maps them.
+    const auto map = [filename](const std::function<void(Arrays&)>& change) {
+        Arrays arrays;
+        change(arrays);
+        {
+            FlatWriter writer(filename);
+            writer.writeArray(FlatArray<uint8_t>(arrays.buffer));
+            writer.writeArray(FlatArray<uint64_t>(arrays.offsets));
+            writer.writeArray(FlatArray<uint32_t>(arrays.first_out));
+            writer.writeArray(FlatArray<uint32_t>(arrays.first_in));
+            writer.writeArray(FlatArray<QueryEdge>(arrays.out_edges));
+            writer.writeArray(FlatArray<QueryEdge>(arrays.in_edges));
+            writer.writeArray(FlatArray<uint32_t>(arrays.out_geometry));
+            writer.writeArray(FlatArray<uint32_t>(arrays.in_geometry));
+            writer.writeArray(FlatArray<OriginalEdge>(arrays.geometry));
+            writer.writeArray(FlatArray<uint64_t>(arrays.ids));
+            writer.writeArray(FlatArray<uint64_t>(arrays.sorted_ids));
+            writer.writeArray(FlatArray<uint32_t>(arrays.sorted_indices));
+            writer.writeArray(FlatArray<std::array<double, 2>>(arrays.locations));
+        }
+        Graph graph;
+        graph.mapFlat(filename);
+        return graph;
+    };
+
+    const std::vector<std::array<double, 2>> expected{{{0.0, 0.0}}, {{1.0, 1.0}}};
+    const Graph graph = map([](Arrays&) {});
+    REQUIRE(graph.getShortestRoute(7, 3) == std::make_pair(expected, 2.0));
+
+    // A segment is never decoded past its end, even if it claims to hold more OSM nodes than it does.
+    const Graph truncated_segment = map([](Arrays& arrays) {
+        arrays.buffer = {0x7e, 0xff};
+        arrays.offsets = {0, 2};
+        arrays.geometry[0].geometry = 0;
+    });
+    const auto route = truncated_segment.getShortestRoute(7, 3);
+    REQUIRE(route.first.front() == expected.front());
+    REQUIRE(route.first.back() == expected.back());
+    REQUIRE(route.first.size() <= 3);
+
+    // Every offset and index must lie within the arrays that it refers to.
+    const std::vector<std::function<void(Arrays&)>> corruptions{
+        [](Arrays& arrays) { arrays.offsets = {0, 5}; },
+        [](Arrays& arrays) { arrays.offsets = {1}; },
+        [](Arrays& arrays) { arrays.first_out = {0, 2, 1}; },
+        [](Arrays& arrays) { arrays.first_out = {0, 1, 0}; },
+        [](Arrays& arrays) { arrays.first_in = {0, 0}; },
+        [](Arrays& arrays) { arrays.out_edges[0].head = 2; },
+        [](Arrays& arrays) { arrays.out_edges[0].middle = 5; },
+        [](Arrays& arrays) { arrays.out_geometry = {0, 2}; },
+        [](Arrays& arrays) { arrays.in_geometry.clear(); },
+        [](Arrays& arrays) { arrays.geometry[0].head = 9; },
+        [](Arrays& arrays) { arrays.geometry[0].geometry = 0; },
+        [](Arrays& arrays) { arrays.sorted_ids = {7, 3}; },
+        [](Arrays& arrays) { arrays.sorted_indices = {1, 5}; },
+        [](Arrays& arrays) { arrays.sorted_indices = {0, 1}; },
+        [](Arrays& arrays) { arrays.locations.pop_back(); }};
+    for (const auto& corruption : corruptions) { REQUIRE_THROWS_AS(map(corruption), std::logic_error); }
+
+    // A truncated copy of a valid file is rejected as well.
+    map([](Arrays&) {});
+    std::ifstream input(filename, std::ios::binary);
+    const std::vector<char> contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+    std::ofstream(filename, std::ios::binary).write(contents.data(), std::streamsize(contents.size() - 10));
+    Graph mapped_graph;
+    REQUIRE_THROWS_AS(mapped_graph.mapFlat(filename), std::logic_error);
+    std::remove(filename);
+}
+
+TEST_CASE_METHOD( EngineFixture, "Routing graph hot swap test", "[RoutingEngine]") {
+    engine.saveRoutingData("test_hot_swap_graph.bin");
+    engine.saveMappedRoutingData("test_hot_swap_graph_flat.bin");
+    const auto queries = getRandomQueries(ids, 20, 17);
+    const auto expected = engine.computeRouteCosts(queries);
+
+    // Queries keep running, and keep returning the same results, while new graphs are published.
+    std::atomic<bool> done{false};
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                for (size_t i = 0; i < queries.size(); i++) {
+                    if (std::abs(engine.computeRoute(queries[i].first, queries[i].second).second - expected[i]) > 0.00001) { mismatches++; }
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 4; i++) {
+        engine.reloadRoutingData(i % 2 ? "test_hot_swap_graph_flat.bin" : "test_hot_swap_graph.bin", i % 2).get();
+    }
+    done = true;
+    for (auto& reader : readers) { reader.join(); }
+    REQUIRE(mismatches == 0);
+    REQUIRE(engine.getGraph()->isMapped());
+
+    // A reload does not wait for the snapshots of the previous graph, and a snapshot is unaffected by later swaps.
+    auto snapshot = engine.getGraph();
+    const std::weak_ptr<const Graph> previous = snapshot;
+    auto reload = engine.reloadRoutingData("test_hot_swap_graph.bin");
+    REQUIRE(reload.wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+    reload.get();
+    REQUIRE(!engine.getGraph()->isMapped());
+    REQUIRE(engine.getGraph() != snapshot);
+    REQUIRE(std::abs(snapshot->getShortestPath(queries[0].first, queries[0].second).second - expected[0]) < 0.00001);
+    snapshot.reset();
+    REQUIRE(previous.expired());
+
+    // A snapshot may outlive the engine.
+    {
+        OSM::RoutingEngine other;
+        other.loadRoutingData("test_hot_swap_graph.bin");
+        snapshot = other.getGraph();
+        other.reloadRoutingData("test_hot_swap_graph_flat.bin", true).get();
+    }
+    REQUIRE(std::abs(snapshot->getShortestPath(queries[0].first, queries[0].second).second - expected[0]) < 0.00001);
+    snapshot.reset();
+
+    // A failed load leaves the current graph in place.
+    REQUIRE_THROWS(engine.reloadRoutingData("test_hot_swap_missing.bin", true).get());
+    REQUIRE(engine.computeRouteCosts(queries) == expected);
+    std::remove("test_hot_swap_graph.bin");
+    std::remove("test_hot_swap_graph_flat.bin");
+}
+
+TEST_CASE_METHOD( EngineFixture, "Route cache test", "[RouteCache]") {
+    // Routes are returned with the precision of OSM coordinates.
+    OSM::RouteCache cache(4, 1);
+    const std::pair<std::vector<std::array<double, 2>>, double> route{{{39.7392358, -104.990251}, {39.7401, -104.9903}}, 3.5};
+    std::pair<std::vector<std::array<double, 2>>, double> cached;
+    REQUIRE(!cache.find(1, 2, 0, &cached));
+    cache.insert(1, 2, 0, route);
+    REQUIRE(cache.find(1, 2, 0, &cached));
+    REQUIRE(cached.second == route.second);
+    REQUIRE(cached.first.size() == route.first.size());
+    for (size_t i = 0; i < route.first.size(); i++) {
+        REQUIRE(std::abs(cached.first[i][0] - route.first[i][0]) < 1e-7);
+        REQUIRE(std::abs(cached.first[i][1] - route.first[i][1]) < 1e-7);
+    }
+    // Routes computed on a previous graph are stale.
+    REQUIRE(!cache.find(1, 2, 1, &cached));
+    REQUIRE(!cache.find(2, 1, 0, &cached));
+
+    // Routes that were used since the clock hand last passed them are kept.
+    for (uint64_t target = 3; target <= 5; target++) { cache.insert(1, target, 0, route); }
+    REQUIRE(cache.find(1, 2, 0, &cached));
+    cache.insert(1, 6, 0, route);
+    REQUIRE(cache.find(1, 2, 0, &cached));
+    REQUIRE(!cache.find(1, 3, 0, &cached));
+    auto statistics = cache.getStatistics();
+    REQUIRE(statistics.size == 4);
+    REQUIRE(statistics.evictions == 1);
+    REQUIRE(statistics.hits == 3);
+    REQUIRE(statistics.misses == 4);
+    REQUIRE(statistics.insertions == 5);
+    REQUIRE(statistics.overwrites == 0);
+    // Inserting a cached route again replaces it, and does not count as a new route.
+    cache.insert(1, 2, 1, route);
+    REQUIRE(cache.find(1, 2, 1, &cached));
+    statistics = cache.getStatistics();
+    REQUIRE(statistics.insertions == 5);
+    REQUIRE(statistics.overwrites == 1);
+    REQUIRE(statistics.size == 4);
+    cache.clear();
+    REQUIRE(cache.getStatistics().size == 0);
+
+    // Cached routes are identical to computed routes, up to the precision of the cache.
+    std::vector<uint64_t> sources, targets;
+    for (const auto& [source, target] : getRandomQueries(ids, 20, 29)) {
+        sources.push_back(source);
+        targets.push_back(target);
+    }
+    std::vector<std::pair<std::vector<std::array<double, 2>>, double>> expected;
+    for (size_t i = 0; i < sources.size(); i++) { expected.push_back(engine.computeRoute(sources[i], targets[i])); }
+
+    engine.enableRouteCache(1000, 4);
+    for (int pass = 0; pass < 3; pass++) {
+        const auto batch = engine.computeRoutes(sources.data(), targets.data(), sources.size(), 2);
+        for (size_t i = 0; i < sources.size(); i++) {
+            const auto route = engine.computeRoute(sources[i], targets[i]);
+            REQUIRE(route.second == expected[i].second);
+            REQUIRE(route.first.size() == expected[i].first.size());
+            REQUIRE(batch.offsets[i + 1] - batch.offsets[i] == expected[i].first.size());
+            for (size_t j = 0; j < route.first.size(); j++) {
+                REQUIRE(std::abs(route.first[j][0] - expected[i].first[j][0]) < 1e-7);
+                REQUIRE(std::abs(route.first[j][1] - expected[i].first[j][1]) < 1e-7);
+            }
+        }
+    }
+    statistics = engine.getRouteCacheStatistics();
+    REQUIRE(statistics.misses <= sources.size());
+    REQUIRE(statistics.hits == 6 * sources.size() - statistics.misses);
+    REQUIRE(statistics.getHitRate() > 0.8);
+
+    // Loading a graph invalidates the cached routes.
+    engine.saveRoutingData("test_route_cache_graph.bin");
+    engine.loadRoutingData("test_route_cache_graph.bin");
+    const auto misses = engine.getRouteCacheStatistics().misses;
+    engine.computeRoute(sources[0], targets[0]);
+    REQUIRE(engine.getRouteCacheStatistics().misses == misses + 1);
+
+    engine.enableRouteCache(0);
+    REQUIRE(engine.getRouteCacheStatistics().hits == 0);
+    std::remove("test_route_cache_graph.bin");
+}
+
+TEST_CASE_METHOD( EngineFixture, "Query statistics test", "[QueryStats]") {
+    // The standard search is run on a graph that has not been contracted.
+    OSM::RoutingEngine standard_engine("test_input2.osm", true, "minutes", "miles", false);
+    for (const auto& [source, target] : getRandomQueries(ids, 20, 31)) {
+        for (const bool standard : {false, true}) {
+            auto& routing_engine = standard ? standard_engine : engine;
+            QueryStats stats;
+            const auto route = routing_engine.computeRoute(source, target, standard, &stats);
+            REQUIRE(route.second == routing_engine.computeRoute(source, target, standard).second);
+            if (!QueryStats::ENABLED) {
+                REQUIRE(stats.settled_forward + stats.settled_backward + stats.heap_pushes + stats.search_ns == 0);
+                continue;
+            }
+            REQUIRE(stats.settled_forward + stats.settled_backward > 0);
+            REQUIRE(stats.heap_pops <= stats.heap_pushes);
+            REQUIRE(stats.relaxed_edges >= stats.heap_pushes - 2);
+            REQUIRE(stats.path_nodes == route.first.size());
+            if (standard) { REQUIRE(stats.unpacked_shortcuts == 0); }
+        }
+    }
+}
+
+TEST_CASE_METHOD( EngineFixture, "Metrics registry test", "[Metrics]") {
+    // Every latency falls into a bucket whose upper bound is within 1/8 of it.
+    for (const uint64_t latency : {0ull, 7ull, 8ull, 1000ull, 123456789ull, 18446744073709551615ull}) {
+        const auto bucket = OSM::LatencyHistogram::getBucket(latency);
+        REQUIRE(bucket < OSM::LatencyHistogram::NUM_BUCKETS);
+        REQUIRE(OSM::LatencyHistogram::getUpperBound(bucket) >= latency);
+        REQUIRE(double(OSM::LatencyHistogram::getUpperBound(bucket) - latency) <= double(latency) / 8);
+        if (bucket > 0) { REQUIRE(OSM::LatencyHistogram::getUpperBound(bucket - 1) < latency); }
+    }
+
+    // Counters and histograms recorded by several threads at once lose nothing.
+    OSM::MetricsRegistry registry;
+    auto& counter = registry.counter("requests_total", "Requests.");
+    auto& histogram = registry.histogram("latency_seconds", "Latency.");
+    std::vector<std::thread> threads;
+    for (uint64_t thread = 0; thread < 4; thread++) {
+        threads.emplace_back([&]() {
+            for (uint64_t i = 1; i <= 1000; i++) {
+                counter.add();
+                histogram.record(i * 1000);
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    REQUIRE(counter.get() == 4000);
+    REQUIRE(&registry.counter("requests_total", "Requests.") == &counter);
+    REQUIRE_THROWS(registry.gauge("requests_total", "Requests."));
+    const auto snapshot = histogram.getSnapshot();
+    REQUIRE(snapshot.count == 4000);
+    REQUIRE(snapshot.sum == 4 * 500500 * 1000);
+    REQUIRE(std::abs(double(snapshot.getQuantile(0.5)) - 500000) <= 500000.0 / 8);
+    REQUIRE(std::abs(double(snapshot.getQuantile(0.99)) - 990000) <= 990000.0 / 8);
+
+    registry.gauge("memory_bytes{component=\"a\"}", "Memory.").set(1);
+    registry.gauge("memory_bytes{component=\"b\"}", "Memory.").set(2);
+    const auto text = registry.exportPrometheus();
+    REQUIRE(text.find("# TYPE requests_total counter\nrequests_total 4000\n") != std::string::npos);
+    REQUIRE(text.find("# TYPE memory_bytes gauge\nmemory_bytes{component=\"a\"} 1\nmemory_bytes{component=\"b\"} 2\n") != std::string::npos);
+    REQUIRE(text.find("latency_seconds_bucket{le=\"+Inf\"} 4000\n") != std::string::npos);
+    REQUIRE(text.find("latency_seconds_count 4000\n") != std::string::npos);
+
+    // The engine records its requests, failures, and loads.
+    engine.computeRoute(ids[0], ids[1]);
+    engine.computeEncodedRoute(ids[1], ids[0]);
+    engine.computeRouteCosts({{ids[0], ids[1]}, {ids[1], ids[2]}});
+    REQUIRE_THROWS(engine.loadRoutingData("test_metrics_missing.bin"));
+    engine.saveRoutingData("test_metrics_graph.bin");
+    engine.loadRoutingData("test_metrics_graph.bin");
+    auto values = engine.getMetrics();
+    REQUIRE(values["routing_route_requests_total"] == 2);
+    REQUIRE(values["routing_route_latency_seconds_count"] == 2);
+    REQUIRE(values["routing_distance_requests_total"] == 1);
+    REQUIRE(values["routing_distance_queries_total"] == 2);
+    REQUIRE(values["routing_graph_loads_total"] == 1);
+    REQUIRE(values["routing_graph_load_errors_total"] == 1);
+    REQUIRE(values["routing_graph_memory_bytes{component=\"query_graph\",kind=\"payload\"}"] == engine.getGraph()->getQueryGraph().getNumBytes());
+    REQUIRE(engine.exportMetrics().find("# TYPE routing_route_latency_seconds histogram\n") != std::string::npos);
+    std::remove("test_metrics_graph.bin");
+}
+
+TEST_CASE_METHOD( EngineFixture, "Memory usage test", "[MemoryUsage]") {
+    const auto graph = engine.getGraph();
+    auto usage = graph->getMemoryUsage();
+    for (const auto& name : {"vertices", "adjacency", "edges", "shortcuts", "locations", "geometry", "query_graph"}) {
+        REQUIRE(usage.get(name).name == name);
+        REQUIRE(!usage.get(name).mapped);
+    }
+    REQUIRE(usage.get("vertices").payload == graph->getNumVertices() * (2 * sizeof(uint64_t) + sizeof(int)));
+    REQUIRE(usage.get("query_graph").payload == graph->getQueryGraph().getNumBytes());
+    REQUIRE(usage.get("geometry").payload == graph->getGeometry().getNumBytes());
+    // Hash maps take more memory than the data they hold.
+    REQUIRE(usage.get("vertices").overhead > usage.get("vertices").payload);
+    REQUIRE(usage.get("adjacency").overhead > usage.get("adjacency").payload);
+    REQUIRE(usage.getTotal() == usage.getPayload() + usage.getOverhead());
+    REQUIRE(engine.getMemoryUsage().components.size() == usage.components.size());
+
+    // The route cache is reported once routes are cached.
+    engine.enableRouteCache(100);
+    for (size_t i = 1; i < 10; i++) { engine.computeRoute(ids[0], ids[i]); }
+    REQUIRE(engine.getMemoryUsage().get("route_cache").payload > 0);
+
+    // A mapped graph allocates nothing for the arrays stored in the file.
+    engine.saveMappedRoutingData("test_memory_usage_graph.flat");
+    Graph mapped;
+    mapped.mapFlat("test_memory_usage_graph.flat");
+    usage = mapped.getMemoryUsage();
+    REQUIRE(usage.get("query_graph").mapped);
+    REQUIRE(usage.get("query_graph").payload == graph->getQueryGraph().getNumBytes());
+    REQUIRE(usage.get("query_graph").overhead == 0);
+    REQUIRE(usage.get("vertices").getTotal() == 0);
+    std::remove("test_memory_usage_graph.flat");
+}